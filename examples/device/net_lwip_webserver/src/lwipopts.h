@@ -61,6 +61,9 @@
 
 #define PBUF_POOL_SIZE                  2
 
+/* received frames are passed to lwip without copying, see lwip_netif.c */
+#define LWIP_SUPPORT_CUSTOM_PBUF        1
+
 #define HTTPD_USE_CUSTOM_FSDATA         0
 
 #define LWIP_MULTICAST_PING             1
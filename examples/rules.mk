@@ -29,12 +29,17 @@ SRC_C += \
 	src/device/usbd.c \
 	src/device/usbd_control.c \
 	src/class/audio/audio_device.c \
+	src/class/audio/audio_pcm.c \
+	src/class/audio/audio_feedback.c \
+	src/class/audio/audio_asrc.c \
 	src/class/cdc/cdc_device.c \
 	src/class/dfu/dfu_device.c \
 	src/class/dfu/dfu_rt_device.c \
 	src/class/hid/hid_device.c \
 	src/class/midi/midi_device.c \
+	src/class/msc/msc_cache.c \
 	src/class/msc/msc_device.c \
+	src/class/msc/uas_device.c \
 	src/class/net/ecm_rndis_device.c \
 	src/class/net/ncm_device.c \
 	src/class/usbtmc/usbtmc_device.c \
@@ -68,6 +68,9 @@ if (NOT TARGET _rp2040_family_inclusion_marker)
 			${TOP}/src/device/usbd.c
 			${TOP}/src/device/usbd_control.c
 			${TOP}/src/class/audio/audio_device.c
+			${TOP}/src/class/audio/audio_pcm.c
+			${TOP}/src/class/audio/audio_feedback.c
+			${TOP}/src/class/audio/audio_asrc.c
 			${TOP}/src/class/cdc/cdc_device.c
 			${TOP}/src/class/dfu/dfu_device.c
 			${TOP}/src/class/dfu/dfu_rt_device.c
@@ -93,6 +96,7 @@ if (NOT TARGET _rp2040_family_inclusion_marker)
 			${TOP}/src/class/cdc/cdc_host.c
 			${TOP}/src/class/hid/hid_host.c
 			${TOP}/src/class/msc/msc_host.c
+			${TOP}/src/class/net/net_host.c
 			${TOP}/src/class/vendor/vendor_host.c
 			)
 
@@ -256,6 +260,9 @@ if (NOT TARGET _rp2040_family_inclusion_marker)
 					${PICO_TINYUSB_PATH}/src/class/hid/hid_device.c
 					${PICO_TINYUSB_PATH}/src/class/hid/hid_host.c
 					${PICO_TINYUSB_PATH}/src/class/audio/audio_device.c
+					${PICO_TINYUSB_PATH}/src/class/audio/audio_pcm.c
+					${PICO_TINYUSB_PATH}/src/class/audio/audio_feedback.c
+					${PICO_TINYUSB_PATH}/src/class/audio/audio_asrc.c
 					${PICO_TINYUSB_PATH}/src/class/dfu/dfu_device.c
 					${PICO_TINYUSB_PATH}/src/class/dfu/dfu_rt_device.c
 					${PICO_TINYUSB_PATH}/src/class/midi/midi_device.c
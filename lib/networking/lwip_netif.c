@@ -0,0 +1,249 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb.h"
+#include "lwip_netif.h"
+
+#include "lwip/pbuf.h"
+#include "lwip/etharp.h"
+#include "lwip/ethip6.h"
+
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+  #error "LWIP_SUPPORT_CUSTOM_PBUF must be enabled in lwipopts.h"
+#endif
+
+// Received frame referenced by lwIP
+typedef struct
+{
+  struct pbuf_custom pc; // must be first
+  uint8_t buf_id;        // from tud_network_recv_hold()
+  bool    used;
+} rx_pbuf_t;
+
+static rx_pbuf_t _rx_pbuf[TUD_LWIP_NETIF_RX_PBUF_N];
+
+static struct netif *_netif;
+
+// shared between tud_network_recv_cb() and tud_lwip_netif_service()
+static struct pbuf *_rx_frame;
+static bool _rx_renew;
+
+//--------------------------------------------------------------------+
+// Receive
+//--------------------------------------------------------------------+
+
+// Invoked by lwIP when the last reference of received frame is freed
+static void rx_pbuf_free(struct pbuf *p)
+{
+  rx_pbuf_t *rp = (rx_pbuf_t *) (void *) p;
+
+  tud_network_recv_release(rp->buf_id);
+  rp->used = false;
+}
+
+static struct pbuf *rx_pbuf_wrap(const uint8_t *src, uint16_t size)
+{
+  for (uint8_t i = 0; i < TUD_LWIP_NETIF_RX_PBUF_N; i++)
+  {
+    rx_pbuf_t *rp = &_rx_pbuf[i];
+    if (rp->used) continue;
+
+    uint8_t const buf_id = tud_network_recv_hold();
+    if (buf_id == TUD_NETWORK_RECV_HOLD_INVALID) break;
+
+    rp->used   = true;
+    rp->buf_id = buf_id;
+    rp->pc.custom_free_function = rx_pbuf_free;
+
+    return pbuf_alloced_custom(PBUF_RAW, size, PBUF_REF, &rp->pc, (void *) (uintptr_t) src, size);
+  }
+
+  // all wrappers are referenced by lwIP or driver has no spare buffer: copy frame so that reception
+  // does not stall on a frame kept by lwIP (e.g. out-of-order TCP segment, IP fragment)
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, size, PBUF_POOL);
+  if (p)
+  {
+    pbuf_take(p, src, size);
+  }
+
+  return p;
+}
+
+bool tud_network_recv_cb(const uint8_t *src, uint16_t size)
+{
+  // previous frame is not yet passed to lwIP
+  if (_rx_frame) return false;
+
+  if (size)
+  {
+    _rx_frame = rx_pbuf_wrap(src, size);
+  }
+
+  _rx_renew = true;
+  return true;
+}
+
+void tud_lwip_netif_service(void)
+{
+  if (_rx_frame)
+  {
+    struct pbuf *p = _rx_frame;
+    _rx_frame = NULL;
+
+    if (_netif->input(p, _netif) != ERR_OK)
+    {
+      pbuf_free(p);
+    }
+  }
+
+  // frame is either referenced by lwIP (buffer is held) or freed, driver can move on
+  if (_rx_renew)
+  {
+    _rx_renew = false;
+    tud_network_recv_renew();
+  }
+}
+
+void tud_network_init_cb(void)
+{
+  // network is re-initializing with a leftover frame
+  if (_rx_frame)
+  {
+    pbuf_free(_rx_frame);
+    _rx_frame = NULL;
+  }
+
+  _rx_renew = false;
+}
+
+//--------------------------------------------------------------------+
+// Transmit
+//--------------------------------------------------------------------+
+
+// pbufs allocated from lwIP heap or pool (not PBUF_ROM/PBUF_REF pointing e.g into flash) are
+// assumed to be DMA capable
+static bool tx_pbuf_to_segments(struct pbuf *p, tud_network_segment_t *segs, uint8_t *count)
+{
+  uint8_t n = 0;
+
+  for (struct pbuf *q = p; q; q = q->next)
+  {
+    if (!q->len) continue;
+    if (n == CFG_TUD_NET_XMIT_SEGMENTS) return false;
+    if (!(q->type_internal & PBUF_TYPE_FLAG_STRUCT_DATA_CONTIGUOUS)) return false;
+
+    segs[n].buf = q->payload;
+    segs[n].len = q->len;
+    n++;
+  }
+
+  *count = n;
+  return n > 0;
+}
+
+static err_t linkoutput_fn(struct netif *netif, struct pbuf *p)
+{
+  (void) netif;
+
+  for (;;)
+  {
+    // if TinyUSB isn't ready, we must signal back to lwip that there is nothing we can do
+    if (!tud_ready()) return ERR_USE;
+
+    if (tud_network_can_xmit(p->tot_len))
+    {
+      tud_network_segment_t segs[CFG_TUD_NET_XMIT_SEGMENTS];
+      uint8_t count;
+
+      if (p->tot_len >= TUD_LWIP_NETIF_TX_SG_MIN_LEN && tx_pbuf_to_segments(p, segs, &count))
+      {
+        // chain is referenced by driver until tud_network_xmit_done_cb()
+        pbuf_ref(p);
+        if (tud_network_xmit_sg(segs, count, p)) return ERR_OK;
+        pbuf_free(p);
+      }
+
+      // copied by tud_network_xmit_cb()
+      tud_network_xmit(p, 0);
+      return ERR_OK;
+    }
+
+    // transfer execution to TinyUSB in the hopes that it will finish transmitting the prior packet
+    tud_task();
+  }
+}
+
+uint16_t tud_network_xmit_cb(uint8_t *dst, void *ref, uint16_t arg)
+{
+  struct pbuf *p = (struct pbuf *) ref;
+  (void) arg;
+
+  return pbuf_copy_partial(p, dst, p->tot_len, 0);
+}
+
+void tud_network_xmit_done_cb(void *ref)
+{
+  pbuf_free((struct pbuf *) ref);
+}
+
+//--------------------------------------------------------------------+
+// Netif
+//--------------------------------------------------------------------+
+
+static err_t ip4_output_fn(struct netif *netif, struct pbuf *p, const ip4_addr_t *addr)
+{
+  return etharp_output(netif, p, addr);
+}
+
+#if LWIP_IPV6
+static err_t ip6_output_fn(struct netif *netif, struct pbuf *p, const ip6_addr_t *addr)
+{
+  return ethip6_output(netif, p, addr);
+}
+#endif
+
+err_t tud_lwip_netif_init(struct netif *netif)
+{
+  LWIP_ASSERT("netif != NULL", (netif != NULL));
+
+  netif->mtu = CFG_TUD_NET_MTU;
+  netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP | NETIF_FLAG_UP;
+  netif->state = NULL;
+  netif->name[0] = 'E';
+  netif->name[1] = 'X';
+  netif->linkoutput = linkoutput_fn;
+  netif->output = ip4_output_fn;
+#if LWIP_IPV6
+  netif->output_ip6 = ip6_output_fn;
+#endif
+
+  _netif = netif;
+  _rx_frame = NULL;
+  _rx_renew = false;
+  tu_memclr(_rx_pbuf, sizeof(_rx_pbuf));
+
+  return ERR_OK;
+}
@@ -0,0 +1,72 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+/*
+ * lwIP (NO_SYS) netif glue for the ECM/RNDIS and NCM device drivers.
+ *
+ * Received frames are passed to lwIP as PBUF_REF custom pbufs pointing into the driver's receive
+ * buffer (held with tud_network_recv_hold()), the buffer is released when lwIP frees the pbuf.
+ * Transmitted pbuf chains of at least TUD_LWIP_NETIF_TX_SG_MIN_LEN bytes are handed to
+ * tud_network_xmit_sg() without copying.
+ *
+ * Requires LWIP_SUPPORT_CUSTOM_PBUF in lwipopts.h. This file implements tud_network_recv_cb(),
+ * tud_network_xmit_cb(), tud_network_xmit_done_cb() and tud_network_init_cb(); application still
+ * provides tud_network_mac_address[].
+ */
+
+#ifndef _TUSB_LWIP_NETIF_H_
+#define _TUSB_LWIP_NETIF_H_
+
+#include "lwip/netif.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// Number of received frames that can be referenced by lwIP at the same time, frames are copied
+// into PBUF_POOL when all are in use e.g TCP queues out-of-order segments
+#ifndef TUD_LWIP_NETIF_RX_PBUF_N
+#define TUD_LWIP_NETIF_RX_PBUF_N   8
+#endif
+
+// Transmitted frames shorter than this are copied into the driver's buffer where they are aggregated
+// with other frames, only larger frames are worth being sent from pbuf memory with tud_network_xmit_sg()
+#ifndef TUD_LWIP_NETIF_TX_SG_MIN_LEN
+#define TUD_LWIP_NETIF_TX_SG_MIN_LEN   512
+#endif
+
+// Init function to be passed to netif_add() with ethernet_input() as input function.
+// netif->hwaddr must be set before.
+err_t tud_lwip_netif_init(struct netif *netif);
+
+// Pass received frame to lwIP, should be called in main loop after tud_task()
+void tud_lwip_netif_service(void);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_LWIP_NETIF_H_ */
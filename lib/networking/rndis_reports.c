@@ -253,9 +253,10 @@ void rndis_class_set_handler(uint8_t *data, int size)
         m->Status = RNDIS_STATUS_SUCCESS;
         m->DeviceFlags = RNDIS_DF_CONNECTIONLESS;
         m->Medium = RNDIS_MEDIUM_802_3;
-        m->MaxPacketsPerTransfer = 1;
-        m->MaxTransferSize = CFG_TUD_NET_MTU + sizeof(rndis_data_packet_t);
-        m->PacketAlignmentFactor = 0;
+        /* host may concatenate packets, each one 4-byte aligned (2^PacketAlignmentFactor) */
+        m->MaxPacketsPerTransfer = CFG_TUD_RNDIS_PACKETS_PER_XFER;
+        m->MaxTransferSize = CFG_TUD_RNDIS_PACKETS_PER_XFER * ((CFG_TUD_NET_MTU + sizeof(rndis_data_packet_t) + 3) & ~3u);
+        m->PacketAlignmentFactor = (CFG_TUD_RNDIS_PACKETS_PER_XFER > 1) ? 2 : 0;
         m->AfListOffset = 0;
         m->AfListSize = 0;
         rndis_state = rndis_initialized;
@@ -0,0 +1,369 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+#include "audio_asrc.h"
+
+#if (CFG_TUD_ENABLED && CFG_TUD_AUDIO && CFG_TUD_AUDIO_ENABLE_ASRC)
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+
+#define ASRC_PHASES_LOG2    6
+#define ASRC_PHASES         (1u << ASRC_PHASES_LOG2)
+
+TU_VERIFY_STATIC(AUDIOD_ASRC_TAPS == 32, "coefficient table is made for 32 taps");
+TU_VERIFY_STATIC(CFG_TUD_AUDIO_ASRC_MAX_CHANNELS >= 1, "at least one channel");
+
+// Kaiser windowed sinc (beta 8, cutoff 0.45 of input rate) of 32 taps in 64 phases plus one to interpolate the last
+// phase, normalized to unity DC gain in Q15. Row p is the filter for an output p/64 input frames past the center,
+// taps are reversed so that they are applied to history from oldest to newest frame.
+static int16_t const _asrc_coef[ASRC_PHASES + 1][AUDIOD_ASRC_TAPS] =
+{
+  {     -7,     17,    -31,     42,    -39,      0,     99,   -283,    569,   -959,   1435,  -1956,   2464,  -2891,   3177,  29493,
+      3177,  -2891,   2464,  -1956,   1435,   -959,    569,   -283,     99,      0,    -39,     42,    -31,     17,     -7,      1 },
+  {     -7,     16,    -29,     39,    -33,     -9,    112,   -298,    583,   -967,   1426,  -1915,   2366,  -2689,   2698,  29483,
+      3664,  -3091,   2557,  -1994,   1442,   -950,    553,   -267,     86,      9,    -44,     45,    -32,     17,     -7,      1 },
+  {     -6,     16,    -28,     36,    -28,    -18,    124,   -312,    596,   -972,   1414,  -1871,   2266,  -2485,   2230,  29454,
+      4160,  -3288,   2647,  -2028,   1445,   -938,    536,   -250,     73,     18,    -50,     48,    -33,     18,     -7,      1 },
+  {     -6,     15,    -27,     33,    -22,    -27,    136,   -326,    608,   -976,   1399,  -1823,   2162,  -2280,   1771,  29405,
+      4665,  -3482,   2732,  -2059,   1446,   -925,    518,   -233,     59,     28,    -55,     51,    -34,     18,     -7,      2 },
+  {     -6,     15,    -25,     30,    -17,    -35,    147,   -338,    618,   -977,   1382,  -1773,   2056,  -2074,   1323,  29338,
+      5178,  -3673,   2814,  -2085,   1444,   -909,    499,   -215,     45,     37,    -61,     54,    -36,     18,     -7,      2 },
+  {     -6,     14,    -24,     27,    -11,    -43,    158,   -350,    627,   -977,   1362,  -1719,   1947,  -1867,    886,  29251,
+      5698,  -3860,   2890,  -2108,   1440,   -892,    478,   -197,     31,     47,    -67,     57,    -37,     19,     -7,      2 },
+  {     -6,     14,    -22,     24,     -6,    -51,    168,   -361,    635,   -974,   1340,  -1663,   1835,  -1660,    460,  29145,
+      6225,  -4043,   2963,  -2127,   1432,   -873,    456,   -177,     16,     56,    -72,     59,    -38,     19,     -7,      2 },
+  {     -6,     13,    -21,     21,     -1,    -59,    178,   -371,    641,   -970,   1315,  -1604,   1721,  -1453,     45,  29020,
+      6759,  -4220,   3030,  -2142,   1421,   -851,    433,   -157,      2,     66,    -77,     62,    -39,     19,     -7,      2 },
+  {     -5,     12,    -19,     18,      5,    -67,    188,   -381,    646,   -964,   1288,  -1543,   1606,  -1247,   -357,  28876,
+      7298,  -4393,   3092,  -2153,   1407,   -828,    409,   -137,    -13,     75,    -83,     64,    -40,     20,     -7,      2 },
+  {     -5,     12,    -18,     15,     10,    -74,    197,   -389,    650,   -956,   1259,  -1479,   1488,  -1042,   -748,  28713,
+      7843,  -4560,   3149,  -2160,   1391,   -803,    384,   -116,    -28,     85,    -88,     67,    -41,     20,     -7,      2 },
+  {     -5,     11,    -16,     12,     15,    -82,    205,   -397,    652,   -946,   1228,  -1413,   1370,   -838,  -1126,  28532,
+      8393,  -4722,   3200,  -2163,   1371,   -776,    357,    -95,    -44,     94,    -93,     69,    -41,     20,     -7,      1 },
+  {     -5,     11,    -15,      9,     20,    -88,    213,   -404,    653,   -935,   1194,  -1345,   1250,   -636,  -1491,  28333,
+      8947,  -4877,   3245,  -2161,   1349,   -747,    330,    -73,    -59,    104,    -98,     71,    -42,     20,     -7,      1 },
+  {     -5,     10,    -13,      6,     24,    -95,    221,   -409,    653,   -922,   1159,  -1275,   1129,   -436,  -1844,  28116,
+      9504,  -5025,   3285,  -2155,   1323,   -716,    302,    -51,    -74,    113,   -103,     74,    -43,     20,     -7,      1 },
+  {     -4,      9,    -12,      3,     29,   -101,    228,   -414,    651,   -907,   1122,  -1204,   1007,   -238,  -2183,  27881,
+     10065,  -5166,   3319,  -2144,   1295,   -683,    273,    -28,    -90,    122,   -108,     76,    -43,     20,     -7,      1 },
+  {     -4,      9,    -10,      1,     33,   -107,    234,   -418,    648,   -890,   1083,  -1131,    885,    -43,  -2510,  27628,
+     10629,  -5299,   3347,  -2130,   1264,   -649,    243,     -5,   -105,    132,   -113,     77,    -44,     20,     -7,      1 },
+  {     -4,      8,     -9,     -2,     38,   -113,    240,   -421,    644,   -872,   1042,  -1056,    763,    149,  -2822,  27359,
+     11194,  -5424,   3368,  -2110,   1229,   -613,    212,     18,   -121,    141,   -117,     79,    -44,     20,     -7,      1 },
+  {     -4,      7,     -7,     -5,     42,   -118,    245,   -424,    639,   -852,    999,   -980,    641,    338,  -3121,  27072,
+     11761,  -5541,   3383,  -2087,   1192,   -576,    180,     42,   -136,    150,   -122,     81,    -45,     20,     -7,      1 },
+  {     -4,      7,     -6,     -7,     46,   -123,    250,   -425,    632,   -831,    955,   -904,    519,    523,  -3406,  26769,
+     12329,  -5650,   3392,  -2059,   1153,   -537,    147,     65,   -151,    158,   -126,     82,    -45,     20,     -7,      1 },
+  {     -3,      6,     -5,    -10,     50,   -128,    254,   -426,    625,   -809,    910,   -826,    398,    704,  -3678,  26450,
+     12897,  -5749,   3393,  -2026,   1110,   -496,    114,     89,   -167,    167,   -130,     84,    -45,     20,     -6,      1 },
+  {     -3,      6,     -3,    -13,     54,   -133,    258,   -425,    616,   -785,    863,   -748,    277,    881,  -3935,  26116,
+     13465,  -5839,   3389,  -1989,   1065,   -454,     81,    113,   -182,    175,   -133,     85,    -45,     19,     -6,      1 },
+  {     -3,      5,     -2,    -15,     57,   -137,    261,   -424,    606,   -760,    816,   -669,    158,   1053,  -4178,  25765,
+     14031,  -5918,   3377,  -1948,   1017,   -411,     46,    137,   -197,    183,   -137,     86,    -45,     19,     -6,      1 },
+  {     -3,      4,      0,    -17,     61,   -141,    263,   -422,    595,   -734,    767,   -589,     39,   1220,  -4407,  25400,
+     14596,  -5988,   3358,  -1903,    967,   -366,     12,    161,   -211,    191,   -140,     87,    -45,     19,     -6,      1 },
+  {     -2,      4,      1,    -20,     64,   -144,    265,   -420,    583,   -706,    717,   -509,    -78,   1383,  -4622,  25020,
+     15159,  -6047,   3333,  -1853,    914,   -320,    -23,    185,   -226,    198,   -143,     88,    -45,     18,     -5,      1 },
+  {     -2,      3,      2,    -22,     67,   -147,    266,   -416,    569,   -678,    666,   -430,   -193,   1541,  -4822,  24627,
+     15719,  -6095,   3300,  -1798,    859,   -273,    -59,    209,   -240,    206,   -146,     88,    -45,     18,     -5,      1 },
+  {     -2,      2,      3,    -24,     70,   -150,    267,   -412,    555,   -648,    614,   -350,   -307,   1693,  -5009,  24219,
+     16275,  -6133,   3261,  -1740,    801,   -225,    -95,    233,   -254,    213,   -149,     89,    -44,     18,     -5,      1 },
+  {     -2,      2,      5,    -26,     72,   -152,    267,   -406,    540,   -617,    562,   -270,   -419,   1839,  -5181,  23799,
+     16828,  -6158,   3214,  -1677,    741,   -176,   -131,    256,   -268,    219,   -151,     89,    -44,     17,     -5,      0 },
+  {     -2,      1,      6,    -28,     75,   -154,    267,   -401,    524,   -586,    510,   -191,   -528,   1979,  -5339,  23365,
+     17376,  -6172,   3161,  -1610,    679,   -125,   -167,    280,   -281,    225,   -153,     89,    -43,     16,     -4,      0 },
+  {     -1,      1,      7,    -30,     77,   -156,    266,   -394,    508,   -554,    456,   -112,   -635,   2114,  -5483,  22920,
+     17918,  -6174,   3100,  -1540,    615,    -75,   -203,    303,   -294,    231,   -155,     89,    -42,     16,     -4,      0 },
+  {     -1,      0,      8,    -31,     79,   -157,    265,   -387,    490,   -521,    403,    -34,   -740,   2242,  -5613,  22463,
+     18455,  -6164,   3032,  -1465,    549,    -23,   -239,    326,   -306,    237,   -157,     89,    -42,     15,     -3,      0 },
+  {     -1,      0,      9,    -33,     81,   -158,    263,   -379,    472,   -487,    349,     43,   -842,   2364,  -5729,  21995,
+     18985,  -6141,   2957,  -1386,    481,     29,   -276,    348,   -318,    242,   -158,     88,    -41,     14,     -3,      0 },
+  {     -1,     -1,     10,    -35,     83,   -159,    261,   -370,    453,   -453,    296,    119,   -940,   2480,  -5831,  21516,
+     19508,  -6105,   2876,  -1304,    412,     82,   -312,    370,   -330,    246,   -159,     87,    -40,     14,     -3,      0 },
+  {     -1,     -1,     11,    -36,     84,   -159,    258,   -361,    433,   -418,    242,    194,  -1036,   2589,  -5920,  21028,
+     20023,  -6057,   2787,  -1218,    341,    135,   -347,    392,   -341,    251,   -159,     86,    -39,     13,     -2,      0 },
+  {     -1,     -2,     12,    -37,     85,   -159,    254,   -351,    412,   -383,    188,    268,  -1129,   2691,  -5995,  20530,
+     20530,  -5995,   2691,  -1129,    268,    188,   -383,    412,   -351,    254,   -159,     85,    -37,     12,     -2,     -1 },
+  {      0,     -2,     13,    -39,     86,   -159,    251,   -341,    392,   -347,    135,    341,  -1218,   2787,  -6057,  20023,
+     21028,  -5920,   2589,  -1036,    194,    242,   -418,    433,   -361,    258,   -159,     84,    -36,     11,     -1,     -1 },
+  {      0,     -3,     14,    -40,     87,   -159,    246,   -330,    370,   -312,     82,    412,  -1304,   2876,  -6105,  19508,
+     21516,  -5831,   2480,   -940,    119,    296,   -453,    453,   -370,    261,   -159,     83,    -35,     10,     -1,     -1 },
+  {      0,     -3,     14,    -41,     88,   -158,    242,   -318,    348,   -276,     29,    481,  -1386,   2957,  -6141,  18985,
+     21995,  -5729,   2364,   -842,     43,    349,   -487,    472,   -379,    263,   -158,     81,    -33,      9,      0,     -1 },
+  {      0,     -3,     15,    -42,     89,   -157,    237,   -306,    326,   -239,    -23,    549,  -1465,   3032,  -6164,  18455,
+     22463,  -5613,   2242,   -740,    -34,    403,   -521,    490,   -387,    265,   -157,     79,    -31,      8,      0,     -1 },
+  {      0,     -4,     16,    -42,     89,   -155,    231,   -294,    303,   -203,    -75,    615,  -1540,   3100,  -6174,  17918,
+     22920,  -5483,   2114,   -635,   -112,    456,   -554,    508,   -394,    266,   -156,     77,    -30,      7,      1,     -1 },
+  {      0,     -4,     16,    -43,     89,   -153,    225,   -281,    280,   -167,   -125,    679,  -1610,   3161,  -6172,  17376,
+     23365,  -5339,   1979,   -528,   -191,    510,   -586,    524,   -401,    267,   -154,     75,    -28,      6,      1,     -2 },
+  {      0,     -5,     17,    -44,     89,   -151,    219,   -268,    256,   -131,   -176,    741,  -1677,   3214,  -6158,  16828,
+     23799,  -5181,   1839,   -419,   -270,    562,   -617,    540,   -406,    267,   -152,     72,    -26,      5,      2,     -2 },
+  {      1,     -5,     18,    -44,     89,   -149,    213,   -254,    233,    -95,   -225,    801,  -1740,   3261,  -6133,  16275,
+     24219,  -5009,   1693,   -307,   -350,    614,   -648,    555,   -412,    267,   -150,     70,    -24,      3,      2,     -2 },
+  {      1,     -5,     18,    -45,     88,   -146,    206,   -240,    209,    -59,   -273,    859,  -1798,   3300,  -6095,  15719,
+     24627,  -4822,   1541,   -193,   -430,    666,   -678,    569,   -416,    266,   -147,     67,    -22,      2,      3,     -2 },
+  {      1,     -5,     18,    -45,     88,   -143,    198,   -226,    185,    -23,   -320,    914,  -1853,   3333,  -6047,  15159,
+     25020,  -4622,   1383,    -78,   -509,    717,   -706,    583,   -420,    265,   -144,     64,    -20,      1,      4,     -2 },
+  {      1,     -6,     19,    -45,     87,   -140,    191,   -211,    161,     12,   -366,    967,  -1903,   3358,  -5988,  14596,
+     25400,  -4407,   1220,     39,   -589,    767,   -734,    595,   -422,    263,   -141,     61,    -17,      0,      4,     -3 },
+  {      1,     -6,     19,    -45,     86,   -137,    183,   -197,    137,     46,   -411,   1017,  -1948,   3377,  -5918,  14031,
+     25765,  -4178,   1053,    158,   -669,    816,   -760,    606,   -424,    261,   -137,     57,    -15,     -2,      5,     -3 },
+  {      1,     -6,     19,    -45,     85,   -133,    175,   -182,    113,     81,   -454,   1065,  -1989,   3389,  -5839,  13465,
+     26116,  -3935,    881,    277,   -748,    863,   -785,    616,   -425,    258,   -133,     54,    -13,     -3,      6,     -3 },
+  {      1,     -6,     20,    -45,     84,   -130,    167,   -167,     89,    114,   -496,   1110,  -2026,   3393,  -5749,  12897,
+     26450,  -3678,    704,    398,   -826,    910,   -809,    625,   -426,    254,   -128,     50,    -10,     -5,      6,     -3 },
+  {      1,     -7,     20,    -45,     82,   -126,    158,   -151,     65,    147,   -537,   1153,  -2059,   3392,  -5650,  12329,
+     26769,  -3406,    523,    519,   -904,    955,   -831,    632,   -425,    250,   -123,     46,     -7,     -6,      7,     -4 },
+  {      1,     -7,     20,    -45,     81,   -122,    150,   -136,     42,    180,   -576,   1192,  -2087,   3383,  -5541,  11761,
+     27072,  -3121,    338,    641,   -980,    999,   -852,    639,   -424,    245,   -118,     42,     -5,     -7,      7,     -4 },
+  {      1,     -7,     20,    -44,     79,   -117,    141,   -121,     18,    212,   -613,   1229,  -2110,   3368,  -5424,  11194,
+     27359,  -2822,    149,    763,  -1056,   1042,   -872,    644,   -421,    240,   -113,     38,     -2,     -9,      8,     -4 },
+  {      1,     -7,     20,    -44,     77,   -113,    132,   -105,     -5,    243,   -649,   1264,  -2130,   3347,  -5299,  10629,
+     27628,  -2510,    -43,    885,  -1131,   1083,   -890,    648,   -418,    234,   -107,     33,      1,    -10,      9,     -4 },
+  {      1,     -7,     20,    -43,     76,   -108,    122,    -90,    -28,    273,   -683,   1295,  -2144,   3319,  -5166,  10065,
+     27881,  -2183,   -238,   1007,  -1204,   1122,   -907,    651,   -414,    228,   -101,     29,      3,    -12,      9,     -4 },
+  {      1,     -7,     20,    -43,     74,   -103,    113,    -74,    -51,    302,   -716,   1323,  -2155,   3285,  -5025,   9504,
+     28116,  -1844,   -436,   1129,  -1275,   1159,   -922,    653,   -409,    221,    -95,     24,      6,    -13,     10,     -5 },
+  {      1,     -7,     20,    -42,     71,    -98,    104,    -59,    -73,    330,   -747,   1349,  -2161,   3245,  -4877,   8947,
+     28333,  -1491,   -636,   1250,  -1345,   1194,   -935,    653,   -404,    213,    -88,     20,      9,    -15,     11,     -5 },
+  {      1,     -7,     20,    -41,     69,    -93,     94,    -44,    -95,    357,   -776,   1371,  -2163,   3200,  -4722,   8393,
+     28532,  -1126,   -838,   1370,  -1413,   1228,   -946,    652,   -397,    205,    -82,     15,     12,    -16,     11,     -5 },
+  {      2,     -7,     20,    -41,     67,    -88,     85,    -28,   -116,    384,   -803,   1391,  -2160,   3149,  -4560,   7843,
+     28713,   -748,  -1042,   1488,  -1479,   1259,   -956,    650,   -389,    197,    -74,     10,     15,    -18,     12,     -5 },
+  {      2,     -7,     20,    -40,     64,    -83,     75,    -13,   -137,    409,   -828,   1407,  -2153,   3092,  -4393,   7298,
+     28876,   -357,  -1247,   1606,  -1543,   1288,   -964,    646,   -381,    188,    -67,      5,     18,    -19,     12,     -5 },
+  {      2,     -7,     19,    -39,     62,    -77,     66,      2,   -157,    433,   -851,   1421,  -2142,   3030,  -4220,   6759,
+     29020,     45,  -1453,   1721,  -1604,   1315,   -970,    641,   -371,    178,    -59,     -1,     21,    -21,     13,     -6 },
+  {      2,     -7,     19,    -38,     59,    -72,     56,     16,   -177,    456,   -873,   1432,  -2127,   2963,  -4043,   6225,
+     29145,    460,  -1660,   1835,  -1663,   1340,   -974,    635,   -361,    168,    -51,     -6,     24,    -22,     14,     -6 },
+  {      2,     -7,     19,    -37,     57,    -67,     47,     31,   -197,    478,   -892,   1440,  -2108,   2890,  -3860,   5698,
+     29251,    886,  -1867,   1947,  -1719,   1362,   -977,    627,   -350,    158,    -43,    -11,     27,    -24,     14,     -6 },
+  {      2,     -7,     18,    -36,     54,    -61,     37,     45,   -215,    499,   -909,   1444,  -2085,   2814,  -3673,   5178,
+     29338,   1323,  -2074,   2056,  -1773,   1382,   -977,    618,   -338,    147,    -35,    -17,     30,    -25,     15,     -6 },
+  {      2,     -7,     18,    -34,     51,    -55,     28,     59,   -233,    518,   -925,   1446,  -2059,   2732,  -3482,   4665,
+     29405,   1771,  -2280,   2162,  -1823,   1399,   -976,    608,   -326,    136,    -27,    -22,     33,    -27,     15,     -6 },
+  {      1,     -7,     18,    -33,     48,    -50,     18,     73,   -250,    536,   -938,   1445,  -2028,   2647,  -3288,   4160,
+     29454,   2230,  -2485,   2266,  -1871,   1414,   -972,    596,   -312,    124,    -18,    -28,     36,    -28,     16,     -6 },
+  {      1,     -7,     17,    -32,     45,    -44,      9,     86,   -267,    553,   -950,   1442,  -1994,   2557,  -3091,   3664,
+     29483,   2698,  -2689,   2366,  -1915,   1426,   -967,    583,   -298,    112,     -9,    -33,     39,    -29,     16,     -7 },
+  {      1,     -7,     17,    -31,     42,    -39,      0,     99,   -283,    569,   -959,   1435,  -1956,   2464,  -2891,   3177,
+     29493,   3177,  -2891,   2464,  -1956,   1435,   -959,    569,   -283,     99,      0,    -39,     42,    -31,     17,     -7 }
+};
+
+//--------------------------------------------------------------------+
+// Resampler
+//--------------------------------------------------------------------+
+
+uint32_t audiod_asrc_ratio(uint32_t in_rate, uint32_t out_rate)
+{
+  return (uint32_t) ((((uint64_t) in_rate) << 30) / out_rate);
+}
+
+void audiod_asrc_init(audiod_asrc_t* asrc, uint8_t n_channels, uint32_t step)
+{
+  tu_memclr(asrc, sizeof(audiod_asrc_t));
+  asrc->step       = step;
+  asrc->n_channels = tu_min8(n_channels, CFG_TUD_AUDIO_ASRC_MAX_CHANNELS);
+  asrc->need       = 1;
+}
+
+// Advance output position by ratio, whole input frames passed are shifted in before next output
+TU_ATTR_ALWAYS_INLINE static inline void asrc_advance(audiod_asrc_t* asrc)
+{
+  uint64_t const pos = (uint64_t) asrc->frac + ((uint64_t) asrc->step << 2);
+  asrc->frac = (uint32_t) pos;
+  asrc->need = (uint8_t) (pos >> 32);
+}
+
+uint16_t audiod_asrc_process_s32(audiod_asrc_t* asrc, void* dst, uint16_t n_out, void const* src, uint16_t* n_in)
+{
+  uint8_t const n_channels = asrc->n_channels;
+  uint8_t * d = (uint8_t *) dst;
+  uint8_t const * s = (uint8_t const *) src;
+  uint16_t in_left = *n_in;
+  uint16_t out = 0;
+
+  while (out < n_out)
+  {
+    for (; asrc->need && in_left; asrc->need--, in_left--)
+    {
+      for (uint8_t ch = 0; ch < n_channels; ch++)
+      {
+        int32_t const v = (int32_t) tu_unaligned_read32(s);
+        asrc->hist[ch].s32[asrc->pos] = asrc->hist[ch].s32[asrc->pos + AUDIOD_ASRC_TAPS] = v;
+        s += 4;
+      }
+      asrc->pos = (uint8_t) ((asrc->pos + 1) & (AUDIOD_ASRC_TAPS - 1));
+    }
+    if (asrc->need) break;
+
+    int16_t const * c0 = _asrc_coef[asrc->frac >> (32 - ASRC_PHASES_LOG2)];
+    int16_t const * c1 = c0 + AUDIOD_ASRC_TAPS;
+    int32_t const a = (int32_t) ((asrc->frac >> (16 - ASRC_PHASES_LOG2)) & 0xFFFF);   // Position between phases in Q16
+
+    for (uint8_t ch = 0; ch < n_channels; ch++)
+    {
+      int32_t const * x = &asrc->hist[ch].s32[asrc->pos];
+      int64_t acc0 = 0, acc1 = 0;
+
+      for (uint8_t k = 0; k < AUDIOD_ASRC_TAPS; k++)
+      {
+        acc0 += (int64_t) x[k] * c0[k];
+        acc1 += (int64_t) x[k] * c1[k];
+      }
+
+      // Q46 to Q31, then interpolate between phases
+      acc0 >>= 15;
+      acc1 >>= 15;
+      int64_t y = acc0 + (((acc1 - acc0) * a) >> 16);
+
+      if (y > INT32_MAX) y = INT32_MAX;
+      if (y < INT32_MIN) y = INT32_MIN;
+      tu_unaligned_write32(d, (uint32_t) (int32_t) y);
+      d += 4;
+    }
+
+    out++;
+    asrc_advance(asrc);
+  }
+
+  *n_in = (uint16_t) (*n_in - in_left);
+  asrc->count += out;
+  return out;
+}
+
+uint16_t audiod_asrc_process_f32(audiod_asrc_t* asrc, void* dst, uint16_t n_out, void const* src, uint16_t* n_in)
+{
+  uint8_t const n_channels = asrc->n_channels;
+  uint8_t * d = (uint8_t *) dst;
+  uint8_t const * s = (uint8_t const *) src;
+  uint16_t in_left = *n_in;
+  uint16_t out = 0;
+
+  while (out < n_out)
+  {
+    for (; asrc->need && in_left; asrc->need--, in_left--)
+    {
+      for (uint8_t ch = 0; ch < n_channels; ch++)
+      {
+        float v;
+        memcpy(&v, s, 4);
+        asrc->hist[ch].f32[asrc->pos] = asrc->hist[ch].f32[asrc->pos + AUDIOD_ASRC_TAPS] = v;
+        s += 4;
+      }
+      asrc->pos = (uint8_t) ((asrc->pos + 1) & (AUDIOD_ASRC_TAPS - 1));
+    }
+    if (asrc->need) break;
+
+    int16_t const * c0 = _asrc_coef[asrc->frac >> (32 - ASRC_PHASES_LOG2)];
+    int16_t const * c1 = c0 + AUDIOD_ASRC_TAPS;
+    float const a = (float) (asrc->frac & ((1UL << (32 - ASRC_PHASES_LOG2)) - 1)) * (1.0f / (float) (1UL << (32 - ASRC_PHASES_LOG2)));
+
+    for (uint8_t ch = 0; ch < n_channels; ch++)
+    {
+      float const * x = &asrc->hist[ch].f32[asrc->pos];
+      float acc0 = 0, acc1 = 0;
+
+      for (uint8_t k = 0; k < AUDIOD_ASRC_TAPS; k++)
+      {
+        acc0 += x[k] * (float) c0[k];
+        acc1 += x[k] * (float) c1[k];
+      }
+
+      float const y = (acc0 + (acc1 - acc0) * a) * (1.0f / 32768);
+      memcpy(d, &y, 4);
+      d += 4;
+    }
+
+    out++;
+    asrc_advance(asrc);
+  }
+
+  *n_in = (uint16_t) (*n_in - in_left);
+  asrc->count += out;
+  return out;
+}
+
+//--------------------------------------------------------------------+
+// Ratio tracking
+//--------------------------------------------------------------------+
+
+void audiod_asrc_tracker_init(audiod_asrc_tracker_t* tr, uint32_t in_rate, uint32_t out_rate, uint16_t level_target)
+{
+  tr->nominal      = audiod_asrc_ratio(in_rate, out_rate);
+  tr->step         = tr->nominal;
+  tr->level_target = level_target;
+  tr->level_avg    = (uint32_t) level_target << 16;
+  tr->integral     = 0;
+
+  // Level changes by about out_rate/1000 frames per ms and unit of ratio
+  tr->p_gain = (uint32_t) ((1000ULL << 30) / ((uint64_t) out_rate << AUDIOD_ASRC_KP_SHIFT));
+}
+
+uint32_t audiod_asrc_tracker_update(audiod_asrc_tracker_t* tr, uint16_t level)
+{
+  int64_t const delta = ((int64_t) level << 16) - tr->level_avg;
+  tr->level_avg = (uint32_t) ((int64_t) tr->level_avg + delta / (1 << AUDIOD_ASRC_LPF_SHIFT));
+
+  // Error in 16.16 frames, positive if FIFO is above target
+  int64_t const error = (int64_t) tr->level_avg - ((int64_t) tr->level_target << 16);
+  int32_t const trim_max = (int32_t) (tr->nominal >> AUDIOD_ASRC_TRIM_SHIFT);
+
+  // Proportional term in Q2.30, bound to maximum trim
+  int64_t p64 = (error * tr->p_gain) / 65536;
+  if (p64 >  trim_max) p64 =  trim_max;
+  if (p64 < -trim_max) p64 = -trim_max;
+  int32_t const p = (int32_t) p64;
+
+  int64_t const i_max = (int64_t) trim_max << AUDIOD_ASRC_KI_SHIFT;
+  int64_t integral = tr->integral + p;
+  if (integral >  i_max) integral =  i_max;
+  if (integral < -i_max) integral = -i_max;
+
+  int32_t trim = p + (int32_t) (integral / (1 << AUDIOD_ASRC_KI_SHIFT));
+
+  // Anti windup: only integrate while trim is not saturated
+  if (trim > trim_max)
+  {
+    trim = trim_max;
+  }
+  else if (trim < -trim_max)
+  {
+    trim = -trim_max;
+  }
+  else
+  {
+    tr->integral = integral;
+  }
+
+  tr->step = (uint32_t) ((int64_t) tr->nominal + trim);
+  return tr->step;
+}
+
+#endif
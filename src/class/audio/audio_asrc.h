@@ -0,0 +1,116 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_AUDIO_ASRC_H_
+#define _TUSB_AUDIO_ASRC_H_
+
+#include "common/tusb_common.h"
+
+//--------------------------------------------------------------------+
+// Class Driver Configuration
+//--------------------------------------------------------------------+
+
+// Asynchronous sample rate converter between support FIFOs and application, see tud_audio_n_set_rx_asrc()
+#ifndef CFG_TUD_AUDIO_ENABLE_ASRC
+#define CFG_TUD_AUDIO_ENABLE_ASRC             0
+#endif
+
+// Maximum number of channels per support FIFO the converter keeps history for
+#ifndef CFG_TUD_AUDIO_ASRC_MAX_CHANNELS
+#define CFG_TUD_AUDIO_ASRC_MAX_CHANNELS       2
+#endif
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Internal polyphase resampler: 32 tap Kaiser windowed sinc in 64 phases, output is linearly interpolated between
+// adjacent phases. Ratio is input frames per output frame in Q2.30. Frames are interleaved int32_t (left justified)
+// or float samples of n_channels, input and output may be unaligned.
+//--------------------------------------------------------------------+
+
+#define AUDIOD_ASRC_TAPS    32
+
+typedef struct
+{
+  uint32_t step;        // Input frames per output frame in Q2.30
+  uint32_t frac;        // Position of next output between input frames in Q0.32
+  uint32_t count;       // Output frames produced, free running
+  uint8_t  need;        // Input frames to shift in before next output
+  uint8_t  pos;         // Oldest frame of history
+  uint8_t  n_channels;
+
+  // Each frame is stored twice so that the last AUDIOD_ASRC_TAPS frames are always contiguous from pos
+  union
+  {
+    int32_t s32[2*AUDIOD_ASRC_TAPS];
+    float   f32[2*AUDIOD_ASRC_TAPS];
+  } hist[CFG_TUD_AUDIO_ASRC_MAX_CHANNELS];
+} audiod_asrc_t;
+
+// Q2.30 ratio of in_rate / out_rate
+uint32_t audiod_asrc_ratio(uint32_t in_rate, uint32_t out_rate);
+
+void audiod_asrc_init(audiod_asrc_t* asrc, uint8_t n_channels, uint32_t step);
+
+// Convert until either n_out frames are written or input is used up. *n_in holds available input frames on entry
+// and consumed ones on return. Return number of frames written.
+uint16_t audiod_asrc_process_s32(audiod_asrc_t* asrc, void* dst, uint16_t n_out, void const* src, uint16_t* n_in);
+uint16_t audiod_asrc_process_f32(audiod_asrc_t* asrc, void* dst, uint16_t n_out, void const* src, uint16_t* n_in);
+
+//--------------------------------------------------------------------+
+// Internal ratio tracking: FIFO level between USB and converter is sampled every SOF (1 ms), low pass filtered and
+// a PI controller trims the nominal ratio such that the level stays at target, which follows any drift between
+// USB and application sample clock.
+//--------------------------------------------------------------------+
+
+#define AUDIOD_ASRC_LPF_SHIFT   4   // Level filter time constant of 16 ms
+#define AUDIOD_ASRC_KP_SHIFT    6   // 1/64 of the level error is corrected per ms
+#define AUDIOD_ASRC_KI_SHIFT    8   // Integral time 4 times the proportional time constant for critical damping
+#define AUDIOD_ASRC_TRIM_SHIFT  8   // Ratio is trimmed by at most 1/256 of nominal
+
+typedef struct
+{
+  uint32_t nominal;       // Q2.30 ratio of nominal rates
+  uint32_t step;          // Q2.30 trimmed ratio, picked up by converters
+  uint32_t level_avg;     // Low pass filtered FIFO level in 16.16 frames
+  uint32_t p_gain;        // Q2.30 ratio change per frame of level error
+  int64_t  integral;      // Sum of proportional terms, Q2.30 << AUDIOD_ASRC_KI_SHIFT
+  uint16_t level_target;  // FIFO level to regulate to in frames
+} audiod_asrc_tracker_t;
+
+void audiod_asrc_tracker_init(audiod_asrc_tracker_t* tr, uint32_t in_rate, uint32_t out_rate, uint16_t level_target);
+
+// Invoked every SOF with FIFO level in frames, return new ratio. Level above target increases ratio: the converter
+// consumes more input per output frame (FIFO feeds converter) or produces less output per input frame (converter feeds FIFO).
+uint32_t audiod_asrc_tracker_update(audiod_asrc_tracker_t* tr, uint16_t level);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_AUDIO_ASRC_H_ */
@@ -25,7 +25,8 @@
  */
 
 /*
- * This driver supports at most one out EP, one in EP, one control EP, and one feedback EP and one alternative interface other than zero. Hence, only one input terminal and one output terminal are support, if you need more adjust the driver!
+ * This driver supports one control EP and per audio function CFG_TUD_AUDIO_FUNC_X_N_EP_OUT out EPs and CFG_TUD_AUDIO_FUNC_X_N_EP_IN in EPs (one per AS interface, numbered as streams in descriptor order).
+ * Software coding, the feedback EP and sample rate conversion are available for the first out/in stream only.
  * It supports multiple TX and RX channels.
  *
  * In case you need more alternate interfaces, you need to define additional defines for this specific alternate interface. Just define them and set them in the set_interface function.
@@ -59,6 +60,9 @@
 #include "device/usbd_pvt.h"
 
 #include "audio_device.h"
+#include "audio_pcm.h"
+#include "audio_feedback.h"
+#include "audio_asrc.h"
 
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF
@@ -113,6 +117,10 @@
 #define  USE_LINEAR_BUFFER     1
 #endif
 
+// Sample rate converters run on support FIFOs of Type I coding
+#define USE_ASRC_RX   (CFG_TUD_AUDIO_ENABLE_ASRC && CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING)
+#define USE_ASRC_TX   (CFG_TUD_AUDIO_ENABLE_ASRC && CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING)
+
 // Declaration of buffers
 
 // Check for maximum supported numbers
@@ -120,24 +128,31 @@
 #error Maximum number of audio functions restricted to three!
 #endif
 
+// Maximum number of streaming EPs of all audio functions, defaults of unused functions are 1
+#define AUDIOD_N_EP_IN_MAX    TU_MAX(CFG_TUD_AUDIO_FUNC_1_N_EP_IN, TU_MAX(CFG_TUD_AUDIO_FUNC_2_N_EP_IN, CFG_TUD_AUDIO_FUNC_3_N_EP_IN))
+#define AUDIOD_N_EP_OUT_MAX   TU_MAX(CFG_TUD_AUDIO_FUNC_1_N_EP_OUT, TU_MAX(CFG_TUD_AUDIO_FUNC_2_N_EP_OUT, CFG_TUD_AUDIO_FUNC_3_N_EP_OUT))
+
+// Stream index returned if an AS interface has no streaming EP of the requested direction
+#define AUDIOD_NO_STREAM      0xFF
+
 // EP IN software buffers and mutexes
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_ENCODING
 #if CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_in_sw_buf_1[CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_in_sw_buf_1[CFG_TUD_AUDIO_FUNC_1_N_EP_IN][CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ];
 #if CFG_FIFO_MUTEX
-osal_mutex_def_t ep_in_ff_mutex_wr_1;                                                             // No need for read mutex as only USB driver reads from FIFO
+osal_mutex_def_t ep_in_ff_mutex_wr_1[CFG_TUD_AUDIO_FUNC_1_N_EP_IN];                               // No need for read mutex as only USB driver reads from FIFO
 #endif
 #endif // CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ > 0
 #if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_EP_IN_SW_BUF_SZ > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_in_sw_buf_2[CFG_TUD_AUDIO_FUNC_2_EP_IN_SW_BUF_SZ];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_in_sw_buf_2[CFG_TUD_AUDIO_FUNC_2_N_EP_IN][CFG_TUD_AUDIO_FUNC_2_EP_IN_SW_BUF_SZ];
 #if CFG_FIFO_MUTEX
-osal_mutex_def_t ep_in_ff_mutex_wr_2;                                                             // No need for read mutex as only USB driver reads from FIFO
+osal_mutex_def_t ep_in_ff_mutex_wr_2[CFG_TUD_AUDIO_FUNC_2_N_EP_IN];                               // No need for read mutex as only USB driver reads from FIFO
 #endif
 #endif // CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_EP_IN_SW_BUF_SZ > 0
 #if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_EP_IN_SW_BUF_SZ > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_in_sw_buf_3[CFG_TUD_AUDIO_FUNC_3_EP_IN_SW_BUF_SZ];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_in_sw_buf_3[CFG_TUD_AUDIO_FUNC_3_N_EP_IN][CFG_TUD_AUDIO_FUNC_3_EP_IN_SW_BUF_SZ];
 #if CFG_FIFO_MUTEX
-osal_mutex_def_t ep_in_ff_mutex_wr_3;                                                             // No need for read mutex as only USB driver reads from FIFO
+osal_mutex_def_t ep_in_ff_mutex_wr_3[CFG_TUD_AUDIO_FUNC_3_N_EP_IN];                               // No need for read mutex as only USB driver reads from FIFO
 #endif
 #endif // CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_EP_IN_SW_BUF_SZ > 0
 #endif // CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_ENCODING
@@ -147,34 +162,34 @@ osal_mutex_def_t ep_in_ff_mutex_wr_3;
 // - the software encoding is used - in this case the linear buffers serve as a target memory where logical channels are encoded into
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && (USE_LINEAR_BUFFER || CFG_TUD_AUDIO_ENABLE_ENCODING)
 #if CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_in_1[CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_in_1[CFG_TUD_AUDIO_FUNC_1_N_EP_IN][CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX];
 #endif
 #if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_EP_IN_SZ_MAX > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_in_2[CFG_TUD_AUDIO_FUNC_2_EP_IN_SZ_MAX];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_in_2[CFG_TUD_AUDIO_FUNC_2_N_EP_IN][CFG_TUD_AUDIO_FUNC_2_EP_IN_SZ_MAX];
 #endif
 #if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_EP_IN_SZ_MAX > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_in_3[CFG_TUD_AUDIO_FUNC_3_EP_IN_SZ_MAX];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_in_3[CFG_TUD_AUDIO_FUNC_3_N_EP_IN][CFG_TUD_AUDIO_FUNC_3_EP_IN_SZ_MAX];
 #endif
 #endif // CFG_TUD_AUDIO_ENABLE_EP_IN && (USE_LINEAR_BUFFER || CFG_TUD_AUDIO_ENABLE_DECODING)
 
 // EP OUT software buffers and mutexes
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING
 #if CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_out_sw_buf_1[CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_out_sw_buf_1[CFG_TUD_AUDIO_FUNC_1_N_EP_OUT][CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ];
 #if CFG_FIFO_MUTEX
-osal_mutex_def_t ep_out_ff_mutex_rd_1;                                                            // No need for write mutex as only USB driver writes into FIFO
+osal_mutex_def_t ep_out_ff_mutex_rd_1[CFG_TUD_AUDIO_FUNC_1_N_EP_OUT];                             // No need for write mutex as only USB driver writes into FIFO
 #endif
 #endif // CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ > 0
 #if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_EP_OUT_SW_BUF_SZ > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_out_sw_buf_2[CFG_TUD_AUDIO_FUNC_2_EP_OUT_SW_BUF_SZ];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_out_sw_buf_2[CFG_TUD_AUDIO_FUNC_2_N_EP_OUT][CFG_TUD_AUDIO_FUNC_2_EP_OUT_SW_BUF_SZ];
 #if CFG_FIFO_MUTEX
-osal_mutex_def_t ep_out_ff_mutex_rd_2;                                                            // No need for write mutex as only USB driver writes into FIFO
+osal_mutex_def_t ep_out_ff_mutex_rd_2[CFG_TUD_AUDIO_FUNC_2_N_EP_OUT];                             // No need for write mutex as only USB driver writes into FIFO
 #endif
 #endif // CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_EP_OUT_SW_BUF_SZ > 0
 #if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_EP_OUT_SW_BUF_SZ > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_out_sw_buf_3[CFG_TUD_AUDIO_FUNC_3_EP_OUT_SW_BUF_SZ];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t audio_ep_out_sw_buf_3[CFG_TUD_AUDIO_FUNC_3_N_EP_OUT][CFG_TUD_AUDIO_FUNC_3_EP_OUT_SW_BUF_SZ];
 #if CFG_FIFO_MUTEX
-osal_mutex_def_t ep_out_ff_mutex_rd_3;                                                            // No need for write mutex as only USB driver writes into FIFO
+osal_mutex_def_t ep_out_ff_mutex_rd_3[CFG_TUD_AUDIO_FUNC_3_N_EP_OUT];                             // No need for write mutex as only USB driver writes into FIFO
 #endif
 #endif // CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_EP_OUT_SW_BUF_SZ > 0
 #endif // CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING
@@ -184,13 +199,13 @@ osal_mutex_def_t ep_out_ff_mutex_rd_3;
 // - the software encoding is used - in this case the linear buffers serve as a target memory where logical channels are encoded into
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && (USE_LINEAR_BUFFER || CFG_TUD_AUDIO_ENABLE_DECODING)
 #if CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_out_1[CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_out_1[CFG_TUD_AUDIO_FUNC_1_N_EP_OUT][CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX];
 #endif
 #if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_EP_OUT_SZ_MAX > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_out_2[CFG_TUD_AUDIO_FUNC_2_EP_OUT_SZ_MAX];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_out_2[CFG_TUD_AUDIO_FUNC_2_N_EP_OUT][CFG_TUD_AUDIO_FUNC_2_EP_OUT_SZ_MAX];
 #endif
 #if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_EP_OUT_SZ_MAX > 0
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_out_3[CFG_TUD_AUDIO_FUNC_3_EP_OUT_SZ_MAX];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t lin_buf_out_3[CFG_TUD_AUDIO_FUNC_3_N_EP_OUT][CFG_TUD_AUDIO_FUNC_3_EP_OUT_SZ_MAX];
 #endif
 #endif // CFG_TUD_AUDIO_ENABLE_EP_OUT && (USE_LINEAR_BUFFER || CFG_TUD_AUDIO_ENABLE_DECODING)
 
@@ -261,21 +276,40 @@ osal_mutex_def_t rx_supp_ff_mutex_rd_3[CFG_TUD_AUDIO_FUNC_3_N_RX_SUPP_SW_FIFO];
 #endif
 #endif
 
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+// Sample rate converters of one direction, one per support FIFO sharing the ratio tracked from level of first FIFO
+typedef struct
+{
+  uint32_t in_rate;       // Rate at converter input, zero if disabled
+  uint32_t out_rate;      // Rate at converter output
+  audiod_asrc_tracker_t tracker;
+  audiod_asrc_t ff[CFG_TUD_AUDIO_ASRC_MAX_FF];
+} audiod_asrc_dir_t;
+#endif
+
+// Streaming data EP of an AS interface, AS interfaces are assigned to streams when audio function is opened
+typedef struct
+{
+  uint8_t ep;                   // EP address, zero while AS interface is in alternate setting zero
+  uint8_t as_intf_num;          // Corresponding Standard AS Interface Descriptor (4.9.1) belonging to terminal to which this EP belongs - 0 is invalid (this fits to UAC2 specification since AS interfaces can not have interface number equal to zero)
+  uint16_t ep_sz;               // Current size of EP
+  uint16_t n_bytes_xfer;        // Size of transfer in progress
+  bool xfer_in_ff;              // Transfer buffer is located directly in application ring, FIFO pointer is advanced on completion
+} audiod_stream_t;
+
 typedef struct
 {
   uint8_t rhport;
   uint8_t const * p_desc;       // Pointer pointing to Standard AC Interface Descriptor(4.7.1) - Audio Control descriptor defining audio function
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN
-  uint8_t ep_in;                // TX audio data EP.
-  uint16_t ep_in_sz;            // Current size of TX EP
-  uint8_t ep_in_as_intf_num;    // Corresponding Standard AS Interface Descriptor (4.9.1) belonging to output terminal to which this EP belongs - 0 is invalid (this fits to UAC2 specification since AS interfaces can not have interface number equal to zero)
+  audiod_stream_t stream_in[AUDIOD_N_EP_IN_MAX];      // TX audio data EPs in descriptor order
+  uint8_t n_stream_in;
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
-  uint8_t ep_out;               // Incoming (into uC) audio data EP.
-  uint16_t ep_out_sz;           // Current size of RX EP
-  uint8_t ep_out_as_intf_num;   // Corresponding Standard AS Interface Descriptor (4.9.1) belonging to input terminal to which this EP belongs - 0 is invalid (this fits to UAC2 specification since AS interfaces can not have interface number equal to zero)
+  audiod_stream_t stream_out[AUDIOD_N_EP_OUT_MAX];    // Incoming (into uC) audio data EPs in descriptor order
+  uint8_t n_stream_out;
 
 #if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
   uint8_t ep_fb;                // Feedback EP.
@@ -301,7 +335,8 @@ typedef struct
   // EP Transfer buffers and FIFOs
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
 #if !CFG_TUD_AUDIO_ENABLE_DECODING
-  tu_fifo_t ep_out_ff;
+  tu_fifo_t ep_out_ff[AUDIOD_N_EP_OUT_MAX];
+  bool ep_out_ff_ext[AUDIOD_N_EP_OUT_MAX];     // EP FIFO buffer is an application owned ring
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
@@ -322,12 +357,7 @@ typedef struct
         uint32_t mclk_freq;
       }fixed;
 
-#if 0 // implement later
-      struct {
-        uint32_t nominal_value;
-        uint32_t threshold_bytes;
-      }fifo_count;
-#endif
+      audiod_fb_fifo_count_t fifo_count;
     }compute;
 
   } feedback;
@@ -336,7 +366,8 @@ typedef struct
 #endif // CFG_TUD_AUDIO_ENABLE_EP_OUT
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_ENCODING
-  tu_fifo_t ep_in_ff;
+  tu_fifo_t ep_in_ff[AUDIOD_N_EP_IN_MAX];
+  bool ep_in_ff_ext[AUDIOD_N_EP_IN_MAX];       // EP FIFO buffer is an application owned ring
 #endif
 
   // Audio control interrupt buffer - no FIFO - 6 Bytes according to UAC 2 specification (p. 74)
@@ -355,6 +386,12 @@ typedef struct
   uint8_t n_bytes_per_sampe_rx;
   uint8_t n_channels_per_ff_rx;
   uint8_t n_ff_used_rx;
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+  audiod_pcm_conv_t conv_rx;             // Format of support FIFOs, kept over bus reset
+#endif
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+  audiod_asrc_dir_t asrc_rx;             // Rates are kept over bus reset
+#endif
 #endif
 #endif
 
@@ -368,6 +405,12 @@ typedef struct
   uint8_t n_bytes_per_sampe_tx;
   uint8_t n_channels_per_ff_tx;
   uint8_t n_ff_used_tx;
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+  audiod_pcm_conv_t conv_tx;             // Format of support FIFOs, kept over bus reset
+#endif
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+  audiod_asrc_dir_t asrc_tx;             // Rates are kept over bus reset
+#endif
 #endif
 #endif
 
@@ -386,12 +429,12 @@ typedef struct
 
   // Linear buffer in case target MCU is not capable of handling a ring buffer FIFO e.g. no hardware buffer is available or driver is would need to be changed dramatically OR the support FIFOs are used
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && (USE_LINEAR_BUFFER || CFG_TUD_AUDIO_ENABLE_DECODING)
-  uint8_t * lin_buf_out;
+  uint8_t * lin_buf_out[AUDIOD_N_EP_OUT_MAX];
 #define USE_LINEAR_BUFFER_RX   1
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && (USE_LINEAR_BUFFER || CFG_TUD_AUDIO_ENABLE_ENCODING)
-  uint8_t * lin_buf_in;
+  uint8_t * lin_buf_in[AUDIOD_N_EP_IN_MAX];
 #define USE_LINEAR_BUFFER_TX   1
 #endif
 
@@ -407,13 +450,296 @@ typedef struct
 
 #define ITF_MEM_RESET_SIZE   offsetof(audiod_function_t, ctrl_buf)
 
+// Buffers and stream numbers of an audio function. Buffers of the streams of a function are laid out back to back,
+// stream s uses the buffer at offset s * size.
+typedef struct
+{
+  uint16_t desc_length;         // Length of audio function descriptor
+  uint8_t * ctrl_buf;
+  uint8_t ctrl_buf_sz;
+  uint8_t * alt_setting;
+
+#if CFG_TUD_AUDIO_ENABLE_EP_IN
+  uint8_t n_stream_in;
+#if !CFG_TUD_AUDIO_ENABLE_ENCODING
+  uint8_t * ep_in_sw_buf;
+  uint16_t ep_in_sw_buf_sz;
+#if CFG_FIFO_MUTEX
+  osal_mutex_def_t * ep_in_ff_mutex_wr;
+#endif
+#endif
+#if USE_LINEAR_BUFFER_TX
+  uint8_t * lin_buf_in;
+  uint16_t lin_buf_in_sz;
+#endif
+#if CFG_TUD_AUDIO_ENABLE_ENCODING
+  tu_fifo_t * tx_supp_ff;
+  uint8_t * tx_supp_ff_buf;
+  uint16_t tx_supp_ff_sz;
+  uint8_t n_tx_supp_ff;
+#if CFG_FIFO_MUTEX
+  osal_mutex_def_t * tx_supp_ff_mutex_wr;
+#endif
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
+  uint8_t n_channels_per_ff_tx;
+#endif
+#endif
+#endif // CFG_TUD_AUDIO_ENABLE_EP_IN
+
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT
+  uint8_t n_stream_out;
+#if !CFG_TUD_AUDIO_ENABLE_DECODING
+  uint8_t * ep_out_sw_buf;
+  uint16_t ep_out_sw_buf_sz;
+#if CFG_FIFO_MUTEX
+  osal_mutex_def_t * ep_out_ff_mutex_rd;
+#endif
+#endif
+#if USE_LINEAR_BUFFER_RX
+  uint8_t * lin_buf_out;
+  uint16_t lin_buf_out_sz;
+#endif
+#if CFG_TUD_AUDIO_ENABLE_DECODING
+  tu_fifo_t * rx_supp_ff;
+  uint8_t * rx_supp_ff_buf;
+  uint16_t rx_supp_ff_sz;
+  uint8_t n_rx_supp_ff;
+#if CFG_FIFO_MUTEX
+  osal_mutex_def_t * rx_supp_ff_mutex_rd;
+#endif
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
+  uint8_t n_channels_per_ff_rx;
+#endif
+#endif
+#endif // CFG_TUD_AUDIO_ENABLE_EP_OUT
+} audiod_fct_cfg_t;
+
+static audiod_fct_cfg_t const _audiod_fct_cfg[CFG_TUD_AUDIO] =
+{
+  {
+    .desc_length       = CFG_TUD_AUDIO_FUNC_1_DESC_LEN,
+    .ctrl_buf          = ctrl_buf_1,
+    .ctrl_buf_sz       = CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ,
+#if CFG_TUD_AUDIO_FUNC_1_N_AS_INT > 0
+    .alt_setting       = alt_setting_1,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_EP_IN
+    .n_stream_in       = CFG_TUD_AUDIO_FUNC_1_N_EP_IN,
+#if !CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ > 0
+    .ep_in_sw_buf      = audio_ep_in_sw_buf_1[0],
+    .ep_in_sw_buf_sz   = CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ,
+#if CFG_FIFO_MUTEX
+    .ep_in_ff_mutex_wr = ep_in_ff_mutex_wr_1,
+#endif
+#endif
+#if USE_LINEAR_BUFFER_TX && CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX > 0
+    .lin_buf_in        = lin_buf_in_1[0],
+    .lin_buf_in_sz     = CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_FUNC_1_TX_SUPP_SW_FIFO_SZ > 0
+    .tx_supp_ff        = tx_supp_ff_1,
+    .tx_supp_ff_buf    = tx_supp_ff_buf_1[0],
+    .tx_supp_ff_sz     = CFG_TUD_AUDIO_FUNC_1_TX_SUPP_SW_FIFO_SZ,
+    .n_tx_supp_ff      = CFG_TUD_AUDIO_FUNC_1_N_TX_SUPP_SW_FIFO,
+#if CFG_FIFO_MUTEX
+    .tx_supp_ff_mutex_wr = tx_supp_ff_mutex_wr_1,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
+    .n_channels_per_ff_tx = CFG_TUD_AUDIO_FUNC_1_CHANNEL_PER_FIFO_TX,
+#endif
+#endif
+#endif // CFG_TUD_AUDIO_ENABLE_EP_IN
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT
+    .n_stream_out      = CFG_TUD_AUDIO_FUNC_1_N_EP_OUT,
+#if !CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ > 0
+    .ep_out_sw_buf     = audio_ep_out_sw_buf_1[0],
+    .ep_out_sw_buf_sz  = CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ,
+#if CFG_FIFO_MUTEX
+    .ep_out_ff_mutex_rd = ep_out_ff_mutex_rd_1,
+#endif
+#endif
+#if USE_LINEAR_BUFFER_RX && CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX > 0
+    .lin_buf_out       = lin_buf_out_1[0],
+    .lin_buf_out_sz    = CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_FUNC_1_RX_SUPP_SW_FIFO_SZ > 0
+    .rx_supp_ff        = rx_supp_ff_1,
+    .rx_supp_ff_buf    = rx_supp_ff_buf_1[0],
+    .rx_supp_ff_sz     = CFG_TUD_AUDIO_FUNC_1_RX_SUPP_SW_FIFO_SZ,
+    .n_rx_supp_ff      = CFG_TUD_AUDIO_FUNC_1_N_RX_SUPP_SW_FIFO,
+#if CFG_FIFO_MUTEX
+    .rx_supp_ff_mutex_rd = rx_supp_ff_mutex_rd_1,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
+    .n_channels_per_ff_rx = CFG_TUD_AUDIO_FUNC_1_CHANNEL_PER_FIFO_RX,
+#endif
+#endif
+#endif // CFG_TUD_AUDIO_ENABLE_EP_OUT
+  },
+#if CFG_TUD_AUDIO > 1
+  {
+    .desc_length       = CFG_TUD_AUDIO_FUNC_2_DESC_LEN,
+    .ctrl_buf          = ctrl_buf_2,
+    .ctrl_buf_sz       = CFG_TUD_AUDIO_FUNC_2_CTRL_BUF_SZ,
+#if CFG_TUD_AUDIO_FUNC_2_N_AS_INT > 0
+    .alt_setting       = alt_setting_2,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_EP_IN
+    .n_stream_in       = CFG_TUD_AUDIO_FUNC_2_N_EP_IN,
+#if !CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_FUNC_2_EP_IN_SW_BUF_SZ > 0
+    .ep_in_sw_buf      = audio_ep_in_sw_buf_2[0],
+    .ep_in_sw_buf_sz   = CFG_TUD_AUDIO_FUNC_2_EP_IN_SW_BUF_SZ,
+#if CFG_FIFO_MUTEX
+    .ep_in_ff_mutex_wr = ep_in_ff_mutex_wr_2,
+#endif
+#endif
+#if USE_LINEAR_BUFFER_TX && CFG_TUD_AUDIO_FUNC_2_EP_IN_SZ_MAX > 0
+    .lin_buf_in        = lin_buf_in_2[0],
+    .lin_buf_in_sz     = CFG_TUD_AUDIO_FUNC_2_EP_IN_SZ_MAX,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_FUNC_2_TX_SUPP_SW_FIFO_SZ > 0
+    .tx_supp_ff        = tx_supp_ff_2,
+    .tx_supp_ff_buf    = tx_supp_ff_buf_2[0],
+    .tx_supp_ff_sz     = CFG_TUD_AUDIO_FUNC_2_TX_SUPP_SW_FIFO_SZ,
+    .n_tx_supp_ff      = CFG_TUD_AUDIO_FUNC_2_N_TX_SUPP_SW_FIFO,
+#if CFG_FIFO_MUTEX
+    .tx_supp_ff_mutex_wr = tx_supp_ff_mutex_wr_2,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
+    .n_channels_per_ff_tx = CFG_TUD_AUDIO_FUNC_2_CHANNEL_PER_FIFO_TX,
+#endif
+#endif
+#endif // CFG_TUD_AUDIO_ENABLE_EP_IN
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT
+    .n_stream_out      = CFG_TUD_AUDIO_FUNC_2_N_EP_OUT,
+#if !CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_FUNC_2_EP_OUT_SW_BUF_SZ > 0
+    .ep_out_sw_buf     = audio_ep_out_sw_buf_2[0],
+    .ep_out_sw_buf_sz  = CFG_TUD_AUDIO_FUNC_2_EP_OUT_SW_BUF_SZ,
+#if CFG_FIFO_MUTEX
+    .ep_out_ff_mutex_rd = ep_out_ff_mutex_rd_2,
+#endif
+#endif
+#if USE_LINEAR_BUFFER_RX && CFG_TUD_AUDIO_FUNC_2_EP_OUT_SZ_MAX > 0
+    .lin_buf_out       = lin_buf_out_2[0],
+    .lin_buf_out_sz    = CFG_TUD_AUDIO_FUNC_2_EP_OUT_SZ_MAX,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_FUNC_2_RX_SUPP_SW_FIFO_SZ > 0
+    .rx_supp_ff        = rx_supp_ff_2,
+    .rx_supp_ff_buf    = rx_supp_ff_buf_2[0],
+    .rx_supp_ff_sz     = CFG_TUD_AUDIO_FUNC_2_RX_SUPP_SW_FIFO_SZ,
+    .n_rx_supp_ff      = CFG_TUD_AUDIO_FUNC_2_N_RX_SUPP_SW_FIFO,
+#if CFG_FIFO_MUTEX
+    .rx_supp_ff_mutex_rd = rx_supp_ff_mutex_rd_2,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
+    .n_channels_per_ff_rx = CFG_TUD_AUDIO_FUNC_2_CHANNEL_PER_FIFO_RX,
+#endif
+#endif
+#endif // CFG_TUD_AUDIO_ENABLE_EP_OUT
+  },
+#endif
+#if CFG_TUD_AUDIO > 2
+  {
+    .desc_length       = CFG_TUD_AUDIO_FUNC_3_DESC_LEN,
+    .ctrl_buf          = ctrl_buf_3,
+    .ctrl_buf_sz       = CFG_TUD_AUDIO_FUNC_3_CTRL_BUF_SZ,
+#if CFG_TUD_AUDIO_FUNC_3_N_AS_INT > 0
+    .alt_setting       = alt_setting_3,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_EP_IN
+    .n_stream_in       = CFG_TUD_AUDIO_FUNC_3_N_EP_IN,
+#if !CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_FUNC_3_EP_IN_SW_BUF_SZ > 0
+    .ep_in_sw_buf      = audio_ep_in_sw_buf_3[0],
+    .ep_in_sw_buf_sz   = CFG_TUD_AUDIO_FUNC_3_EP_IN_SW_BUF_SZ,
+#if CFG_FIFO_MUTEX
+    .ep_in_ff_mutex_wr = ep_in_ff_mutex_wr_3,
+#endif
+#endif
+#if USE_LINEAR_BUFFER_TX && CFG_TUD_AUDIO_FUNC_3_EP_IN_SZ_MAX > 0
+    .lin_buf_in        = lin_buf_in_3[0],
+    .lin_buf_in_sz     = CFG_TUD_AUDIO_FUNC_3_EP_IN_SZ_MAX,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_FUNC_3_TX_SUPP_SW_FIFO_SZ > 0
+    .tx_supp_ff        = tx_supp_ff_3,
+    .tx_supp_ff_buf    = tx_supp_ff_buf_3[0],
+    .tx_supp_ff_sz     = CFG_TUD_AUDIO_FUNC_3_TX_SUPP_SW_FIFO_SZ,
+    .n_tx_supp_ff      = CFG_TUD_AUDIO_FUNC_3_N_TX_SUPP_SW_FIFO,
+#if CFG_FIFO_MUTEX
+    .tx_supp_ff_mutex_wr = tx_supp_ff_mutex_wr_3,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
+    .n_channels_per_ff_tx = CFG_TUD_AUDIO_FUNC_3_CHANNEL_PER_FIFO_TX,
+#endif
+#endif
+#endif // CFG_TUD_AUDIO_ENABLE_EP_IN
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT
+    .n_stream_out      = CFG_TUD_AUDIO_FUNC_3_N_EP_OUT,
+#if !CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_FUNC_3_EP_OUT_SW_BUF_SZ > 0
+    .ep_out_sw_buf     = audio_ep_out_sw_buf_3[0],
+    .ep_out_sw_buf_sz  = CFG_TUD_AUDIO_FUNC_3_EP_OUT_SW_BUF_SZ,
+#if CFG_FIFO_MUTEX
+    .ep_out_ff_mutex_rd = ep_out_ff_mutex_rd_3,
+#endif
+#endif
+#if USE_LINEAR_BUFFER_RX && CFG_TUD_AUDIO_FUNC_3_EP_OUT_SZ_MAX > 0
+    .lin_buf_out       = lin_buf_out_3[0],
+    .lin_buf_out_sz    = CFG_TUD_AUDIO_FUNC_3_EP_OUT_SZ_MAX,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_FUNC_3_RX_SUPP_SW_FIFO_SZ > 0
+    .rx_supp_ff        = rx_supp_ff_3,
+    .rx_supp_ff_buf    = rx_supp_ff_buf_3[0],
+    .rx_supp_ff_sz     = CFG_TUD_AUDIO_FUNC_3_RX_SUPP_SW_FIFO_SZ,
+    .n_rx_supp_ff      = CFG_TUD_AUDIO_FUNC_3_N_RX_SUPP_SW_FIFO,
+#if CFG_FIFO_MUTEX
+    .rx_supp_ff_mutex_rd = rx_supp_ff_mutex_rd_3,
+#endif
+#if CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
+    .n_channels_per_ff_rx = CFG_TUD_AUDIO_FUNC_3_CHANNEL_PER_FIFO_RX,
+#endif
+#endif
+#endif // CFG_TUD_AUDIO_ENABLE_EP_OUT
+  },
+#endif
+};
+
 //--------------------------------------------------------------------+
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
 CFG_TUSB_MEM_SECTION audiod_function_t _audiod_fct[CFG_TUD_AUDIO];
 
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+typedef struct
+{
+  tu_fifo_t ff;
+  audio_trace_record_t records[CFG_TUD_AUDIO_TRACE_DEPTH];
+  audio_trace_record_t xfer_buf[CFG_TUD_AUDIO_TRACE_XFER_N];    // Records being sent by tud_audio_trace_control_xfer()
+
+  // Taken in SOF ISR
+  volatile uint16_t sof_frame;
+  volatile uint32_t sof_time;
+} audiod_trace_t;
+
+static audiod_trace_t _audiod_trace;
+
+static inline uint32_t audiod_trace_time(void)
+{
+  return tud_audio_trace_timestamp_cb ? tud_audio_trace_timestamp_cb() : 0;
+}
+
+// Stamp record with frame and time relative to last SOF at start of packet handling, return current time
+static inline uint32_t audiod_trace_begin(audio_trace_record_t* rec, audiod_function_t* audio, uint8_t ep);
+#endif
+
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
-static bool audiod_rx_done_cb(uint8_t rhport, audiod_function_t* audio, uint16_t n_bytes_received);
+static bool audiod_rx_done_cb(uint8_t rhport, audiod_function_t* audio, uint8_t stream, uint16_t n_bytes_received);
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING
+static bool audiod_rx_xfer(uint8_t rhport, audiod_function_t* audio, uint8_t stream);
+#endif
+
+#if (CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING) || (CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_ENCODING)
+static void audiod_ep_ff_discard(tu_fifo_t* ff, bool ext);
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_EP_OUT
@@ -421,7 +747,7 @@ static bool audiod_decode_type_I_pcm(uint8_t rhport, audiod_function_t* audio, u
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN
-static bool audiod_tx_done_cb(uint8_t rhport, audiod_function_t* audio);
+static bool audiod_tx_done_cb(uint8_t rhport, audiod_function_t* audio, uint8_t stream);
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_ENABLE_EP_IN
@@ -457,11 +783,11 @@ bool tud_audio_n_mounted(uint8_t func_id)
   audiod_function_t* audio = &_audiod_fct[func_id];
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
-  if (audio->ep_out == 0) return false;
+  if (audio->stream_out[0].ep == 0) return false;
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN
-  if (audio->ep_in == 0) return false;
+  if (audio->stream_in[0].ep == 0) return false;
 #endif
 
 #if CFG_TUD_AUDIO_INT_CTR_EPSIZE_IN
@@ -481,28 +807,70 @@ bool tud_audio_n_mounted(uint8_t func_id)
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING
 
+uint16_t tud_audio_n_stream_available(uint8_t func_id, uint8_t stream)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL && stream < _audiod_fct[func_id].n_stream_out);
+  return tu_fifo_count(&_audiod_fct[func_id].ep_out_ff[stream]);
+}
+
+uint16_t tud_audio_n_stream_read(uint8_t func_id, uint8_t stream, void* buffer, uint16_t bufsize)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL && stream < _audiod_fct[func_id].n_stream_out);
+  return tu_fifo_read_n(&_audiod_fct[func_id].ep_out_ff[stream], buffer, bufsize);
+}
+
+bool tud_audio_n_stream_clear_ep_out_ff(uint8_t func_id, uint8_t stream)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL && stream < _audiod_fct[func_id].n_stream_out);
+  audiod_ep_ff_discard(&_audiod_fct[func_id].ep_out_ff[stream], _audiod_fct[func_id].ep_out_ff_ext[stream]);
+  return true;
+}
+
+tu_fifo_t* tud_audio_n_stream_get_ep_out_ff(uint8_t func_id, uint8_t stream)
+{
+  if(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL && stream < _audiod_fct[func_id].n_stream_out) return &_audiod_fct[func_id].ep_out_ff[stream];
+  return NULL;
+}
+
+bool tud_audio_n_stream_set_ep_out_ff_buf(uint8_t func_id, uint8_t stream, void* buffer, uint16_t depth)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && stream < _audiod_fct_cfg[func_id].n_stream_out);
+  audiod_function_t* audio = &_audiod_fct[func_id];
+  audiod_fct_cfg_t const* cfg = &_audiod_fct_cfg[func_id];
+
+  // Buffer must not be exchanged while a transfer may be pending
+  TU_VERIFY(audio->stream_out[stream].ep == 0);
+
+  bool const ext = (buffer != NULL);
+  if (!ext)
+  {
+    buffer = cfg->ep_out_sw_buf + stream * cfg->ep_out_sw_buf_sz;
+    depth  = cfg->ep_out_sw_buf_sz;
+  }
+  TU_VERIFY(depth > 0 && tu_fifo_config(&audio->ep_out_ff[stream], buffer, depth, 1, true));
+  audio->ep_out_ff_ext[stream] = ext;
+
+  return true;
+}
+
 uint16_t tud_audio_n_available(uint8_t func_id)
 {
-  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL);
-  return tu_fifo_count(&_audiod_fct[func_id].ep_out_ff);
+  return tud_audio_n_stream_available(func_id, 0);
 }
 
 uint16_t tud_audio_n_read(uint8_t func_id, void* buffer, uint16_t bufsize)
 {
-  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL);
-  return tu_fifo_read_n(&_audiod_fct[func_id].ep_out_ff, buffer, bufsize);
+  return tud_audio_n_stream_read(func_id, 0, buffer, bufsize);
 }
 
 bool tud_audio_n_clear_ep_out_ff(uint8_t func_id)
 {
-  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL);
-  return tu_fifo_clear(&_audiod_fct[func_id].ep_out_ff);
+  return tud_audio_n_stream_clear_ep_out_ff(func_id, 0);
 }
 
 tu_fifo_t* tud_audio_n_get_ep_out_ff(uint8_t func_id)
 {
-  if(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL) return &_audiod_fct[func_id].ep_out_ff;
-  return NULL;
+  return tud_audio_n_stream_get_ep_out_ff(func_id, 0);
 }
 
 #endif
@@ -532,6 +900,21 @@ tu_fifo_t* tud_audio_n_get_rx_support_ff(uint8_t func_id, uint8_t ff_idx)
   if(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL && ff_idx < _audiod_fct[func_id].n_rx_supp_ff) return &_audiod_fct[func_id].rx_supp_ff[ff_idx];
   return NULL;
 }
+
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+// Support FIFO depth depends on the format, hence it can only be changed while no alternate setting with OUT EP is active.
+// Setting is kept over bus resets, so it can be called once after tud_init().
+bool tud_audio_n_set_rx_support_ff_format(uint8_t func_id, audio_pcm_format_t format, audio_pcm_dither_t dither)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && format <= AUDIO_PCM_FORMAT_F32 && dither <= AUDIO_PCM_DITHER_TPDF);
+  audiod_function_t* audio = &_audiod_fct[func_id];
+  TU_VERIFY(audio->stream_out[0].ep == 0);
+
+  audio->conv_rx.format = (uint8_t) format;
+  audio->conv_rx.dither = (uint8_t) dither;
+  return true;
+}
+#endif
 #endif
 
 // This function is called once an audio packet is received by the USB and is responsible for putting data from USB memory into EP_OUT_FIFO (or support FIFOs + decoding of received stream into audio channels).
@@ -539,24 +922,34 @@ tu_fifo_t* tud_audio_n_get_rx_support_ff(uint8_t func_id, uint8_t ff_idx)
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
 
-static bool audiod_rx_done_cb(uint8_t rhport, audiod_function_t* audio, uint16_t n_bytes_received)
+static bool audiod_rx_done_cb(uint8_t rhport, audiod_function_t* audio, uint8_t stream, uint16_t n_bytes_received)
 {
+  audiod_stream_t const * st = &audio->stream_out[stream];
   uint8_t idxItf = 0;
   uint8_t const *dummy2;
   uint8_t idx_audio_fct = 0;
 
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+  audio_trace_record_t rec;
+  audiod_trace_begin(&rec, audio, st->ep);
+#endif
+
   if (tud_audio_rx_done_pre_read_cb || tud_audio_rx_done_post_read_cb)
   {
     idx_audio_fct = audiod_get_audio_fct_idx(audio);
-    TU_VERIFY(audiod_get_AS_interface_index(audio->ep_out_as_intf_num, audio, &idxItf, &dummy2));
+    TU_VERIFY(audiod_get_AS_interface_index(st->as_intf_num, audio, &idxItf, &dummy2));
   }
 
   // Call a weak callback here - a possibility for user to get informed an audio packet was received and data gets now loaded into EP FIFO (or decoded into support RX software FIFO)
   if (tud_audio_rx_done_pre_read_cb)
   {
-    TU_VERIFY(tud_audio_rx_done_pre_read_cb(rhport, n_bytes_received, idx_audio_fct, audio->ep_out, audio->alt_setting[idxItf]));
+    TU_VERIFY(tud_audio_rx_done_pre_read_cb(rhport, n_bytes_received, idx_audio_fct, st->ep, audio->alt_setting[idxItf]));
   }
 
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+  uint32_t const t_proc = audiod_trace_time();
+#endif
+
 #if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_EP_OUT
 
   switch (audio->format_type_rx)
@@ -591,27 +984,48 @@ static bool audiod_rx_done_cb(uint8_t rhport, audiod_function_t* audio, uint16_t
   }
 
   // Prepare for next transmission
-  TU_VERIFY(usbd_edpt_xfer(rhport, audio->ep_out, audio->lin_buf_out, audio->ep_out_sz), false);
+  TU_VERIFY(usbd_edpt_xfer(rhport, st->ep, audio->lin_buf_out[stream], st->ep_sz), false);
 
 #else
 
 #if USE_LINEAR_BUFFER_RX
-  // Data currently is in linear buffer, copy into EP OUT FIFO
-  TU_VERIFY(tu_fifo_write_n(&audio->ep_out_ff, audio->lin_buf_out, n_bytes_received));
+  if (st->xfer_in_ff)
+  {
+    // Data was received straight into application ring, just commit it
+    tu_fifo_advance_write_pointer(&audio->ep_out_ff[stream], n_bytes_received);
+  }
+  else
+  {
+    // Data currently is in linear buffer, copy into EP OUT FIFO
+    TU_VERIFY(tu_fifo_write_n(&audio->ep_out_ff[stream], audio->lin_buf_out[stream], n_bytes_received));
+  }
+#endif
+
+  // Schedule for next receive - without linear buffer data is already placed in EP FIFO
+  TU_VERIFY(audiod_rx_xfer(rhport, audio, stream), false);
 
-  // Schedule for next receive
-  TU_VERIFY(usbd_edpt_xfer(rhport, audio->ep_out, audio->lin_buf_out, audio->ep_out_sz), false);
-#else
-  // Data is already placed in EP FIFO, schedule for next receive
-  TU_VERIFY(usbd_edpt_xfer_fifo(rhport, audio->ep_out, &audio->ep_out_ff, audio->ep_out_sz), false);
 #endif
 
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+  rec.proc_time = audiod_trace_time() - t_proc;
+  rec.n_bytes   = n_bytes_received;
+#if CFG_TUD_AUDIO_ENABLE_DECODING
+  rec.ff_count  = tu_fifo_count(&audio->rx_supp_ff[0]);
+#else
+  rec.ff_count  = tu_fifo_count(&audio->ep_out_ff[stream]);
+#endif
+#if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
+  rec.fb_value  = (stream == 0) ? audio->feedback.value : 0;
+#else
+  rec.fb_value  = 0;
+#endif
+  tu_fifo_write(&_audiod_trace.ff, &rec);
 #endif
 
   // Call a weak callback here - a possibility for user to get informed decoding was completed
   if (tud_audio_rx_done_post_read_cb)
   {
-    TU_VERIFY(tud_audio_rx_done_post_read_cb(rhport, n_bytes_received, idx_audio_fct, audio->ep_out, audio->alt_setting[idxItf]));
+    TU_VERIFY(tud_audio_rx_done_post_read_cb(rhport, n_bytes_received, idx_audio_fct, st->ep, audio->alt_setting[idxItf]));
   }
 
   return true;
@@ -619,93 +1033,210 @@ static bool audiod_rx_done_cb(uint8_t rhport, audiod_function_t* audio, uint16_t
 
 #endif //CFG_TUD_AUDIO_ENABLE_EP_OUT
 
-// The following functions are used in case CFG_TUD_AUDIO_ENABLE_DECODING != 0
-#if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_EP_OUT
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING
 
-// Decoding according to 2.3.1.5 Audio Streams
+// Schedule receive of next packet, it is placed straight into an application ring if it fits without wrap around
+static bool audiod_rx_xfer(uint8_t rhport, audiod_function_t* audio, uint8_t stream)
+{
+  audiod_stream_t* st = &audio->stream_out[stream];
+  st->n_bytes_xfer = st->ep_sz;
+
+#if USE_LINEAR_BUFFER_RX
+  tu_fifo_buffer_info_t info;
+  tu_fifo_get_write_info(&audio->ep_out_ff[stream], &info);
+
+  st->xfer_in_ff = audio->ep_out_ff_ext[stream] && info.len_lin >= st->ep_sz;
+  return usbd_edpt_xfer(rhport, st->ep, st->xfer_in_ff ? (uint8_t*) info.ptr_lin : audio->lin_buf_out[stream], st->ep_sz);
+#else
+  return usbd_edpt_xfer_fifo(rhport, st->ep, &audio->ep_out_ff[stream], st->ep_sz);
+#endif
+}
+
+#endif
+
+#if (CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING) || (CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_ENCODING)
 
-// Helper function
-static inline uint8_t * audiod_interleaved_copy_bytes_fast_decode(uint16_t const nBytesToCopy, void * dst, uint8_t * dst_end, uint8_t * src, uint8_t const n_ff_used)
+// Drop content of an EP FIFO. An application ring keeps its position since its DMA continues at the current write position.
+static void audiod_ep_ff_discard(tu_fifo_t* ff, bool ext)
 {
+  if (ext)
+  {
+    tu_fifo_buffer_info_t info;
+    tu_fifo_get_read_info(ff, &info);   // Also corrects read pointer in case DMA overflowed ring
+    tu_fifo_advance_read_pointer(ff, (uint16_t) (info.len_lin + info.len_wrap));
+  }
+  else
+  {
+    tu_fifo_clear(ff);
+  }
+}
 
-  // This function is an optimized version of
-  //  while((uint8_t *)dst < dst_end)
-  //  {
-  //    memcpy(dst, src, nBytesToCopy);
-  //    dst = (uint8_t *)dst + nBytesToCopy;
-  //    src += nBytesToCopy * n_ff_used;
-  //  }
+#endif
 
-  // Optimize for fast half word copies
-  typedef struct{
-    uint16_t val;
-  } __attribute((__packed__)) unaligned_uint16_t;
+#if USE_ASRC_RX || USE_ASRC_TX
 
-  // Optimize for fast word copies
-  typedef struct{
-    uint32_t val;
-  } __attribute((__packed__)) unaligned_uint32_t;
+// (Re)start converters of one direction, ratio is then regulated to keep first FIFO half full
+static bool audiod_asrc_start(audiod_asrc_dir_t* a, uint32_t in_rate, uint32_t out_rate, tu_fifo_t* ff, uint8_t format,
+                              uint8_t n_ff, uint8_t n_channels, uint8_t frame_size)
+{
+  TU_VERIFY(format == AUDIO_PCM_FORMAT_S32 || format == AUDIO_PCM_FORMAT_F32);
+  TU_VERIFY(n_ff <= CFG_TUD_AUDIO_ASRC_MAX_FF && n_channels <= CFG_TUD_AUDIO_ASRC_MAX_CHANNELS);
 
-  switch (nBytesToCopy)
+  audiod_asrc_tracker_init(&a->tracker, in_rate, out_rate, (uint16_t) (tu_fifo_depth(ff) / frame_size / 2));
+  for (uint8_t i = 0; i < n_ff; i++)
   {
-    case 1:
-      while((uint8_t *)dst < dst_end)
-      {
-        *(uint8_t *)dst++ = *src;
-        src += n_ff_used;
-      }
-      break;
+    audiod_asrc_init(&a->ff[i], n_channels, a->tracker.step);
+  }
 
-    case 2:
-      while((uint8_t *)dst < dst_end)
-      {
-        *(unaligned_uint16_t*)dst = *(unaligned_uint16_t*)src;
-        dst += 2;
-        src += 2 * n_ff_used;
-      }
-      break;
+  a->in_rate  = in_rate;
+  a->out_rate = out_rate;
+  return true;
+}
 
-    case 3:
-      while((uint8_t *)dst < dst_end)
-      {
-        //        memcpy(dst, src, 3);
-        //        dst = (uint8_t *)dst + 3;
-        //        src += 3 * n_ff_used;
+// Converters pick up a new ratio only at the same output position to keep channels of all FIFOs in phase, which is
+// the case as long as application converts the same number of frames for each FIFO.
+static void audiod_asrc_latch_step(audiod_asrc_dir_t* a, uint8_t n_ff)
+{
+  for (uint8_t i = 1; i < n_ff; i++)
+  {
+    if (a->ff[i].count != a->ff[0].count) return;
+  }
 
-        // TODO: Is there a faster way to copy 3 bytes?
-        *(uint8_t *)dst++ = *src++;
-        *(uint8_t *)dst++ = *src++;
-        *(uint8_t *)dst++ = *src++;
+  for (uint8_t i = 0; i < n_ff; i++)
+  {
+    a->ff[i].step = a->tracker.step;
+  }
+}
 
-        src += 3 * (n_ff_used - 1);
-      }
-      break;
+static inline uint16_t audiod_asrc_process(audiod_asrc_t* asrc, uint8_t format, void* dst, uint16_t n_out, void const* src, uint16_t* n_in)
+{
+  if (format == AUDIO_PCM_FORMAT_F32) return audiod_asrc_process_f32(asrc, dst, n_out, src, n_in);
+  return audiod_asrc_process_s32(asrc, dst, n_out, src, n_in);
+}
 
-    case 4:
-      while((uint8_t *)dst < dst_end)
-      {
-        *(unaligned_uint32_t*)dst = *(unaligned_uint32_t*)src;
-        dst += 4;
-        src += 4 * n_ff_used;
-      }
-      break;
+// Convert from FIFO into dst directly from FIFO memory, return number of frames written
+static uint16_t audiod_asrc_read_ff(audiod_asrc_t* asrc, uint8_t format, tu_fifo_t* ff, uint8_t frame_size, uint8_t* dst, uint16_t n_frames)
+{
+  tu_fifo_buffer_info_t info;
+  tu_fifo_get_read_info(ff, &info);
+
+  // Linear part first, wrapped part only if output is not complete yet
+  uint16_t n_in = (uint16_t) (info.len_lin / frame_size);
+  uint16_t n_out = audiod_asrc_process(asrc, format, dst, n_frames, info.ptr_lin, &n_in);
+  uint16_t n_bytes = (uint16_t) (n_in * frame_size);
+
+  if (n_out < n_frames && info.len_wrap)
+  {
+    n_in = (uint16_t) (info.len_wrap / frame_size);
+    n_out = (uint16_t) (n_out + audiod_asrc_process(asrc, format, dst + n_out * frame_size, (uint16_t) (n_frames - n_out), info.ptr_wrap, &n_in));
+    n_bytes = (uint16_t) (n_bytes + n_in * frame_size);
+  }
+
+  tu_fifo_advance_read_pointer(ff, n_bytes);
+  return n_out;
+}
+
+// Convert from src directly into FIFO memory, return number of frames taken from src
+static uint16_t audiod_asrc_write_ff(audiod_asrc_t* asrc, uint8_t format, tu_fifo_t* ff, uint8_t frame_size, uint8_t const* src, uint16_t n_frames)
+{
+  tu_fifo_buffer_info_t info;
+  tu_fifo_get_write_info(ff, &info);
+
+  // Linear part first, wrapped part only if input is left
+  uint16_t n_in = n_frames;
+  uint16_t n_out = audiod_asrc_process(asrc, format, info.ptr_lin, (uint16_t) (info.len_lin / frame_size), src, &n_in);
+  uint16_t n_used = n_in;
+
+  if (n_used < n_frames && info.len_wrap)
+  {
+    n_in = (uint16_t) (n_frames - n_used);
+    n_out = (uint16_t) (n_out + audiod_asrc_process(asrc, format, info.ptr_wrap, (uint16_t) (info.len_wrap / frame_size), src + n_used * frame_size, &n_in));
+    n_used = (uint16_t) (n_used + n_in);
   }
 
-  return src;
+  tu_fifo_advance_write_pointer(ff, (uint16_t) (n_out * frame_size));
+  return n_used;
 }
 
+#endif
+
+// The following functions are used in case CFG_TUD_AUDIO_ENABLE_DECODING != 0
+#if CFG_TUD_AUDIO_ENABLE_DECODING && CFG_TUD_AUDIO_ENABLE_EP_OUT
+
+// Decoding according to 2.3.1.5 Audio Streams
+
+// Bytes of one sample (all channels of a FIFO) as kept in support RX FIFOs
+static inline uint8_t audiod_rx_supp_ff_sample_size(audiod_function_t const * audio)
+{
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+  return (uint8_t) (audio->n_channels_per_ff_rx * audiod_pcm_format_size(audio->conv_rx.format, audio->n_bytes_per_sampe_rx));
+#else
+  return (uint8_t) (audio->n_channels_per_ff_rx * audio->n_bytes_per_sampe_rx);
+#endif
+}
+
+static inline uint8_t const * audiod_rx_deinterleave(audiod_function_t * audio, void * dst, uint8_t const * src, uint16_t n_samples, uint8_t n_bytes)
+{
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+  (void) n_bytes;
+  return audiod_pcm_deinterleave_convert(dst, src, n_samples, audio->n_ff_used_rx, &audio->conv_rx);
+#else
+  return audiod_pcm_deinterleave(dst, src, n_samples, n_bytes, audio->n_ff_used_rx);
+#endif
+}
+
+#if USE_ASRC_RX
+// Converter ratio is host_rate / device_rate, trimmed such that the first support FIFO stays half full which follows any
+// drift between USB and application clock. Support FIFOs must be set to AUDIO_PCM_FORMAT_S32 or AUDIO_PCM_FORMAT_F32.
+// Rates are kept over bus resets, converters restart whenever host opens the OUT EP.
+bool tud_audio_n_set_rx_asrc(uint8_t func_id, uint32_t host_rate, uint32_t device_rate)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO);
+  TU_VERIFY(host_rate == 0 || (device_rate != 0 && host_rate < 3ULL * device_rate));
+  audiod_function_t* audio = &_audiod_fct[func_id];
+
+  // Stop ratio tracking until converters are restarted
+  audio->asrc_rx.in_rate = 0;
+  if (host_rate == 0) return true;
+
+  if (audio->stream_out[0].ep == 0)
+  {
+    audio->asrc_rx.in_rate  = host_rate;
+    audio->asrc_rx.out_rate = device_rate;
+    return true;
+  }
+
+  TU_VERIFY(audiod_asrc_start(&audio->asrc_rx, host_rate, device_rate, &audio->rx_supp_ff[0], audio->conv_rx.format,
+                              audio->n_ff_used_rx, audio->n_channels_per_ff_rx, audiod_rx_supp_ff_sample_size(audio)));
+  usbd_sof_enable(audio->rhport, SOF_CONSUMER_AUDIO, true);
+  return true;
+}
+
+uint16_t tud_audio_n_read_support_ff_asrc(uint8_t func_id, uint8_t ff_idx, void* buffer, uint16_t n_frames)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL);
+  audiod_function_t* audio = &_audiod_fct[func_id];
+  TU_VERIFY(audio->stream_out[0].ep != 0 && audio->asrc_rx.in_rate != 0 && ff_idx < audio->n_ff_used_rx);
+
+  audiod_asrc_latch_step(&audio->asrc_rx, audio->n_ff_used_rx);
+  return audiod_asrc_read_ff(&audio->asrc_rx.ff[ff_idx], audio->conv_rx.format, &audio->rx_supp_ff[ff_idx],
+                             audiod_rx_supp_ff_sample_size(audio), (uint8_t*) buffer, n_frames);
+}
+#endif
+
 static bool audiod_decode_type_I_pcm(uint8_t rhport, audiod_function_t* audio, uint16_t n_bytes_received)
 {
   (void) rhport;
 
   // Determine amount of samples
   uint8_t const n_ff_used               = audio->n_ff_used_rx;
-  uint16_t const nBytesPerFFToRead      = n_bytes_received / n_ff_used;
+  uint8_t const n_bytes                 = (uint8_t) (audio->n_channels_per_ff_rx * audio->n_bytes_per_sampe_rx); // Channels of one FIFO are adjacent in stream
+  uint8_t const n_bytes_ff              = audiod_rx_supp_ff_sample_size(audio);                                // Differs from n_bytes if samples are converted
+  uint16_t const nBytesPerFFToWrite     = (uint16_t) ((n_bytes_received / n_ff_used / n_bytes) * n_bytes_ff);
   uint8_t cnt_ff;
 
   // Decode
-  uint8_t * src;
-  uint8_t * dst_end;
+  uint8_t const * src;
 
   tu_fifo_buffer_info_t info;
 
@@ -715,17 +1246,15 @@ static bool audiod_decode_type_I_pcm(uint8_t rhport, audiod_function_t* audio, u
 
     if (info.len_lin != 0)
     {
-      info.len_lin = tu_min16(nBytesPerFFToRead, info.len_lin);
-      src = &audio->lin_buf_out[cnt_ff*audio->n_channels_per_ff_rx * audio->n_bytes_per_sampe_rx];
-      dst_end = info.ptr_lin + info.len_lin;
-      src = audiod_interleaved_copy_bytes_fast_decode(audio->n_bytes_per_sampe_rx, info.ptr_lin, dst_end, src, n_ff_used);
+      info.len_lin = tu_min16(nBytesPerFFToWrite, info.len_lin);
+      src = &audio->lin_buf_out[0][cnt_ff * n_bytes];
+      src = audiod_rx_deinterleave(audio, info.ptr_lin, src, info.len_lin / n_bytes_ff, n_bytes);
 
       // Handle wrapped part of FIFO
-      info.len_wrap = tu_min16(nBytesPerFFToRead - info.len_lin, info.len_wrap);
+      info.len_wrap = tu_min16(nBytesPerFFToWrite - info.len_lin, info.len_wrap);
       if (info.len_wrap != 0)
       {
-        dst_end = info.ptr_wrap + info.len_wrap;
-        audiod_interleaved_copy_bytes_fast_decode(audio->n_bytes_per_sampe_rx, info.ptr_wrap, dst_end, src, n_ff_used);
+        audiod_rx_deinterleave(audio, info.ptr_wrap, src, info.len_wrap / n_bytes_ff, n_bytes);
       }
       tu_fifo_advance_write_pointer(&audio->rx_supp_ff[cnt_ff], info.len_lin + info.len_wrap);
     }
@@ -751,26 +1280,67 @@ static bool audiod_decode_type_I_pcm(uint8_t rhport, audiod_function_t* audio, u
  *  If TX FIFOs are used, this function is not available in order to not let the user mess up the encoding process.
  *
  * \param[in]       func_id: Index of audio function interface
+ * \param[in]       stream: Index of IN stream of audio function
  * \param[in]       data: Pointer to data array to be copied from
  * \param[in]       len: # of array elements to copy
  * \return          Number of bytes actually written
  */
+uint16_t tud_audio_n_stream_write(uint8_t func_id, uint8_t stream, const void * data, uint16_t len)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL && stream < _audiod_fct[func_id].n_stream_in);
+  return tu_fifo_write_n(&_audiod_fct[func_id].ep_in_ff[stream], data, len);
+}
+
+bool tud_audio_n_stream_clear_ep_in_ff(uint8_t func_id, uint8_t stream)   // Delete all content in the EP IN FIFO
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL && stream < _audiod_fct[func_id].n_stream_in);
+  audiod_function_t* audio = &_audiod_fct[func_id];
+  audiod_ep_ff_discard(&audio->ep_in_ff[stream], audio->ep_in_ff_ext[stream]);
+  // Packet in flight out of the application ring is discarded along, its bytes must not be released again on completion
+  audio->stream_in[stream].xfer_in_ff = false;
+  return true;
+}
+
+tu_fifo_t* tud_audio_n_stream_get_ep_in_ff(uint8_t func_id, uint8_t stream)
+{
+  if(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL && stream < _audiod_fct[func_id].n_stream_in) return &_audiod_fct[func_id].ep_in_ff[stream];
+  return NULL;
+}
+
+bool tud_audio_n_stream_set_ep_in_ff_buf(uint8_t func_id, uint8_t stream, void* buffer, uint16_t depth)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && stream < _audiod_fct_cfg[func_id].n_stream_in);
+  audiod_function_t* audio = &_audiod_fct[func_id];
+  audiod_fct_cfg_t const* cfg = &_audiod_fct_cfg[func_id];
+
+  // Buffer must not be exchanged while a transfer may be pending
+  TU_VERIFY(audio->stream_in[stream].ep == 0);
+
+  bool const ext = (buffer != NULL);
+  if (!ext)
+  {
+    buffer = cfg->ep_in_sw_buf + stream * cfg->ep_in_sw_buf_sz;
+    depth  = cfg->ep_in_sw_buf_sz;
+  }
+  TU_VERIFY(depth > 0 && tu_fifo_config(&audio->ep_in_ff[stream], buffer, depth, 1, true));
+  audio->ep_in_ff_ext[stream] = ext;
+
+  return true;
+}
+
 uint16_t tud_audio_n_write(uint8_t func_id, const void * data, uint16_t len)
 {
-  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL);
-  return tu_fifo_write_n(&_audiod_fct[func_id].ep_in_ff, data, len);
+  return tud_audio_n_stream_write(func_id, 0, data, len);
 }
 
-bool tud_audio_n_clear_ep_in_ff(uint8_t func_id)                          // Delete all content in the EP IN FIFO
+bool tud_audio_n_clear_ep_in_ff(uint8_t func_id)
 {
-  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL);
-  return tu_fifo_clear(&_audiod_fct[func_id].ep_in_ff);
+  return tud_audio_n_stream_clear_ep_in_ff(func_id, 0);
 }
 
 tu_fifo_t* tud_audio_n_get_ep_in_ff(uint8_t func_id)
 {
-  if(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL) return &_audiod_fct[func_id].ep_in_ff;
-  return NULL;
+  return tud_audio_n_stream_get_ep_in_ff(func_id, 0);
 }
 
 #endif
@@ -784,7 +1354,7 @@ uint16_t tud_audio_n_flush_tx_support_ff(uint8_t func_id)                 // For
 
   uint16_t n_bytes_copied = tu_fifo_count(&audio->tx_supp_ff[0]);
 
-  TU_VERIFY(audiod_tx_done_cb(audio->rhport, audio));
+  TU_VERIFY(audiod_tx_done_cb(audio->rhport, audio, 0));
 
   n_bytes_copied -= tu_fifo_count(&audio->tx_supp_ff[0]);
   n_bytes_copied = n_bytes_copied*audio->tx_supp_ff[0].item_size;
@@ -810,6 +1380,20 @@ tu_fifo_t* tud_audio_n_get_tx_support_ff(uint8_t func_id, uint8_t ff_idx)
   return NULL;
 }
 
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+// Support FIFO depth depends on the format, hence it can only be changed while no alternate setting with IN EP is active
+bool tud_audio_n_set_tx_support_ff_format(uint8_t func_id, audio_pcm_format_t format, audio_pcm_dither_t dither)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && format <= AUDIO_PCM_FORMAT_F32 && dither <= AUDIO_PCM_DITHER_TPDF);
+  audiod_function_t* audio = &_audiod_fct[func_id];
+  TU_VERIFY(audio->stream_in[0].ep == 0);
+
+  audio->conv_tx.format = (uint8_t) format;
+  audio->conv_tx.dither = (uint8_t) dither;
+  return true;
+}
+#endif
+
 #endif
 
 
@@ -842,20 +1426,30 @@ uint16_t tud_audio_int_ctr_n_write(uint8_t func_id, uint8_t const* buffer, uint1
 
 // n_bytes_copied - Informs caller how many bytes were loaded. In case n_bytes_copied = 0, a ZLP is scheduled to inform host no data is available for current frame.
 #if CFG_TUD_AUDIO_ENABLE_EP_IN
-static bool audiod_tx_done_cb(uint8_t rhport, audiod_function_t * audio)
+static bool audiod_tx_done_cb(uint8_t rhport, audiod_function_t * audio, uint8_t stream)
 {
+  audiod_stream_t const * st = &audio->stream_in[stream];
   uint8_t idxItf;
   uint8_t const *dummy2;
 
   uint8_t idx_audio_fct = audiod_get_audio_fct_idx(audio);
-  TU_VERIFY(audiod_get_AS_interface_index(audio->ep_in_as_intf_num, audio, &idxItf, &dummy2));
+  TU_VERIFY(audiod_get_AS_interface_index(st->as_intf_num, audio, &idxItf, &dummy2));
 
   // Only send something if current alternate interface is not 0 as in this case nothing is to be sent due to UAC2 specifications
   if (audio->alt_setting[idxItf] == 0) return false;
 
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+  audio_trace_record_t rec;
+  audiod_trace_begin(&rec, audio, st->ep);
+#endif
+
   // Call a weak callback here - a possibility for user to get informed former TX was completed and data gets now loaded into EP in buffer (in case FIFOs are used) or
   // if no FIFOs are used the user may use this call back to load its data into the EP IN buffer by use of tud_audio_n_write_ep_in_buffer().
-  if (tud_audio_tx_done_pre_load_cb) TU_VERIFY(tud_audio_tx_done_pre_load_cb(rhport, idx_audio_fct, audio->ep_in, audio->alt_setting[idxItf]));
+  if (tud_audio_tx_done_pre_load_cb) TU_VERIFY(tud_audio_tx_done_pre_load_cb(rhport, idx_audio_fct, st->ep, audio->alt_setting[idxItf]));
+
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+  uint32_t const t_proc = audiod_trace_time();
+#endif
 
   // Send everything in ISO EP FIFO
   uint16_t n_bytes_tx;
@@ -897,25 +1491,51 @@ static bool audiod_tx_done_cb(uint8_t rhport, audiod_function_t * audio)
           break;
   }
 
-  TU_VERIFY(usbd_edpt_xfer(rhport, audio->ep_in, audio->lin_buf_in, n_bytes_tx));
+  TU_VERIFY(usbd_edpt_xfer(rhport, st->ep, audio->lin_buf_in[stream], n_bytes_tx));
 
 #else
   // No support FIFOs, if no linear buffer required schedule transmit, else put data into linear buffer and schedule
+  tu_fifo_t* ff = &audio->ep_in_ff[stream];
+  audiod_stream_t* st_tx = &audio->stream_in[stream];
 
-  n_bytes_tx = tu_min16(tu_fifo_count(&audio->ep_in_ff), audio->ep_in_sz);      // Limit up to max packet size, more can not be done for ISO
+  // Packet sent straight out of application ring is released only now that its transfer completed
+  if (st_tx->xfer_in_ff) tu_fifo_advance_read_pointer(ff, st_tx->n_bytes_xfer);
+  if (audio->ep_in_ff_ext[stream] && st_tx->n_bytes_xfer && tud_audio_ep_in_ff_consumed_cb)
+  {
+    tud_audio_ep_in_ff_consumed_cb(idx_audio_fct, stream, st_tx->n_bytes_xfer);
+  }
+
+  n_bytes_tx = tu_min16(tu_fifo_count(ff), st->ep_sz);      // Limit up to max packet size, more can not be done for ISO
 
 #if USE_LINEAR_BUFFER_TX
-  tu_fifo_read_n(&audio->ep_in_ff, audio->lin_buf_in, n_bytes_tx);
-  TU_VERIFY(usbd_edpt_xfer(rhport, audio->ep_in, audio->lin_buf_in, n_bytes_tx));
+  tu_fifo_buffer_info_t info;
+  tu_fifo_get_read_info(ff, &info);
+
+  st_tx->xfer_in_ff = audio->ep_in_ff_ext[stream] && n_bytes_tx && info.len_lin >= n_bytes_tx;
+  if (!st_tx->xfer_in_ff) tu_fifo_read_n(ff, audio->lin_buf_in[stream], n_bytes_tx);
+  TU_VERIFY(usbd_edpt_xfer(rhport, st->ep, st_tx->xfer_in_ff ? (uint8_t*) info.ptr_lin : audio->lin_buf_in[stream], n_bytes_tx));
 #else
   // Send everything in ISO EP FIFO
-  TU_VERIFY(usbd_edpt_xfer_fifo(rhport, audio->ep_in, &audio->ep_in_ff, n_bytes_tx));
+  TU_VERIFY(usbd_edpt_xfer_fifo(rhport, st->ep, ff, n_bytes_tx));
 #endif
+  st_tx->n_bytes_xfer = n_bytes_tx;
 
 #endif
 
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+  rec.proc_time = audiod_trace_time() - t_proc;
+  rec.n_bytes   = n_bytes_tx;
+#if CFG_TUD_AUDIO_ENABLE_ENCODING
+  rec.ff_count  = tu_fifo_count(&audio->tx_supp_ff[0]);
+#else
+  rec.ff_count  = tu_fifo_count(&audio->ep_in_ff[stream]);
+#endif
+  rec.fb_value  = 0;
+  tu_fifo_write(&_audiod_trace.ff, &rec);
+#endif
+
   // Call a weak callback here - a possibility for user to get informed former TX was completed and how many bytes were loaded for the next frame
-  if (tud_audio_tx_done_post_load_cb) TU_VERIFY(tud_audio_tx_done_post_load_cb(rhport, n_bytes_tx, idx_audio_fct, audio->ep_in, audio->alt_setting[idxItf]));
+  if (tud_audio_tx_done_post_load_cb) TU_VERIFY(tud_audio_tx_done_post_load_cb(rhport, n_bytes_tx, idx_audio_fct, st->ep, audio->alt_setting[idxItf]));
 
   return true;
 }
@@ -940,66 +1560,64 @@ range [-1, +1)
  * does not change the number of bytes per sample.
  * */
 
-// Helper function
-static inline uint8_t * audiod_interleaved_copy_bytes_fast_encode(uint16_t const nBytesToCopy, uint8_t * src, uint8_t * src_end, uint8_t * dst, uint8_t const n_ff_used)
+// Bytes of one sample (all channels of a FIFO) as kept in support TX FIFOs
+static inline uint8_t audiod_tx_supp_ff_sample_size(audiod_function_t const * audio)
 {
-  // Optimize for fast half word copies
-  typedef struct{
-    uint16_t val;
-  } __attribute((__packed__)) unaligned_uint16_t;
-
-  // Optimize for fast word copies
-  typedef struct{
-    uint32_t val;
-  } __attribute((__packed__)) unaligned_uint32_t;
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+  return (uint8_t) (audio->n_channels_per_ff_tx * audiod_pcm_format_size(audio->conv_tx.format, audio->n_bytes_per_sampe_tx));
+#else
+  return (uint8_t) (audio->n_channels_per_ff_tx * audio->n_bytes_per_sampe_tx);
+#endif
+}
 
-  switch (nBytesToCopy)
-  {
-    case 1:
-      while(src < src_end)
-      {
-        *dst = *src++;
-        dst += n_ff_used;
-      }
-      break;
+static inline uint8_t * audiod_tx_interleave(audiod_function_t * audio, uint8_t * dst, void const * src, uint16_t n_samples, uint8_t n_bytes)
+{
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+  (void) n_bytes;
+  return audiod_pcm_interleave_convert(dst, src, n_samples, audio->n_ff_used_tx, &audio->conv_tx);
+#else
+  return audiod_pcm_interleave(dst, src, n_samples, n_bytes, audio->n_ff_used_tx);
+#endif
+}
 
-    case 2:
-      while(src < src_end)
-      {
-        *(unaligned_uint16_t*)dst = *(unaligned_uint16_t*)src;
-        src += 2;
-        dst += 2 * n_ff_used;
-      }
-      break;
+#if USE_ASRC_TX
+// Converter ratio is device_rate / host_rate, trimmed such that the first support FIFO stays half full which follows any
+// drift between application and USB clock. Support FIFOs must be set to AUDIO_PCM_FORMAT_S32 or AUDIO_PCM_FORMAT_F32.
+// Rates are kept over bus resets, converters restart whenever host opens the IN EP.
+bool tud_audio_n_set_tx_asrc(uint8_t func_id, uint32_t device_rate, uint32_t host_rate)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO);
+  TU_VERIFY(device_rate == 0 || (host_rate != 0 && device_rate < 3ULL * host_rate));
+  audiod_function_t* audio = &_audiod_fct[func_id];
 
-    case 3:
-      while(src < src_end)
-      {
-        //        memcpy(dst, src, 3);
-        //        src = (uint8_t *)src + 3;
-        //        dst += 3 * n_ff_used;
+  // Stop ratio tracking until converters are restarted
+  audio->asrc_tx.in_rate = 0;
+  if (device_rate == 0) return true;
 
-        // TODO: Is there a faster way to copy 3 bytes?
-        *dst++ = *src++;
-        *dst++ = *src++;
-        *dst++ = *src++;
+  if (audio->stream_in[0].ep == 0)
+  {
+    audio->asrc_tx.in_rate  = device_rate;
+    audio->asrc_tx.out_rate = host_rate;
+    return true;
+  }
 
-        dst += 3 * (n_ff_used - 1);
-      }
-      break;
+  TU_VERIFY(audiod_asrc_start(&audio->asrc_tx, device_rate, host_rate, &audio->tx_supp_ff[0], audio->conv_tx.format,
+                              audio->n_ff_used_tx, audio->n_channels_per_ff_tx, audiod_tx_supp_ff_sample_size(audio)));
+  usbd_sof_enable(audio->rhport, SOF_CONSUMER_AUDIO, true);
+  return true;
+}
 
-    case 4:
-      while(src < src_end)
-      {
-        *(unaligned_uint32_t*)dst = *(unaligned_uint32_t*)src;
-        src += 4;
-        dst += 4 * n_ff_used;
-      }
-      break;
-  }
+uint16_t tud_audio_n_write_support_ff_asrc(uint8_t func_id, uint8_t ff_idx, const void * data, uint16_t n_frames)
+{
+  TU_VERIFY(func_id < CFG_TUD_AUDIO && _audiod_fct[func_id].p_desc != NULL);
+  audiod_function_t* audio = &_audiod_fct[func_id];
+  TU_VERIFY(audio->stream_in[0].ep != 0 && audio->asrc_tx.in_rate != 0 && ff_idx < audio->n_ff_used_tx);
 
-  return dst;
+  audiod_asrc_latch_step(&audio->asrc_tx, audio->n_ff_used_tx);
+  return audiod_asrc_write_ff(&audio->asrc_tx.ff[ff_idx], audio->conv_tx.format, &audio->tx_supp_ff[ff_idx],
+                              audiod_tx_supp_ff_sample_size(audio), (uint8_t const*) data, n_frames);
 }
+#endif
 
 static uint16_t audiod_encode_type_I_pcm(uint8_t rhport, audiod_function_t* audio)
 {
@@ -1007,391 +1625,178 @@ static uint16_t audiod_encode_type_I_pcm(uint8_t rhport, audiod_function_t* audi
   // This is ensured within set_interface, where the FIFOs are reconfigured according to this size
 
   // We encode directly into IN EP's linear buffer - abort if previous transfer not complete
-  TU_VERIFY(!usbd_edpt_busy(rhport, audio->ep_in));
+  TU_VERIFY(!usbd_edpt_busy(rhport, audio->stream_in[0].ep));
 
   // Determine amount of samples
   uint8_t const n_ff_used               = audio->n_ff_used_tx;
-  uint16_t const nBytesToCopy           = audio->n_channels_per_ff_tx * audio->n_bytes_per_sampe_tx;
-  uint16_t const capPerFF               = audio->ep_in_sz / n_ff_used;                                        // Sample capacity per FIFO in bytes
-  uint16_t nBytesPerFFToSend            = tu_fifo_count(&audio->tx_supp_ff[0]);
+  uint8_t const n_bytes                 = (uint8_t) (audio->n_channels_per_ff_tx * audio->n_bytes_per_sampe_tx); // Channels of one FIFO are adjacent in stream
+  uint8_t const n_bytes_ff              = audiod_tx_supp_ff_sample_size(audio);                                // Differs from n_bytes if samples are converted
+  uint16_t const capPerFF               = (uint16_t) (audio->stream_in[0].ep_sz / n_ff_used / n_bytes);                 // Sample capacity per FIFO
+  uint16_t nSamplesPerFFToSend          = tu_fifo_count(&audio->tx_supp_ff[0]);
   uint8_t cnt_ff;
 
   for (cnt_ff = 1; cnt_ff < n_ff_used; cnt_ff++)
   {
     uint16_t const count = tu_fifo_count(&audio->tx_supp_ff[cnt_ff]);
-    if (count < nBytesPerFFToSend)
+    if (count < nSamplesPerFFToSend)
     {
-      nBytesPerFFToSend = count;
+      nSamplesPerFFToSend = count;
     }
   }
 
+  // Round to full number of samples (flooring)
+  nSamplesPerFFToSend = nSamplesPerFFToSend / n_bytes_ff;
+
   // Check if there is enough
-  if (nBytesPerFFToSend == 0)    return 0;
+  if (nSamplesPerFFToSend == 0)    return 0;
 
   // Limit to maximum sample number - THIS IS A POSSIBLE ERROR SOURCE IF TOO MANY SAMPLE WOULD NEED TO BE SENT BUT CAN NOT!
-  nBytesPerFFToSend = tu_min16(nBytesPerFFToSend, capPerFF);
+  nSamplesPerFFToSend = tu_min16(nSamplesPerFFToSend, capPerFF);
 
-  // Round to full number of samples (flooring)
-  nBytesPerFFToSend = (nBytesPerFFToSend / nBytesToCopy) * nBytesToCopy;
+  uint16_t const nBytesPerFFToRead = (uint16_t) (nSamplesPerFFToSend * n_bytes_ff);
 
-  // Encode
+  // Encode, channels of one FIFO are adjacent in stream
   uint8_t * dst;
-  uint8_t * src_end;
 
   tu_fifo_buffer_info_t info;
 
   for (cnt_ff = 0; cnt_ff < n_ff_used; cnt_ff++)
   {
-    dst = &audio->lin_buf_in[cnt_ff*audio->n_channels_per_ff_tx*audio->n_bytes_per_sampe_tx];
+    dst = &audio->lin_buf_in[0][cnt_ff * n_bytes];
 
     tu_fifo_get_read_info(&audio->tx_supp_ff[cnt_ff], &info);
 
     if (info.len_lin != 0)
     {
-      info.len_lin = tu_min16(nBytesPerFFToSend, info.len_lin);       // Limit up to desired length
-      src_end = (uint8_t *)info.ptr_lin + info.len_lin;
-      dst = audiod_interleaved_copy_bytes_fast_encode(audio->n_bytes_per_sampe_tx, info.ptr_lin, src_end, dst, n_ff_used);
+      info.len_lin = tu_min16(nBytesPerFFToRead, info.len_lin);       // Limit up to desired length
+      dst = audiod_tx_interleave(audio, dst, info.ptr_lin, info.len_lin / n_bytes_ff, n_bytes);
 
       // Limit up to desired length
-      info.len_wrap = tu_min16(nBytesPerFFToSend - info.len_lin, info.len_wrap);
+      info.len_wrap = tu_min16(nBytesPerFFToRead - info.len_lin, info.len_wrap);
 
       // Handle wrapped part of FIFO
       if (info.len_wrap != 0)
       {
-        src_end = (uint8_t *)info.ptr_wrap + info.len_wrap;
-        audiod_interleaved_copy_bytes_fast_encode(audio->n_bytes_per_sampe_tx, info.ptr_wrap, src_end, dst, n_ff_used);
+        audiod_tx_interleave(audio, dst, info.ptr_wrap, info.len_wrap / n_bytes_ff, n_bytes);
       }
 
       tu_fifo_advance_read_pointer(&audio->tx_supp_ff[cnt_ff], info.len_lin + info.len_wrap);
     }
-  }
-
-  return nBytesPerFFToSend * n_ff_used;
-}
-#endif //CFG_TUD_AUDIO_ENABLE_ENCODING
-
-// This function is called once a transmit of a feedback packet was successfully completed. Here, we get the next feedback value to be sent
-
-#if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
-static inline bool audiod_fb_send(uint8_t rhport, audiod_function_t *audio)
-{
-  return usbd_edpt_xfer(rhport, audio->ep_fb, (uint8_t *) &audio->feedback.value, 4);
-}
-#endif
-
-//--------------------------------------------------------------------+
-// USBD Driver API
-//--------------------------------------------------------------------+
-void audiod_init(void)
-{
-  tu_memclr(_audiod_fct, sizeof(_audiod_fct));
-
-  for(uint8_t i=0; i<CFG_TUD_AUDIO; i++)
-  {
-    audiod_function_t* audio = &_audiod_fct[i];
-
-    // Initialize control buffers
-    switch (i)
-    {
-      case 0:
-        audio->ctrl_buf = ctrl_buf_1;
-        audio->ctrl_buf_sz = CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ;
-        break;
-#if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_CTRL_BUF_SZ > 0
-      case 1:
-        audio->ctrl_buf = ctrl_buf_2;
-        audio->ctrl_buf_sz = CFG_TUD_AUDIO_FUNC_2_CTRL_BUF_SZ;
-        break;
-#endif
-#if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_CTRL_BUF_SZ > 0
-      case 2:
-        audio->ctrl_buf = ctrl_buf_3;
-        audio->ctrl_buf_sz = CFG_TUD_AUDIO_FUNC_3_CTRL_BUF_SZ;
-        break;
-#endif
-    }
-
-    // Initialize active alternate interface buffers
-    switch (i)
-    {
-#if CFG_TUD_AUDIO_FUNC_1_N_AS_INT > 0
-      case 0:
-        audio->alt_setting = alt_setting_1;
-        break;
-#endif
-#if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_N_AS_INT > 0
-      case 1:
-        audio->alt_setting = alt_setting_2;
-        break;
-#endif
-#if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_N_AS_INT > 0
-      case 2:
-        audio->alt_setting = alt_setting_3;
-        break;
-#endif
-    }
-
-    // Initialize IN EP FIFO if required
-#if CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_ENCODING
-
-    switch (i)
-    {
-#if CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ > 0
-      case 0:
-        tu_fifo_config(&audio->ep_in_ff, audio_ep_in_sw_buf_1, CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ, 1, true);
-#if CFG_FIFO_MUTEX
-        tu_fifo_config_mutex(&audio->ep_in_ff, osal_mutex_create(&ep_in_ff_mutex_wr_1), NULL);
-#endif
-        break;
-#endif
-#if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_EP_IN_SW_BUF_SZ > 0
-      case 1:
-        tu_fifo_config(&audio->ep_in_ff, audio_ep_in_sw_buf_2, CFG_TUD_AUDIO_FUNC_2_EP_IN_SW_BUF_SZ, 1, true);
-#if CFG_FIFO_MUTEX
-        tu_fifo_config_mutex(&audio->ep_in_ff, osal_mutex_create(&ep_in_ff_mutex_wr_2), NULL);
-#endif
-        break;
-#endif
-#if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_EP_IN_SW_BUF_SZ > 0
-      case 2:
-        tu_fifo_config(&audio->ep_in_ff, audio_ep_in_sw_buf_3, CFG_TUD_AUDIO_FUNC_3_EP_IN_SW_BUF_SZ, 1, true);
-#if CFG_FIFO_MUTEX
-        tu_fifo_config_mutex(&audio->ep_in_ff, osal_mutex_create(&ep_in_ff_mutex_wr_3), NULL);
-#endif
-        break;
-#endif
-    }
-#endif // CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_ENCODING
+  }
 
-    // Initialize linear buffers
-#if USE_LINEAR_BUFFER_TX
-    switch (i)
-    {
-#if CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX > 0
-      case 0:
-        audio->lin_buf_in = lin_buf_in_1;
-        break;
-#endif
-#if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_EP_IN_SZ_MAX > 0
-      case 1:
-        audio->lin_buf_in = lin_buf_in_2;
-        break;
+  return (uint16_t) (nSamplesPerFFToSend * n_bytes * n_ff_used);
+}
+#endif //CFG_TUD_AUDIO_ENABLE_ENCODING
+
+// This function is called once a transmit of a feedback packet was successfully completed. Here, we get the next feedback value to be sent
+
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
+static inline bool audiod_fb_send(uint8_t rhport, audiod_function_t *audio)
+{
+  return usbd_edpt_xfer(rhport, audio->ep_fb, (uint8_t *) &audio->feedback.value, 4);
+}
 #endif
-#if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_EP_IN_SZ_MAX > 0
-      case 2:
-        audio->lin_buf_in = lin_buf_in_3;
-        break;
+
+//--------------------------------------------------------------------+
+// USBD Driver API
+//--------------------------------------------------------------------+
+void audiod_init(void)
+{
+  tu_memclr(_audiod_fct, sizeof(_audiod_fct));
+
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+  tu_fifo_config(&_audiod_trace.ff, _audiod_trace.records, CFG_TUD_AUDIO_TRACE_DEPTH, sizeof(audio_trace_record_t), true);
 #endif
-    }
-#endif // USE_LINEAR_BUFFER_TX
 
-    // Initialize OUT EP FIFO if required
-#if CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING
+  for(uint8_t i=0; i<CFG_TUD_AUDIO; i++)
+  {
+    audiod_function_t* audio = &_audiod_fct[i];
+    audiod_fct_cfg_t const * cfg = &_audiod_fct_cfg[i];
+
+    // Initialize control buffers and active alternate interface buffers
+    audio->ctrl_buf    = cfg->ctrl_buf;
+    audio->ctrl_buf_sz = cfg->ctrl_buf_sz;
+    audio->alt_setting = cfg->alt_setting;
 
-    switch (i)
+#if CFG_TUD_AUDIO_ENABLE_EP_IN
+    for (uint8_t stream = 0; stream < cfg->n_stream_in; stream++)
     {
-#if CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ > 0
-      case 0:
-        tu_fifo_config(&audio->ep_out_ff, audio_ep_out_sw_buf_1, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ, 1, true);
-#if CFG_FIFO_MUTEX
-        tu_fifo_config_mutex(&audio->ep_out_ff, NULL, osal_mutex_create(&ep_out_ff_mutex_rd_1));
-#endif
-        break;
-#endif
-#if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_EP_OUT_SW_BUF_SZ > 0
-      case 1:
-        tu_fifo_config(&audio->ep_out_ff, audio_ep_out_sw_buf_2, CFG_TUD_AUDIO_FUNC_2_EP_OUT_SW_BUF_SZ, 1, true);
-#if CFG_FIFO_MUTEX
-        tu_fifo_config_mutex(&audio->ep_out_ff, NULL, osal_mutex_create(&ep_out_ff_mutex_rd_2));
-#endif
-        break;
-#endif
-#if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_EP_OUT_SW_BUF_SZ > 0
-      case 2:
-        tu_fifo_config(&audio->ep_out_ff, audio_ep_out_sw_buf_3, CFG_TUD_AUDIO_FUNC_3_EP_OUT_SW_BUF_SZ, 1, true);
+      // Initialize IN EP FIFO if required
+#if !CFG_TUD_AUDIO_ENABLE_ENCODING
+      if (cfg->ep_in_sw_buf)
+      {
+        tu_fifo_config(&audio->ep_in_ff[stream], cfg->ep_in_sw_buf + stream * cfg->ep_in_sw_buf_sz, cfg->ep_in_sw_buf_sz, 1, true);
 #if CFG_FIFO_MUTEX
-        tu_fifo_config_mutex(&audio->ep_out_ff, NULL, osal_mutex_create(&ep_out_ff_mutex_rd_3));
+        tu_fifo_config_mutex(&audio->ep_in_ff[stream], osal_mutex_create(&cfg->ep_in_ff_mutex_wr[stream]), NULL);
 #endif
-        break;
+      }
 #endif
-    }
-#endif // CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING
 
-    // Initialize linear buffers
-#if USE_LINEAR_BUFFER_RX
-    switch (i)
-    {
-#if CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX > 0
-      case 0:
-        audio->lin_buf_out = lin_buf_out_1;
-        break;
-#endif
-#if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_EP_OUT_SZ_MAX > 0
-      case 1:
-        audio->lin_buf_out = lin_buf_out_2;
-        break;
-#endif
-#if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_EP_OUT_SZ_MAX > 0
-      case 2:
-        audio->lin_buf_out = lin_buf_out_3;
-        break;
+      // Initialize linear buffers
+#if USE_LINEAR_BUFFER_TX
+      if (cfg->lin_buf_in) audio->lin_buf_in[stream] = cfg->lin_buf_in + stream * cfg->lin_buf_in_sz;
 #endif
     }
-#endif // USE_LINEAR_BUFFER_TX
 
     // Initialize TX support FIFOs if required
-#if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING
-
-    switch (i)
+#if CFG_TUD_AUDIO_ENABLE_ENCODING
+    audio->tx_supp_ff = cfg->tx_supp_ff;
+    audio->n_tx_supp_ff = cfg->n_tx_supp_ff;
+    audio->tx_supp_ff_sz_max = cfg->tx_supp_ff_sz;
+    for (uint8_t cnt = 0; cnt < cfg->n_tx_supp_ff; cnt++)
     {
-#if CFG_TUD_AUDIO_FUNC_1_TX_SUPP_SW_FIFO_SZ > 0
-      case 0:
-        audio->tx_supp_ff = tx_supp_ff_1;
-        audio->n_tx_supp_ff = CFG_TUD_AUDIO_FUNC_1_N_TX_SUPP_SW_FIFO;
-        audio->tx_supp_ff_sz_max = CFG_TUD_AUDIO_FUNC_1_TX_SUPP_SW_FIFO_SZ;
-        for (uint8_t cnt = 0; cnt < CFG_TUD_AUDIO_FUNC_1_N_TX_SUPP_SW_FIFO; cnt++)
-        {
-          tu_fifo_config(&tx_supp_ff_1[cnt], tx_supp_ff_buf_1[cnt], CFG_TUD_AUDIO_FUNC_1_TX_SUPP_SW_FIFO_SZ, 1, true);
-#if CFG_FIFO_MUTEX
-          tu_fifo_config_mutex(&tx_supp_ff_1[cnt], osal_mutex_create(&tx_supp_ff_mutex_wr_1[cnt]), NULL);
-#endif
-        }
-
-        break;
-#endif // CFG_TUD_AUDIO_FUNC_1_TX_SUPP_SW_FIFO_SZ > 0
-
-#if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_TX_SUPP_SW_FIFO_SZ > 0
-      case 1:
-        audio->tx_supp_ff = tx_supp_ff_2;
-        audio->n_tx_supp_ff = CFG_TUD_AUDIO_FUNC_2_N_TX_SUPP_SW_FIFO;
-        audio->tx_supp_ff_sz_max = CFG_TUD_AUDIO_FUNC_2_TX_SUPP_SW_FIFO_SZ;
-        for (uint8_t cnt = 0; cnt < CFG_TUD_AUDIO_FUNC_2_N_TX_SUPP_SW_FIFO; cnt++)
-        {
-          tu_fifo_config(&tx_supp_ff_2[cnt], tx_supp_ff_buf_2[cnt], CFG_TUD_AUDIO_FUNC_2_TX_SUPP_SW_FIFO_SZ, 1, true);
-#if CFG_FIFO_MUTEX
-          tu_fifo_config_mutex(&tx_supp_ff_2[cnt], osal_mutex_create(&tx_supp_ff_mutex_wr_2[cnt]), NULL);
-#endif
-        }
-
-        break;
-#endif // CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_TX_SUPP_SW_FIFO_SZ > 0
-
-#if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_TX_SUPP_SW_FIFO_SZ > 0
-      case 2:
-        audio->tx_supp_ff = tx_supp_ff_3;
-        audio->n_tx_supp_ff = CFG_TUD_AUDIO_FUNC_3_N_TX_SUPP_SW_FIFO;
-        audio->tx_supp_ff_sz_max = CFG_TUD_AUDIO_FUNC_3_TX_SUPP_SW_FIFO_SZ;
-        for (uint8_t cnt = 0; cnt < CFG_TUD_AUDIO_FUNC_3_N_TX_SUPP_SW_FIFO; cnt++)
-        {
-          tu_fifo_config(&tx_supp_ff_3[cnt], tx_supp_ff_buf_3[cnt], CFG_TUD_AUDIO_FUNC_3_TX_SUPP_SW_FIFO_SZ, 1, true);
+      tu_fifo_config(&cfg->tx_supp_ff[cnt], cfg->tx_supp_ff_buf + cnt * cfg->tx_supp_ff_sz, cfg->tx_supp_ff_sz, 1, true);
 #if CFG_FIFO_MUTEX
-          tu_fifo_config_mutex(&tx_supp_ff_3[cnt], osal_mutex_create(&tx_supp_ff_mutex_wr_3[cnt]), NULL);
+      tu_fifo_config_mutex(&cfg->tx_supp_ff[cnt], osal_mutex_create(&cfg->tx_supp_ff_mutex_wr[cnt]), NULL);
 #endif
-        }
-
-        break;
-#endif // CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_TX_SUPP_SW_FIFO_SZ > 0
     }
-#endif // CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING
 
     // Set encoding parameters for Type_I formats
 #if CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
-    switch (i)
-    {
-#if CFG_TUD_AUDIO_FUNC_1_TX_SUPP_SW_FIFO_SZ > 0
-      case 0:
-        audio->n_channels_per_ff_tx = CFG_TUD_AUDIO_FUNC_1_CHANNEL_PER_FIFO_TX;
-        break;
-#endif
-#if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_TX_SUPP_SW_FIFO_SZ > 0
-      case 1:
-        audio->n_channels_per_ff_tx = CFG_TUD_AUDIO_FUNC_2_CHANNEL_PER_FIFO_TX;
-        break;
+    audio->n_channels_per_ff_tx = cfg->n_channels_per_ff_tx;
 #endif
-#if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_TX_SUPP_SW_FIFO_SZ > 0
-      case 2:
-        audio->n_channels_per_ff_tx = CFG_TUD_AUDIO_FUNC_3_CHANNEL_PER_FIFO_TX;
-        break;
 #endif
-    }
-#endif // CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
-
-    // Initialize RX support FIFOs if required
-#if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING
+#endif // CFG_TUD_AUDIO_ENABLE_EP_IN
 
-    switch (i)
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT
+    for (uint8_t stream = 0; stream < cfg->n_stream_out; stream++)
     {
-#if CFG_TUD_AUDIO_FUNC_1_RX_SUPP_SW_FIFO_SZ > 0
-      case 0:
-        audio->rx_supp_ff = rx_supp_ff_1;
-        audio->n_rx_supp_ff = CFG_TUD_AUDIO_FUNC_1_N_RX_SUPP_SW_FIFO;
-        audio->rx_supp_ff_sz_max = CFG_TUD_AUDIO_FUNC_1_RX_SUPP_SW_FIFO_SZ;
-        for (uint8_t cnt = 0; cnt < CFG_TUD_AUDIO_FUNC_1_N_RX_SUPP_SW_FIFO; cnt++)
-        {
-          tu_fifo_config(&rx_supp_ff_1[cnt], rx_supp_ff_buf_1[cnt], CFG_TUD_AUDIO_FUNC_1_RX_SUPP_SW_FIFO_SZ, 1, true);
+      // Initialize OUT EP FIFO if required
+#if !CFG_TUD_AUDIO_ENABLE_DECODING
+      if (cfg->ep_out_sw_buf)
+      {
+        tu_fifo_config(&audio->ep_out_ff[stream], cfg->ep_out_sw_buf + stream * cfg->ep_out_sw_buf_sz, cfg->ep_out_sw_buf_sz, 1, true);
 #if CFG_FIFO_MUTEX
-          tu_fifo_config_mutex(&rx_supp_ff_1[cnt], osal_mutex_create(&rx_supp_ff_mutex_rd_1[cnt]), NULL);
+        tu_fifo_config_mutex(&audio->ep_out_ff[stream], NULL, osal_mutex_create(&cfg->ep_out_ff_mutex_rd[stream]));
 #endif
-        }
-
-        break;
-#endif // CFG_TUD_AUDIO_FUNC_1_RX_SUPP_SW_FIFO_SZ > 0
-
-#if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_RX_SUPP_SW_FIFO_SZ > 0
-      case 1:
-        audio->rx_supp_ff = rx_supp_ff_2;
-        audio->n_rx_supp_ff = CFG_TUD_AUDIO_FUNC_2_N_RX_SUPP_SW_FIFO;
-        audio->rx_supp_ff_sz_max = CFG_TUD_AUDIO_FUNC_2_RX_SUPP_SW_FIFO_SZ;
-        for (uint8_t cnt = 0; cnt < CFG_TUD_AUDIO_FUNC_2_N_RX_SUPP_SW_FIFO; cnt++)
-        {
-          tu_fifo_config(&rx_supp_ff_2[cnt], rx_supp_ff_buf_2[cnt], CFG_TUD_AUDIO_FUNC_2_RX_SUPP_SW_FIFO_SZ, 1, true);
-#if CFG_FIFO_MUTEX
-          tu_fifo_config_mutex(&rx_supp_ff_2[cnt], osal_mutex_create(&rx_supp_ff_mutex_rd_2[cnt]), NULL);
+      }
 #endif
-        }
 
-        break;
-#endif // CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_RX_SUPP_SW_FIFO_SZ > 0
+      // Initialize linear buffers
+#if USE_LINEAR_BUFFER_RX
+      if (cfg->lin_buf_out) audio->lin_buf_out[stream] = cfg->lin_buf_out + stream * cfg->lin_buf_out_sz;
+#endif
+    }
 
-#if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_RX_SUPP_SW_FIFO_SZ > 0
-      case 2:
-        audio->rx_supp_ff = rx_supp_ff_3;
-        audio->n_rx_supp_ff = CFG_TUD_AUDIO_FUNC_3_N_RX_SUPP_SW_FIFO;
-        audio->rx_supp_ff_sz_max = CFG_TUD_AUDIO_FUNC_3_RX_SUPP_SW_FIFO_SZ;
-        for (uint8_t cnt = 0; cnt < CFG_TUD_AUDIO_FUNC_3_N_RX_SUPP_SW_FIFO; cnt++)
-        {
-          tu_fifo_config(&rx_supp_ff_3[cnt], rx_supp_ff_buf_3[cnt], CFG_TUD_AUDIO_FUNC_3_RX_SUPP_SW_FIFO_SZ, 1, true);
+    // Initialize RX support FIFOs if required
+#if CFG_TUD_AUDIO_ENABLE_DECODING
+    audio->rx_supp_ff = cfg->rx_supp_ff;
+    audio->n_rx_supp_ff = cfg->n_rx_supp_ff;
+    audio->rx_supp_ff_sz_max = cfg->rx_supp_ff_sz;
+    for (uint8_t cnt = 0; cnt < cfg->n_rx_supp_ff; cnt++)
+    {
+      tu_fifo_config(&cfg->rx_supp_ff[cnt], cfg->rx_supp_ff_buf + cnt * cfg->rx_supp_ff_sz, cfg->rx_supp_ff_sz, 1, true);
 #if CFG_FIFO_MUTEX
-          tu_fifo_config_mutex(&rx_supp_ff_3[cnt], osal_mutex_create(&rx_supp_ff_mutex_rd_3[cnt]), NULL);
+      tu_fifo_config_mutex(&cfg->rx_supp_ff[cnt], osal_mutex_create(&cfg->rx_supp_ff_mutex_rd[cnt]), NULL);
 #endif
-        }
-
-        break;
-#endif // CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_RX_SUPP_SW_FIFO_SZ > 0
     }
-#endif // CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING
 
-    // Set encoding parameters for Type_I formats
+    // Set decoding parameters for Type_I formats
 #if CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
-    switch (i)
-    {
-#if CFG_TUD_AUDIO_FUNC_1_RX_SUPP_SW_FIFO_SZ > 0
-      case 0:
-        audio->n_channels_per_ff_rx = CFG_TUD_AUDIO_FUNC_1_CHANNEL_PER_FIFO_RX;
-        break;
+    audio->n_channels_per_ff_rx = cfg->n_channels_per_ff_rx;
 #endif
-#if CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_RX_SUPP_SW_FIFO_SZ > 0
-      case 1:
-        audio->n_channels_per_ff_rx = CFG_TUD_AUDIO_FUNC_2_CHANNEL_PER_FIFO_RX;
-        break;
-#endif
-#if CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_RX_SUPP_SW_FIFO_SZ > 0
-      case 2:
-        audio->n_channels_per_ff_rx = CFG_TUD_AUDIO_FUNC_3_CHANNEL_PER_FIFO_RX;
-        break;
 #endif
-    }
-#endif // CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
+#endif // CFG_TUD_AUDIO_ENABLE_EP_OUT
   }
 }
 
@@ -1405,11 +1810,17 @@ void audiod_reset(uint8_t rhport)
     tu_memclr(audio, ITF_MEM_RESET_SIZE);
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_ENCODING
-    tu_fifo_clear(&audio->ep_in_ff);
+    for (uint8_t stream = 0; stream < _audiod_fct_cfg[i].n_stream_in; stream++)
+    {
+      audiod_ep_ff_discard(&audio->ep_in_ff[stream], audio->ep_in_ff_ext[stream]);
+    }
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && !CFG_TUD_AUDIO_ENABLE_DECODING
-    tu_fifo_clear(&audio->ep_out_ff);
+    for (uint8_t stream = 0; stream < _audiod_fct_cfg[i].n_stream_out; stream++)
+    {
+      audiod_ep_ff_discard(&audio->ep_out_ff[stream], audio->ep_out_ff_ext[stream]);
+    }
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING
@@ -1428,6 +1839,74 @@ void audiod_reset(uint8_t rhport)
   }
 }
 
+#if CFG_TUD_AUDIO_ENABLE_EP_IN
+static uint8_t audiod_get_stream_in(audiod_function_t const * audio, uint8_t itf)
+{
+  for (uint8_t stream = 0; stream < audio->n_stream_in; stream++)
+  {
+    if (audio->stream_in[stream].as_intf_num == itf) return stream;
+  }
+  return AUDIOD_NO_STREAM;
+}
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT
+static uint8_t audiod_get_stream_out(audiod_function_t const * audio, uint8_t itf)
+{
+  for (uint8_t stream = 0; stream < audio->n_stream_out; stream++)
+  {
+    if (audio->stream_out[stream].as_intf_num == itf) return stream;
+  }
+  return AUDIOD_NO_STREAM;
+}
+#endif
+
+// Number AS interfaces having an isochronous data EP in any alternate setting in descriptor order, the index is the stream number used by the API
+static bool audiod_parse_streams(audiod_function_t * audio, audiod_fct_cfg_t const * cfg)
+{
+  (void) cfg;
+
+  uint8_t const *p_desc = audio->p_desc;
+  uint8_t const *p_desc_end = audio->p_desc + audio->desc_length - TUD_AUDIO_DESC_IAD_LEN;
+  uint8_t itf = 0;
+
+  while (p_desc < p_desc_end)
+  {
+    if (tu_desc_type(p_desc) == TUSB_DESC_INTERFACE)
+    {
+      itf = ((tusb_desc_interface_t const *) p_desc)->bInterfaceNumber;
+    }
+    else if (tu_desc_type(p_desc) == TUSB_DESC_ENDPOINT)
+    {
+      tusb_desc_endpoint_t const* desc_ep = (tusb_desc_endpoint_t const *) p_desc;
+      uint8_t const ep_addr = desc_ep->bEndpointAddress;
+      (void) ep_addr;
+
+      if (desc_ep->bmAttributes.xfer == TUSB_XFER_ISOCHRONOUS)
+      {
+#if CFG_TUD_AUDIO_ENABLE_EP_IN
+        if (tu_edpt_dir(ep_addr) == TUSB_DIR_IN && desc_ep->bmAttributes.usage == 0x00 && audiod_get_stream_in(audio, itf) == AUDIOD_NO_STREAM)
+        {
+          TU_ASSERT(audio->n_stream_in < cfg->n_stream_in);   // Increase CFG_TUD_AUDIO_FUNC_X_N_EP_IN
+          audio->stream_in[audio->n_stream_in++].as_intf_num = itf;
+        }
+#endif
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT
+        if (tu_edpt_dir(ep_addr) == TUSB_DIR_OUT && audiod_get_stream_out(audio, itf) == AUDIOD_NO_STREAM)
+        {
+          TU_ASSERT(audio->n_stream_out < cfg->n_stream_out); // Increase CFG_TUD_AUDIO_FUNC_X_N_EP_OUT
+          audio->stream_out[audio->n_stream_out++].as_intf_num = itf;
+        }
+#endif
+      }
+    }
+
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  return true;
+}
+
 uint16_t audiod_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t max_len)
 {
   (void) max_len;
@@ -1457,22 +1936,7 @@ uint16_t audiod_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uin
       _audiod_fct[i].rhport = rhport;
 
       // Setup descriptor lengths
-      switch (i)
-      {
-        case 0:
-          _audiod_fct[i].desc_length = CFG_TUD_AUDIO_FUNC_1_DESC_LEN;
-          break;
-#if CFG_TUD_AUDIO > 1
-        case 1:
-          _audiod_fct[i].desc_length = CFG_TUD_AUDIO_FUNC_2_DESC_LEN;
-          break;
-#endif
-#if CFG_TUD_AUDIO > 2
-        case 2:
-          _audiod_fct[i].desc_length = CFG_TUD_AUDIO_FUNC_3_DESC_LEN;
-          break;
-#endif
-      }
+      _audiod_fct[i].desc_length = _audiod_fct_cfg[i].desc_length;
 
       break;
     }
@@ -1481,6 +1945,13 @@ uint16_t audiod_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uin
   // Verify we found a free one
   TU_ASSERT( i < CFG_TUD_AUDIO );
 
+  // Assign AS interfaces with streaming EPs to streams, release function again if there are more than configured
+  if (!audiod_parse_streams(&_audiod_fct[i], &_audiod_fct_cfg[i]))
+  {
+    tu_memclr(&_audiod_fct[i], ITF_MEM_RESET_SIZE);
+    return 0;
+  }
+
   // This is all we need so far - the EPs are setup by a later set_interface request (as per UAC2 specification)
   uint16_t drv_len = _audiod_fct[i].desc_length - TUD_AUDIO_DESC_IAD_LEN;    // - TUD_AUDIO_DESC_IAD_LEN since tinyUSB already handles the IAD descriptor
 
@@ -1503,6 +1974,35 @@ static bool audiod_get_interface(uint8_t rhport, tusb_control_request_t const *
   return true;
 }
 
+#if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP || USE_ASRC_RX || USE_ASRC_TX || CFG_TUD_AUDIO_ENABLE_TRACE
+// SOF drives feedback computation, converter ratio tracking and trace frame numbers
+static inline bool audiod_sof_needed(audiod_function_t const * audio)
+{
+#if CFG_TUD_AUDIO_ENABLE_TRACE && CFG_TUD_AUDIO_ENABLE_EP_IN
+  for (uint8_t stream = 0; stream < audio->n_stream_in; stream++)
+  {
+    if (audio->stream_in[stream].ep != 0) return true;
+  }
+#endif
+#if CFG_TUD_AUDIO_ENABLE_TRACE && CFG_TUD_AUDIO_ENABLE_EP_OUT
+  for (uint8_t stream = 0; stream < audio->n_stream_out; stream++)
+  {
+    if (audio->stream_out[stream].ep != 0) return true;
+  }
+#endif
+#if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
+  if (audio->ep_fb != 0) return true;
+#endif
+#if USE_ASRC_RX
+  if (audio->stream_out[0].ep != 0 && audio->asrc_rx.in_rate != 0) return true;
+#endif
+#if USE_ASRC_TX
+  if (audio->stream_in[0].ep != 0 && audio->asrc_tx.in_rate != 0) return true;
+#endif
+  return false;
+}
+#endif
+
 static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const * p_request)
 {
   (void) rhport;
@@ -1530,16 +2030,16 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
 
   audiod_function_t* audio = &_audiod_fct[func_id];
 
-  // Look if there is an EP to be closed - for this driver, there are only 3 possible EPs which may be closed (only AS related EPs can be closed, AC EP (if present) is always open)
+  // Look if there is an EP to be closed - only AS related EPs can be closed, AC EP (if present) is always open
 #if CFG_TUD_AUDIO_ENABLE_EP_IN
-  if (audio->ep_in_as_intf_num == itf)
+  uint8_t const stream_in = audiod_get_stream_in(audio, itf);
+  if (stream_in != AUDIOD_NO_STREAM && audio->stream_in[stream_in].ep != 0)
   {
-    audio->ep_in_as_intf_num = 0;
-    usbd_edpt_close(rhport, audio->ep_in);
+    usbd_edpt_close(rhport, audio->stream_in[stream_in].ep);
 
     // Clear FIFOs, since data is no longer valid
 #if !CFG_TUD_AUDIO_ENABLE_ENCODING
-    tu_fifo_clear(&audio->ep_in_ff);
+    audiod_ep_ff_discard(&audio->ep_in_ff[stream_in], audio->ep_in_ff_ext[stream_in]);
 #else
     for (uint8_t cnt = 0; cnt < audio->n_tx_supp_ff; cnt++)
     {
@@ -1550,20 +2050,21 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
     // Invoke callback - can be used to stop data sampling
     if (tud_audio_set_itf_close_EP_cb) TU_VERIFY(tud_audio_set_itf_close_EP_cb(rhport, p_request));
 
-    audio->ep_in = 0;                           // Necessary?
-
+    audio->stream_in[stream_in].ep = 0;
+    audio->stream_in[stream_in].n_bytes_xfer = 0;
+    audio->stream_in[stream_in].xfer_in_ff = false;
   }
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
-  if (audio->ep_out_as_intf_num == itf)
+  uint8_t const stream_out = audiod_get_stream_out(audio, itf);
+  if (stream_out != AUDIOD_NO_STREAM && audio->stream_out[stream_out].ep != 0)
   {
-    audio->ep_out_as_intf_num = 0;
-    usbd_edpt_close(rhport, audio->ep_out);
+    usbd_edpt_close(rhport, audio->stream_out[stream_out].ep);
 
     // Clear FIFOs, since data is no longer valid
 #if !CFG_TUD_AUDIO_ENABLE_DECODING
-    tu_fifo_clear(&audio->ep_out_ff);
+    audiod_ep_ff_discard(&audio->ep_out_ff[stream_out], audio->ep_out_ff_ext[stream_out]);
 #else
     for (uint8_t cnt = 0; cnt < audio->n_rx_supp_ff; cnt++)
     {
@@ -1574,13 +2075,17 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
     // Invoke callback - can be used to stop data sampling
     if (tud_audio_set_itf_close_EP_cb) TU_VERIFY(tud_audio_set_itf_close_EP_cb(rhport, p_request));
 
-    audio->ep_out = 0;                          // Necessary?
+    audio->stream_out[stream_out].ep = 0;
+    audio->stream_out[stream_out].xfer_in_ff = false;
 
     // Close corresponding feedback EP
 #if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
-    usbd_edpt_close(rhport, audio->ep_fb);
-    audio->ep_fb = 0;
-    tu_memclr(&audio->feedback, sizeof(audio->feedback));
+    if (audio->ep_fb != 0 && stream_out == 0)
+    {
+      usbd_edpt_close(rhport, audio->ep_fb);
+      audio->ep_fb = 0;
+      tu_memclr(&audio->feedback, sizeof(audio->feedback));
+    }
 #endif
   }
 #endif
@@ -1615,13 +2120,18 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
           //TODO: We need to set EP non busy since this is not taken care of right now in ep_close() - THIS IS A WORKAROUND!
           usbd_edpt_clear_stall(rhport, ep_addr);
 
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+          // Trace records are stamped with SOF frame number and time
+          usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, true);
+#endif
+
 #if CFG_TUD_AUDIO_ENABLE_EP_IN
           if (tu_edpt_dir(ep_addr) == TUSB_DIR_IN && desc_ep->bmAttributes.usage == 0x00)   // Check if usage is data EP
           {
             // Save address
-            audio->ep_in = ep_addr;
-            audio->ep_in_as_intf_num = itf;
-            audio->ep_in_sz = tu_edpt_packet_size(desc_ep);
+            TU_ASSERT(stream_in != AUDIOD_NO_STREAM);
+            audio->stream_in[stream_in].ep = ep_addr;
+            audio->stream_in[stream_in].ep_sz = tu_edpt_packet_size(desc_ep);
 
             // If software encoding is enabled, parse for the corresponding parameters - doing this here means only AS interfaces with EPs get scanned for parameters
 #if CFG_TUD_AUDIO_ENABLE_ENCODING
@@ -1629,20 +2139,33 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
 
             // Reconfigure size of support FIFOs - this is necessary to avoid samples to get split in case of a wrap
 #if CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
-            const uint16_t active_fifo_depth = (uint16_t) ((audio->tx_supp_ff_sz_max / audio->n_bytes_per_sampe_tx) * audio->n_bytes_per_sampe_tx);
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+            audio->conv_tx.n_bytes    = audio->n_bytes_per_sampe_tx;
+            audio->conv_tx.n_channels = audio->n_channels_per_ff_tx;
+#endif
+            const uint16_t n_bytes_per_ff_sample = audiod_tx_supp_ff_sample_size(audio);
+            const uint16_t active_fifo_depth = (uint16_t) ((audio->tx_supp_ff_sz_max / n_bytes_per_ff_sample) * n_bytes_per_ff_sample);
             for (uint8_t cnt = 0; cnt < audio->n_tx_supp_ff; cnt++)
             {
               tu_fifo_config(&audio->tx_supp_ff[cnt], audio->tx_supp_ff[cnt].buffer, active_fifo_depth, 1, true);
             }
             audio->n_ff_used_tx = audio->n_channels_tx / audio->n_channels_per_ff_tx;
             TU_ASSERT( audio->n_ff_used_tx <= audio->n_tx_supp_ff );
+#if USE_ASRC_TX
+            if (audio->asrc_tx.in_rate)
+            {
+              TU_ASSERT(audiod_asrc_start(&audio->asrc_tx, audio->asrc_tx.in_rate, audio->asrc_tx.out_rate, &audio->tx_supp_ff[0],
+                                          audio->conv_tx.format, audio->n_ff_used_tx, audio->n_channels_per_ff_tx, (uint8_t) n_bytes_per_ff_sample));
+              usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, true);
+            }
+#endif
 #endif
 
 #endif
 
             // Schedule first transmit if alternate interface is not zero i.e. streaming is disabled - in case no sample data is available a ZLP is loaded
             // It is necessary to trigger this here since the refill is done with an RX FIFO empty interrupt which can only trigger if something was in there
-            TU_VERIFY(audiod_tx_done_cb(rhport, &_audiod_fct[func_id]));
+            TU_VERIFY(audiod_tx_done_cb(rhport, audio, stream_in));
           }
 #endif // CFG_TUD_AUDIO_ENABLE_EP_IN
 
@@ -1651,41 +2174,55 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
           if (tu_edpt_dir(ep_addr) == TUSB_DIR_OUT)     // Checking usage not necessary
           {
             // Save address
-            audio->ep_out = ep_addr;
-            audio->ep_out_as_intf_num = itf;
-            audio->ep_out_sz = tu_edpt_packet_size(desc_ep);
+            TU_ASSERT(stream_out != AUDIOD_NO_STREAM);
+            audio->stream_out[stream_out].ep = ep_addr;
+            audio->stream_out[stream_out].ep_sz = tu_edpt_packet_size(desc_ep);
 
 #if CFG_TUD_AUDIO_ENABLE_DECODING
             audiod_parse_for_AS_params(audio, p_desc_parse_for_params, p_desc_end, itf);
 
             // Reconfigure size of support FIFOs - this is necessary to avoid samples to get split in case of a wrap
 #if CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING
-            const uint16_t active_fifo_depth = (audio->rx_supp_ff_sz_max / audio->n_bytes_per_sampe_rx) * audio->n_bytes_per_sampe_rx;
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+            audio->conv_rx.n_bytes    = audio->n_bytes_per_sampe_rx;
+            audio->conv_rx.n_channels = audio->n_channels_per_ff_rx;
+#endif
+            const uint16_t n_bytes_per_ff_sample = audiod_rx_supp_ff_sample_size(audio);
+            const uint16_t active_fifo_depth = (uint16_t) ((audio->rx_supp_ff_sz_max / n_bytes_per_ff_sample) * n_bytes_per_ff_sample);
             for (uint8_t cnt = 0; cnt < audio->n_rx_supp_ff; cnt++)
             {
               tu_fifo_config(&audio->rx_supp_ff[cnt], audio->rx_supp_ff[cnt].buffer, active_fifo_depth, 1, true);
             }
             audio->n_ff_used_rx = audio->n_channels_rx / audio->n_channels_per_ff_rx;
             TU_ASSERT( audio->n_ff_used_rx <= audio->n_rx_supp_ff );
+#if USE_ASRC_RX
+            if (audio->asrc_rx.in_rate)
+            {
+              TU_ASSERT(audiod_asrc_start(&audio->asrc_rx, audio->asrc_rx.in_rate, audio->asrc_rx.out_rate, &audio->rx_supp_ff[0],
+                                          audio->conv_rx.format, audio->n_ff_used_rx, audio->n_channels_per_ff_rx, (uint8_t) n_bytes_per_ff_sample));
+              usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, true);
+            }
+#endif
 #endif
 #endif
 
             // Prepare for incoming data
-#if USE_LINEAR_BUFFER_RX
-            TU_VERIFY(usbd_edpt_xfer(rhport, audio->ep_out, audio->lin_buf_out, audio->ep_out_sz), false);
+#if CFG_TUD_AUDIO_ENABLE_DECODING
+            TU_VERIFY(usbd_edpt_xfer(rhport, ep_addr, audio->lin_buf_out[stream_out], audio->stream_out[stream_out].ep_sz), false);
 #else
-            TU_VERIFY(usbd_edpt_xfer_fifo(rhport, audio->ep_out, &audio->ep_out_ff, audio->ep_out_sz), false);
+            TU_VERIFY(audiod_rx_xfer(rhport, audio, stream_out), false);
 #endif
           }
 
 #if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
           if (tu_edpt_dir(ep_addr) == TUSB_DIR_IN && desc_ep->bmAttributes.usage == 1)   // Check if usage is explicit data feedback
           {
+            TU_ASSERT(stream_out == 0);   // Feedback EP is supported for first OUT stream only
             audio->ep_fb = ep_addr;
             audio->feedback.frame_shift = desc_ep->bInterval -1;
 
             // Enable SOF interrupt if callback is implemented
-            if (tud_audio_feedback_interval_isr) usbd_sof_enable(rhport, true);
+            if (tud_audio_feedback_interval_isr) usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, true);
           }
 #endif
 #endif // CFG_TUD_AUDIO_ENABLE_EP_OUT
@@ -1701,8 +2238,8 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
       if (tud_audio_set_itf_cb) TU_VERIFY(tud_audio_set_itf_cb(rhport, p_request));
 
 #if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
-      // Prepare feedback computation if callback is available
-      if (tud_audio_feedback_params_cb)
+      // Prepare feedback computation of first OUT stream if callback is available
+      if (tud_audio_feedback_params_cb && stream_out == 0)
       {
         audio_feedback_params_t fb_param;
 
@@ -1722,17 +2259,32 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
             set_fb_params_freq(audio, fb_param.sample_freq, fb_param.frequency.mclk_freq);
           break;
 
-          #if 0 // implement later
           case AUDIO_FEEDBACK_METHOD_FIFO_COUNT:
           {
             uint64_t fb64 = ((uint64_t) fb_param.sample_freq) << 16;
-            audio->feedback.compute.fifo_count.nominal_value = (uint32_t) (fb64 / frame_div);
-            audio->feedback.compute.fifo_count.threshold_bytes = fb_param.fifo_count.threshold_bytes;
+            uint32_t const nominal_value = (uint32_t) (fb64 / frame_div);
+
+            // Level is taken from the FIFO the application reads from
+#if CFG_TUD_AUDIO_ENABLE_DECODING
+            uint16_t const ff_depth  = tu_fifo_depth(&audio->rx_supp_ff[0]);
+            uint16_t const slot_size = audiod_rx_supp_ff_sample_size(audio);
+#else
+            // Bytes per slot are not parsed without decoding, estimate them from packet size which holds at most one slot more than nominal
+            uint16_t const ff_depth  = tu_fifo_depth(&audio->ep_out_ff[0]);
+            uint16_t const slot_size = (uint16_t) (audio->stream_out[0].ep_sz / ((nominal_value >> 16) + 1));
+#endif
+            uint16_t const target = fb_param.fifo_count.target_bytes ? fb_param.fifo_count.target_bytes : ff_depth / 2;
+
+            // Controller runs with SOF i.e. at least every 1 ms (8 micro frames) on high speed
+            uint8_t update_shift = audio->feedback.frame_shift;
+            if (TUSB_SPEED_HIGH == tud_speed_get() && update_shift < 3) update_shift = 3;
 
-            tud_audio_fb_set(audio->feedback.compute.fifo_count.nominal_value);
+            audiod_fb_fifo_count_init(&audio->feedback.compute.fifo_count, nominal_value, target, slot_size, update_shift);
+            tud_audio_n_fb_set(func_id, nominal_value);
+
+            usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, true);
           }
           break;
-          #endif
 
           // nothing to do
           default: break;
@@ -1748,18 +2300,18 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
     p_desc = tu_desc_next(p_desc);
   }
 
-#if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
-  // Disable SOF interrupt if no driver has any enabled feedback EP
+#if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP || USE_ASRC_RX || USE_ASRC_TX || CFG_TUD_AUDIO_ENABLE_TRACE
+  // Release SOF interrupt if no audio function has any enabled feedback EP, running converter or traced stream
   bool disable = true;
   for(uint8_t i=0; i < CFG_TUD_AUDIO; i++)
   {
-    if (_audiod_fct[i].ep_fb != 0)
+    if (audiod_sof_needed(&_audiod_fct[i]))
     {
       disable = false;
       break;
     }
   }
-  if (disable) usbd_sof_enable(rhport, false);
+  if (disable) usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, false);
 #endif
 
   tud_control_status(rhport, p_request);
@@ -2002,8 +2554,10 @@ bool audiod_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint3
 #if CFG_TUD_AUDIO_ENABLE_EP_IN
 
     // Data transmission of audio packet finished
-    if (audio->ep_in == ep_addr && audio->alt_setting != 0)
+    for (uint8_t stream = 0; stream < audio->n_stream_in; stream++)
     {
+      if (audio->stream_in[stream].ep != ep_addr || audio->alt_setting == 0) continue;
+
       // USB 2.0, section 5.6.4, third paragraph, states "An isochronous endpoint must specify its required bus access period. However, an isochronous endpoint must be prepared to handle poll rates faster than the one specified."
       // That paragraph goes on to say "An isochronous IN endpoint must return a zero-length packet whenever data is requested at a faster interval than the specified interval and data is not available."
       // This can only be solved reliably if we load a ZLP after every IN transmission since we can not say if the host requests samples earlier than we declared! Once all samples are collected we overwrite the loaded ZLP.
@@ -2013,7 +2567,7 @@ bool audiod_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint3
       // This is the only place where we can fill something into the EPs buffer!
 
       // Load new data
-      TU_VERIFY(audiod_tx_done_cb(rhport, audio));
+      TU_VERIFY(audiod_tx_done_cb(rhport, audio, stream));
 
       // Transmission of ZLP is done by audiod_tx_done_cb()
       return true;
@@ -2023,9 +2577,11 @@ bool audiod_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint3
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
 
     // New audio packet received
-    if (audio->ep_out == ep_addr)
+    for (uint8_t stream = 0; stream < audio->n_stream_out; stream++)
     {
-      TU_VERIFY(audiod_rx_done_cb(rhport, audio, (uint16_t) xferred_bytes));
+      if (audio->stream_out[stream].ep != ep_addr) continue;
+
+      TU_VERIFY(audiod_rx_done_cb(rhport, audio, stream, (uint16_t) xferred_bytes));
       return true;
     }
 
@@ -2129,6 +2685,11 @@ TU_ATTR_FAST_FUNC void audiod_sof_isr (uint8_t rhport, uint32_t frame_count)
   (void) rhport;
   (void) frame_count;
 
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+  _audiod_trace.sof_time  = audiod_trace_time();
+  _audiod_trace.sof_frame = (uint16_t) frame_count;
+#endif
+
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
   // Determine feedback value - The feedback method is described in 5.12.4.2 of the USB 2.0 spec
   // Boiled down, the feedback value Ff = n_samples / (micro)frame.
@@ -2145,16 +2706,91 @@ TU_ATTR_FAST_FUNC void audiod_sof_isr (uint8_t rhport, uint32_t frame_count)
     {
       // HS shift need to be adjusted since SOF event is generated for frame only
       uint8_t const hs_adjust = (TUSB_SPEED_HIGH == tud_speed_get()) ? 3 : 0;
-      uint32_t const interval = 1UL << (audio->feedback.frame_shift - hs_adjust);
+      // SOF is only generated every frame, shorter intervals are served every frame
+      uint32_t const interval = (audio->feedback.frame_shift > hs_adjust) ? (1UL << (audio->feedback.frame_shift - hs_adjust)) : 1;
       if ( 0 == (frame_count & (interval-1)) )
       {
+        if (AUDIO_FEEDBACK_METHOD_FIFO_COUNT == audio->feedback.compute_method)
+        {
+#if CFG_TUD_AUDIO_ENABLE_DECODING
+          uint16_t const level = tu_fifo_count(&audio->rx_supp_ff[0]);
+#else
+          uint16_t const level = tu_fifo_count(&audio->ep_out_ff[0]);
+#endif
+          tud_audio_n_fb_set(i, audiod_fb_fifo_count_update(&audio->feedback.compute.fifo_count, level,
+                                                             audio->feedback.min_value, audio->feedback.max_value));
+        }
+
         if(tud_audio_feedback_interval_isr) tud_audio_feedback_interval_isr(i, frame_count, audio->feedback.frame_shift);
       }
     }
   }
 #endif // CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
+
+#if USE_ASRC_RX || USE_ASRC_TX
+  // Track converter ratios from level of first support FIFO in frames, SOF event is generated every 1 ms frame
+  for(uint8_t i=0; i < CFG_TUD_AUDIO; i++)
+  {
+    audiod_function_t* audio = &_audiod_fct[i];
+
+#if USE_ASRC_RX
+    if (audio->stream_out[0].ep != 0 && audio->asrc_rx.in_rate != 0)
+    {
+      uint16_t const level = tu_fifo_count(&audio->rx_supp_ff[0]) / audiod_rx_supp_ff_sample_size(audio);
+      audiod_asrc_tracker_update(&audio->asrc_rx.tracker, level);
+    }
+#endif
+
+#if USE_ASRC_TX
+    if (audio->stream_in[0].ep != 0 && audio->asrc_tx.in_rate != 0)
+    {
+      uint16_t const level = tu_fifo_count(&audio->tx_supp_ff[0]) / audiod_tx_supp_ff_sample_size(audio);
+      audiod_asrc_tracker_update(&audio->asrc_tx.tracker, level);
+    }
+#endif
+  }
+#endif
+}
+
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+
+static inline uint32_t audiod_trace_begin(audio_trace_record_t* rec, audiod_function_t* audio, uint8_t ep)
+{
+  uint32_t const now = audiod_trace_time();
+
+  rec->frame      = _audiod_trace.sof_frame;
+  rec->sof_offset = now - _audiod_trace.sof_time;
+  rec->func_id    = audiod_get_audio_fct_idx(audio);
+  rec->ep         = ep;
+
+  return now;
+}
+
+uint16_t tud_audio_trace_read(audio_trace_record_t* records, uint16_t max_records)
+{
+  return tu_fifo_read_n(&_audiod_trace.ff, records, max_records);
+}
+
+void tud_audio_trace_clear(void)
+{
+  tu_fifo_clear(&_audiod_trace.ff);
 }
 
+bool tud_audio_trace_control_xfer(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request)
+{
+  // nothing to do with DATA & ACK stage
+  if (stage != CONTROL_STAGE_SETUP) return true;
+
+  TU_VERIFY(request->bmRequestType_bit.direction == TUSB_DIR_IN);
+
+  uint16_t const n_max = tu_min16((uint16_t) (request->wLength / sizeof(audio_trace_record_t)), CFG_TUD_AUDIO_TRACE_XFER_N);
+  uint16_t const n     = tud_audio_trace_read(_audiod_trace.xfer_buf, n_max);
+
+  return tud_control_xfer(rhport, request, _audiod_trace.xfer_buf, (uint16_t) (n * sizeof(audio_trace_record_t)));
+}
+
+#endif
+
 bool tud_audio_buffer_and_schedule_control_xfer(uint8_t rhport, tusb_control_request_t const * p_request, void* data, uint16_t len)
 {
   // Handles only sending of data not receiving
@@ -2350,13 +2986,13 @@ static bool audiod_verify_ep_exists(uint8_t ep, uint8_t *func_id)
 static void audiod_parse_for_AS_params(audiod_function_t* audio, uint8_t const * p_desc, uint8_t const * p_desc_end, uint8_t const as_itf)
 {
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_EP_OUT
-  if (as_itf != audio->ep_in_as_intf_num && as_itf != audio->ep_out_as_intf_num) return;           // Abort, this interface has no EP, this driver does not support this currently
+  if (as_itf != audio->stream_in[0].as_intf_num && as_itf != audio->stream_out[0].as_intf_num) return;           // Abort, this interface has no EP, this driver does not support this currently
 #endif
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_EP_OUT
-  if (as_itf != audio->ep_in_as_intf_num) return;
+  if (as_itf != audio->stream_in[0].as_intf_num) return;
 #endif
 #if !CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_EP_OUT
-  if (as_itf != audio->ep_out_as_intf_num) return;
+  if (as_itf != audio->stream_out[0].as_intf_num) return;
 #endif
 
   p_desc = tu_desc_next(p_desc);    // Exclude standard AS interface descriptor of current alternate interface descriptor
@@ -2370,7 +3006,7 @@ static void audiod_parse_for_AS_params(audiod_function_t* audio, uint8_t const *
     if (tu_desc_type(p_desc) == TUSB_DESC_CS_INTERFACE && tu_desc_subtype(p_desc) == AUDIO_CS_AS_INTERFACE_AS_GENERAL)
     {
 #if CFG_TUD_AUDIO_ENABLE_EP_IN
-      if (as_itf == audio->ep_in_as_intf_num)
+      if (as_itf == audio->stream_in[0].as_intf_num)
       {
         audio->n_channels_tx = ((audio_desc_cs_as_interface_t const * )p_desc)->bNrChannels;
         audio->format_type_tx = (audio_format_type_t)(((audio_desc_cs_as_interface_t const * )p_desc)->bFormatType);
@@ -2382,7 +3018,7 @@ static void audiod_parse_for_AS_params(audiod_function_t* audio, uint8_t const *
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
-      if (as_itf == audio->ep_out_as_intf_num)
+      if (as_itf == audio->stream_out[0].as_intf_num)
       {
         audio->n_channels_rx = ((audio_desc_cs_as_interface_t const * )p_desc)->bNrChannels;
         audio->format_type_rx = ((audio_desc_cs_as_interface_t const * )p_desc)->bFormatType;
@@ -2398,24 +3034,24 @@ static void audiod_parse_for_AS_params(audiod_function_t* audio, uint8_t const *
     if (tu_desc_type(p_desc) == TUSB_DESC_CS_INTERFACE && tu_desc_subtype(p_desc) == AUDIO_CS_AS_INTERFACE_FORMAT_TYPE && ((audio_desc_type_I_format_t const * )p_desc)->bFormatType == AUDIO_FORMAT_TYPE_I)
     {
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_EP_OUT
-      if (as_itf != audio->ep_in_as_intf_num && as_itf != audio->ep_out_as_intf_num) break;           // Abort loop, this interface has no EP, this driver does not support this currently
+      if (as_itf != audio->stream_in[0].as_intf_num && as_itf != audio->stream_out[0].as_intf_num) break;           // Abort loop, this interface has no EP, this driver does not support this currently
 #endif
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_EP_OUT
-      if (as_itf != audio->ep_in_as_intf_num) break;
+      if (as_itf != audio->stream_in[0].as_intf_num) break;
 #endif
 #if !CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_EP_OUT
-      if (as_itf != audio->ep_out_as_intf_num) break;
+      if (as_itf != audio->stream_out[0].as_intf_num) break;
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN
-      if (as_itf == audio->ep_in_as_intf_num)
+      if (as_itf == audio->stream_in[0].as_intf_num)
       {
         audio->n_bytes_per_sampe_tx = ((audio_desc_type_I_format_t const * )p_desc)->bSubslotSize;
       }
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
-      if (as_itf == audio->ep_out_as_intf_num)
+      if (as_itf == audio->stream_out[0].as_intf_num)
       {
         audio->n_bytes_per_sampe_rx = ((audio_desc_type_I_format_t const * )p_desc)->bSubslotSize;
       }
@@ -29,6 +29,8 @@
 #define _TUSB_AUDIO_DEVICE_H_
 
 #include "audio.h"
+#include "audio_pcm.h"
+#include "audio_asrc.h"
 
 //--------------------------------------------------------------------+
 // Class Driver Configuration
@@ -181,6 +183,29 @@
 #endif
 #endif
 
+// Number of streaming OUT (RX) and IN (TX) endpoints per audio function i.e. number of AS interfaces with an OUT resp. IN data EP.
+// Streams are numbered in descriptor order, each stream gets its own EP software FIFO of size EP_X_SW_BUF_SZ and linear buffer of
+// size EP_X_SZ_MAX. Software coding, format conversion, ASRC and the feedback EP are available for stream 0 only.
+#ifndef CFG_TUD_AUDIO_FUNC_1_N_EP_OUT
+#define CFG_TUD_AUDIO_FUNC_1_N_EP_OUT                       1
+#endif
+#ifndef CFG_TUD_AUDIO_FUNC_2_N_EP_OUT
+#define CFG_TUD_AUDIO_FUNC_2_N_EP_OUT                       1
+#endif
+#ifndef CFG_TUD_AUDIO_FUNC_3_N_EP_OUT
+#define CFG_TUD_AUDIO_FUNC_3_N_EP_OUT                       1
+#endif
+
+#ifndef CFG_TUD_AUDIO_FUNC_1_N_EP_IN
+#define CFG_TUD_AUDIO_FUNC_1_N_EP_IN                        1
+#endif
+#ifndef CFG_TUD_AUDIO_FUNC_2_N_EP_IN
+#define CFG_TUD_AUDIO_FUNC_2_N_EP_IN                        1
+#endif
+#ifndef CFG_TUD_AUDIO_FUNC_3_N_EP_IN
+#define CFG_TUD_AUDIO_FUNC_3_N_EP_IN                        1
+#endif
+
 // Enable/disable feedback EP (required for asynchronous RX applications)
 #ifndef CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
 #define CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP                    0                             // Feedback - 0 or 1
@@ -200,6 +225,19 @@
 #define CFG_TUD_AUDIO_INT_CTR_EP_IN_SW_BUFFER_SIZE          6                             // Buffer size of audio control interrupt EP - 6 Bytes according to UAC 2 specification (p. 74)
 #endif
 
+// Enable/disable recording of a trace record for each ISO data packet, see tud_audio_trace_read(). Enables SOF interrupt while streaming.
+#ifndef CFG_TUD_AUDIO_ENABLE_TRACE
+#define CFG_TUD_AUDIO_ENABLE_TRACE                          0                             // 0 or 1
+#endif
+
+#ifndef CFG_TUD_AUDIO_TRACE_DEPTH
+#define CFG_TUD_AUDIO_TRACE_DEPTH                           64                            // Number of records kept, oldest ones are overwritten
+#endif
+
+#ifndef CFG_TUD_AUDIO_TRACE_XFER_N
+#define CFG_TUD_AUDIO_TRACE_XFER_N                          8                             // Maximum number of records returned by one tud_audio_trace_control_xfer()
+#endif
+
 // Use software encoding/decoding
 
 // The software coding feature of the driver is not mandatory. It is useful if, for instance, you have two I2S streams which need to be interleaved
@@ -263,6 +301,35 @@
 #define CFG_TUD_AUDIO_ENABLE_TYPE_I_DECODING                0
 #endif
 
+// Convert samples between the format of the active alternate setting and the format the support FIFOs are set to with
+// tud_audio_n_set_rx_support_ff_format() / tud_audio_n_set_tx_support_ff_format() while decoding/encoding. This way the
+// application sees e.g. float samples no matter if host selected a 16 or 24 bit alternate setting. The active FIFO depth is
+// then a multiple of the sample size in FIFO format.
+#ifndef CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+#define CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION              0
+#endif
+
+// Asynchronous sample rate conversion between support FIFOs and application (CFG_TUD_AUDIO_ENABLE_ASRC, see audio_asrc.h)
+// works on support FIFOs in AUDIO_PCM_FORMAT_S32 or AUDIO_PCM_FORMAT_F32, hence requires format conversion.
+// Maximum number of support FIFOs per direction the converter is run for.
+#ifndef CFG_TUD_AUDIO_ASRC_MAX_FF
+#define CFG_TUD_AUDIO_ASRC_MAX_FF                           2
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_ASRC && !CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+#error CFG_TUD_AUDIO_ENABLE_ASRC requires CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING && \
+    (CFG_TUD_AUDIO_FUNC_1_N_EP_OUT > 1 || (CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_N_EP_OUT > 1) || (CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_N_EP_OUT > 1))
+#error Software decoding supports a single OUT stream per audio function only
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING && \
+    (CFG_TUD_AUDIO_FUNC_1_N_EP_IN > 1 || (CFG_TUD_AUDIO > 1 && CFG_TUD_AUDIO_FUNC_2_N_EP_IN > 1) || (CFG_TUD_AUDIO > 2 && CFG_TUD_AUDIO_FUNC_3_N_EP_IN > 1))
+#error Software encoding supports a single IN stream per audio function only
+#endif
+
 // Type I Coding parameters not given within UAC2 descriptors
 // It would be possible to allow for a more flexible setting and not fix this parameter as done below. However, this is most often not needed and kept for later if really necessary. The more flexible setting could be implemented within set_interface(), however, how the values are saved per alternate setting is to be determined!
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING && CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING
@@ -366,6 +433,18 @@ uint16_t tud_audio_n_available                    (uint8_t func_id);
 uint16_t tud_audio_n_read                         (uint8_t func_id, void* buffer, uint16_t bufsize);
 bool     tud_audio_n_clear_ep_out_ff              (uint8_t func_id);                          // Delete all content in the EP OUT FIFO
 tu_fifo_t*   tud_audio_n_get_ep_out_ff            (uint8_t func_id);
+
+// Same as above for OUT stream number 'stream' (see CFG_TUD_AUDIO_FUNC_X_N_EP_OUT), above functions access stream 0
+uint16_t tud_audio_n_stream_available             (uint8_t func_id, uint8_t stream);
+uint16_t tud_audio_n_stream_read                  (uint8_t func_id, uint8_t stream, void* buffer, uint16_t bufsize);
+bool     tud_audio_n_stream_clear_ep_out_ff       (uint8_t func_id, uint8_t stream);
+tu_fifo_t*   tud_audio_n_stream_get_ep_out_ff     (uint8_t func_id, uint8_t stream);
+
+// Use an application owned ring buffer as EP OUT FIFO of a stream instead of the internal one, buffer = NULL restores the
+// internal one. Only while stream is not active. Packets are received straight into the ring as long as they fit in without
+// wrap around, application consumes with tu_fifo_get_read_info() and tu_fifo_advance_read_pointer() on the EP OUT FIFO.
+// Ring must be accessible by the USB controller (see CFG_TUSB_MEM_SECTION and CFG_TUSB_MEM_ALIGN).
+bool     tud_audio_n_stream_set_ep_out_ff_buf     (uint8_t func_id, uint8_t stream, void* buffer, uint16_t depth);
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING
@@ -373,12 +452,31 @@ bool     tud_audio_n_clear_rx_support_ff          (uint8_t func_id, uint8_t ff_i
 uint16_t tud_audio_n_available_support_ff         (uint8_t func_id, uint8_t ff_idx);
 uint16_t tud_audio_n_read_support_ff              (uint8_t func_id, uint8_t ff_idx, void* buffer, uint16_t bufsize);
 tu_fifo_t* tud_audio_n_get_rx_support_ff          (uint8_t func_id, uint8_t ff_idx);
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+bool     tud_audio_n_set_rx_support_ff_format     (uint8_t func_id, audio_pcm_format_t format, audio_pcm_dither_t dither);  // Only while OUT streaming is stopped
+#endif
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+bool     tud_audio_n_set_rx_asrc                  (uint8_t func_id, uint32_t host_rate, uint32_t device_rate);        // host_rate = 0 disables converter
+uint16_t tud_audio_n_read_support_ff_asrc         (uint8_t func_id, uint8_t ff_idx, void* buffer, uint16_t n_frames); // Return frames written to buffer
+#endif
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_ENCODING
 uint16_t tud_audio_n_write                        (uint8_t func_id, const void * data, uint16_t len);
 bool     tud_audio_n_clear_ep_in_ff               (uint8_t func_id);                          // Delete all content in the EP IN FIFO
 tu_fifo_t*   tud_audio_n_get_ep_in_ff             (uint8_t func_id);
+
+// Same as above for IN stream number 'stream' (see CFG_TUD_AUDIO_FUNC_X_N_EP_IN), above functions access stream 0
+uint16_t tud_audio_n_stream_write                 (uint8_t func_id, uint8_t stream, const void * data, uint16_t len);
+bool     tud_audio_n_stream_clear_ep_in_ff        (uint8_t func_id, uint8_t stream);
+tu_fifo_t*   tud_audio_n_stream_get_ep_in_ff      (uint8_t func_id, uint8_t stream);
+
+// Use an application owned ring buffer e.g. circular buffer of an I2S DMA as EP IN FIFO of a stream instead of the internal one,
+// buffer = NULL restores the internal one. Only while stream is not active. Application announces new data by
+// tu_fifo_advance_write_pointer() on the EP IN FIFO, packets are transmitted straight out of the ring as long as they do not
+// wrap around. Space is handed back by tud_audio_ep_in_ff_consumed_cb() once the packet is sent. Ring must be accessible by
+// the USB controller (see CFG_TUSB_MEM_SECTION and CFG_TUSB_MEM_ALIGN).
+bool     tud_audio_n_stream_set_ep_in_ff_buf      (uint8_t func_id, uint8_t stream, void* buffer, uint16_t depth);
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING
@@ -386,6 +484,13 @@ uint16_t tud_audio_n_flush_tx_support_ff          (uint8_t func_id);      // For
 bool     tud_audio_n_clear_tx_support_ff          (uint8_t func_id, uint8_t ff_idx);
 uint16_t tud_audio_n_write_support_ff             (uint8_t func_id, uint8_t ff_idx, const void * data, uint16_t len);
 tu_fifo_t* tud_audio_n_get_tx_support_ff          (uint8_t func_id, uint8_t ff_idx);
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+bool     tud_audio_n_set_tx_support_ff_format     (uint8_t func_id, audio_pcm_format_t format, audio_pcm_dither_t dither);  // Only while IN streaming is stopped
+#endif
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+bool     tud_audio_n_set_tx_asrc                  (uint8_t func_id, uint32_t device_rate, uint32_t host_rate);              // device_rate = 0 disables converter
+uint16_t tud_audio_n_write_support_ff_asrc        (uint8_t func_id, uint8_t ff_idx, const void * data, uint16_t n_frames);  // Return frames taken from data
+#endif
 #endif
 
 #if CFG_TUD_AUDIO_INT_CTR_EPSIZE_IN
@@ -405,6 +510,11 @@ static inline uint16_t     tud_audio_available              (void);
 static inline bool         tud_audio_clear_ep_out_ff        (void);                       // Delete all content in the EP OUT FIFO
 static inline uint16_t     tud_audio_read                   (void* buffer, uint16_t bufsize);
 static inline tu_fifo_t*   tud_audio_get_ep_out_ff          (void);
+static inline uint16_t     tud_audio_stream_available       (uint8_t stream);
+static inline uint16_t     tud_audio_stream_read            (uint8_t stream, void* buffer, uint16_t bufsize);
+static inline bool         tud_audio_stream_clear_ep_out_ff (uint8_t stream);
+static inline tu_fifo_t*   tud_audio_stream_get_ep_out_ff   (uint8_t stream);
+static inline bool         tud_audio_stream_set_ep_out_ff_buf (uint8_t stream, void* buffer, uint16_t depth);
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING
@@ -412,6 +522,13 @@ static inline bool     tud_audio_clear_rx_support_ff        (uint8_t ff_idx);
 static inline uint16_t tud_audio_available_support_ff       (uint8_t ff_idx);
 static inline uint16_t tud_audio_read_support_ff            (uint8_t ff_idx, void* buffer, uint16_t bufsize);
 static inline tu_fifo_t* tud_audio_get_rx_support_ff        (uint8_t ff_idx);
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+static inline bool     tud_audio_set_rx_support_ff_format   (audio_pcm_format_t format, audio_pcm_dither_t dither);
+#endif
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+static inline bool     tud_audio_set_rx_asrc                (uint32_t host_rate, uint32_t device_rate);
+static inline uint16_t tud_audio_read_support_ff_asrc       (uint8_t ff_idx, void* buffer, uint16_t n_frames);
+#endif
 #endif
 
 // TX API
@@ -420,6 +537,10 @@ static inline tu_fifo_t* tud_audio_get_rx_support_ff        (uint8_t ff_idx);
 static inline uint16_t tud_audio_write                      (const void * data, uint16_t len);
 static inline bool 	   tud_audio_clear_ep_in_ff             (void);
 static inline tu_fifo_t* tud_audio_get_ep_in_ff             (void);
+static inline uint16_t tud_audio_stream_write               (uint8_t stream, const void * data, uint16_t len);
+static inline bool     tud_audio_stream_clear_ep_in_ff      (uint8_t stream);
+static inline tu_fifo_t* tud_audio_stream_get_ep_in_ff      (uint8_t stream);
+static inline bool     tud_audio_stream_set_ep_in_ff_buf    (uint8_t stream, void* buffer, uint16_t depth);
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING
@@ -427,6 +548,13 @@ static inline uint16_t tud_audio_flush_tx_support_ff        (void);
 static inline uint16_t tud_audio_clear_tx_support_ff        (uint8_t ff_idx);
 static inline uint16_t tud_audio_write_support_ff           (uint8_t ff_idx, const void * data, uint16_t len);
 static inline tu_fifo_t* tud_audio_get_tx_support_ff        (uint8_t ff_idx);
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+static inline bool     tud_audio_set_tx_support_ff_format   (audio_pcm_format_t format, audio_pcm_dither_t dither);
+#endif
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+static inline bool     tud_audio_set_tx_asrc                (uint32_t device_rate, uint32_t host_rate);
+static inline uint16_t tud_audio_write_support_ff_asrc      (uint8_t ff_idx, const void * data, uint16_t n_frames);
+#endif
 #endif
 
 // INT CTR API
@@ -443,6 +571,31 @@ static inline uint16_t tud_audio_int_ctr_write              (uint8_t const* buff
 // If the request's wLength is zero, a status packet is sent instead.
 bool tud_audio_buffer_and_schedule_control_xfer(uint8_t rhport, tusb_control_request_t const * p_request, void* data, uint16_t len);
 
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+// Trace record of one ISO data packet, sent in MCU byte order by tud_audio_trace_control_xfer().
+// Times are in units of tud_audio_trace_timestamp_cb() and zero if callback is not implemented.
+typedef struct {
+  uint16_t frame;         // Number of last SOF before the packet was handled
+  uint8_t  func_id;
+  uint8_t  ep;            // Data EP address, IN packets have bit 7 set
+  uint16_t n_bytes;       // Size of packet received resp. scheduled for transmission
+  uint16_t ff_count;      // Fill level in bytes of EP FIFO (first support FIFO if coding is used) after packet was handled
+  uint32_t sof_offset;    // Time from last SOF until packet was handled
+  uint32_t proc_time;     // Time spent decoding resp. encoding (or copying) the packet
+  uint32_t fb_value;      // Feedback value last set for OUT stream 0 (10.14 resp. 16.16 format), zero otherwise
+} audio_trace_record_t;
+
+TU_VERIFY_STATIC(sizeof(audio_trace_record_t) == 20, "size is not correct");
+
+// Move up to max_records oldest trace records of all audio functions into records, return number of records
+uint16_t tud_audio_trace_read(audio_trace_record_t* records, uint16_t max_records);
+void     tud_audio_trace_clear(void);
+
+// Answer a device-to-host vendor request with trace records (up to wLength resp. CFG_TUD_AUDIO_TRACE_XFER_N), to be invoked
+// by the application from tud_vendor_control_xfer_cb() for the request code it assigned to tracing, see tools/audio_trace_plot.py
+bool     tud_audio_trace_control_xfer(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request);
+#endif
+
 //--------------------------------------------------------------------+
 // Application Callback API (weak is optional)
 //--------------------------------------------------------------------+
@@ -452,6 +605,11 @@ TU_ATTR_WEAK bool tud_audio_tx_done_pre_load_cb(uint8_t rhport, uint8_t func_id,
 TU_ATTR_WEAK bool tud_audio_tx_done_post_load_cb(uint8_t rhport, uint16_t n_bytes_copied, uint8_t func_id, uint8_t ep_in, uint8_t cur_alt_setting);
 #endif
 
+#if CFG_TUD_AUDIO_ENABLE_EP_IN && !CFG_TUD_AUDIO_ENABLE_ENCODING
+// Invoked when a packet of a stream using an application ring (see tud_audio_n_stream_set_ep_in_ff_buf()) was sent, its n_bytes can be overwritten now
+TU_ATTR_WEAK void tud_audio_ep_in_ff_consumed_cb(uint8_t func_id, uint8_t stream, uint16_t n_bytes);
+#endif
+
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT
 TU_ATTR_WEAK bool tud_audio_rx_done_pre_read_cb(uint8_t rhport, uint16_t n_bytes_received, uint8_t func_id, uint8_t ep_out, uint8_t cur_alt_setting);
 TU_ATTR_WEAK bool tud_audio_rx_done_post_read_cb(uint8_t rhport, uint16_t n_bytes_received, uint8_t func_id, uint8_t ep_out, uint8_t cur_alt_setting);
@@ -499,8 +657,10 @@ enum {
   AUDIO_FEEDBACK_METHOD_FREQUENCY_FLOAT,
   AUDIO_FEEDBACK_METHOD_FREQUENCY_POWER_OF_2,
 
-  // impelemnt later
-  // AUDIO_FEEDBACK_METHOD_FIFO_COUNT
+  // Feedback is computed by the driver at each feedback interval from the level of the EP OUT FIFO (or first support RX FIFO
+  // if decoding is enabled), no clock measurement is needed. The application should start consuming samples once the FIFO
+  // has reached about the target level and then consume at its own (nominal) sample rate.
+  AUDIO_FEEDBACK_METHOD_FIFO_COUNT
 };
 
 typedef struct {
@@ -512,11 +672,9 @@ typedef struct {
       uint32_t mclk_freq; // Main clock frequency in Hz i.e. master clock to which sample clock is based on
     }frequency;
 
-#if 0 // implement later
     struct {
-      uint32_t threshold_bytes; // minimum number of bytes received to be considered as filled/ready
+      uint16_t target_bytes;    // FIFO level in bytes to regulate to, 0 for half of the FIFO depth
     }fifo_count;
-#endif
   };
 }audio_feedback_params_t;
 
@@ -535,6 +693,11 @@ TU_ATTR_WEAK TU_ATTR_FAST_FUNC void tud_audio_feedback_interval_isr(uint8_t func
 TU_ATTR_WEAK bool tud_audio_int_ctr_done_cb(uint8_t rhport, uint16_t n_bytes_copied);
 #endif
 
+#if CFG_TUD_AUDIO_ENABLE_TRACE
+// Return a free running timestamp e.g. CPU cycle counter, used for the timing fields of trace records. Invoked from ISR (SOF) and task context.
+TU_ATTR_WEAK uint32_t tud_audio_trace_timestamp_cb(void);
+#endif
+
 // Invoked when audio set interface request received
 TU_ATTR_WEAK bool tud_audio_set_itf_cb(uint8_t rhport, tusb_control_request_t const * p_request);
 
@@ -592,6 +755,31 @@ static inline tu_fifo_t* tud_audio_get_ep_out_ff(void)
   return tud_audio_n_get_ep_out_ff(0);
 }
 
+static inline uint16_t tud_audio_stream_available(uint8_t stream)
+{
+  return tud_audio_n_stream_available(0, stream);
+}
+
+static inline uint16_t tud_audio_stream_read(uint8_t stream, void* buffer, uint16_t bufsize)
+{
+  return tud_audio_n_stream_read(0, stream, buffer, bufsize);
+}
+
+static inline bool tud_audio_stream_clear_ep_out_ff(uint8_t stream)
+{
+  return tud_audio_n_stream_clear_ep_out_ff(0, stream);
+}
+
+static inline tu_fifo_t* tud_audio_stream_get_ep_out_ff(uint8_t stream)
+{
+  return tud_audio_n_stream_get_ep_out_ff(0, stream);
+}
+
+static inline bool tud_audio_stream_set_ep_out_ff_buf(uint8_t stream, void* buffer, uint16_t depth)
+{
+  return tud_audio_n_stream_set_ep_out_ff_buf(0, stream, buffer, depth);
+}
+
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_OUT && CFG_TUD_AUDIO_ENABLE_DECODING
@@ -616,6 +804,25 @@ static inline tu_fifo_t* tud_audio_get_rx_support_ff(uint8_t ff_idx)
   return tud_audio_n_get_rx_support_ff(0, ff_idx);
 }
 
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+static inline bool tud_audio_set_rx_support_ff_format(audio_pcm_format_t format, audio_pcm_dither_t dither)
+{
+  return tud_audio_n_set_rx_support_ff_format(0, format, dither);
+}
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+static inline bool tud_audio_set_rx_asrc(uint32_t host_rate, uint32_t device_rate)
+{
+  return tud_audio_n_set_rx_asrc(0, host_rate, device_rate);
+}
+
+static inline uint16_t tud_audio_read_support_ff_asrc(uint8_t ff_idx, void* buffer, uint16_t n_frames)
+{
+  return tud_audio_n_read_support_ff_asrc(0, ff_idx, buffer, n_frames);
+}
+#endif
+
 #endif
 
 // TX API
@@ -637,6 +844,26 @@ static inline tu_fifo_t* tud_audio_get_ep_in_ff(void)
   return tud_audio_n_get_ep_in_ff(0);
 }
 
+static inline uint16_t tud_audio_stream_write(uint8_t stream, const void * data, uint16_t len)
+{
+  return tud_audio_n_stream_write(0, stream, data, len);
+}
+
+static inline bool tud_audio_stream_clear_ep_in_ff(uint8_t stream)
+{
+  return tud_audio_n_stream_clear_ep_in_ff(0, stream);
+}
+
+static inline tu_fifo_t* tud_audio_stream_get_ep_in_ff(uint8_t stream)
+{
+  return tud_audio_n_stream_get_ep_in_ff(0, stream);
+}
+
+static inline bool tud_audio_stream_set_ep_in_ff_buf(uint8_t stream, void* buffer, uint16_t depth)
+{
+  return tud_audio_n_stream_set_ep_in_ff_buf(0, stream, buffer, depth);
+}
+
 #endif
 
 #if CFG_TUD_AUDIO_ENABLE_EP_IN && CFG_TUD_AUDIO_ENABLE_ENCODING
@@ -661,6 +888,25 @@ static inline tu_fifo_t* tud_audio_get_tx_support_ff(uint8_t ff_idx)
   return tud_audio_n_get_tx_support_ff(0, ff_idx);
 }
 
+#if CFG_TUD_AUDIO_ENABLE_FORMAT_CONVERSION
+static inline bool tud_audio_set_tx_support_ff_format(audio_pcm_format_t format, audio_pcm_dither_t dither)
+{
+  return tud_audio_n_set_tx_support_ff_format(0, format, dither);
+}
+#endif
+
+#if CFG_TUD_AUDIO_ENABLE_ASRC
+static inline bool tud_audio_set_tx_asrc(uint32_t device_rate, uint32_t host_rate)
+{
+  return tud_audio_n_set_tx_asrc(0, device_rate, host_rate);
+}
+
+static inline uint16_t tud_audio_write_support_ff_asrc(uint8_t ff_idx, const void * data, uint16_t n_frames)
+{
+  return tud_audio_n_write_support_ff_asrc(0, ff_idx, data, n_frames);
+}
+#endif
+
 #endif
 
 #if CFG_TUD_AUDIO_INT_CTR_EPSIZE_IN
@@ -0,0 +1,86 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if (CFG_TUD_ENABLED && CFG_TUD_AUDIO)
+
+#include "audio_feedback.h"
+
+//--------------------------------------------------------------------+
+// Feedback from FIFO level
+//--------------------------------------------------------------------+
+
+void audiod_fb_fifo_count_init(audiod_fb_fifo_count_t* fc, uint32_t nominal_value, uint16_t level_target, uint16_t slot_size, uint8_t update_shift)
+{
+  fc->nominal_value = nominal_value;
+  fc->level_target  = level_target;
+  fc->level_avg     = (uint32_t) level_target << 16; // Filter starts at target, so that its settling is not integrated
+  fc->integral      = 0;
+
+  // Level error is converted to samples and scaled by the number of (micro)frames the correction is applied for until
+  // next update, such that the proportional term alone corrects 1/2^AUDIOD_FB_KP_SHIFT of the error per update
+  fc->p_div = (uint32_t) tu_max16(slot_size, 1) << (update_shift + AUDIOD_FB_KP_SHIFT);
+}
+
+uint32_t audiod_fb_fifo_count_update(audiod_fb_fifo_count_t* fc, uint16_t level, uint32_t min_value, uint32_t max_value)
+{
+  // Exponential moving average, smooths out the level jumps by whole packets
+  int64_t const delta = ((int64_t) level << 16) - fc->level_avg;
+  fc->level_avg = (uint32_t) ((int64_t) fc->level_avg + delta / (1 << AUDIOD_FB_LPF_SHIFT));
+
+  // Error in 16.16 bytes, positive if host sends too fast
+  int64_t const error = (int64_t) fc->level_avg - ((int64_t) fc->level_target << 16);
+
+  // Proportional term in 16.16 samples per (micro)frame
+  int32_t const p = (int32_t) (error / (int64_t) fc->p_div);
+
+  // Integral is bound to +/- one sample per (micro)frame, which is the maximum deviation allowed anyway
+  int32_t const i_max = (int32_t) (1UL << (16 + AUDIOD_FB_KI_SHIFT));
+  int32_t integral = fc->integral + p;
+  if (integral >  i_max) integral =  i_max;
+  if (integral < -i_max) integral = -i_max;
+
+  int64_t feedback = (int64_t) fc->nominal_value - p - integral / (1 << AUDIOD_FB_KI_SHIFT);
+
+  // Anti windup: only integrate while the output is not saturated, e.g. while the FIFO is filled initially
+  if (feedback > (int64_t) max_value)
+  {
+    feedback = max_value;
+  }
+  else if (feedback < (int64_t) min_value)
+  {
+    feedback = min_value;
+  }
+  else
+  {
+    fc->integral = integral;
+  }
+
+  return (uint32_t) feedback;
+}
+
+#endif
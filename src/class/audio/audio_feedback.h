@@ -0,0 +1,70 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_AUDIO_FEEDBACK_H_
+#define _TUSB_AUDIO_FEEDBACK_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Internal feedback computation from FIFO level (AUDIO_FEEDBACK_METHOD_FIFO_COUNT) for asynchronous sinks without
+// a master clock counter. FIFO level is low pass filtered and a PI controller steers the feedback value such that
+// the host sends slightly more or less samples until the level settles at the target.
+//--------------------------------------------------------------------+
+
+// Low pass filter of FIFO level: level_avg += (level - level_avg) / 2^AUDIOD_FB_LPF_SHIFT per update
+#define AUDIOD_FB_LPF_SHIFT   3
+
+// Proportional gain: 1/2^AUDIOD_FB_KP_SHIFT of the level error (in samples) is corrected per update
+#define AUDIOD_FB_KP_SHIFT    4
+
+// Integral time in updates is 2^AUDIOD_FB_KI_SHIFT, chosen as 4 times the proportional time constant for critical damping
+#define AUDIOD_FB_KI_SHIFT    6
+
+typedef struct
+{
+  uint32_t nominal_value; // Feedback value at target level in 16.16
+  uint32_t level_avg;     // Low pass filtered FIFO level in 16.16 bytes
+  int32_t  integral;      // Sum of proportional terms, 16.16 << AUDIOD_FB_KI_SHIFT
+  uint32_t p_div;         // Bytes per slot << (update_shift + AUDIOD_FB_KP_SHIFT)
+  uint16_t level_target;  // Target FIFO level in bytes
+} audiod_fb_fifo_count_t;
+
+// slot_size: bytes of one sample of all channels in FIFO, update_shift: log2 of (micro)frames between updates
+void audiod_fb_fifo_count_init(audiod_fb_fifo_count_t* fc, uint32_t nominal_value, uint16_t level_target, uint16_t slot_size, uint8_t update_shift);
+
+// Feed current FIFO level, return new feedback value in 16.16 clamped to [min_value, max_value]
+uint32_t audiod_fb_fifo_count_update(audiod_fb_fifo_count_t* fc, uint16_t level, uint32_t min_value, uint32_t max_value);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_AUDIO_FEEDBACK_H_ */
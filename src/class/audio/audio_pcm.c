@@ -0,0 +1,422 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if (CFG_TUD_ENABLED && CFG_TUD_AUDIO)
+
+#include "audio_pcm.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+
+// Word-wise kernels gather several samples into a 32-bit word with shifts, which only matches
+// the byte order of the stream on little endian. Otherwise samples are copied one by one.
+#define PCM_WORD_WISE   (TU_BYTE_ORDER == TU_LITTLE_ENDIAN)
+
+#if PCM_WORD_WISE
+TU_ATTR_ALWAYS_INLINE static inline uint32_t pcm_read24(uint8_t const * p)
+{
+  return (uint32_t) tu_unaligned_read16(p) | ((uint32_t) p[2] << 16);
+}
+
+TU_ATTR_ALWAYS_INLINE static inline void pcm_write24(uint8_t * p, uint32_t value)
+{
+  tu_unaligned_write16(p, (uint16_t) value);
+  p[2] = (uint8_t) (value >> 16);
+}
+#endif
+
+//--------------------------------------------------------------------+
+// Decode: interleaved stream -> support FIFO
+//--------------------------------------------------------------------+
+
+uint8_t const * audiod_pcm_deinterleave(void * dst, uint8_t const * src, uint16_t n_samples, uint8_t n_bytes, uint8_t n_ff_used)
+{
+  uint8_t * d = (uint8_t *) dst;
+  uint16_t const stride = (uint16_t) (n_bytes * n_ff_used);
+  uint16_t n = n_samples;
+
+  // Stream of a single FIFO is already contiguous
+  if (n_ff_used == 1)
+  {
+    memcpy(d, src, (size_t) n_samples * n_bytes);
+    return src + (size_t) n_samples * n_bytes;
+  }
+
+#if PCM_WORD_WISE
+  switch (n_bytes)
+  {
+    case 1:
+      // 4 samples per word
+      for (; n >= 4; n -= 4)
+      {
+        tu_unaligned_write32(d, (uint32_t) src[0]                  | ((uint32_t) src[stride] << 8) |
+                                ((uint32_t) src[2*stride] << 16)   | ((uint32_t) src[3*stride] << 24));
+        d   += 4;
+        src += 4*stride;
+      }
+    break;
+
+    case 2:
+      // 2 samples per word
+      for (; n >= 2; n -= 2)
+      {
+        tu_unaligned_write32(d, (uint32_t) tu_unaligned_read16(src) | ((uint32_t) tu_unaligned_read16(src + stride) << 16));
+        d   += 4;
+        src += 2*stride;
+      }
+    break;
+
+    case 3:
+      // 4 samples are packed into 3 words
+      for (; n >= 4; n -= 4)
+      {
+        uint32_t const s0 = pcm_read24(src);
+        uint32_t const s1 = pcm_read24(src + stride);
+        uint32_t const s2 = pcm_read24(src + 2*stride);
+        uint32_t const s3 = pcm_read24(src + 3*stride);
+
+        tu_unaligned_write32(d    , s0         | (s1 << 24));
+        tu_unaligned_write32(d + 4, (s1 >> 8)  | (s2 << 16));
+        tu_unaligned_write32(d + 8, (s2 >> 16) | (s3 << 8));
+        d   += 12;
+        src += 4*stride;
+      }
+    break;
+
+    case 4:
+      for (; n >= 2; n -= 2)
+      {
+        tu_unaligned_write32(d    , tu_unaligned_read32(src));
+        tu_unaligned_write32(d + 4, tu_unaligned_read32(src + stride));
+        d   += 8;
+        src += 2*stride;
+      }
+    break;
+
+    default: break;
+  }
+#endif
+
+  // Remaining samples
+  for (; n; n--)
+  {
+    memcpy(d, src, n_bytes);
+    d   += n_bytes;
+    src += stride;
+  }
+
+  return src;
+}
+
+//--------------------------------------------------------------------+
+// Encode: support FIFO -> interleaved stream
+//--------------------------------------------------------------------+
+
+uint8_t * audiod_pcm_interleave(uint8_t * dst, void const * src, uint16_t n_samples, uint8_t n_bytes, uint8_t n_ff_used)
+{
+  uint8_t const * s = (uint8_t const *) src;
+  uint16_t const stride = (uint16_t) (n_bytes * n_ff_used);
+  uint16_t n = n_samples;
+
+  // Stream of a single FIFO is contiguous
+  if (n_ff_used == 1)
+  {
+    memcpy(dst, s, (size_t) n_samples * n_bytes);
+    return dst + (size_t) n_samples * n_bytes;
+  }
+
+#if PCM_WORD_WISE
+  switch (n_bytes)
+  {
+    case 1:
+      for (; n >= 4; n -= 4)
+      {
+        uint32_t const w = tu_unaligned_read32(s);
+
+        dst[0]        = (uint8_t) w;
+        dst[stride]   = (uint8_t) (w >> 8);
+        dst[2*stride] = (uint8_t) (w >> 16);
+        dst[3*stride] = (uint8_t) (w >> 24);
+        s   += 4;
+        dst += 4*stride;
+      }
+    break;
+
+    case 2:
+      for (; n >= 2; n -= 2)
+      {
+        uint32_t const w = tu_unaligned_read32(s);
+
+        tu_unaligned_write16(dst         , (uint16_t) w);
+        tu_unaligned_write16(dst + stride, (uint16_t) (w >> 16));
+        s   += 4;
+        dst += 2*stride;
+      }
+    break;
+
+    case 3:
+      // 3 words hold 4 samples
+      for (; n >= 4; n -= 4)
+      {
+        uint32_t const w0 = tu_unaligned_read32(s);
+        uint32_t const w1 = tu_unaligned_read32(s + 4);
+        uint32_t const w2 = tu_unaligned_read32(s + 8);
+
+        pcm_write24(dst           , w0);
+        pcm_write24(dst + stride  , (w0 >> 24) | (w1 << 8));
+        pcm_write24(dst + 2*stride, (w1 >> 16) | (w2 << 16));
+        pcm_write24(dst + 3*stride, w2 >> 8);
+        s   += 12;
+        dst += 4*stride;
+      }
+    break;
+
+    case 4:
+      for (; n >= 2; n -= 2)
+      {
+        tu_unaligned_write32(dst         , tu_unaligned_read32(s));
+        tu_unaligned_write32(dst + stride, tu_unaligned_read32(s + 4));
+        s   += 8;
+        dst += 2*stride;
+      }
+    break;
+
+    default: break;
+  }
+#endif
+
+  // Remaining samples
+  for (; n; n--)
+  {
+    memcpy(dst, s, n_bytes);
+    s   += n_bytes;
+    dst += stride;
+  }
+
+  return dst;
+}
+
+//--------------------------------------------------------------------+
+// Sample format conversion
+// Every sample passes through a 32-bit left justified intermediate, so that conversion between
+// any stream and FIFO format is a load, an optional dither and a store.
+//--------------------------------------------------------------------+
+
+uint8_t audiod_pcm_format_size(uint8_t format, uint8_t n_bytes)
+{
+  switch (format)
+  {
+    case AUDIO_PCM_FORMAT_S16: return 2;
+    case AUDIO_PCM_FORMAT_S24: return 3;
+    case AUDIO_PCM_FORMAT_S32:
+    case AUDIO_PCM_FORMAT_F32: return 4;
+    default:                   return n_bytes;
+  }
+}
+
+// Resolution in bits of a FIFO format
+TU_ATTR_ALWAYS_INLINE static inline uint8_t pcm_format_bits(uint8_t format)
+{
+  return (format == AUDIO_PCM_FORMAT_S16) ? 16 : (format == AUDIO_PCM_FORMAT_S24) ? 24 : 32;
+}
+
+// Number of bits dithered away when converting from src_bits to dst_bits, 0 if no dither is needed
+TU_ATTR_ALWAYS_INLINE static inline uint8_t pcm_dither_shift(audiod_pcm_conv_t const * conv, uint8_t src_bits, uint8_t dst_bits)
+{
+  return (conv->dither != AUDIO_PCM_DITHER_NONE && src_bits > dst_bits) ? (uint8_t) (32 - dst_bits) : 0;
+}
+
+// Add noise below the LSB of the target resolution, saturating
+TU_ATTR_ALWAYS_INLINE static inline int32_t pcm_dither(audiod_pcm_conv_t * conv, int32_t value, uint8_t shift)
+{
+  // Numerical Recipes LCG, only its upper bits are used
+  uint32_t r = conv->seed * 1664525u + 1013904223u;
+  int32_t noise = (int32_t) (r >> (32 - shift));
+
+  if (conv->dither == AUDIO_PCM_DITHER_TPDF)
+  {
+    // Sum of two uniform noises, centered such that truncation has no bias
+    r = r * 1664525u + 1013904223u;
+    noise += (int32_t) (r >> (32 - shift)) - (int32_t) (1u << (shift - 1));
+  }
+  conv->seed = r;
+
+  int64_t const v = (int64_t) value + noise;
+  if (v > INT32_MAX) return INT32_MAX;
+  if (v < INT32_MIN) return INT32_MIN;
+  return (int32_t) v;
+}
+
+// Stream sample of n_bytes to 32-bit left justified
+TU_ATTR_ALWAYS_INLINE static inline int32_t pcm_load_stream(uint8_t const * p, uint8_t n_bytes)
+{
+  switch (n_bytes)
+  {
+    case 1:  return (int32_t) ((uint32_t) p[0] << 24);
+    case 2:  return (int32_t) (((uint32_t) p[0] << 16) | ((uint32_t) p[1] << 24));
+    case 3:  return (int32_t) (((uint32_t) p[0] << 8) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 24));
+    default: return (int32_t) ((uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24));
+  }
+}
+
+// 32-bit left justified to stream sample of n_bytes, lower bits are truncated
+TU_ATTR_ALWAYS_INLINE static inline void pcm_store_stream(uint8_t * p, int32_t value, uint8_t n_bytes)
+{
+  uint32_t const v = (uint32_t) value;
+  for (uint8_t i = 0; i < n_bytes; i++)
+  {
+    p[i] = (uint8_t) (v >> (8*(4 - n_bytes + i)));
+  }
+}
+
+// FIFO sample to 32-bit left justified
+TU_ATTR_ALWAYS_INLINE static inline int32_t pcm_load_fifo(uint8_t const * p, uint8_t format)
+{
+  switch (format)
+  {
+    case AUDIO_PCM_FORMAT_S16: return (int32_t) ((uint32_t) tu_unaligned_read16(p) << 16);
+    case AUDIO_PCM_FORMAT_S24: return (int32_t) (((uint32_t) p[0] << 8) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 24));
+    case AUDIO_PCM_FORMAT_S32: return (int32_t) tu_unaligned_read32(p);
+
+    default:
+    {
+      float f;
+      memcpy(&f, p, 4);
+      f *= 2147483648.0f;
+
+      // Saturate, also to keep the cast defined
+      if (f >= 2147483648.0f) return INT32_MAX;
+      if (f > -2147483648.0f) return (int32_t) f;
+      return INT32_MIN;
+    }
+  }
+}
+
+// 32-bit left justified to FIFO sample, lower bits are truncated
+TU_ATTR_ALWAYS_INLINE static inline void pcm_store_fifo(uint8_t * p, int32_t value, uint8_t format)
+{
+  switch (format)
+  {
+    case AUDIO_PCM_FORMAT_S16: tu_unaligned_write16(p, (uint16_t) ((uint32_t) value >> 16)); break;
+    case AUDIO_PCM_FORMAT_S24:
+      p[0] = (uint8_t) ((uint32_t) value >> 8);
+      p[1] = (uint8_t) ((uint32_t) value >> 16);
+      p[2] = (uint8_t) ((uint32_t) value >> 24);
+    break;
+    case AUDIO_PCM_FORMAT_S32: tu_unaligned_write32(p, (uint32_t) value); break;
+
+    default:
+    {
+      float const f = (float) value * (1.0f / 2147483648.0f);
+      memcpy(p, &f, 4);
+    }
+    break;
+  }
+}
+
+// Called with constant format, so that each format gets its own loop without per sample dispatch
+TU_ATTR_ALWAYS_INLINE static inline uint8_t const * pcm_deinterleave_convert(uint8_t * dst, uint8_t const * src, uint16_t n_samples,
+                                                                              uint8_t n_ff_used, audiod_pcm_conv_t * conv, uint8_t format)
+{
+  uint8_t const n_bytes    = conv->n_bytes;
+  uint8_t const n_channels = conv->n_channels;
+  uint8_t const dst_size   = audiod_pcm_format_size(format, n_bytes);
+  uint8_t const shift      = pcm_dither_shift(conv, (uint8_t) (8*n_bytes), pcm_format_bits(format));
+  uint16_t const skip      = (uint16_t) ((n_ff_used - 1) * n_channels * n_bytes);  // Samples of other FIFOs
+
+  for (; n_samples; n_samples--)
+  {
+    for (uint8_t ch = 0; ch < n_channels; ch++)
+    {
+      int32_t v = pcm_load_stream(src, n_bytes);
+      if (shift) v = pcm_dither(conv, v, shift);
+      pcm_store_fifo(dst, v, format);
+      src += n_bytes;
+      dst += dst_size;
+    }
+    src += skip;
+  }
+
+  return src;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline uint8_t * pcm_interleave_convert(uint8_t * dst, uint8_t const * src, uint16_t n_samples,
+                                                                      uint8_t n_ff_used, audiod_pcm_conv_t * conv, uint8_t format)
+{
+  uint8_t const n_bytes    = conv->n_bytes;
+  uint8_t const n_channels = conv->n_channels;
+  uint8_t const src_size   = audiod_pcm_format_size(format, n_bytes);
+  uint8_t const shift      = pcm_dither_shift(conv, pcm_format_bits(format), (uint8_t) (8*n_bytes));
+  uint16_t const skip      = (uint16_t) ((n_ff_used - 1) * n_channels * n_bytes);
+
+  for (; n_samples; n_samples--)
+  {
+    for (uint8_t ch = 0; ch < n_channels; ch++)
+    {
+      int32_t v = pcm_load_fifo(src, format);
+      if (shift) v = pcm_dither(conv, v, shift);
+      pcm_store_stream(dst, v, n_bytes);
+      src += src_size;
+      dst += n_bytes;
+    }
+    dst += skip;
+  }
+
+  return dst;
+}
+
+uint8_t const * audiod_pcm_deinterleave_convert(void * dst, uint8_t const * src, uint16_t n_samples, uint8_t n_ff_used, audiod_pcm_conv_t * conv)
+{
+  uint8_t * d = (uint8_t *) dst;
+
+  switch (conv->format)
+  {
+    case AUDIO_PCM_FORMAT_S16: return pcm_deinterleave_convert(d, src, n_samples, n_ff_used, conv, AUDIO_PCM_FORMAT_S16);
+    case AUDIO_PCM_FORMAT_S24: return pcm_deinterleave_convert(d, src, n_samples, n_ff_used, conv, AUDIO_PCM_FORMAT_S24);
+    case AUDIO_PCM_FORMAT_S32: return pcm_deinterleave_convert(d, src, n_samples, n_ff_used, conv, AUDIO_PCM_FORMAT_S32);
+    case AUDIO_PCM_FORMAT_F32: return pcm_deinterleave_convert(d, src, n_samples, n_ff_used, conv, AUDIO_PCM_FORMAT_F32);
+    default: return audiod_pcm_deinterleave(dst, src, n_samples, (uint8_t) (conv->n_channels * conv->n_bytes), n_ff_used);
+  }
+}
+
+uint8_t * audiod_pcm_interleave_convert(uint8_t * dst, void const * src, uint16_t n_samples, uint8_t n_ff_used, audiod_pcm_conv_t * conv)
+{
+  uint8_t const * s = (uint8_t const *) src;
+
+  switch (conv->format)
+  {
+    case AUDIO_PCM_FORMAT_S16: return pcm_interleave_convert(dst, s, n_samples, n_ff_used, conv, AUDIO_PCM_FORMAT_S16);
+    case AUDIO_PCM_FORMAT_S24: return pcm_interleave_convert(dst, s, n_samples, n_ff_used, conv, AUDIO_PCM_FORMAT_S24);
+    case AUDIO_PCM_FORMAT_S32: return pcm_interleave_convert(dst, s, n_samples, n_ff_used, conv, AUDIO_PCM_FORMAT_S32);
+    case AUDIO_PCM_FORMAT_F32: return pcm_interleave_convert(dst, s, n_samples, n_ff_used, conv, AUDIO_PCM_FORMAT_F32);
+    default: return audiod_pcm_interleave(dst, src, n_samples, (uint8_t) (conv->n_channels * conv->n_bytes), n_ff_used);
+  }
+}
+
+#endif
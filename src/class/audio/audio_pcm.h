@@ -0,0 +1,92 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_AUDIO_PCM_H_
+#define _TUSB_AUDIO_PCM_H_
+
+#include "common/tusb_common.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Sample format conversion
+//--------------------------------------------------------------------+
+
+// Sample format of support FIFOs. Stream samples are signed, left justified and little endian with
+// bSubslotSize of 1 to 4 bytes (Frmts 2.3.1.5), they are converted while being (de)interleaved.
+typedef enum
+{
+  AUDIO_PCM_FORMAT_WIRE = 0,  // same as active alternate setting, no conversion
+  AUDIO_PCM_FORMAT_S16,       // int16_t
+  AUDIO_PCM_FORMAT_S24,       // 24 bit packed into 3 bytes, little endian
+  AUDIO_PCM_FORMAT_S32,       // int32_t, left justified
+  AUDIO_PCM_FORMAT_F32,       // float in range [-1, +1)
+} audio_pcm_format_t;
+
+// Applied whenever a conversion drops bits of resolution e.g. 24 bit stream to S16
+typedef enum
+{
+  AUDIO_PCM_DITHER_NONE = 0,  // truncate
+  AUDIO_PCM_DITHER_RPDF,      // rectangular noise of 1 LSB, removes truncation bias
+  AUDIO_PCM_DITHER_TPDF,      // triangular noise of 2 LSB, also decorrelates error from signal
+} audio_pcm_dither_t;
+
+typedef struct
+{
+  uint8_t  format;      // audio_pcm_format_t
+  uint8_t  dither;      // audio_pcm_dither_t
+  uint8_t  n_bytes;     // bytes per sample of one channel in stream
+  uint8_t  n_channels;  // channels of one FIFO, adjacent in stream
+  uint32_t seed;        // state of dither noise generator
+} audiod_pcm_conv_t;
+
+// Bytes per sample of one channel in support FIFO
+uint8_t audiod_pcm_format_size(uint8_t format, uint8_t n_bytes);
+
+//--------------------------------------------------------------------+
+// Internal PCM kernels used by audio driver to split/merge an interleaved stream (2.3.1.5 Audio Streams)
+// into/from support FIFOs. A sample of n_bytes holds all channels of one FIFO, consecutive samples of a FIFO
+// are n_ff_used samples apart in the interleaved stream.
+//--------------------------------------------------------------------+
+
+// Copy n_samples from interleaved src to contiguous dst, return src past the last copied sample
+uint8_t const * audiod_pcm_deinterleave(void * dst, uint8_t const * src, uint16_t n_samples, uint8_t n_bytes, uint8_t n_ff_used);
+
+// Copy n_samples from contiguous src to interleaved dst, return dst past the last copied sample
+uint8_t * audiod_pcm_interleave(uint8_t * dst, void const * src, uint16_t n_samples, uint8_t n_bytes, uint8_t n_ff_used);
+
+// Same as above but converting each sample between stream and FIFO format of conv in the same pass.
+// A sample holds conv->n_channels channels in both buffers.
+uint8_t const * audiod_pcm_deinterleave_convert(void * dst, uint8_t const * src, uint16_t n_samples, uint8_t n_ff_used, audiod_pcm_conv_t * conv);
+uint8_t * audiod_pcm_interleave_convert(uint8_t * dst, void const * src, uint16_t n_samples, uint8_t n_ff_used, audiod_pcm_conv_t * conv);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_AUDIO_PCM_H_ */
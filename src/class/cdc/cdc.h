@@ -265,6 +265,19 @@ typedef struct TU_ATTR_PACKED
   uint16_t wCountryCode[no_country] ;\
 }
 
+/// Ethernet Networking Functional Descriptor (Communication Interface) [USBECM1.2]
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  bLength              ; ///< Size of this descriptor in bytes.
+  uint8_t  bDescriptorType      ; ///< Descriptor Type, must be Class-Specific
+  uint8_t  bDescriptorSubType   ; ///< Descriptor SubType CDC_FUNC_DESC_ETHERNET_NETWORKING
+  uint8_t  iMACAddress          ; ///< Index of string descriptor holding the 48-bit MAC address as 12 hex digits
+  uint32_t bmEthernetStatistics ; ///< Ethernet statistics collected by device
+  uint16_t wMaxSegmentSize      ; ///< Maximum segment size of the Ethernet device, typically 1514
+  uint16_t wNumberMCFilters     ; ///< Number of multicast filters that can be configured by host
+  uint8_t  bNumberPowerFilters  ; ///< Number of pattern filters available for causing wake-up of host
+}cdc_desc_func_ethernet_networking_t;
+
 //--------------------------------------------------------------------+
 // PUBLIC SWITCHED TELEPHONE NETWORK (PSTN) SUBCLASS
 //--------------------------------------------------------------------+
@@ -58,7 +58,8 @@ typedef enum
 {
   MSC_PROTOCOL_CBI              = 0 ,  ///< Control/Bulk/Interrupt protocol (with command completion interrupt)
   MSC_PROTOCOL_CBI_NO_INTERRUPT = 1 ,  ///< Control/Bulk/Interrupt protocol (without command completion interrupt)
-  MSC_PROTOCOL_BOT              = 0x50 ///< Bulk-Only Transport
+  MSC_PROTOCOL_BOT              = 0x50 ,///< Bulk-Only Transport
+  MSC_PROTOCOL_UAS              = 0x62  ///< USB Attached SCSI
 }msc_protocol_type_t;
 
 /// MassStorage Class-Specific Control Request
@@ -121,8 +122,45 @@ typedef enum
   SCSI_CMD_READ_FORMAT_CAPACITY         = 0x23, ///< The command allows the Host to request a list of the possible format capacities for an installed writable media. This command also has the capability to report the writable capacity for a media when it is installed
   SCSI_CMD_READ_10                      = 0x28, ///< The READ (10) command requests that the device server read the specified logical block(s) and transfer them to the data-in buffer.
   SCSI_CMD_WRITE_10                     = 0x2A, ///< The WRITE (10) command requests thatthe device server transfer the specified logical block(s) from the data-out buffer and write them.
+  SCSI_CMD_SYNCHRONIZE_CACHE_10         = 0x35, ///< The SYNCHRONIZE CACHE (10) command requests that the device server write cached logical blocks to the medium.
+  SCSI_CMD_WRITE_SAME_10                = 0x41, ///< The WRITE SAME (10) command writes a single block of data to a range of logical blocks, or unmaps them if UNMAP bit is set.
+  SCSI_CMD_UNMAP                        = 0x42, ///< The UNMAP command tells the device server that the logical blocks in parameter list are no longer used and can be deallocated.
+  SCSI_CMD_READ_16                      = 0x88, ///< The READ (16) command is READ (10) with 64-bit LBA and 32-bit block count.
+  SCSI_CMD_WRITE_16                     = 0x8A, ///< The WRITE (16) command is WRITE (10) with 64-bit LBA and 32-bit block count.
+  SCSI_CMD_WRITE_SAME_16                = 0x93, ///< The WRITE SAME (16) command is WRITE SAME (10) with 64-bit LBA and 32-bit block count.
+  SCSI_CMD_SERVICE_ACTION_IN_16         = 0x9E, ///< Service Action In (16), sub-command is specified by service action field e.g READ CAPACITY (16).
 }scsi_cmd_type_t;
 
+/// SCSI Service Action of \ref SCSI_CMD_SERVICE_ACTION_IN_16
+enum
+{
+  SCSI_SERVICE_ACTION_READ_CAPACITY_16 = 0x10,
+};
+
+/// Vital Product Data (VPD) page code of INQUIRY command with EVPD bit set
+enum
+{
+  SCSI_VPD_PAGE_SUPPORTED_PAGES            = 0x00,
+  SCSI_VPD_PAGE_BLOCK_LIMITS               = 0xB0,
+  SCSI_VPD_PAGE_LOGICAL_BLOCK_PROVISIONING = 0xB2,
+};
+
+/// Flags of WRITE SAME (10/16) command
+enum
+{
+  SCSI_WRITE_SAME_FLAG_NDOB  = TU_BIT(0), ///< No Data-Out Buffer, WRITE SAME (16) only
+  SCSI_WRITE_SAME_FLAG_UNMAP = TU_BIT(3), ///< Unmap blocks instead of writing them
+};
+
+/// SCSI Status (SAM)
+typedef enum
+{
+  SCSI_STATUS_GOOD            = 0x00,
+  SCSI_STATUS_CHECK_CONDITION = 0x02, ///< Sense data is available
+  SCSI_STATUS_BUSY            = 0x08,
+  SCSI_STATUS_TASK_SET_FULL   = 0x28, ///< Command is rejected since device's command queue is full
+}scsi_status_type_t;
+
 /// SCSI Sense Key
 typedef enum
 {
@@ -215,6 +253,16 @@ typedef struct TU_ATTR_PACKED
 
 TU_VERIFY_STATIC(sizeof(scsi_inquiry_resp_t) == 36, "size is not correct");
 
+/// SCSI VPD Page Header, common for all VPD pages
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  peripheral_device_type ; ///< Peripheral qualifier (bit 7:5) and device type (bit 4:0)
+  uint8_t  page_code              ;
+  uint16_t page_length            ; ///< Bytes following this header
+} scsi_vpd_page_header_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_vpd_page_header_t) == 4, "size is not correct");
+
 
 typedef struct TU_ATTR_PACKED
 {
@@ -375,6 +423,137 @@ typedef struct TU_ATTR_PACKED
 TU_VERIFY_STATIC(sizeof(scsi_read10_t) == 10, "size is not correct");
 TU_VERIFY_STATIC(sizeof(scsi_write10_t) == 10, "size is not correct");
 
+/// SCSI Read 16 Command
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  cmd_code    ; ///< SCSI OpCode
+  uint8_t  flags       ;
+  uint64_t lba         ; ///< The first Logical Block Address (LBA) accessed by this command
+  uint32_t block_count ; ///< Number of Blocks used by this command
+  uint8_t  group_num   ;
+  uint8_t  control     ;
+} scsi_read16_t, scsi_write16_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_read16_t) == 16, "size is not correct");
+TU_VERIFY_STATIC(sizeof(scsi_write16_t) == 16, "size is not correct");
+
+/// SCSI Read Capacity 16 Command
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  cmd_code                 ; ///< SCSI OpCode for \ref SCSI_CMD_SERVICE_ACTION_IN_16
+  uint8_t  service_action           ; ///< \ref SCSI_SERVICE_ACTION_READ_CAPACITY_16 (lower 5 bits)
+  uint64_t lba                      ;
+  uint32_t alloc_length             ; ///< Maximum number of bytes that host has allocated for response
+  uint8_t  partial_medium_indicator ;
+  uint8_t  control                  ;
+} scsi_read_capacity16_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_read_capacity16_t) == 16, "size is not correct");
+
+/// SCSI Read Capacity 16 Response Data
+typedef struct TU_ATTR_PACKED
+{
+  uint64_t last_lba           ; ///< The last Logical Block Address of the device
+  uint32_t block_size         ; ///< Block size in bytes
+  uint8_t  protection         ; ///< P_TYPE and PROT_EN
+  uint8_t  lbppb_exponent     ; ///< Logical blocks per physical block exponent (lower 4 bits)
+  uint16_t lowest_aligned_lba ; ///< Lowest aligned LBA (lower 14 bits), bit 15 is LBPME, bit 14 is LBPRZ
+  uint8_t  reserved[16]       ;
+} scsi_read_capacity16_resp_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_read_capacity16_resp_t) == 32, "size is not correct");
+
+/// SCSI Write Same 10 Command
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  cmd_code    ; ///< SCSI OpCode for \ref SCSI_CMD_WRITE_SAME_10
+  uint8_t  flags       ; ///< \ref SCSI_WRITE_SAME_FLAG_UNMAP
+  uint32_t lba         ;
+  uint8_t  group_num   ;
+  uint16_t block_count ;
+  uint8_t  control     ;
+} scsi_write_same10_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_write_same10_t) == 10, "size is not correct");
+
+/// SCSI Write Same 16 Command
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  cmd_code    ; ///< SCSI OpCode for \ref SCSI_CMD_WRITE_SAME_16
+  uint8_t  flags       ; ///< \ref SCSI_WRITE_SAME_FLAG_UNMAP and \ref SCSI_WRITE_SAME_FLAG_NDOB
+  uint64_t lba         ;
+  uint32_t block_count ;
+  uint8_t  group_num   ;
+  uint8_t  control     ;
+} scsi_write_same16_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_write_same16_t) == 16, "size is not correct");
+
+/// SCSI Unmap Command
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  cmd_code         ; ///< SCSI OpCode for \ref SCSI_CMD_UNMAP
+  uint8_t  anchor           ;
+  uint8_t  reserved[4]      ;
+  uint8_t  group_num        ;
+  uint16_t param_list_length; ///< Length of parameter list in Data-Out
+  uint8_t  control          ;
+} scsi_unmap_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_unmap_t) == 10, "size is not correct");
+
+/// SCSI Unmap Parameter List Header, followed by block descriptors
+typedef struct TU_ATTR_PACKED
+{
+  uint16_t data_length      ; ///< Bytes following this field
+  uint16_t block_desc_length; ///< Bytes of all block descriptors
+  uint8_t  reserved[4]      ;
+} scsi_unmap_param_header_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_unmap_param_header_t) == 8, "size is not correct");
+
+/// SCSI Unmap Block Descriptor
+typedef struct TU_ATTR_PACKED
+{
+  uint64_t lba         ;
+  uint32_t block_count ;
+  uint8_t  reserved[4] ;
+} scsi_unmap_block_desc_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_unmap_block_desc_t) == 16, "size is not correct");
+
+/// SCSI Block Limits VPD Page (0xB0)
+typedef struct TU_ATTR_PACKED
+{
+  scsi_vpd_page_header_t header;
+  uint8_t  wsnz                       ; ///< Write Same Non Zero (bit 0): block count of zero is not supported
+  uint8_t  max_compare_write_length   ;
+  uint16_t opt_transfer_granularity   ;
+  uint32_t max_transfer_length        ;
+  uint32_t opt_transfer_length        ;
+  uint32_t max_prefetch_length        ;
+  uint32_t max_unmap_lba_count        ;
+  uint32_t max_unmap_desc_count       ;
+  uint32_t opt_unmap_granularity      ;
+  uint32_t unmap_granularity_alignment; ///< bit 31 is UGAVALID
+  uint64_t max_write_same_length      ;
+  uint8_t  reserved[20]               ;
+} scsi_vpd_block_limits_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_vpd_block_limits_t) == 64, "size is not correct");
+
+/// SCSI Logical Block Provisioning VPD Page (0xB2)
+typedef struct TU_ATTR_PACKED
+{
+  scsi_vpd_page_header_t header;
+  uint8_t threshold_exponent;
+  uint8_t flags             ; ///< LBPU (bit 7), LBPWS (bit 6), LBPWS10 (bit 5), LBPRZ (bit 2), ANC_SUP (bit 1), DP (bit 0)
+  uint8_t provisioning_type ; ///< 0: fully provisioned, 1: resource provisioned, 2: thin provisioned
+  uint8_t reserved          ;
+} scsi_vpd_lb_provisioning_t;
+
+TU_VERIFY_STATIC(sizeof(scsi_vpd_lb_provisioning_t) == 8, "size is not correct");
+
 #ifdef __cplusplus
  }
 #endif
@@ -0,0 +1,444 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if (CFG_TUD_ENABLED && CFG_TUD_MSC && CFG_TUD_MSC_CACHE)
+
+#include "msc_device.h"
+#include "msc_cache.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+
+// Can be selectively disabled to reduce logging when troubleshooting other driver
+#define MSC_CACHE_DEBUG   2
+
+typedef struct
+{
+  uint64_t tag;        // line number i.e address / CFG_TUD_MSC_CACHE_LINE_SIZE
+  uint32_t block_size;
+  uint32_t valid;      // bitmap of blocks whose data is in cache
+  uint32_t dirty;      // bitmap of blocks not yet written back
+  uint32_t stamp;      // last access for LRU eviction
+  uint8_t  lun;
+  uint8_t  block_num;  // number of blocks, less than a full line at the end of disk
+  bool     used;
+}msc_cache_line_t;
+
+typedef struct
+{
+  msc_cache_line_t line[CFG_TUD_MSC_CACHE_LINES];
+  uint32_t stamp;
+
+  // Idle timeout, counted in SOF ISR
+  volatile bool     dirty;
+  volatile uint16_t idle_ms;
+  uint16_t          frame;
+}msc_cache_t;
+
+static msc_cache_t _cache;
+TU_ATTR_ALIGNED(4) static uint8_t _cache_data[CFG_TUD_MSC_CACHE_LINES][CFG_TUD_MSC_CACHE_LINE_SIZE];
+
+//--------------------------------------------------------------------+
+// Storage Access
+//--------------------------------------------------------------------+
+
+// 64-bit callbacks take precedence since writing back is not tied to a SCSI command
+static int32_t storage_read(uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  if ( tud_msc_read16_cb ) return tud_msc_read16_cb(lun, lba, offset, buffer, bufsize);
+  return tud_msc_read10_cb(lun, (uint32_t) lba, offset, buffer, bufsize);
+}
+
+static int32_t storage_write(uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  if ( tud_msc_write16_cb ) return tud_msc_write16_cb(lun, lba, offset, buffer, bufsize);
+  return tud_msc_write10_cb(lun, (uint32_t) lba, offset, buffer, bufsize);
+}
+
+// Transfer whole buffer to/from storage. Return bufsize when done, TUD_MSC_RET_BUSY if storage is busy
+// (whole transfer is retried later on) or TUD_MSC_RET_ERROR. Asynchronous I/O is not supported here.
+static int32_t storage_xfer(bool is_read, uint8_t lun, uint32_t block_size, uint64_t lba, uint8_t* buffer, uint32_t bufsize)
+{
+  uint32_t done = 0;
+
+  while ( done < bufsize )
+  {
+    uint64_t const cur_lba = lba + done / block_size;
+    uint32_t const offset  = done % block_size;
+
+    int32_t const nbytes = is_read ? storage_read (lun, cur_lba, offset, buffer + done, bufsize - done) :
+                                     storage_write(lun, cur_lba, offset, buffer + done, bufsize - done);
+
+    if ( nbytes == TUD_MSC_RET_BUSY ) return TUD_MSC_RET_BUSY;
+
+    if ( nbytes < 0 )
+    {
+      TU_LOG(MSC_CACHE_DEBUG, "  MSC cache: storage %s failed (%ld)\r\n", is_read ? "read" : "write", (long) nbytes);
+      return TUD_MSC_RET_ERROR;
+    }
+
+    done += (uint32_t) nbytes;
+  }
+
+  return (int32_t) bufsize;
+}
+
+//--------------------------------------------------------------------+
+// Cache Line
+//--------------------------------------------------------------------+
+
+// bitmap of blocks from first to last (inclusive)
+TU_ATTR_ALWAYS_INLINE static inline uint32_t block_mask(uint32_t first, uint32_t last)
+{
+  uint32_t const upper = (last >= 31) ? UINT32_MAX : ((1u << (last + 1)) - 1u);
+  return upper & ~((1u << first) - 1u);
+}
+
+TU_ATTR_ALWAYS_INLINE static inline uint32_t line_block_count(uint32_t block_size)
+{
+  return CFG_TUD_MSC_CACHE_LINE_SIZE / block_size;
+}
+
+// Line must hold whole blocks and block bitmap is 32-bit
+TU_ATTR_ALWAYS_INLINE static inline bool is_cacheable(uint32_t block_size)
+{
+  return block_size && (CFG_TUD_MSC_CACHE_LINE_SIZE % block_size == 0) && (line_block_count(block_size) <= 32);
+}
+
+TU_ATTR_ALWAYS_INLINE static inline uint8_t* line_data(msc_cache_line_t const* line)
+{
+  return _cache_data[line - _cache.line];
+}
+
+TU_ATTR_ALWAYS_INLINE static inline uint64_t line_lba(msc_cache_line_t const* line)
+{
+  return line->tag * line_block_count(line->block_size);
+}
+
+static msc_cache_line_t* line_find(uint8_t lun, uint32_t block_size, uint64_t tag)
+{
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_LINES; i++)
+  {
+    msc_cache_line_t* line = &_cache.line[i];
+
+    if ( line->used && line->lun == lun && line->block_size == block_size && line->tag == tag )
+    {
+      line->stamp = ++_cache.stamp;
+      return line;
+    }
+  }
+
+  return NULL;
+}
+
+// Read blocks in mask which are not valid yet, consecutive blocks are read at once
+static int32_t line_fill(msc_cache_line_t* line, uint32_t mask)
+{
+  uint32_t const bs = line->block_size;
+  uint8_t i = 0;
+
+  mask &= ~line->valid;
+
+  while ( i < line->block_num )
+  {
+    if ( !tu_bit_test(mask, i) )
+    {
+      i++;
+      continue;
+    }
+
+    uint8_t count = 1;
+    while ( (i + count < line->block_num) && tu_bit_test(mask, i + count) ) count++;
+
+    int32_t const rc = storage_xfer(true, line->lun, bs, line_lba(line) + i, line_data(line) + i*bs, count*bs);
+    if ( rc <= 0 ) return rc;
+
+    line->valid |= block_mask(i, i + count - 1u);
+    i = (uint8_t) (i + count);
+  }
+
+  return 1;
+}
+
+// Whole line is programmed at once, blocks not written by host are read from storage first
+static int32_t line_write_back(msc_cache_line_t* line)
+{
+  if ( !line->dirty ) return 1;
+
+  TU_LOG(MSC_CACHE_DEBUG, "  MSC cache: write back lba %lu, dirty 0x%08lX\r\n", (unsigned long) line_lba(line), (unsigned long) line->dirty);
+
+  int32_t rc = line_fill(line, block_mask(0, line->block_num - 1u));
+  if ( rc <= 0 ) return rc;
+
+  rc = storage_xfer(false, line->lun, line->block_size, line_lba(line), line_data(line), line->block_num*line->block_size);
+  if ( rc <= 0 ) return rc;
+
+  line->dirty = 0;
+  return 1;
+}
+
+// Evict least recently used line for new tag
+static int32_t line_alloc(uint8_t lun, uint32_t block_size, uint64_t tag, msc_cache_line_t** p_line)
+{
+  msc_cache_line_t* victim = &_cache.line[0];
+
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_LINES; i++)
+  {
+    msc_cache_line_t* line = &_cache.line[i];
+
+    if ( !line->used )
+    {
+      victim = line;
+      break;
+    }
+
+    if ( line->stamp < victim->stamp ) victim = line;
+  }
+
+  if ( victim->used )
+  {
+    int32_t const rc = line_write_back(victim);
+    if ( rc <= 0 ) return rc;
+  }
+
+  uint64_t disk_block_count = 0;
+  uint32_t disk_block_size  = 0;
+  mscd_scsi_capacity(lun, &disk_block_count, &disk_block_size);
+
+  uint64_t const first_lba = tag * line_block_count(block_size);
+  TU_VERIFY(first_lba < disk_block_count, TUD_MSC_RET_ERROR);
+
+  victim->tag        = tag;
+  victim->block_size = block_size;
+  victim->valid      = 0;
+  victim->dirty      = 0;
+  victim->stamp      = ++_cache.stamp;
+  victim->lun        = lun;
+  victim->block_num  = (uint8_t) tu_min64(line_block_count(block_size), disk_block_count - first_lba);
+  victim->used       = true;
+
+  *p_line = victim;
+  return 1;
+}
+
+static bool any_dirty(void)
+{
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_LINES; i++)
+  {
+    if ( _cache.line[i].used && _cache.line[i].dirty ) return true;
+  }
+
+  return false;
+}
+
+//--------------------------------------------------------------------+
+// APPLICATION API
+//--------------------------------------------------------------------+
+int32_t tud_msc_cache_flush(uint8_t lun)
+{
+  return mscd_cache_flush(lun, false);
+}
+
+//--------------------------------------------------------------------+
+// Internal Cache API
+//--------------------------------------------------------------------+
+void mscd_cache_init(void)
+{
+  tu_memclr(&_cache, sizeof(_cache));
+}
+
+int32_t mscd_cache_read(uint8_t lun, uint32_t block_size, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  _cache.idle_ms = 0;
+
+  if ( !is_cacheable(block_size) ) return storage_read(lun, lba, offset, buffer, bufsize);
+
+  lba    += offset / block_size;
+  offset %= block_size;
+
+  uint32_t const first = (uint32_t) (lba % line_block_count(block_size));
+  uint32_t const pos   = first*block_size + offset;
+
+  msc_cache_line_t const* line = line_find(lun, block_size, lba / line_block_count(block_size));
+
+  if ( line == NULL )
+  {
+    // read through, but not across into next line which may be cached
+    return storage_read(lun, lba, offset, buffer, tu_min32(bufsize, CFG_TUD_MSC_CACHE_LINE_SIZE - pos));
+  }
+
+  uint32_t const line_len = line->block_num*block_size;
+  TU_VERIFY(pos < line_len, TUD_MSC_RET_ERROR);
+
+  uint32_t count = tu_min32(bufsize, line_len - pos);
+
+  // Serve run of blocks which are either all cached or all not cached
+  bool const cached = tu_bit_test(line->valid, (uint8_t) first);
+  uint32_t const last = (pos + count - 1) / block_size;
+
+  for(uint32_t i = first+1; i <= last; i++)
+  {
+    if ( tu_bit_test(line->valid, (uint8_t) i) != cached )
+    {
+      count = i*block_size - pos;
+      break;
+    }
+  }
+
+  if ( !cached ) return storage_read(lun, lba, offset, buffer, count);
+
+  memcpy(buffer, line_data(line) + pos, count);
+  return (int32_t) count;
+}
+
+int32_t mscd_cache_write(uint8_t lun, uint32_t block_size, uint64_t lba, uint32_t offset, uint8_t const* buffer, uint32_t bufsize)
+{
+  _cache.idle_ms = 0;
+
+  if ( !is_cacheable(block_size) ) return storage_write(lun, lba, offset, (uint8_t*) (uintptr_t) buffer, bufsize);
+
+  lba    += offset / block_size;
+  offset %= block_size;
+
+  uint64_t const tag   = lba / line_block_count(block_size);
+  uint32_t const first = (uint32_t) (lba % line_block_count(block_size));
+  uint32_t const pos   = first*block_size + offset;
+
+  msc_cache_line_t* line = line_find(lun, block_size, tag);
+
+  if ( line == NULL )
+  {
+    int32_t const rc = line_alloc(lun, block_size, tag, &line);
+    if ( rc <= 0 ) return rc;
+  }
+
+  uint32_t const line_len = line->block_num*block_size;
+  TU_VERIFY(pos < line_len, TUD_MSC_RET_ERROR);
+
+  // up to end of line, callback is invoked again with the rest
+  uint32_t const count = tu_min32(bufsize, line_len - pos);
+  uint32_t const last  = (pos + count - 1) / block_size;
+
+  // Partially written first and last block must keep the rest of their data
+  uint32_t partial = 0;
+  if ( pos % block_size           ) partial |= (uint32_t) TU_BIT(first);
+  if ( (pos + count) % block_size ) partial |= (uint32_t) TU_BIT(last);
+
+  int32_t const rc = line_fill(line, partial);
+  if ( rc <= 0 ) return rc;
+
+  memcpy(line_data(line) + pos, buffer, count);
+
+  uint32_t const mask = block_mask(first, last);
+  line->valid |= mask;
+  line->dirty |= mask;
+
+  _cache.dirty = true;
+
+  return (int32_t) count;
+}
+
+int32_t mscd_cache_flush(uint8_t lun, bool invalidate)
+{
+  int32_t rc = 1;
+
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_LINES; i++)
+  {
+    msc_cache_line_t* line = &_cache.line[i];
+    if ( !(line->used && line->lun == lun) ) continue;
+
+    // busy storage is not waited for, lines written back so far are clean and skipped on retry
+    rc = line_write_back(line);
+    if ( rc <= 0 ) break;
+
+    if ( invalidate ) line->used = false;
+  }
+
+  _cache.dirty = any_dirty();
+
+  return rc;
+}
+
+void mscd_cache_discard(uint8_t lun, uint64_t lba, uint32_t block_count)
+{
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_LINES; i++)
+  {
+    msc_cache_line_t* line = &_cache.line[i];
+    if ( !(line->used && line->lun == lun) ) continue;
+
+    uint64_t const first_lba = line_lba(line);
+    if ( (first_lba >= lba) && (first_lba + line->block_num <= lba + block_count) ) line->used = false;
+  }
+
+  _cache.dirty = any_dirty();
+}
+
+bool mscd_cache_idle_flush(void)
+{
+  bool done = true;
+
+  for(uint8_t i=0; i<CFG_TUD_MSC_CACHE_LINES; i++)
+  {
+    msc_cache_line_t* line = &_cache.line[i];
+    if ( !line->used ) continue;
+
+    // line with failed write back is kept dirty, host will be reported on next eviction or flush
+    if ( line_write_back(line) == TUD_MSC_RET_BUSY ) done = false;
+  }
+
+  _cache.dirty = any_dirty();
+  _cache.idle_ms = 0;
+
+  return done;
+}
+
+void mscd_cache_idle_restart(void)
+{
+  _cache.idle_ms = 0;
+}
+
+bool mscd_cache_sof_isr(uint32_t frame_count)
+{
+#if CFG_TUD_MSC_CACHE_IDLE_MS
+  // count 1ms frame, SOF can be invoked for each microframe in highspeed
+  uint16_t const frame = (uint16_t) (frame_count & 0x7FFu);
+  if ( frame == _cache.frame ) return false;
+  _cache.frame = frame;
+
+  if ( !_cache.dirty ) return false;
+
+  _cache.idle_ms++;
+  return _cache.idle_ms == CFG_TUD_MSC_CACHE_IDLE_MS;
+#else
+  (void) frame_count;
+  return false;
+#endif
+}
+
+#endif
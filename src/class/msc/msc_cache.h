@@ -0,0 +1,69 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_MSC_CACHE_H_
+#define _TUSB_MSC_CACHE_H_
+
+#include "common/tusb_common.h"
+#include "msc_device.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Internal Cache API used by MSC/UAS driver
+// READ/WRITE return values have the same meaning as tud_msc_read10_cb()/tud_msc_write10_cb()
+//--------------------------------------------------------------------+
+void    mscd_cache_init  (void);
+
+// Serve READ from cached line, otherwise read through storage callback
+int32_t mscd_cache_read  (uint8_t lun, uint32_t block_size, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
+
+// Copy WRITE data to cache line, storage callback is only invoked to write back an evicted line
+int32_t mscd_cache_write (uint8_t lun, uint32_t block_size, uint64_t lba, uint32_t offset, uint8_t const* buffer, uint32_t bufsize);
+
+// Write back dirty lines of LUN, lines are also dropped if invalidate is true e.g medium is ejected.
+// Return 1 when done, TUD_MSC_RET_BUSY if storage is busy and flush should be retried later or TUD_MSC_RET_ERROR
+int32_t mscd_cache_flush (uint8_t lun, bool invalidate);
+
+// Drop lines entirely within unmapped range, partially covered lines are written back as usual
+void    mscd_cache_discard (uint8_t lun, uint64_t lba, uint32_t block_count);
+
+// Write back dirty lines of all LUNs, return false if storage is busy and should be retried later
+bool    mscd_cache_idle_flush (void);
+
+// Invoked on SOF in ISR context, return true when idle timeout is reached with dirty lines
+bool    mscd_cache_sof_isr (uint32_t frame_count);
+
+// Restart idle timeout e.g write back is postponed since storage is in use
+void    mscd_cache_idle_restart (void);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_MSC_CACHE_H_ */
@@ -34,6 +34,14 @@
 
 #include "msc_device.h"
 
+#if CFG_TUD_MSC_CACHE
+#include "msc_cache.h"
+#endif
+
+#if CFG_TUD_UAS
+#include "uas_device.h"
+#endif
+
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF
 //--------------------------------------------------------------------+
@@ -48,6 +56,7 @@ enum
   MSC_STAGE_STATUS,
   MSC_STAGE_STATUS_SENT,
   MSC_STAGE_NEED_RESET,
+  MSC_STAGE_CMD_BUSY,   // built-in command is executed again on SOF since storage is busy
 };
 
 typedef struct
@@ -56,6 +65,7 @@ typedef struct
   CFG_TUSB_MEM_ALIGN msc_cbw_t cbw;
   CFG_TUSB_MEM_ALIGN msc_csw_t csw;
 
+  uint8_t  rhport;
   uint8_t  itf_num;
   uint8_t  ep_in;
   uint8_t  ep_out;
@@ -65,6 +75,13 @@ typedef struct
   uint32_t total_len;   // byte to be transferred, can be smaller than total_bytes in cbw
   uint32_t xferred_len; // numbered of bytes transferred so far in the Data Stage
 
+  // Asynchronous READ/WRITE I/O
+  volatile bool    pending_io;        // application callback returned TUD_MSC_RET_ASYNC
+  volatile int32_t pending_io_result; // result reported by tud_msc_async_io_done()
+  uint32_t pending_io_len;            // bytes handed to application by the pending WRITE callback
+
+  volatile bool retry_cmd;            // busy command is due to be executed again on next SOF
+
   // Sense Response Data
   uint8_t sense_key;
   uint8_t add_sense_code;
@@ -78,10 +95,20 @@ CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t _mscd_buf[CFG_TUD_MSC_EP_
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
 static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buffer, uint32_t bufsize);
-static void proc_read10_cmd(uint8_t rhport, mscd_interface_t* p_msc);
+static int32_t proc_builtin_scsi_data_out(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t const* buffer, uint32_t len);
+static void proc_read_cmd(uint8_t rhport, mscd_interface_t* p_msc);
+static void proc_read_io_data(uint8_t rhport, mscd_interface_t* p_msc, int32_t nbytes);
 
-static void proc_write10_cmd(uint8_t rhport, mscd_interface_t* p_msc);
-static void proc_write10_new_data(uint8_t rhport, mscd_interface_t* p_msc, uint32_t xferred_bytes);
+static void proc_write_cmd(uint8_t rhport, mscd_interface_t* p_msc);
+static void proc_write_new_data(uint8_t rhport, mscd_interface_t* p_msc, uint32_t xferred_bytes);
+static void proc_write_io_data(uint8_t rhport, mscd_interface_t* p_msc, uint32_t xferred_bytes, int32_t nbytes);
+
+static void proc_async_io_done(void* param);
+
+#if CFG_TUD_MSC_CACHE
+static void proc_cache_idle(void* param);
+static void proc_retry_cmd(void* param);
+#endif
 
 TU_ATTR_ALWAYS_INLINE static inline bool is_data_in(uint8_t dir)
 {
@@ -129,36 +156,131 @@ static void fail_scsi_op(uint8_t rhport, mscd_interface_t* p_msc, uint8_t status
   }
 }
 
-static inline uint32_t rdwr10_get_lba(uint8_t const command[])
+TU_ATTR_ALWAYS_INLINE static inline bool is_read_cmd(uint8_t cmd_code)
+{
+  return (cmd_code == SCSI_CMD_READ_10) || (cmd_code == SCSI_CMD_READ_16);
+}
+
+TU_ATTR_ALWAYS_INLINE static inline bool is_write_cmd(uint8_t cmd_code)
+{
+  return (cmd_code == SCSI_CMD_WRITE_10) || (cmd_code == SCSI_CMD_WRITE_16);
+}
+
+TU_ATTR_ALWAYS_INLINE static inline bool is_rdwr16_cmd(uint8_t cmd_code)
+{
+  return (cmd_code == SCSI_CMD_READ_16) || (cmd_code == SCSI_CMD_WRITE_16);
+}
+
+// 64-bit field in SCSI command/response is in Big Endian
+static inline uint64_t scsi_read_be64(uint8_t const* mem)
+{
+  uint64_t const hi = tu_ntohl(tu_unaligned_read32(mem));
+  uint64_t const lo = tu_ntohl(tu_unaligned_read32(mem + 4));
+
+  return (hi << 32) | lo;
+}
+
+static inline void scsi_write_be64(uint8_t* mem, uint64_t value)
+{
+  tu_unaligned_write32(mem    , tu_htonl((uint32_t) (value >> 32)));
+  tu_unaligned_write32(mem + 4, tu_htonl((uint32_t) value));
+}
+
+static inline uint64_t rdwr_get_lba(uint8_t const command[])
 {
   // use offsetof to avoid pointer to the odd/unaligned address
+  if ( is_rdwr16_cmd(command[0]) )
+  {
+    return scsi_read_be64(command + offsetof(scsi_write16_t, lba));
+  }
+
   uint32_t const lba = tu_unaligned_read32(command + offsetof(scsi_write10_t, lba));
 
   // lba is in Big Endian
   return tu_ntohl(lba);
 }
 
-static inline uint16_t rdwr10_get_blockcount(msc_cbw_t const* cbw)
+static inline uint32_t rdwr_get_blockcount(uint8_t const command[])
 {
-  uint16_t const block_count = tu_unaligned_read16(cbw->command + offsetof(scsi_write10_t, block_count));
+  if ( is_rdwr16_cmd(command[0]) )
+  {
+    uint32_t const block_count = tu_unaligned_read32(command + offsetof(scsi_write16_t, block_count));
+    return tu_ntohl(block_count);
+  }
+
+  uint16_t const block_count = tu_unaligned_read16(command + offsetof(scsi_write10_t, block_count));
   return tu_ntohs(block_count);
 }
 
-static inline uint16_t rdwr10_get_blocksize(msc_cbw_t const* cbw)
+static inline uint32_t rdwr_get_blocksize(msc_cbw_t const* cbw)
 {
   // first extract block count in the command
-  uint16_t const block_count = rdwr10_get_blockcount(cbw);
+  uint32_t const block_count = rdwr_get_blockcount(cbw->command);
 
   // invalid block count
   if (block_count == 0) return 0;
 
-  return (uint16_t) (cbw->total_bytes / block_count);
+  return cbw->total_bytes / block_count;
+}
+
+// READ16/WRITE16 beyond 32-bit lba requires application to implement 64-bit callback
+static bool rdwr_lba_supported(uint8_t const command[])
+{
+  uint8_t const cmd_code = command[0];
+
+  if ( !is_rdwr16_cmd(cmd_code) ) return true;
+  if ( (cmd_code == SCSI_CMD_READ_16 ) && tud_msc_read16_cb  ) return true;
+  if ( (cmd_code == SCSI_CMD_WRITE_16) && tud_msc_write16_cb ) return true;
+
+  // last block must be addressable with 32-bit lba, compare without overflow
+  uint64_t const lba   = rdwr_get_lba(command);
+  uint32_t const count = rdwr_get_blockcount(command);
+  return (lba <= UINT32_MAX) && ((count == 0) || (count - 1 <= UINT32_MAX - lba));
+}
+
+// Invoke application READ/WRITE callback matching the command
+static int32_t rdwr_io(uint8_t lun, uint8_t const command[], uint32_t block_size, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  uint8_t const cmd_code = command[0];
+
+#if CFG_TUD_MSC_CACHE
+  // cache invokes application callbacks on miss and write back
+  if ( is_read_cmd(cmd_code) ) return mscd_cache_read(lun, block_size, lba, offset, buffer, bufsize);
+  return mscd_cache_write(lun, block_size, lba, offset, buffer, bufsize);
+#else
+  (void) block_size;
+
+  if ( is_read_cmd(cmd_code) )
+  {
+    if ( (cmd_code == SCSI_CMD_READ_16) && tud_msc_read16_cb )
+    {
+      return tud_msc_read16_cb(lun, lba, offset, buffer, bufsize);
+    }
+
+    // lba range already verified to fit 32-bit
+    return tud_msc_read10_cb(lun, (uint32_t) lba, offset, buffer, bufsize);
+  }else
+  {
+    if ( (cmd_code == SCSI_CMD_WRITE_16) && tud_msc_write16_cb )
+    {
+      return tud_msc_write16_cb(lun, lba, offset, buffer, bufsize);
+    }
+
+    // lba range already verified to fit 32-bit
+    return tud_msc_write10_cb(lun, (uint32_t) lba, offset, buffer, bufsize);
+  }
+#endif
+}
+
+static inline bool is_writable(uint8_t lun)
+{
+  return tud_msc_is_writable_cb ? tud_msc_is_writable_cb(lun) : true;
 }
 
-uint8_t rdwr10_validate_cmd(msc_cbw_t const* cbw)
+static uint8_t rdwr_validate_cmd(msc_cbw_t const* cbw)
 {
   uint8_t status = MSC_CSW_STATUS_PASSED;
-  uint16_t const block_count = rdwr10_get_blockcount(cbw);
+  uint32_t const block_count = rdwr_get_blockcount(cbw->command);
 
   if ( cbw->total_bytes == 0 )
   {
@@ -172,26 +294,33 @@ uint8_t rdwr10_validate_cmd(msc_cbw_t const* cbw)
     }
   }else
   {
-    if ( SCSI_CMD_READ_10 == cbw->command[0] && !is_data_in(cbw->dir) )
+    if ( is_read_cmd(cbw->command[0]) && !is_data_in(cbw->dir) )
     {
       TU_LOG(MSC_DEBUG, "  SCSI case 10 (Ho <> Di)\r\n");
       status = MSC_CSW_STATUS_PHASE_ERROR;
     }
-    else if ( SCSI_CMD_WRITE_10 == cbw->command[0] && is_data_in(cbw->dir) )
+    else if ( is_write_cmd(cbw->command[0]) && is_data_in(cbw->dir) )
     {
       TU_LOG(MSC_DEBUG, "  SCSI case 8 (Hi <> Do)\r\n");
       status = MSC_CSW_STATUS_PHASE_ERROR;
     }
     else if ( 0 == block_count )
     {
-      TU_LOG(MSC_DEBUG, "  SCSI case 4 Hi > Dn (READ10) or case 9 Ho > Dn (WRITE10) \r\n");
+      TU_LOG(MSC_DEBUG, "  SCSI case 4 Hi > Dn (READ) or case 9 Ho > Dn (WRITE) \r\n");
       status =  MSC_CSW_STATUS_FAILED;
     }
     else if ( cbw->total_bytes / block_count == 0 )
     {
-      TU_LOG(MSC_DEBUG, " Computed block size = 0. SCSI case 7 Hi < Di (READ10) or case 13 Ho < Do (WRIT10)\r\n");
+      TU_LOG(MSC_DEBUG, " Computed block size = 0. SCSI case 7 Hi < Di (READ) or case 13 Ho < Do (WRITE)\r\n");
       status = MSC_CSW_STATUS_PHASE_ERROR;
     }
+    else if ( !rdwr_lba_supported(cbw->command) )
+    {
+      // 64-bit lba without 64-bit callback: LOGICAL BLOCK ADDRESS OUT OF RANGE
+      TU_LOG(MSC_DEBUG, "  SCSI READ16/WRITE16 lba is out of range\r\n");
+      tud_msc_set_sense(cbw->lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x21, 0x00);
+      status = MSC_CSW_STATUS_FAILED;
+    }
   }
 
   return status;
@@ -214,7 +343,14 @@ TU_ATTR_UNUSED static tu_lookup_entry_t const _msc_scsi_cmd_lookup[] =
   { .key = SCSI_CMD_REQUEST_SENSE                , .data = "Request Sense" },
   { .key = SCSI_CMD_READ_FORMAT_CAPACITY         , .data = "Read Format Capacity" },
   { .key = SCSI_CMD_READ_10                      , .data = "Read10" },
-  { .key = SCSI_CMD_WRITE_10                     , .data = "Write10" }
+  { .key = SCSI_CMD_WRITE_10                     , .data = "Write10" },
+  { .key = SCSI_CMD_SYNCHRONIZE_CACHE_10         , .data = "Synchronize Cache10" },
+  { .key = SCSI_CMD_WRITE_SAME_10                , .data = "Write Same10" },
+  { .key = SCSI_CMD_UNMAP                        , .data = "Unmap" },
+  { .key = SCSI_CMD_READ_16                      , .data = "Read16" },
+  { .key = SCSI_CMD_WRITE_16                     , .data = "Write16" },
+  { .key = SCSI_CMD_WRITE_SAME_16                , .data = "Write Same16" },
+  { .key = SCSI_CMD_SERVICE_ACTION_IN_16         , .data = "Service Action In16" }
 };
 
 TU_ATTR_UNUSED static tu_lookup_table_t const _msc_scsi_cmd_table =
@@ -239,24 +375,80 @@ bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, u
   return true;
 }
 
+bool tud_msc_async_io_done(uint8_t lun, int32_t nbytes, bool in_isr)
+{
+  (void) lun;
+  mscd_interface_t* p_msc = &_mscd_itf;
+
+  #if CFG_TUD_UAS
+  // I/O is issued by UAS driver
+  if ( uasd_async_io_done(nbytes, in_isr) ) return true;
+  #endif
+
+  // no I/O is pending e.g aborted by bus or BOT reset
+  TU_VERIFY(p_msc->pending_io);
+
+  // result is processed later in usbd task context
+  p_msc->pending_io_result = nbytes;
+  usbd_defer_func(proc_async_io_done, p_msc, in_isr);
+
+  return true;
+}
+
 static inline void set_sense_medium_not_present(uint8_t lun)
 {
   // default sense is NOT READY, MEDIUM NOT PRESENT
   tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
 }
 
+static inline void set_sense_write_error(uint8_t lun)
+{
+  // MEDIUM ERROR, WRITE ERROR
+  tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+}
+
+static inline void set_sense_invalid_cdb(uint8_t lun)
+{
+  // ILLEGAL REQUEST, INVALID FIELD IN CDB
+  tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+}
+
+// Get disk size from application, 64-bit callback takes precedence
+static void get_capacity(uint8_t lun, uint64_t* block_count, uint32_t* block_size)
+{
+  if ( tud_msc_capacity16_cb )
+  {
+    tud_msc_capacity16_cb(lun, block_count, block_size);
+  }else
+  {
+    uint32_t block_count_u32;
+    uint16_t block_size_u16;
+
+    tud_msc_capacity_cb(lun, &block_count_u32, &block_size_u16);
+
+    *block_count = block_count_u32;
+    *block_size  = block_size_u16;
+  }
+}
+
 //--------------------------------------------------------------------+
 // USBD Driver API
 //--------------------------------------------------------------------+
 void mscd_init(void)
 {
   tu_memclr(&_mscd_itf, sizeof(mscd_interface_t));
+
+#if CFG_TUD_MSC_CACHE
+  mscd_cache_init();
+#endif
 }
 
 void mscd_reset(uint8_t rhport)
 {
   (void) rhport;
   tu_memclr(&_mscd_itf, sizeof(mscd_interface_t));
+
+  // cache is kept, dirty lines are written back by idle timeout or tud_msc_cache_flush()
 }
 
 uint16_t mscd_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t max_len)
@@ -273,6 +465,7 @@ uint16_t mscd_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint1
   TU_ASSERT(max_len >= drv_len, 0);
 
   mscd_interface_t * p_msc = &_mscd_itf;
+  p_msc->rhport  = rhport;
   p_msc->itf_num = itf_desc->bInterfaceNumber;
 
   // Open endpoint pair
@@ -281,14 +474,37 @@ uint16_t mscd_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint1
   // Prepare for Command Block Wrapper
   TU_ASSERT( prepare_cbw(rhport, p_msc), drv_len);
 
+#if CFG_TUD_MSC_CACHE && CFG_TUD_MSC_CACHE_IDLE_MS
+  // SOF is used to time idle write back of cache
+  usbd_sof_enable(rhport, SOF_CONSUMER_MSC, true);
+#endif
+
   return drv_len;
 }
 
+#if CFG_TUD_MSC_CACHE
+void mscd_sof_isr(uint8_t rhport, uint32_t frame_count)
+{
+  (void) rhport;
+
+  // command waiting for busy storage is executed again in usbd task context
+  if ( _mscd_itf.retry_cmd )
+  {
+    _mscd_itf.retry_cmd = false;
+    usbd_defer_func(proc_retry_cmd, &_mscd_itf, true);
+  }
+
+  // write back in usbd task context
+  if ( mscd_cache_sof_isr(frame_count) ) usbd_defer_func(proc_cache_idle, NULL, true);
+}
+#endif
+
 static void proc_bot_reset(mscd_interface_t* p_msc)
 {
   p_msc->stage       = MSC_STAGE_CMD;
   p_msc->total_len   = 0;
   p_msc->xferred_len = 0;
+  p_msc->pending_io  = false;
 
   p_msc->sense_key           = 0;
   p_msc->add_sense_code      = 0;
@@ -425,22 +641,22 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
       p_msc->total_len = p_cbw->total_bytes;
       p_msc->xferred_len = 0;
 
-      // Read10 or Write10
-      if ( (SCSI_CMD_READ_10 == p_cbw->command[0]) || (SCSI_CMD_WRITE_10 == p_cbw->command[0]) )
+      // Read10/Read16 or Write10/Write16
+      if ( is_read_cmd(p_cbw->command[0]) || is_write_cmd(p_cbw->command[0]) )
       {
-        uint8_t const status = rdwr10_validate_cmd(p_cbw);
+        uint8_t const status = rdwr_validate_cmd(p_cbw);
 
         if ( status != MSC_CSW_STATUS_PASSED)
         {
           fail_scsi_op(rhport, p_msc, status);
         }else if ( p_cbw->total_bytes )
         {
-          if (SCSI_CMD_READ_10 == p_cbw->command[0])
+          if ( is_read_cmd(p_cbw->command[0]) )
           {
-            proc_read10_cmd(rhport, p_msc);
+            proc_read_cmd(rhport, p_msc);
           }else
           {
-            proc_write10_cmd(rhport, p_msc);
+            proc_write_cmd(rhport, p_msc);
           }
         }else
         {
@@ -457,7 +673,7 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
         {
           if (p_cbw->total_bytes > sizeof(_mscd_buf))
           {
-            TU_LOG(MSC_DEBUG, "  SCSI reject non READ10/WRITE10 with large data\r\n");
+            TU_LOG(MSC_DEBUG, "  SCSI reject non READ/WRITE with large data\r\n");
             fail_scsi_op(rhport, p_msc, MSC_CSW_STATUS_FAILED);
           }else
           {
@@ -470,6 +686,17 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
           // First process if it is a built-in commands
           int32_t resplen = proc_builtin_scsi(p_cbw->lun, p_cbw->command, _mscd_buf, sizeof(_mscd_buf));
 
+#if CFG_TUD_MSC_CACHE
+          if ( resplen == MSCD_SCSI_RET_BUSY )
+          {
+            // storage is busy, command is executed again on SOF instead of waiting here
+            p_msc->stage     = MSC_STAGE_CMD_BUSY;
+            p_msc->retry_cmd = true;
+            usbd_sof_enable(rhport, SOF_CONSUMER_MSC, true);
+            return true;
+          }
+#endif
+
           // Invoke user callback if not built-in
           if ( (resplen < 0) && (p_msc->sense_key == 0) )
           {
@@ -517,7 +744,7 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
       TU_LOG(MSC_DEBUG, "  SCSI Data [Lun%u]\r\n", p_cbw->lun);
       //TU_LOG_MEM(MSC_DEBUG, _mscd_buf, xferred_bytes, 2);
 
-      if (SCSI_CMD_READ_10 == p_cbw->command[0])
+      if ( is_read_cmd(p_cbw->command[0]) )
       {
         p_msc->xferred_len += xferred_bytes;
 
@@ -527,12 +754,12 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
           p_msc->stage = MSC_STAGE_STATUS;
         }else
         {
-          proc_read10_cmd(rhport, p_msc);
+          proc_read_cmd(rhport, p_msc);
         }
       }
-      else if (SCSI_CMD_WRITE_10 == p_cbw->command[0])
+      else if ( is_write_cmd(p_cbw->command[0]) )
       {
-        proc_write10_new_data(rhport, p_msc, xferred_bytes);
+        proc_write_new_data(rhport, p_msc, xferred_bytes);
       }
       else
       {
@@ -541,7 +768,7 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
         // OUT transfer, invoke callback if needed
         if ( !is_data_in(p_cbw->dir) )
         {
-          int32_t cb_result = tud_msc_scsi_cb(p_cbw->lun, p_cbw->command, _mscd_buf, (uint16_t) p_msc->total_len);
+          int32_t cb_result = mscd_scsi_data_out(p_cbw->lun, p_cbw->command, _mscd_buf, p_msc->total_len);
 
           if ( cb_result < 0 )
           {
@@ -584,10 +811,12 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
         switch(p_cbw->command[0])
         {
           case SCSI_CMD_READ_10:
+          case SCSI_CMD_READ_16:
             if ( tud_msc_read10_complete_cb ) tud_msc_read10_complete_cb(p_cbw->lun);
           break;
 
           case SCSI_CMD_WRITE_10:
+          case SCSI_CMD_WRITE_16:
             if ( tud_msc_write10_complete_cb ) tud_msc_write10_complete_cb(p_cbw->lun);
           break;
 
@@ -638,10 +867,330 @@ bool mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t
   return true;
 }
 
+//--------------------------------------------------------------------+
+// Internal SCSI API (shared with UAS driver)
+//--------------------------------------------------------------------+
+bool mscd_scsi_is_read(uint8_t cmd_code)
+{
+  return is_read_cmd(cmd_code);
+}
+
+bool mscd_scsi_is_write(uint8_t cmd_code)
+{
+  return is_write_cmd(cmd_code);
+}
+
+uint64_t mscd_scsi_rdwr_lba(uint8_t const scsi_cmd[16])
+{
+  return rdwr_get_lba(scsi_cmd);
+}
+
+uint32_t mscd_scsi_rdwr_block_count(uint8_t const scsi_cmd[16])
+{
+  return rdwr_get_blockcount(scsi_cmd);
+}
+
+bool mscd_scsi_rdwr_lba_supported(uint8_t const scsi_cmd[16])
+{
+  return rdwr_lba_supported(scsi_cmd);
+}
+
+int32_t mscd_scsi_rdwr_io(uint8_t lun, uint8_t const scsi_cmd[16], uint32_t block_size, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  return rdwr_io(lun, scsi_cmd, block_size, lba, offset, buffer, bufsize);
+}
+
+bool mscd_scsi_writable(uint8_t lun)
+{
+  return is_writable(lun);
+}
+
+void mscd_scsi_capacity(uint8_t lun, uint64_t* block_count, uint32_t* block_size)
+{
+  get_capacity(lun, block_count, block_size);
+}
+
+int32_t mscd_scsi_cmd(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buffer, uint32_t bufsize)
+{
+  mscd_interface_t* p_msc = &_mscd_itf;
+
+  // First process if it is a built-in commands
+  int32_t resplen = proc_builtin_scsi(lun, scsi_cmd, buffer, bufsize);
+
+  // Invoke user callback if not built-in
+  if ( (resplen < 0) && (resplen != MSCD_SCSI_RET_BUSY) && (p_msc->sense_key == 0) )
+  {
+    resplen = tud_msc_scsi_cb(lun, scsi_cmd, buffer, (uint16_t) tu_min32(bufsize, UINT16_MAX));
+
+    // any negative result of callback is a failure
+    if ( resplen < 0 ) resplen = -1;
+  }
+
+  return resplen;
+}
+
+int32_t mscd_scsi_data_out(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buffer, uint32_t len)
+{
+  mscd_interface_t* p_msc = &_mscd_itf;
+
+  // First process if it is a built-in commands
+  int32_t result = proc_builtin_scsi_data_out(lun, scsi_cmd, buffer, len);
+
+  // Invoke user callback if not built-in
+  if ( (result < 0) && (p_msc->sense_key == 0) )
+  {
+    result = tud_msc_scsi_cb(lun, scsi_cmd, buffer, (uint16_t) tu_min32(len, UINT16_MAX));
+  }
+
+  return result;
+}
+
+int32_t mscd_scsi_sense(uint8_t lun, uint8_t* buffer, uint32_t bufsize)
+{
+  mscd_interface_t* p_msc = &_mscd_itf;
+
+  scsi_sense_fixed_resp_t sense_rsp =
+  {
+      .response_code = 0x70, // current, fixed format
+      .valid         = 1
+  };
+
+  sense_rsp.add_sense_len       = sizeof(scsi_sense_fixed_resp_t) - 8;
+  sense_rsp.sense_key           = (uint8_t) (p_msc->sense_key & 0x0F);
+  sense_rsp.add_sense_code      = p_msc->add_sense_code;
+  sense_rsp.add_sense_qualifier = p_msc->add_sense_qualifier;
+
+  int32_t resplen = (int32_t) tu_min32(sizeof(sense_rsp), bufsize);
+  memcpy(buffer, &sense_rsp, (size_t) resplen);
+
+  // request sense callback could overwrite the sense data
+  if (tud_msc_request_sense_cb)
+  {
+    resplen = tud_msc_request_sense_cb(lun, buffer, (uint16_t) bufsize);
+  }
+
+  // Clear sense data after copy
+  tud_msc_set_sense(lun, 0, 0, 0);
+
+  return resplen;
+}
+
+bool mscd_scsi_has_sense(uint8_t lun)
+{
+  (void) lun;
+  return _mscd_itf.sense_key != 0;
+}
+
 /*------------------------------------------------------------------*/
 /* SCSI Command Process
  *------------------------------------------------------------------*/
 
+// max block descriptors of an UNMAP parameter list received in one transfer
+#define MSC_UNMAP_MAX_DESC  ((CFG_TUD_MSC_EP_BUFSIZE - sizeof(scsi_unmap_param_header_t)) / sizeof(scsi_unmap_block_desc_t))
+
+static bool unmap_range_valid(uint8_t lun, uint64_t lba, uint32_t block_count)
+{
+  uint64_t capacity;
+  uint32_t block_size;
+  get_capacity(lun, &capacity, &block_size);
+
+  if ( (lba > capacity) || (block_count > capacity - lba) )
+  {
+    // ILLEGAL REQUEST, LOGICAL BLOCK ADDRESS OUT OF RANGE
+    tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x21, 0x00);
+    return false;
+  }
+
+  return true;
+}
+
+static bool unmap_range(uint8_t lun, uint64_t lba, uint32_t block_count)
+{
+  if ( block_count == 0 ) return true;
+
+#if CFG_TUD_MSC_CACHE
+  // dirty blocks are not worth writing back
+  mscd_cache_discard(lun, lba, block_count);
+#endif
+
+  if ( !tud_msc_unmap_cb(lun, lba, block_count) )
+  {
+    // set default sense if not set by callback
+    if ( _mscd_itf.sense_key == 0 ) set_sense_write_error(lun);
+    return false;
+  }
+
+  return true;
+}
+
+// WRITE SAME with UNMAP bit is handled if application supports unmapping
+static bool is_write_same_unmap(uint8_t const scsi_cmd[16])
+{
+  if ( !tud_msc_unmap_cb ) return false;
+  if ( (scsi_cmd[0] != SCSI_CMD_WRITE_SAME_10) && (scsi_cmd[0] != SCSI_CMD_WRITE_SAME_16) ) return false;
+
+  return (scsi_cmd[1] & SCSI_WRITE_SAME_FLAG_UNMAP) != 0;
+}
+
+static int32_t proc_write_same_unmap(uint8_t lun, uint8_t const scsi_cmd[16])
+{
+  uint64_t lba;
+  uint32_t block_count;
+
+  if ( scsi_cmd[0] == SCSI_CMD_WRITE_SAME_10 )
+  {
+    scsi_write_same10_t const* cmd = (scsi_write_same10_t const*) scsi_cmd;
+    lba         = tu_ntohl(cmd->lba);
+    block_count = tu_ntohs(cmd->block_count);
+  }else
+  {
+    lba         = scsi_read_be64(scsi_cmd + offsetof(scsi_write_same16_t, lba));
+    block_count = tu_ntohl(tu_unaligned_read32(scsi_cmd + offsetof(scsi_write_same16_t, block_count)));
+  }
+
+  // zero block count (to the end of medium) is not supported, reported as WSNZ in Block Limits VPD
+  if ( block_count == 0 )
+  {
+    set_sense_invalid_cdb(lun);
+    return -1;
+  }
+
+  TU_VERIFY(unmap_range_valid(lun, lba, block_count), -1);
+  TU_VERIFY(unmap_range(lun, lba, block_count), -1);
+
+  return 0;
+}
+
+static int32_t proc_unmap_cmd(uint8_t lun, uint8_t const* param, uint32_t len)
+{
+  // no parameter list is not an error
+  if ( len == 0 ) return 0;
+
+  if ( len < sizeof(scsi_unmap_param_header_t) )
+  {
+    // ILLEGAL REQUEST, PARAMETER LIST LENGTH ERROR
+    tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x1A, 0x00);
+    return -1;
+  }
+
+  uint16_t const desc_len = tu_ntohs(tu_unaligned_read16(param + offsetof(scsi_unmap_param_header_t, block_desc_length)));
+  uint32_t const desc_count = tu_min32(desc_len, len - (uint32_t) sizeof(scsi_unmap_param_header_t)) / (uint32_t) sizeof(scsi_unmap_block_desc_t);
+
+  if ( desc_count > MSC_UNMAP_MAX_DESC )
+  {
+    // ILLEGAL REQUEST, INVALID FIELD IN PARAMETER LIST
+    tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x26, 0x00);
+    return -1;
+  }
+
+  scsi_unmap_block_desc_t const* desc = (scsi_unmap_block_desc_t const*) (param + sizeof(scsi_unmap_param_header_t));
+
+  // nothing is unmapped if any of descriptors is out of range
+  for(uint32_t i=0; i<desc_count; i++)
+  {
+    uint8_t const* p_desc = (uint8_t const*) &desc[i];
+    uint64_t const lba = scsi_read_be64(p_desc + offsetof(scsi_unmap_block_desc_t, lba));
+    uint32_t const block_count = tu_ntohl(tu_unaligned_read32(p_desc + offsetof(scsi_unmap_block_desc_t, block_count)));
+
+    TU_VERIFY(unmap_range_valid(lun, lba, block_count), -1);
+  }
+
+  for(uint32_t i=0; i<desc_count; i++)
+  {
+    uint8_t const* p_desc = (uint8_t const*) &desc[i];
+    uint64_t const lba = scsi_read_be64(p_desc + offsetof(scsi_unmap_block_desc_t, lba));
+    uint32_t const block_count = tu_ntohl(tu_unaligned_read32(p_desc + offsetof(scsi_unmap_block_desc_t, block_count)));
+
+    TU_VERIFY(unmap_range(lun, lba, block_count), -1);
+  }
+
+  return 0;
+}
+
+// Vital Product Data pages for thin provisioning, other pages are handled by application
+static int32_t proc_inquiry_vpd(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buffer, uint32_t bufsize)
+{
+  (void) lun;
+
+  union
+  {
+    struct TU_ATTR_PACKED
+    {
+      scsi_vpd_page_header_t header;
+      uint8_t page_list[3];
+    } supported;
+
+    scsi_vpd_block_limits_t    block_limits;
+    scsi_vpd_lb_provisioning_t lb_provisioning;
+  } vpd;
+
+  tu_memclr(&vpd, sizeof(vpd));
+
+  uint8_t const page_code = scsi_cmd[2];
+  uint16_t page_len;
+
+  switch ( page_code )
+  {
+    case SCSI_VPD_PAGE_SUPPORTED_PAGES:
+      vpd.supported.page_list[0] = SCSI_VPD_PAGE_SUPPORTED_PAGES;
+      vpd.supported.page_list[1] = SCSI_VPD_PAGE_BLOCK_LIMITS;
+      vpd.supported.page_list[2] = SCSI_VPD_PAGE_LOGICAL_BLOCK_PROVISIONING;
+      page_len = sizeof(vpd.supported);
+    break;
+
+    case SCSI_VPD_PAGE_BLOCK_LIMITS:
+    {
+      vpd.block_limits.wsnz                 = 1;
+      vpd.block_limits.max_unmap_lba_count  = tu_htonl(UINT32_MAX);
+      vpd.block_limits.max_unmap_desc_count = tu_htonl((uint32_t) MSC_UNMAP_MAX_DESC);
+      // max_write_same_length stays 0: only WRITE SAME with UNMAP is handled, not writing of the data block
+
+#if CFG_TUD_MSC_CACHE
+      // unmapping whole cache lines also drops them from cache
+      uint64_t block_count;
+      uint32_t block_size;
+      get_capacity(lun, &block_count, &block_size);
+
+      if ( block_size ) vpd.block_limits.opt_unmap_granularity = tu_htonl(CFG_TUD_MSC_CACHE_LINE_SIZE / block_size);
+#endif
+
+      page_len = sizeof(vpd.block_limits);
+    }
+    break;
+
+    case SCSI_VPD_PAGE_LOGICAL_BLOCK_PROVISIONING:
+      vpd.lb_provisioning.flags             = 0xE0; // LBPU, LBPWS, LBPWS10
+      vpd.lb_provisioning.provisioning_type = 2;    // thin provisioned
+      page_len = sizeof(vpd.lb_provisioning);
+    break;
+
+    default: return -1;
+  }
+
+  vpd.supported.header.page_code   = page_code;
+  vpd.supported.header.page_length = tu_htons((uint16_t) (page_len - sizeof(scsi_vpd_page_header_t)));
+
+  // response is truncated to allocation length
+  uint16_t const alloc_len = tu_ntohs(tu_unaligned_read16(scsi_cmd + 3));
+
+  int32_t const resplen = (int32_t) tu_min32(page_len, tu_min32(alloc_len, bufsize));
+  memcpy(buffer, &vpd, (size_t) resplen);
+
+  return resplen;
+}
+
+#if CFG_TUD_MSC_CACHE
+// Result of built-in command whose cache write back is not completed
+static int32_t cache_flush_failed(uint8_t lun, int32_t rc)
+{
+  // storage is busy, command is executed again later on
+  if ( rc == TUD_MSC_RET_BUSY ) return MSCD_SCSI_RET_BUSY;
+
+  set_sense_write_error(lun);
+  return -1;
+}
+#endif
+
 // return response's length (copied to buffer). Negative if it is not an built-in command or indicate Failed status (CSW)
 // In case of a failed status, sense key must be set for reason of failure
 static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buffer, uint32_t bufsize)
@@ -668,6 +1217,22 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
     case SCSI_CMD_START_STOP_UNIT:
       resplen = 0;
 
+#if CFG_TUD_MSC_CACHE
+      {
+        // write back before stopping, medium could also be changed after eject
+        scsi_start_stop_unit_t const * start_stop = (scsi_start_stop_unit_t const *) scsi_cmd;
+        if ( !start_stop->start )
+        {
+          int32_t const rc = mscd_cache_flush(lun, start_stop->load_eject);
+          if ( rc <= 0 )
+          {
+            resplen = cache_flush_failed(lun, rc);
+            break;
+          }
+        }
+      }
+#endif
+
       if (tud_msc_start_stop_cb)
       {
         scsi_start_stop_unit_t const * start_stop = (scsi_start_stop_unit_t const *) scsi_cmd;
@@ -682,14 +1247,32 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
       }
     break;
 
+    case SCSI_CMD_WRITE_SAME_16:
+      // only WRITE SAME (16) with UNMAP and no Data-Out buffer is processed here
+      if ( is_write_same_unmap(scsi_cmd) && (scsi_cmd[1] & SCSI_WRITE_SAME_FLAG_NDOB) )
+      {
+        resplen = proc_write_same_unmap(lun, scsi_cmd);
+      }else
+      {
+        resplen = -1;
+      }
+    break;
+
+#if CFG_TUD_MSC_CACHE
+    case SCSI_CMD_SYNCHRONIZE_CACHE_10:
+    {
+      int32_t const rc = mscd_cache_flush(lun, false);
+      resplen = (rc > 0) ? 0 : cache_flush_failed(lun, rc);
+    }
+    break;
+#endif
+
     case SCSI_CMD_READ_CAPACITY_10:
     {
-      uint32_t block_count;
+      uint64_t block_count;
       uint32_t block_size;
-      uint16_t block_size_u16;
 
-      tud_msc_capacity_cb(lun, &block_count, &block_size_u16);
-      block_size = (uint32_t) block_size_u16;
+      get_capacity(lun, &block_count, &block_size);
 
       // Invalid block size/count from callback, possibly unit is not ready
       // stall this request, set sense key to NOT READY
@@ -703,7 +1286,8 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
       {
         scsi_read_capacity10_resp_t read_capa10;
 
-        read_capa10.last_lba   = tu_htonl(block_count-1);
+        // last lba = 0xFFFFFFFF indicates host to use READ CAPACITY16
+        read_capa10.last_lba   = tu_htonl((uint32_t) tu_min64(block_count-1, UINT32_MAX));
         read_capa10.block_size = tu_htonl(block_size);
 
         resplen = sizeof(read_capa10);
@@ -712,6 +1296,48 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
     }
     break;
 
+    case SCSI_CMD_SERVICE_ACTION_IN_16:
+    {
+      scsi_read_capacity16_t const * cmd_capa16 = (scsi_read_capacity16_t const *) scsi_cmd;
+
+      // other service actions are handled by application
+      if ( (cmd_capa16->service_action & 0x1Fu) != SCSI_SERVICE_ACTION_READ_CAPACITY_16 )
+      {
+        resplen = -1;
+        break;
+      }
+
+      uint64_t block_count;
+      uint32_t block_size;
+
+      get_capacity(lun, &block_count, &block_size);
+
+      if (block_count == 0 || block_size == 0)
+      {
+        resplen = -1;
+
+        // set default sense if not set by callback
+        if ( p_msc->sense_key == 0 ) set_sense_medium_not_present(lun);
+      }else
+      {
+        scsi_read_capacity16_resp_t read_capa16;
+        tu_memclr(&read_capa16, sizeof(read_capa16));
+
+        scsi_write_be64((uint8_t*) &read_capa16.last_lba, block_count-1);
+        read_capa16.block_size = tu_htonl(block_size);
+
+        // LBPME: logical block provisioning management is enabled
+        if ( tud_msc_unmap_cb ) read_capa16.lowest_aligned_lba = tu_htons(0x8000);
+
+        // response is truncated to allocation length
+        uint32_t const alloc_len = tu_ntohl(tu_unaligned_read32(scsi_cmd + offsetof(scsi_read_capacity16_t, alloc_length)));
+
+        resplen = (int32_t) tu_min32(sizeof(read_capa16), tu_min32(alloc_len, bufsize));
+        memcpy(buffer, &read_capa16, (size_t) resplen);
+      }
+    }
+    break;
+
     case SCSI_CMD_READ_FORMAT_CAPACITY:
     {
       scsi_read_format_capacity_data_t read_fmt_capa =
@@ -722,10 +1348,10 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
           .block_size_u16  = 0
       };
 
-      uint32_t block_count;
-      uint16_t block_size;
+      uint64_t block_count;
+      uint32_t block_size;
 
-      tud_msc_capacity_cb(lun, &block_count, &block_size);
+      get_capacity(lun, &block_count, &block_size);
 
       // Invalid block size/count from callback, possibly unit is not ready
       // stall this request, set sense key to NOT READY
@@ -737,8 +1363,8 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
         if ( p_msc->sense_key == 0 ) set_sense_medium_not_present(lun);
       }else
       {
-        read_fmt_capa.block_num = tu_htonl(block_count);
-        read_fmt_capa.block_size_u16 = tu_htons(block_size);
+        read_fmt_capa.block_num = tu_htonl((uint32_t) tu_min64(block_count, UINT32_MAX));
+        read_fmt_capa.block_size_u16 = tu_htons((uint16_t) block_size);
 
         resplen = sizeof(read_fmt_capa);
         memcpy(buffer, &read_fmt_capa, (size_t) resplen);
@@ -748,6 +1374,13 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
 
     case SCSI_CMD_INQUIRY:
     {
+      // EVPD: Vital Product Data pages are built-in only for unmapping
+      if ( scsi_cmd[1] & 0x01 )
+      {
+        resplen = tud_msc_unmap_cb ? proc_inquiry_vpd(lun, scsi_cmd, buffer, bufsize) : -1;
+        break;
+      }
+
       scsi_inquiry_resp_t inquiry_rsp =
       {
           .is_removable         = 1,
@@ -756,6 +1389,9 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
           .additional_length    = sizeof(scsi_inquiry_resp_t) - 5,
       };
 
+      // SPC-3 is required for host to query VPD pages
+      if ( tud_msc_unmap_cb ) inquiry_rsp.version = 5;
+
       // vendor_id, product_id, product_rev is space padded string
       memset(inquiry_rsp.vendor_id  , ' ', sizeof(inquiry_rsp.vendor_id));
       memset(inquiry_rsp.product_id , ' ', sizeof(inquiry_rsp.product_id));
@@ -779,13 +1415,7 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
           .block_descriptor_len = 0  // no block descriptor are included
       };
 
-      bool writable = true;
-      if ( tud_msc_is_writable_cb )
-      {
-        writable = tud_msc_is_writable_cb(lun);
-      }
-
-      mode_resp.write_protected = !writable;
+      mode_resp.write_protected = !is_writable(lun);
 
       resplen = sizeof(mode_resp);
       memcpy(buffer, &mode_resp, (size_t) resplen);
@@ -793,30 +1423,7 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
     break;
 
     case SCSI_CMD_REQUEST_SENSE:
-    {
-      scsi_sense_fixed_resp_t sense_rsp =
-      {
-          .response_code = 0x70, // current, fixed format
-          .valid         = 1
-      };
-
-      sense_rsp.add_sense_len       = sizeof(scsi_sense_fixed_resp_t) - 8;
-      sense_rsp.sense_key           = (uint8_t) (p_msc->sense_key & 0x0F);
-      sense_rsp.add_sense_code      = p_msc->add_sense_code;
-      sense_rsp.add_sense_qualifier = p_msc->add_sense_qualifier;
-
-      resplen = sizeof(sense_rsp);
-      memcpy(buffer, &sense_rsp, (size_t) resplen);
-
-      // request sense callback could overwrite the sense data
-      if (tud_msc_request_sense_cb)
-      {
-        resplen = tud_msc_request_sense_cb(lun, buffer, (uint16_t) bufsize);
-      }
-
-      // Clear sense data after copy
-      tud_msc_set_sense(lun, 0, 0, 0);
-    }
+      resplen = mscd_scsi_sense(lun, buffer, bufsize);
     break;
 
     default: resplen = -1; break;
@@ -825,27 +1432,58 @@ static int32_t proc_builtin_scsi(uint8_t lun, uint8_t const scsi_cmd[16], uint8_
   return resplen;
 }
 
-static void proc_read10_cmd(uint8_t rhport, mscd_interface_t* p_msc)
+// Process built-in command with Data-Out once all data is received, same return value as proc_builtin_scsi()
+static int32_t proc_builtin_scsi_data_out(uint8_t lun, uint8_t const scsi_cmd[16], uint8_t const* buffer, uint32_t len)
+{
+  if ( scsi_cmd[0] == SCSI_CMD_UNMAP && tud_msc_unmap_cb )
+  {
+    uint16_t const param_len = tu_ntohs(tu_unaligned_read16(scsi_cmd + offsetof(scsi_unmap_t, param_list_length)));
+    return proc_unmap_cmd(lun, buffer, tu_min32(len, param_len));
+  }
+
+  // data block of WRITE SAME with UNMAP is ignored
+  if ( is_write_same_unmap(scsi_cmd) ) return proc_write_same_unmap(lun, scsi_cmd);
+
+  return -1;
+}
+
+static void proc_read_cmd(uint8_t rhport, mscd_interface_t* p_msc)
 {
   msc_cbw_t const * p_cbw = &p_msc->cbw;
 
   // block size already verified not zero
-  uint16_t const block_sz = rdwr10_get_blocksize(p_cbw);
+  uint32_t const block_sz = rdwr_get_blocksize(p_cbw);
 
   // Adjust lba with transferred bytes
-  uint32_t const lba = rdwr10_get_lba(p_cbw->command) + (p_msc->xferred_len / block_sz);
+  uint64_t const lba = rdwr_get_lba(p_cbw->command) + (p_msc->xferred_len / block_sz);
 
   // remaining bytes capped at class buffer
   int32_t nbytes = (int32_t) tu_min32(sizeof(_mscd_buf), p_cbw->total_bytes-p_msc->xferred_len);
 
   // Application can consume smaller bytes
   uint32_t const offset = p_msc->xferred_len % block_sz;
-  nbytes = tud_msc_read10_cb(p_cbw->lun, lba, offset, _mscd_buf, (uint32_t) nbytes);
+
+  // armed before callback since application may invoke tud_msc_async_io_done() before it returns e.g from DMA ISR
+  p_msc->pending_io = true;
+  nbytes = rdwr_io(p_cbw->lun, p_cbw->command, block_sz, lba, offset, _mscd_buf, (uint32_t) nbytes);
+
+  // otherwise application will invoke tud_msc_async_io_done() when data is ready in buffer
+  if ( nbytes != TUD_MSC_RET_ASYNC )
+  {
+    p_msc->pending_io = false;
+    proc_read_io_data(rhport, p_msc, nbytes);
+  }
+}
+
+// process result of READ10/READ16 callback (synchronous or asynchronous)
+static void proc_read_io_data(uint8_t rhport, mscd_interface_t* p_msc, int32_t nbytes)
+{
+  msc_cbw_t const * p_cbw = &p_msc->cbw;
 
   if ( nbytes < 0 )
   {
     // negative means error -> endpoint is stalled & status in CSW set to failed
-    TU_LOG(MSC_DEBUG, "  tud_msc_read10_cb() return -1\r\n");
+    TU_LOG(MSC_DEBUG, "  tud_msc_read10_cb() or tud_msc_read16_cb() return -1\r\n");
 
     // set sense
     set_sense_medium_not_present(p_cbw->lun);
@@ -863,17 +1501,11 @@ static void proc_read10_cmd(uint8_t rhport, mscd_interface_t* p_msc)
   }
 }
 
-static void proc_write10_cmd(uint8_t rhport, mscd_interface_t* p_msc)
+static void proc_write_cmd(uint8_t rhport, mscd_interface_t* p_msc)
 {
   msc_cbw_t const * p_cbw = &p_msc->cbw;
-  bool writable = true;
-
-  if ( tud_msc_is_writable_cb )
-  {
-    writable = tud_msc_is_writable_cb(p_cbw->lun);
-  }
 
-  if ( !writable )
+  if ( !is_writable(p_cbw->lun) )
   {
     // Not writable, complete this SCSI op with error
     // Sense = Write protected
@@ -885,29 +1517,46 @@ static void proc_write10_cmd(uint8_t rhport, mscd_interface_t* p_msc)
   // remaining bytes capped at class buffer
   uint16_t nbytes = (uint16_t) tu_min32(sizeof(_mscd_buf), p_cbw->total_bytes-p_msc->xferred_len);
 
-  // Write10 callback will be called later when usb transfer complete
+  // Write10/Write16 callback will be called later when usb transfer complete
   TU_ASSERT( usbd_edpt_xfer(rhport, p_msc->ep_out, _mscd_buf, nbytes), );
 }
 
-// process new data arrived from WRITE10
-static void proc_write10_new_data(uint8_t rhport, mscd_interface_t* p_msc, uint32_t xferred_bytes)
+// process new data arrived from WRITE10/WRITE16
+static void proc_write_new_data(uint8_t rhport, mscd_interface_t* p_msc, uint32_t xferred_bytes)
 {
   msc_cbw_t const * p_cbw = &p_msc->cbw;
 
   // block size already verified not zero
-  uint16_t const block_sz = rdwr10_get_blocksize(p_cbw);
+  uint32_t const block_sz = rdwr_get_blocksize(p_cbw);
 
   // Adjust lba with transferred bytes
-  uint32_t const lba = rdwr10_get_lba(p_cbw->command) + (p_msc->xferred_len / block_sz);
+  uint64_t const lba = rdwr_get_lba(p_cbw->command) + (p_msc->xferred_len / block_sz);
 
   // Invoke callback to consume new data
   uint32_t const offset = p_msc->xferred_len % block_sz;
-  int32_t nbytes = tud_msc_write10_cb(p_cbw->lun, lba, offset, _mscd_buf, xferred_bytes);
+
+  // armed before callback since application may invoke tud_msc_async_io_done() before it returns e.g from DMA ISR
+  p_msc->pending_io     = true;
+  p_msc->pending_io_len = xferred_bytes;
+  int32_t nbytes = rdwr_io(p_cbw->lun, p_cbw->command, block_sz, lba, offset, _mscd_buf, xferred_bytes);
+
+  // otherwise application will invoke tud_msc_async_io_done() when buffer is consumed
+  if ( nbytes != TUD_MSC_RET_ASYNC )
+  {
+    p_msc->pending_io = false;
+    proc_write_io_data(rhport, p_msc, xferred_bytes, nbytes);
+  }
+}
+
+// process result of WRITE10/WRITE16 callback (synchronous or asynchronous)
+static void proc_write_io_data(uint8_t rhport, mscd_interface_t* p_msc, uint32_t xferred_bytes, int32_t nbytes)
+{
+  msc_cbw_t const * p_cbw = &p_msc->cbw;
 
   if ( nbytes < 0 )
   {
     // negative means error -> failed this scsi op
-    TU_LOG(MSC_DEBUG, "  tud_msc_write10_cb() return -1\r\n");
+    TU_LOG(MSC_DEBUG, "  tud_msc_write10_cb() or tud_msc_write16_cb() return -1\r\n");
 
     // update actual byte before failed
     p_msc->xferred_len += xferred_bytes;
@@ -943,10 +1592,77 @@ static void proc_write10_new_data(uint8_t rhport, mscd_interface_t* p_msc, uint3
       }else
       {
         // prepare to receive more data from host
-        proc_write10_cmd(rhport, p_msc);
+        proc_write_cmd(rhport, p_msc);
       }
     }
   }
 }
 
+// Deferred from tud_msc_async_io_done(), running in usbd task context
+static void proc_async_io_done(void* param)
+{
+  mscd_interface_t* p_msc = (mscd_interface_t*) param;
+
+  // I/O is aborted by reset in the mean time
+  if ( !(p_msc->pending_io && p_msc->stage == MSC_STAGE_DATA) ) return;
+  p_msc->pending_io = false;
+
+  int32_t const nbytes = p_msc->pending_io_result;
+
+  if ( is_read_cmd(p_msc->cbw.command[0]) )
+  {
+    proc_read_io_data(p_msc->rhport, p_msc, nbytes);
+  }
+  else if ( is_write_cmd(p_msc->cbw.command[0]) )
+  {
+    proc_write_io_data(p_msc->rhport, p_msc, p_msc->pending_io_len, nbytes);
+  }
+
+  // Data stage may be completed by this I/O
+  if ( p_msc->stage == MSC_STAGE_STATUS && !usbd_edpt_stalled(p_msc->rhport, p_msc->ep_in) )
+  {
+    TU_ASSERT( send_csw(p_msc->rhport, p_msc), );
+  }
+}
+
+#if CFG_TUD_MSC_CACHE
+// Deferred from SOF, execute again the command postponed since storage was busy
+static void proc_retry_cmd(void* param)
+{
+  mscd_interface_t* p_msc = (mscd_interface_t*) param;
+
+  // SOF is still used by idle write back, otherwise it is enabled again if storage is still busy
+  #if !CFG_TUD_MSC_CACHE_IDLE_MS
+  usbd_sof_enable(p_msc->rhport, SOF_CONSUMER_MSC, false);
+  #endif
+
+  // command is dropped by reset in the mean time
+  if ( p_msc->stage != MSC_STAGE_CMD_BUSY ) return;
+
+  // process received CBW again
+  p_msc->stage = MSC_STAGE_CMD;
+  mscd_xfer_cb(p_msc->rhport, p_msc->ep_out, XFER_RESULT_SUCCESS, sizeof(msc_cbw_t));
+}
+
+// Deferred from SOF when there is no READ/WRITE for CFG_TUD_MSC_CACHE_IDLE_MS
+static void proc_cache_idle(void* param)
+{
+  (void) param;
+
+  // storage callbacks could be in progress, try again after another idle period
+  bool busy = (_mscd_itf.stage == MSC_STAGE_DATA);
+  #if CFG_TUD_UAS
+  busy = busy || uasd_busy();
+  #endif
+
+  if ( busy )
+  {
+    mscd_cache_idle_restart();
+    return;
+  }
+
+  mscd_cache_idle_flush();
+}
+#endif
+
 #endif
@@ -50,6 +50,40 @@
 
 TU_VERIFY_STATIC(CFG_TUD_MSC_EP_BUFSIZE < UINT16_MAX, "Size is not correct");
 
+// Write-back cache between SCSI READ/WRITE and storage callbacks. Small writes are gathered into
+// erase-block sized lines and written back as a whole on SYNCHRONIZE CACHE, eject, eviction or idle timeout.
+#ifndef CFG_TUD_MSC_CACHE
+  #define CFG_TUD_MSC_CACHE  0
+#endif
+
+#if CFG_TUD_MSC_CACHE
+  // Number of cache lines
+  #ifndef CFG_TUD_MSC_CACHE_LINES
+    #define CFG_TUD_MSC_CACHE_LINES     4
+  #endif
+
+  // Line size should be the erase block size of storage, must be multiple of block size and up to 32 blocks
+  #ifndef CFG_TUD_MSC_CACHE_LINE_SIZE
+    #define CFG_TUD_MSC_CACHE_LINE_SIZE 4096
+  #endif
+
+  // Dirty lines are written back when there is no READ/WRITE for this duration (based on SOF), 0 to disable
+  #ifndef CFG_TUD_MSC_CACHE_IDLE_MS
+    #define CFG_TUD_MSC_CACHE_IDLE_MS   500
+  #endif
+
+  TU_VERIFY_STATIC(CFG_TUD_MSC_CACHE_LINES > 0 && CFG_TUD_MSC_CACHE_LINES < 256, "Number of lines is not correct");
+  TU_VERIFY_STATIC(CFG_TUD_MSC_CACHE_IDLE_MS < 2048, "Idle timeout must be less than 2048 ms");
+#endif
+
+// Return values of READ10/WRITE10 (and READ16/WRITE16) callbacks other than number of processed bytes
+enum
+{
+  TUD_MSC_RET_BUSY  = 0,   // storage is not ready, callback is invoked again later on
+  TUD_MSC_RET_ERROR = -1,  // I/O error, SCSI op is failed
+  TUD_MSC_RET_ASYNC = -16, // I/O is in progress, application must call tud_msc_async_io_done() when complete
+};
+
 //--------------------------------------------------------------------+
 // Application API
 //--------------------------------------------------------------------+
@@ -57,6 +91,19 @@ TU_VERIFY_STATIC(CFG_TUD_MSC_EP_BUFSIZE < UINT16_MAX, "Size is not correct");
 // Set SCSI sense response
 bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier);
 
+// Complete a READ10/WRITE10 I/O whose callback returned TUD_MSC_RET_ASYNC. Can be called from any context
+// including ISR e.g DMA complete interrupt. nbytes has the same meaning as the callback's return value:
+// number of bytes read/written, TUD_MSC_RET_BUSY to retry or TUD_MSC_RET_ERROR to fail the SCSI op.
+// It may also be called before the callback has returned TUD_MSC_RET_ASYNC.
+bool tud_msc_async_io_done(uint8_t lun, int32_t nbytes, bool in_isr);
+
+#if CFG_TUD_MSC_CACHE
+// Write back dirty cache lines of the LUN to storage. Storage callbacks are invoked in the caller context and
+// must complete synchronously. Return 1 when done, TUD_MSC_RET_BUSY if storage is busy and flush should be
+// called again later on, or TUD_MSC_RET_ERROR if a storage callback failed.
+int32_t tud_msc_cache_flush(uint8_t lun);
+#endif
+
 //--------------------------------------------------------------------+
 // Application Callbacks (WEAK is optional)
 //--------------------------------------------------------------------+
@@ -73,6 +120,9 @@ bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, u
 //
 //   - read < 0       : Indicate application error e.g invalid address. This request will be STALLed
 //                      and return failed status in command status wrapper phase.
+//
+//   - TUD_MSC_RET_ASYNC : Application has started the I/O (e.g DMA) and will fill the buffer later on.
+//                      Buffer must stay untouched by the stack until tud_msc_async_io_done() is called.
 int32_t tud_msc_read10_cb (uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize);
 
 // Invoked when received SCSI WRITE10 command
@@ -88,6 +138,12 @@ int32_t tud_msc_read10_cb (uint8_t lun, uint32_t lba, uint32_t offset, void* buf
 //   - write < 0       : Indicate application error e.g invalid address. This request will be STALLed
 //                       and return failed status in command status wrapper phase.
 //
+//   - TUD_MSC_RET_ASYNC : Application has started the I/O (e.g DMA) from buffer and will report number of
+//                       written bytes later on with tud_msc_async_io_done().
+//
+// With CFG_TUD_MSC_CACHE, writes are line aligned and issued when a line is written back, TUD_MSC_RET_ASYNC
+// is not supported by write back and also by READ10 to fill up a partially written line.
+//
 // TODO change buffer to const uint8_t*
 int32_t tud_msc_write10_cb (uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
 
@@ -105,8 +161,9 @@ void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_siz
 
 /**
  * Invoked when received an SCSI command not in built-in list below.
- * - READ_CAPACITY10, READ_FORMAT_CAPACITY, INQUIRY, TEST_UNIT_READY, START_STOP_UNIT, MODE_SENSE6, REQUEST_SENSE
- * - READ10 and WRITE10 has their own callbacks
+ * - READ_CAPACITY10, READ_CAPACITY16, READ_FORMAT_CAPACITY, INQUIRY, TEST_UNIT_READY, START_STOP_UNIT, MODE_SENSE6, REQUEST_SENSE
+ * - READ10, WRITE10, READ16 and WRITE16 has their own callbacks
+ * - UNMAP and WRITE SAME with UNMAP bit are handled with tud_msc_unmap_cb() if implemented
  *
  * \param[in]   lun         Logical unit number
  * \param[in]   scsi_cmd    SCSI command contents which application must examine to response accordingly
@@ -123,6 +180,19 @@ int32_t tud_msc_scsi_cb (uint8_t lun, uint8_t const scsi_cmd[16], void* buffer,
 
 /*------------- Optional callbacks -------------*/
 
+// Invoked when received SCSI READ16 command, same as tud_msc_read10_cb() but with 64-bit lba.
+// If not implemented, READ16 addressing only the first 2^32 blocks is forwarded to tud_msc_read10_cb()
+TU_ATTR_WEAK int32_t tud_msc_read16_cb (uint8_t lun, uint64_t lba, uint32_t offset, void* buffer, uint32_t bufsize);
+
+// Invoked when received SCSI WRITE16 command, same as tud_msc_write10_cb() but with 64-bit lba.
+// If not implemented, WRITE16 addressing only the first 2^32 blocks is forwarded to tud_msc_write10_cb()
+TU_ATTR_WEAK int32_t tud_msc_write16_cb (uint8_t lun, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
+
+// Invoked to determine disk size for storage larger than 2^32 blocks (2 TiB with 512-byte block).
+// If implemented, it is used instead of tud_msc_capacity_cb() for all capacity commands including
+// SCSI_CMD_READ_CAPACITY_16. Host is told to use READ_CAPACITY_16 and READ16/WRITE16 when capacity does not fit 32-bit.
+TU_ATTR_WEAK void tud_msc_capacity16_cb(uint8_t lun, uint64_t* block_count, uint32_t* block_size);
+
 // Invoked when received GET_MAX_LUN request, required for multiple LUNs implementation
 TU_ATTR_WEAK uint8_t tud_msc_get_maxlun_cb(void);
 
@@ -134,18 +204,24 @@ TU_ATTR_WEAK bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bo
 // Invoked when received REQUEST_SENSE
 TU_ATTR_WEAK int32_t tud_msc_request_sense_cb(uint8_t lun, void* buffer, uint16_t bufsize);
 
-// Invoked when Read10 command is complete
+// Invoked when Read10 (or Read16) command is complete
 TU_ATTR_WEAK void tud_msc_read10_complete_cb(uint8_t lun);
 
-// Invoke when Write10 command is complete, can be used to flush flash caching
+// Invoke when Write10 (or Write16) command is complete, can be used to flush flash caching
 TU_ATTR_WEAK void tud_msc_write10_complete_cb(uint8_t lun);
 
 // Invoked when command in tud_msc_scsi_cb is complete
 TU_ATTR_WEAK void tud_msc_scsi_complete_cb(uint8_t lun, uint8_t const scsi_cmd[16]);
 
-// Invoked to check if device is writable as part of SCSI WRITE10
+// Invoked to check if device is writable as part of SCSI WRITE10 and WRITE16
 TU_ATTR_WEAK bool tud_msc_is_writable_cb(uint8_t lun);
 
+// Invoked when host deallocates blocks (TRIM) with UNMAP or WRITE SAME (10/16) with UNMAP bit e.g flash
+// translation layer can drop these blocks instead of garbage collecting them. Implementing this callback
+// advertises thin provisioning to host with READ CAPACITY16 and Block Limits/Logical Block Provisioning VPD pages.
+// Deallocated blocks are not required to read back as zero. Return false if failed.
+TU_ATTR_WEAK bool tud_msc_unmap_cb(uint8_t lun, uint64_t lba, uint32_t block_count);
+
 //--------------------------------------------------------------------+
 // Internal Class Driver API
 //--------------------------------------------------------------------+
@@ -155,6 +231,41 @@ uint16_t mscd_open            (uint8_t rhport, tusb_desc_interface_t const * itf
 bool     mscd_control_xfer_cb (uint8_t rhport, uint8_t stage, tusb_control_request_t const * p_request);
 bool     mscd_xfer_cb         (uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes);
 
+#if CFG_TUD_MSC_CACHE
+void     mscd_sof_isr         (uint8_t rhport, uint32_t frame_count);
+#endif
+
+//--------------------------------------------------------------------+
+// Internal SCSI API (shared with UAS driver)
+//--------------------------------------------------------------------+
+
+// READ10/READ16 and WRITE10/WRITE16 command parsing
+bool     mscd_scsi_is_read            (uint8_t cmd_code);
+bool     mscd_scsi_is_write           (uint8_t cmd_code);
+uint64_t mscd_scsi_rdwr_lba           (uint8_t const scsi_cmd[16]);
+uint32_t mscd_scsi_rdwr_block_count   (uint8_t const scsi_cmd[16]);
+bool     mscd_scsi_rdwr_lba_supported (uint8_t const scsi_cmd[16]);
+
+// Invoke application READ/WRITE callback matching the command
+int32_t  mscd_scsi_rdwr_io            (uint8_t lun, uint8_t const scsi_cmd[16], uint32_t block_size, uint64_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
+
+bool     mscd_scsi_writable           (uint8_t lun);
+void     mscd_scsi_capacity           (uint8_t lun, uint64_t* block_count, uint32_t* block_size);
+
+// Returned by mscd_scsi_cmd() when a built-in command cannot complete since storage is busy e.g cache write back,
+// command must be executed again later on.
+#define MSCD_SCSI_RET_BUSY  (-32)
+
+// Process non READ/WRITE command: built-in first then tud_msc_scsi_cb(). Return response length, negative if failed
+int32_t  mscd_scsi_cmd                (uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buffer, uint32_t bufsize);
+
+// Same as mscd_scsi_cmd() for non READ/WRITE command with Data-Out, invoked when data is received
+int32_t  mscd_scsi_data_out           (uint8_t lun, uint8_t const scsi_cmd[16], uint8_t* buffer, uint32_t len);
+
+// Fill fixed format sense data then clear current sense
+int32_t  mscd_scsi_sense              (uint8_t lun, uint8_t* buffer, uint32_t bufsize);
+bool     mscd_scsi_has_sense          (uint8_t lun);
+
 #ifdef __cplusplus
  }
 #endif
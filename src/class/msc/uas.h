@@ -0,0 +1,174 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_UAS_H_
+#define _TUSB_UAS_H_
+
+#include "common/tusb_common.h"
+#include "msc.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// USB Attached SCSI (UAS) Constant
+// NOTE: All multi-byte fields in Information Unit (IU) are in Big Endian
+//--------------------------------------------------------------------+
+
+/// Pipe ID in Pipe Usage descriptor (following each endpoint descriptor)
+typedef enum
+{
+  UAS_PIPE_ID_COMMAND  = 1, ///< Bulk OUT: Command and Task Management IU
+  UAS_PIPE_ID_STATUS   = 2, ///< Bulk IN : Sense, Response and Read/Write Ready IU
+  UAS_PIPE_ID_DATA_IN  = 3, ///< Bulk IN : Data from device to host
+  UAS_PIPE_ID_DATA_OUT = 4, ///< Bulk OUT: Data from host to device
+}uas_pipe_id_t;
+
+/// Information Unit ID
+typedef enum
+{
+  UAS_IU_ID_COMMAND     = 0x01,
+  UAS_IU_ID_SENSE       = 0x03,
+  UAS_IU_ID_RESPONSE    = 0x04,
+  UAS_IU_ID_TASK_MGMT   = 0x05,
+  UAS_IU_ID_READ_READY  = 0x06,
+  UAS_IU_ID_WRITE_READY = 0x07,
+}uas_iu_id_t;
+
+/// Task Management Function
+typedef enum
+{
+  UAS_TMF_ABORT_TASK         = 0x01,
+  UAS_TMF_ABORT_TASK_SET     = 0x02,
+  UAS_TMF_CLEAR_TASK_SET     = 0x04,
+  UAS_TMF_LOGICAL_UNIT_RESET = 0x08,
+  UAS_TMF_IT_NEXUS_RESET     = 0x10,
+  UAS_TMF_CLEAR_ACA          = 0x40,
+  UAS_TMF_QUERY_TASK         = 0x80,
+  UAS_TMF_QUERY_TASK_SET     = 0x81,
+  UAS_TMF_QUERY_ASYNC_EVENT  = 0x82,
+}uas_tmf_type_t;
+
+/// Response Code of Response IU
+typedef enum
+{
+  UAS_RC_TMF_COMPLETE      = 0x00,
+  UAS_RC_INVALID_IU        = 0x02,
+  UAS_RC_TMF_NOT_SUPPORTED = 0x04,
+  UAS_RC_TMF_FAILED        = 0x05,
+  UAS_RC_TMF_SUCCEEDED     = 0x08,
+  UAS_RC_INCORRECT_LUN     = 0x09,
+  UAS_RC_OVERLAPPED_TAG    = 0x0A,
+}uas_response_code_t;
+
+/// Pipe Usage descriptor, class specific descriptor following each endpoint descriptor
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t bLength         ; ///< Size of this descriptor in bytes: 4
+  uint8_t bDescriptorType ; ///< CS_INTERFACE
+  uint8_t bPipeID         ; ///< \ref uas_pipe_id_t
+  uint8_t reserved        ;
+}uas_desc_pipe_usage_t;
+
+TU_VERIFY_STATIC(sizeof(uas_desc_pipe_usage_t) == 4, "size is not correct");
+
+//--------------------------------------------------------------------+
+// UAS Information Unit
+//--------------------------------------------------------------------+
+
+/// Command IU
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  iu_id       ; ///< \ref UAS_IU_ID_COMMAND
+  uint8_t  reserved1   ;
+  uint16_t tag         ; ///< Tag chosen by host to identify this command
+  uint8_t  task_attr   ; ///< Task priority (bit 6:3) and task attribute (bit 2:0)
+  uint8_t  reserved5   ;
+  uint8_t  add_cdb_len ; ///< Additional CDB length in dwords (bit 7:2), not supported
+  uint8_t  reserved7   ;
+  uint8_t  lun[8]      ; ///< SAM LUN, single level LUN is in lun[1]
+  uint8_t  cdb[16]     ;
+}uas_command_iu_t;
+
+TU_VERIFY_STATIC(sizeof(uas_command_iu_t) == 32, "size is not correct");
+
+/// Task Management IU
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  iu_id     ; ///< \ref UAS_IU_ID_TASK_MGMT
+  uint8_t  reserved1 ;
+  uint16_t tag       ;
+  uint8_t  function  ; ///< \ref uas_tmf_type_t
+  uint8_t  reserved5 ;
+  uint16_t task_tag  ; ///< Tag of the command to be managed
+  uint8_t  lun[8]    ;
+}uas_task_mgmt_iu_t;
+
+TU_VERIFY_STATIC(sizeof(uas_task_mgmt_iu_t) == 16, "size is not correct");
+
+/// Sense IU: status of a completed command, sense data is included with CHECK CONDITION
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  iu_id            ; ///< \ref UAS_IU_ID_SENSE
+  uint8_t  reserved1        ;
+  uint16_t tag              ;
+  uint16_t status_qualifier ;
+  uint8_t  status           ; ///< \ref scsi_status_type_t
+  uint8_t  reserved7[7]     ;
+  uint16_t sense_len        ;
+  uint8_t  sense[18]        ; ///< Fixed format sense data
+}uas_sense_iu_t;
+
+TU_VERIFY_STATIC(sizeof(uas_sense_iu_t) == 34, "size is not correct");
+
+/// Response IU: result of Task Management or rejected Command IU
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  iu_id                ; ///< \ref UAS_IU_ID_RESPONSE
+  uint8_t  reserved1            ;
+  uint16_t tag                  ;
+  uint8_t  add_response_info[3] ;
+  uint8_t  response_code        ; ///< \ref uas_response_code_t
+}uas_response_iu_t;
+
+TU_VERIFY_STATIC(sizeof(uas_response_iu_t) == 8, "size is not correct");
+
+/// Read Ready/Write Ready IU: device is ready for data stage of command with tag (without streams)
+typedef struct TU_ATTR_PACKED
+{
+  uint8_t  iu_id     ; ///< \ref UAS_IU_ID_READ_READY or \ref UAS_IU_ID_WRITE_READY
+  uint8_t  reserved1 ;
+  uint16_t tag       ;
+}uas_ready_iu_t;
+
+TU_VERIFY_STATIC(sizeof(uas_ready_iu_t) == 4, "size is not correct");
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_UAS_H_ */
@@ -0,0 +1,1020 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if (CFG_TUD_ENABLED && CFG_TUD_UAS)
+
+#include "device/dcd.h"         // for faking dcd_event_xfer_complete
+#include "device/usbd.h"
+#include "device/usbd_pvt.h"
+
+#include "uas_device.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+
+// Can be selectively disabled to reduce logging when troubleshooting other driver
+#define UAS_DEBUG   2
+
+// Stage of the command being executed (head of queue)
+enum
+{
+  UAS_STAGE_IDLE = 0,     // no command in execution
+  UAS_STAGE_READY,        // Read/Write Ready IU to be sent
+  UAS_STAGE_READY_SENT,
+  UAS_STAGE_DATA,
+  UAS_STAGE_STATUS,       // Sense IU to be sent
+  UAS_STAGE_STATUS_SENT,
+  UAS_STAGE_BUSY,         // command is executed again on SOF since storage is busy
+};
+
+// Command queued by host
+typedef struct
+{
+  uint8_t  lun;
+  bool     aborted;
+  uint16_t tag;
+  uint8_t  cdb[16];
+}uasd_cmd_t;
+
+// Response IU or TASK SET FULL status pending to be sent on status pipe
+typedef struct
+{
+  uint16_t tag;
+  uint8_t  iu_id; // UAS_IU_ID_RESPONSE or UAS_IU_ID_SENSE
+  uint8_t  code;  // response code or SCSI status
+}uasd_resp_t;
+
+typedef struct
+{
+  union
+  {
+    uas_command_iu_t   command;
+    uas_task_mgmt_iu_t task_mgmt;
+  }cmd_iu;
+
+  union
+  {
+    uas_sense_iu_t    sense;
+    uas_response_iu_t response;
+    uas_ready_iu_t    ready;
+  }status_iu;
+
+  uint8_t rhport;
+  uint8_t itf_num;
+  uint8_t ep_cmd;
+  uint8_t ep_status;
+  uint8_t ep_data_in;
+  uint8_t ep_data_out;
+
+  // Commands in queued order, head is the one being executed
+  uasd_cmd_t cmd_queue[CFG_TUD_UAS_QUEUE_DEPTH];
+  uint8_t    cmd_rd_idx;
+  uint8_t    cmd_count;
+
+  // Response IUs, status pipe is shared with command in execution
+  uasd_resp_t resp_queue[CFG_TUD_UAS_QUEUE_DEPTH];
+  uint8_t     resp_rd_idx;
+  uint8_t     resp_count;
+  bool        resp_sent;
+
+  // Command in execution
+  uint8_t  stage;
+  uint8_t  status;      // SCSI status in Sense IU
+  bool     data_in;
+  uint32_t total_len;   // bytes of data stage
+  uint32_t xferred_len; // bytes transferred so far in data stage
+  uint32_t block_size;  // READ/WRITE command only
+
+  // Asynchronous READ/WRITE I/O
+  volatile bool    pending_io;
+  volatile int32_t pending_io_result;
+  uint32_t pending_io_len;
+
+  volatile bool retry_cmd; // busy command is due to be executed again on next SOF
+}uasd_interface_t;
+
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uasd_interface_t _uasd_itf;
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t _uasd_buf[CFG_TUD_UAS_EP_BUFSIZE];
+
+//--------------------------------------------------------------------+
+// INTERNAL OBJECT & FUNCTION DECLARATION
+//--------------------------------------------------------------------+
+static void schedule_status(uint8_t rhport, uasd_interface_t* p_uas);
+
+static void proc_read_cmd(uint8_t rhport, uasd_interface_t* p_uas);
+static void proc_read_io_data(uint8_t rhport, uasd_interface_t* p_uas, int32_t nbytes);
+
+static void proc_write_cmd(uint8_t rhport, uasd_interface_t* p_uas);
+static void proc_write_new_data(uint8_t rhport, uasd_interface_t* p_uas, uint32_t xferred_bytes);
+static void proc_write_io_data(uint8_t rhport, uasd_interface_t* p_uas, uint32_t xferred_bytes, int32_t nbytes);
+
+static void proc_async_io_done(void* param);
+
+#if CFG_TUD_MSC_CACHE
+static void proc_retry_cmd(void* param);
+#endif
+
+static inline uint8_t get_maxlun(void)
+{
+  return tud_msc_get_maxlun_cb ? tud_msc_get_maxlun_cb() : 1;
+}
+
+static inline bool prepare_cmd_iu(uint8_t rhport, uasd_interface_t* p_uas)
+{
+  return usbd_edpt_xfer(rhport, p_uas->ep_cmd, (uint8_t*) &p_uas->cmd_iu, sizeof(p_uas->cmd_iu));
+}
+
+static inline bool status_pipe_busy(uasd_interface_t const* p_uas)
+{
+  return p_uas->resp_sent || p_uas->stage == UAS_STAGE_READY_SENT || p_uas->stage == UAS_STAGE_STATUS_SENT;
+}
+
+//------------- Command Queue -------------//
+static inline uasd_cmd_t* cmd_queue_head(uasd_interface_t* p_uas)
+{
+  return &p_uas->cmd_queue[p_uas->cmd_rd_idx];
+}
+
+static uasd_cmd_t* cmd_queue_find(uasd_interface_t* p_uas, uint16_t tag)
+{
+  for(uint8_t i=0; i<p_uas->cmd_count; i++)
+  {
+    uasd_cmd_t* cmd = &p_uas->cmd_queue[(p_uas->cmd_rd_idx + i) % CFG_TUD_UAS_QUEUE_DEPTH];
+    if ( !cmd->aborted && cmd->tag == tag ) return cmd;
+  }
+
+  return NULL;
+}
+
+static uasd_cmd_t* cmd_queue_push(uasd_interface_t* p_uas)
+{
+  TU_VERIFY(p_uas->cmd_count < CFG_TUD_UAS_QUEUE_DEPTH, NULL);
+
+  uasd_cmd_t* cmd = &p_uas->cmd_queue[(p_uas->cmd_rd_idx + p_uas->cmd_count) % CFG_TUD_UAS_QUEUE_DEPTH];
+  p_uas->cmd_count++;
+
+  return cmd;
+}
+
+static void cmd_queue_pop(uasd_interface_t* p_uas)
+{
+  p_uas->cmd_rd_idx = (uint8_t) ((p_uas->cmd_rd_idx + 1) % CFG_TUD_UAS_QUEUE_DEPTH);
+  p_uas->cmd_count--;
+}
+
+//------------- Response Queue -------------//
+static void resp_queue_push(uasd_interface_t* p_uas, uint16_t tag, uint8_t iu_id, uint8_t code)
+{
+  // response queue is as deep as command queue, host should not flood us with more than that
+  TU_VERIFY(p_uas->resp_count < CFG_TUD_UAS_QUEUE_DEPTH, );
+
+  uasd_resp_t* resp = &p_uas->resp_queue[(p_uas->resp_rd_idx + p_uas->resp_count) % CFG_TUD_UAS_QUEUE_DEPTH];
+  resp->tag   = tag;
+  resp->iu_id = iu_id;
+  resp->code  = code;
+
+  p_uas->resp_count++;
+}
+
+static bool send_resp(uint8_t rhport, uasd_interface_t* p_uas)
+{
+  uasd_resp_t const* resp = &p_uas->resp_queue[p_uas->resp_rd_idx];
+  uint16_t len;
+
+  if ( resp->iu_id == UAS_IU_ID_RESPONSE )
+  {
+    uas_response_iu_t* iu = &p_uas->status_iu.response;
+    tu_memclr(iu, sizeof(uas_response_iu_t));
+
+    iu->iu_id         = UAS_IU_ID_RESPONSE;
+    iu->tag           = tu_htons(resp->tag);
+    iu->response_code = resp->code;
+
+    len = sizeof(uas_response_iu_t);
+  }else
+  {
+    // Sense IU without sense data
+    uas_sense_iu_t* iu = &p_uas->status_iu.sense;
+    tu_memclr(iu, sizeof(uas_sense_iu_t));
+
+    iu->iu_id  = UAS_IU_ID_SENSE;
+    iu->tag    = tu_htons(resp->tag);
+    iu->status = resp->code;
+
+    len = offsetof(uas_sense_iu_t, sense);
+  }
+
+  p_uas->resp_rd_idx = (uint8_t) ((p_uas->resp_rd_idx + 1) % CFG_TUD_UAS_QUEUE_DEPTH);
+  p_uas->resp_count--;
+
+  p_uas->resp_sent = true;
+  return usbd_edpt_xfer(rhport, p_uas->ep_status, (uint8_t*) &p_uas->status_iu, len);
+}
+
+//--------------------------------------------------------------------+
+// Debug
+//--------------------------------------------------------------------+
+#if CFG_TUSB_DEBUG >= 2
+
+TU_ATTR_UNUSED static tu_lookup_entry_t const _uas_iu_lookup[] =
+{
+  { .key = UAS_IU_ID_COMMAND    , .data = "Command"     },
+  { .key = UAS_IU_ID_SENSE      , .data = "Sense"       },
+  { .key = UAS_IU_ID_RESPONSE   , .data = "Response"    },
+  { .key = UAS_IU_ID_TASK_MGMT  , .data = "Task Mgmt"   },
+  { .key = UAS_IU_ID_READ_READY , .data = "Read Ready"  },
+  { .key = UAS_IU_ID_WRITE_READY, .data = "Write Ready" },
+};
+
+TU_ATTR_UNUSED static tu_lookup_table_t const _uas_iu_table =
+{
+  .count = TU_ARRAY_SIZE(_uas_iu_lookup),
+  .items = _uas_iu_lookup
+};
+
+#endif
+
+//--------------------------------------------------------------------+
+// APPLICATION API
+//--------------------------------------------------------------------+
+uint8_t tud_uas_queued_count(void)
+{
+  return _uasd_itf.cmd_count;
+}
+
+uint16_t tud_uas_current_tag(void)
+{
+  uasd_interface_t* p_uas = &_uasd_itf;
+  return p_uas->cmd_count ? cmd_queue_head(p_uas)->tag : 0;
+}
+
+bool uasd_async_io_done(int32_t nbytes, bool in_isr)
+{
+  uasd_interface_t* p_uas = &_uasd_itf;
+
+  // I/O is not issued by this driver or aborted by reset
+  TU_VERIFY(p_uas->pending_io);
+
+  // result is processed later in usbd task context
+  p_uas->pending_io_result = nbytes;
+  usbd_defer_func(proc_async_io_done, p_uas, in_isr);
+
+  return true;
+}
+
+bool uasd_busy(void)
+{
+  uint8_t const stage = _uasd_itf.stage;
+  return stage == UAS_STAGE_READY || stage == UAS_STAGE_READY_SENT || stage == UAS_STAGE_DATA;
+}
+
+//--------------------------------------------------------------------+
+// USBD Driver API
+//--------------------------------------------------------------------+
+void uasd_init(void)
+{
+  tu_memclr(&_uasd_itf, sizeof(uasd_interface_t));
+}
+
+void uasd_reset(uint8_t rhport)
+{
+  (void) rhport;
+  tu_memclr(&_uasd_itf, sizeof(uasd_interface_t));
+}
+
+uint16_t uasd_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t max_len)
+{
+  TU_VERIFY(TUSB_CLASS_MSC    == itf_desc->bInterfaceClass &&
+            MSC_SUBCLASS_SCSI == itf_desc->bInterfaceSubClass &&
+            MSC_PROTOCOL_UAS  == itf_desc->bInterfaceProtocol, 0);
+
+  // 1 interface + 4 endpoints, each followed by a pipe usage descriptor
+  uint16_t const drv_len = sizeof(tusb_desc_interface_t) + 4*(sizeof(tusb_desc_endpoint_t) + sizeof(uas_desc_pipe_usage_t));
+
+  TU_ASSERT(itf_desc->bNumEndpoints == 4 && max_len >= drv_len, 0);
+
+  uasd_interface_t * p_uas = &_uasd_itf;
+  p_uas->rhport  = rhport;
+  p_uas->itf_num = itf_desc->bInterfaceNumber;
+
+  uint8_t const * p_desc = tu_desc_next(itf_desc);
+
+  for(uint8_t i=0; i<4; i++)
+  {
+    tusb_desc_endpoint_t const * desc_ep = (tusb_desc_endpoint_t const *) p_desc;
+    TU_ASSERT(TUSB_DESC_ENDPOINT == desc_ep->bDescriptorType && TUSB_XFER_BULK == desc_ep->bmAttributes.xfer, 0);
+
+    p_desc = tu_desc_next(p_desc);
+    uas_desc_pipe_usage_t const * desc_pipe = (uas_desc_pipe_usage_t const *) p_desc;
+    TU_ASSERT(TUSB_DESC_CS_INTERFACE == desc_pipe->bDescriptorType, 0);
+
+    TU_ASSERT(usbd_edpt_open(rhport, desc_ep), 0);
+
+    switch ( desc_pipe->bPipeID )
+    {
+      case UAS_PIPE_ID_COMMAND : p_uas->ep_cmd      = desc_ep->bEndpointAddress; break;
+      case UAS_PIPE_ID_STATUS  : p_uas->ep_status   = desc_ep->bEndpointAddress; break;
+      case UAS_PIPE_ID_DATA_IN : p_uas->ep_data_in  = desc_ep->bEndpointAddress; break;
+      case UAS_PIPE_ID_DATA_OUT: p_uas->ep_data_out = desc_ep->bEndpointAddress; break;
+      default: TU_BREAKPOINT(); return 0;
+    }
+
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  // Prepare for Command IU
+  TU_ASSERT( prepare_cmd_iu(rhport, p_uas), drv_len);
+
+  return drv_len;
+}
+
+// Invoked when a control transfer occurred on an interface of this class
+// UAS has no class specific request, recovery is done with task management IU
+bool uasd_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request)
+{
+  (void) rhport;
+
+  // nothing to do with DATA & ACK stage
+  if (stage != CONTROL_STAGE_SETUP) return true;
+
+  // Clear/Set Endpoint Feature is acknowledged by usbd
+  return TUSB_REQ_TYPE_STANDARD == request->bmRequestType_bit.type &&
+         TUSB_REQ_RCPT_ENDPOINT == request->bmRequestType_bit.recipient;
+}
+
+//--------------------------------------------------------------------+
+// Command & Task Management IU
+//--------------------------------------------------------------------+
+
+// Remove command from queue, return false if it is already in data stage and cannot be aborted
+static bool abort_cmd(uasd_interface_t* p_uas, uasd_cmd_t* cmd)
+{
+  if ( cmd == cmd_queue_head(p_uas) && p_uas->stage != UAS_STAGE_IDLE )
+  {
+    // Ready IU is not sent yet
+    if ( p_uas->stage != UAS_STAGE_READY && p_uas->stage != UAS_STAGE_BUSY ) return false;
+    p_uas->stage = UAS_STAGE_IDLE;
+  }
+
+  // removed from queue when it becomes head
+  cmd->aborted = true;
+  return true;
+}
+
+static void proc_command_iu(uasd_interface_t* p_uas)
+{
+  uas_command_iu_t const * p_iu = &p_uas->cmd_iu.command;
+  uint16_t const tag = tu_ntohs(p_iu->tag);
+  uint8_t  const lun = p_iu->lun[1];
+
+  TU_LOG(UAS_DEBUG, "  UAS Command Tag %u [Lun%u]: opcode 0x%02X\r\n", tag, lun, p_iu->cdb[0]);
+
+  if ( p_iu->add_cdb_len >> 2 )
+  {
+    // Additional CDB is not supported
+    resp_queue_push(p_uas, tag, UAS_IU_ID_RESPONSE, UAS_RC_INVALID_IU);
+  }
+  else if ( lun >= get_maxlun() )
+  {
+    resp_queue_push(p_uas, tag, UAS_IU_ID_RESPONSE, UAS_RC_INCORRECT_LUN);
+  }
+  else if ( cmd_queue_find(p_uas, tag) )
+  {
+    resp_queue_push(p_uas, tag, UAS_IU_ID_RESPONSE, UAS_RC_OVERLAPPED_TAG);
+  }
+  else
+  {
+    uasd_cmd_t* cmd = cmd_queue_push(p_uas);
+
+    if ( cmd == NULL )
+    {
+      TU_LOG(UAS_DEBUG, "  UAS queue is full\r\n");
+      resp_queue_push(p_uas, tag, UAS_IU_ID_SENSE, SCSI_STATUS_TASK_SET_FULL);
+    }else
+    {
+      cmd->lun     = lun;
+      cmd->aborted = false;
+      cmd->tag     = tag;
+      memcpy(cmd->cdb, p_iu->cdb, sizeof(cmd->cdb));
+
+      if ( tud_uas_command_queued_cb ) tud_uas_command_queued_cb(lun, tag, cmd->cdb);
+    }
+  }
+}
+
+static void proc_task_mgmt_iu(uasd_interface_t* p_uas)
+{
+  uas_task_mgmt_iu_t const * p_iu = &p_uas->cmd_iu.task_mgmt;
+  uint16_t const tag      = tu_ntohs(p_iu->tag);
+  uint16_t const task_tag = tu_ntohs(p_iu->task_tag);
+  uint8_t  const lun      = p_iu->lun[1];
+
+  TU_LOG(UAS_DEBUG, "  UAS Task Management Tag %u: function 0x%02X\r\n", tag, p_iu->function);
+
+  uint8_t rc;
+
+  switch ( p_iu->function )
+  {
+    case UAS_TMF_ABORT_TASK:
+    {
+      uasd_cmd_t* cmd = cmd_queue_find(p_uas, task_tag);
+      rc = (cmd && !abort_cmd(p_uas, cmd)) ? UAS_RC_TMF_FAILED : UAS_RC_TMF_COMPLETE;
+    }
+    break;
+
+    case UAS_TMF_ABORT_TASK_SET:
+    case UAS_TMF_CLEAR_TASK_SET:
+    case UAS_TMF_LOGICAL_UNIT_RESET:
+    case UAS_TMF_IT_NEXUS_RESET:
+      rc = UAS_RC_TMF_COMPLETE;
+
+      for(uint8_t i=0; i<p_uas->cmd_count; i++)
+      {
+        uasd_cmd_t* cmd = &p_uas->cmd_queue[(p_uas->cmd_rd_idx + i) % CFG_TUD_UAS_QUEUE_DEPTH];
+
+        if ( cmd->aborted || (p_iu->function != UAS_TMF_IT_NEXUS_RESET && cmd->lun != lun) ) continue;
+        if ( !abort_cmd(p_uas, cmd) ) rc = UAS_RC_TMF_FAILED;
+      }
+    break;
+
+    case UAS_TMF_QUERY_TASK:
+      rc = cmd_queue_find(p_uas, task_tag) ? UAS_RC_TMF_SUCCEEDED : UAS_RC_TMF_COMPLETE;
+    break;
+
+    default:
+      rc = UAS_RC_TMF_NOT_SUPPORTED;
+    break;
+  }
+
+  resp_queue_push(p_uas, tag, UAS_IU_ID_RESPONSE, rc);
+}
+
+//--------------------------------------------------------------------+
+// Command Execution
+//--------------------------------------------------------------------+
+
+// Allocation length of data-in command by its CDB group, zero if not available
+static uint32_t scsi_alloc_len(uint8_t const cdb[16])
+{
+  switch ( cdb[0] >> 5 )
+  {
+    case 0        : return cdb[4];                                   // 6-byte
+    case 1: case 2: return tu_ntohs(tu_unaligned_read16(cdb + 7));   // 10-byte
+    case 4        : return tu_ntohl(tu_unaligned_read32(cdb + 10));  // 16-byte
+    case 5        : return tu_ntohl(tu_unaligned_read32(cdb + 6));   // 12-byte
+    default       : return 0;
+  }
+}
+
+// Parameter list length of non READ/WRITE data-out command, zero if none
+static uint32_t scsi_data_out_len(uint8_t lun, uint8_t const cdb[16])
+{
+  switch ( cdb[0] )
+  {
+    case SCSI_CMD_MODE_SELECT_6: return cdb[4];
+    case SCSI_CMD_UNMAP        : return tu_ntohs(tu_unaligned_read16(cdb + offsetof(scsi_unmap_t, param_list_length)));
+
+    case SCSI_CMD_WRITE_SAME_10:
+    case SCSI_CMD_WRITE_SAME_16:
+    {
+      // a single block unless there is no data-out buffer
+      if ( (cdb[0] == SCSI_CMD_WRITE_SAME_16) && (cdb[1] & SCSI_WRITE_SAME_FLAG_NDOB) ) return 0;
+
+      uint64_t block_count = 0;
+      uint32_t block_size  = 0;
+      mscd_scsi_capacity(lun, &block_count, &block_size);
+
+      return block_size;
+    }
+
+    default: return 0;
+  }
+}
+
+static void fail_cmd(uasd_interface_t* p_uas, uint8_t lun)
+{
+  // failed but sense key is not set: default to Illegal Request
+  if ( !mscd_scsi_has_sense(lun) ) tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+
+  p_uas->status = SCSI_STATUS_CHECK_CONDITION;
+  p_uas->stage  = UAS_STAGE_STATUS;
+}
+
+static void start_rdwr_cmd(uasd_interface_t* p_uas, uasd_cmd_t const* cmd)
+{
+  uint8_t  const lun         = cmd->lun;
+  bool     const is_write    = mscd_scsi_is_write(cmd->cdb[0]);
+  uint64_t const lba         = mscd_scsi_rdwr_lba(cmd->cdb);
+  uint32_t const block_count = mscd_scsi_rdwr_block_count(cmd->cdb);
+
+  uint64_t disk_block_count = 0;
+  uint32_t block_size       = 0;
+  mscd_scsi_capacity(lun, &disk_block_count, &block_size);
+
+  if ( disk_block_count == 0 || block_size == 0 )
+  {
+    // Medium not present
+    tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+    fail_cmd(p_uas, lun);
+  }
+  else if ( !mscd_scsi_rdwr_lba_supported(cmd->cdb) ||
+            lba >= disk_block_count || block_count > disk_block_count - lba )
+  {
+    // Logical block address out of range
+    tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x21, 0x00);
+    fail_cmd(p_uas, lun);
+  }
+  else if ( (uint64_t) block_count * block_size > UINT32_MAX )
+  {
+    // Invalid field in CDB
+    tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+    fail_cmd(p_uas, lun);
+  }
+  else if ( is_write && !mscd_scsi_writable(lun) )
+  {
+    // Write protected
+    tud_msc_set_sense(lun, SCSI_SENSE_DATA_PROTECT, 0x27, 0x00);
+    fail_cmd(p_uas, lun);
+  }
+  else
+  {
+    p_uas->block_size = block_size;
+    p_uas->total_len  = block_count * block_size;
+    p_uas->data_in    = !is_write;
+    p_uas->stage      = p_uas->total_len ? UAS_STAGE_READY : UAS_STAGE_STATUS;
+  }
+}
+
+// Execute command at head of queue, stage is advanced to READY or STATUS
+static void start_cmd(uasd_interface_t* p_uas)
+{
+  uasd_cmd_t const* cmd = cmd_queue_head(p_uas);
+  uint8_t const lun = cmd->lun;
+
+  p_uas->status      = SCSI_STATUS_GOOD;
+  p_uas->total_len   = 0;
+  p_uas->xferred_len = 0;
+  p_uas->block_size  = 0;
+
+  // sense from previous command is not requested by host, UAS reports it with Sense IU
+  tud_msc_set_sense(lun, 0, 0, 0);
+
+  if ( mscd_scsi_is_read(cmd->cdb[0]) || mscd_scsi_is_write(cmd->cdb[0]) )
+  {
+    start_rdwr_cmd(p_uas, cmd);
+  }
+  else if ( scsi_data_out_len(lun, cmd->cdb) )
+  {
+    // parameter list must fit in our buffer, command is processed when received
+    uint32_t const len = scsi_data_out_len(lun, cmd->cdb);
+
+    if ( len > sizeof(_uasd_buf) )
+    {
+      tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+      fail_cmd(p_uas, lun);
+    }else
+    {
+      p_uas->total_len = len;
+      p_uas->data_in   = false;
+      p_uas->stage     = UAS_STAGE_READY;
+    }
+  }
+  else
+  {
+    int32_t resplen = mscd_scsi_cmd(lun, cmd->cdb, _uasd_buf, sizeof(_uasd_buf));
+
+    if ( resplen == MSCD_SCSI_RET_BUSY )
+    {
+      // storage is busy, command is executed again on SOF instead of waiting here
+      p_uas->stage     = UAS_STAGE_BUSY;
+      p_uas->retry_cmd = true;
+      usbd_sof_enable(p_uas->rhport, SOF_CONSUMER_UAS, true);
+    }
+    else if ( resplen < 0 )
+    {
+      TU_LOG(UAS_DEBUG, "  SCSI command 0x%02X failed\r\n", cmd->cdb[0]);
+      fail_cmd(p_uas, lun);
+    }
+    else if ( resplen == 0 )
+    {
+      p_uas->stage = UAS_STAGE_STATUS;
+    }
+    else
+    {
+      // response is truncated to allocation length
+      uint32_t const alloc_len = scsi_alloc_len(cmd->cdb);
+
+      p_uas->total_len = tu_min32((uint32_t) resplen, sizeof(_uasd_buf));
+      if ( alloc_len ) p_uas->total_len = tu_min32(p_uas->total_len, alloc_len);
+
+      p_uas->data_in = true;
+      p_uas->stage   = UAS_STAGE_READY;
+    }
+  }
+}
+
+static bool send_ready_iu(uint8_t rhport, uasd_interface_t* p_uas)
+{
+  uas_ready_iu_t* p_iu = &p_uas->status_iu.ready;
+  tu_memclr(p_iu, sizeof(uas_ready_iu_t));
+
+  p_iu->iu_id = p_uas->data_in ? UAS_IU_ID_READ_READY : UAS_IU_ID_WRITE_READY;
+  p_iu->tag   = tu_htons(cmd_queue_head(p_uas)->tag);
+
+  p_uas->stage = UAS_STAGE_READY_SENT;
+  return usbd_edpt_xfer(rhport, p_uas->ep_status, (uint8_t*) p_iu, sizeof(uas_ready_iu_t));
+}
+
+static bool send_sense_iu(uint8_t rhport, uasd_interface_t* p_uas)
+{
+  uasd_cmd_t const* cmd = cmd_queue_head(p_uas);
+  uas_sense_iu_t* p_iu = &p_uas->status_iu.sense;
+  tu_memclr(p_iu, sizeof(uas_sense_iu_t));
+
+  p_iu->iu_id  = UAS_IU_ID_SENSE;
+  p_iu->tag    = tu_htons(cmd->tag);
+  p_iu->status = p_uas->status;
+
+  uint16_t len = offsetof(uas_sense_iu_t, sense);
+
+  // sense data is only included with CHECK CONDITION
+  if ( p_uas->status == SCSI_STATUS_CHECK_CONDITION )
+  {
+    int32_t const sense_len = mscd_scsi_sense(cmd->lun, p_iu->sense, sizeof(p_iu->sense));
+
+    if ( sense_len > 0 )
+    {
+      p_iu->sense_len = tu_htons((uint16_t) sense_len);
+      len = (uint16_t) (len + sense_len);
+    }
+  }
+
+  p_uas->stage = UAS_STAGE_STATUS_SENT;
+  return usbd_edpt_xfer(rhport, p_uas->ep_status, (uint8_t*) p_iu, len);
+}
+
+static void start_data_stage(uint8_t rhport, uasd_interface_t* p_uas)
+{
+  p_uas->stage = UAS_STAGE_DATA;
+
+  if ( p_uas->block_size )
+  {
+    if ( p_uas->data_in )
+    {
+      proc_read_cmd(rhport, p_uas);
+    }else
+    {
+      proc_write_cmd(rhport, p_uas);
+    }
+  }
+  else if ( p_uas->data_in )
+  {
+    // response of non READ/WRITE command is already in buffer
+    TU_ASSERT( usbd_edpt_xfer(rhport, p_uas->ep_data_in, _uasd_buf, (uint16_t) p_uas->total_len), );
+  }
+  else
+  {
+    TU_ASSERT( usbd_edpt_xfer(rhport, p_uas->ep_data_out, _uasd_buf, (uint16_t) p_uas->total_len), );
+  }
+}
+
+// Invoked when Sense IU is sent, command is completed
+static void complete_cmd(uasd_interface_t* p_uas)
+{
+  uasd_cmd_t const* cmd = cmd_queue_head(p_uas);
+
+  TU_LOG(UAS_DEBUG, "  UAS Command Tag %u complete, status = %u\r\n", cmd->tag, p_uas->status);
+
+  if ( mscd_scsi_is_read(cmd->cdb[0]) )
+  {
+    if ( tud_msc_read10_complete_cb ) tud_msc_read10_complete_cb(cmd->lun);
+  }
+  else if ( mscd_scsi_is_write(cmd->cdb[0]) )
+  {
+    if ( tud_msc_write10_complete_cb ) tud_msc_write10_complete_cb(cmd->lun);
+  }
+  else
+  {
+    if ( tud_msc_scsi_complete_cb ) tud_msc_scsi_complete_cb(cmd->lun, cmd->cdb);
+  }
+
+  cmd_queue_pop(p_uas);
+  p_uas->stage = UAS_STAGE_IDLE;
+}
+
+// Status pipe is shared by all queued commands: send pending Response IU first,
+// then Ready/Sense IU of command in execution or start the next one
+static void schedule_status(uint8_t rhport, uasd_interface_t* p_uas)
+{
+  if ( status_pipe_busy(p_uas) ) return;
+
+  if ( p_uas->resp_count )
+  {
+    TU_ASSERT( send_resp(rhport, p_uas), );
+    return;
+  }
+
+  if ( p_uas->stage == UAS_STAGE_IDLE )
+  {
+    // skip aborted commands
+    while ( p_uas->cmd_count && cmd_queue_head(p_uas)->aborted ) cmd_queue_pop(p_uas);
+
+    if ( p_uas->cmd_count ) start_cmd(p_uas);
+  }
+
+  if ( p_uas->stage == UAS_STAGE_READY )
+  {
+    TU_ASSERT( send_ready_iu(rhport, p_uas), );
+  }
+  else if ( p_uas->stage == UAS_STAGE_STATUS )
+  {
+    TU_ASSERT( send_sense_iu(rhport, p_uas), );
+  }
+}
+
+bool uasd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes)
+{
+  (void) event;
+
+  uasd_interface_t* p_uas = &_uasd_itf;
+
+  if ( ep_addr == p_uas->ep_cmd )
+  {
+    uint8_t const iu_id = p_uas->cmd_iu.command.iu_id;
+    TU_LOG(UAS_DEBUG, "  UAS %s IU\r\n", tu_lookup_find(&_uas_iu_table, iu_id));
+
+    if ( iu_id == UAS_IU_ID_COMMAND && xferred_bytes == sizeof(uas_command_iu_t) )
+    {
+      proc_command_iu(p_uas);
+    }
+    else if ( iu_id == UAS_IU_ID_TASK_MGMT && xferred_bytes == sizeof(uas_task_mgmt_iu_t) )
+    {
+      proc_task_mgmt_iu(p_uas);
+    }
+    else
+    {
+      uint16_t const tag = (xferred_bytes >= 4) ? tu_ntohs(p_uas->cmd_iu.command.tag) : 0;
+      resp_queue_push(p_uas, tag, UAS_IU_ID_RESPONSE, UAS_RC_INVALID_IU);
+    }
+
+    // Host can queue more IUs while a command is in execution
+    TU_ASSERT( prepare_cmd_iu(rhport, p_uas) );
+  }
+  else if ( ep_addr == p_uas->ep_status )
+  {
+    if ( p_uas->resp_sent )
+    {
+      p_uas->resp_sent = false;
+    }
+    else if ( p_uas->stage == UAS_STAGE_READY_SENT )
+    {
+      start_data_stage(rhport, p_uas);
+    }
+    else if ( p_uas->stage == UAS_STAGE_STATUS_SENT )
+    {
+      complete_cmd(p_uas);
+    }
+  }
+  else if ( ep_addr == p_uas->ep_data_in && p_uas->stage == UAS_STAGE_DATA )
+  {
+    p_uas->xferred_len += xferred_bytes;
+
+    if ( p_uas->xferred_len >= p_uas->total_len )
+    {
+      p_uas->stage = UAS_STAGE_STATUS;
+    }
+    else if ( p_uas->block_size )
+    {
+      proc_read_cmd(rhport, p_uas);
+    }
+  }
+  else if ( ep_addr == p_uas->ep_data_out && p_uas->stage == UAS_STAGE_DATA )
+  {
+    if ( p_uas->block_size )
+    {
+      proc_write_new_data(rhport, p_uas, xferred_bytes);
+    }else
+    {
+      uasd_cmd_t const* cmd = cmd_queue_head(p_uas);
+
+      // parameter list received: built-in command or tud_msc_scsi_cb()
+      p_uas->xferred_len = xferred_bytes;
+      if ( mscd_scsi_data_out(cmd->lun, cmd->cdb, _uasd_buf, xferred_bytes) < 0 )
+      {
+        fail_cmd(p_uas, cmd->lun);
+      }else
+      {
+        p_uas->stage = UAS_STAGE_STATUS;
+      }
+    }
+  }
+
+  schedule_status(rhport, p_uas);
+
+  return true;
+}
+
+/*------------------------------------------------------------------*/
+/* READ/WRITE Data Stage
+ *------------------------------------------------------------------*/
+static void proc_read_cmd(uint8_t rhport, uasd_interface_t* p_uas)
+{
+  uasd_cmd_t const* cmd = cmd_queue_head(p_uas);
+
+  // Adjust lba with transferred bytes
+  uint64_t const lba    = mscd_scsi_rdwr_lba(cmd->cdb) + (p_uas->xferred_len / p_uas->block_size);
+  uint32_t const offset = p_uas->xferred_len % p_uas->block_size;
+
+  // remaining bytes capped at class buffer
+  uint32_t const bufsize = tu_min32(sizeof(_uasd_buf), p_uas->total_len - p_uas->xferred_len);
+
+  // armed before callback since application may invoke tud_msc_async_io_done() before it returns
+  p_uas->pending_io = true;
+  int32_t const nbytes = mscd_scsi_rdwr_io(cmd->lun, cmd->cdb, p_uas->block_size, lba, offset, _uasd_buf, bufsize);
+
+  // otherwise application will invoke tud_msc_async_io_done() when data is ready in buffer
+  if ( nbytes != TUD_MSC_RET_ASYNC )
+  {
+    p_uas->pending_io = false;
+    proc_read_io_data(rhport, p_uas, nbytes);
+  }
+}
+
+// process result of READ10/READ16 callback (synchronous or asynchronous)
+static void proc_read_io_data(uint8_t rhport, uasd_interface_t* p_uas, int32_t nbytes)
+{
+  if ( nbytes < 0 )
+  {
+    // negative means error -> command is completed with CHECK CONDITION
+    TU_LOG(UAS_DEBUG, "  tud_msc_read10_cb() or tud_msc_read16_cb() return -1\r\n");
+
+    uint8_t const lun = cmd_queue_head(p_uas)->lun;
+    tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+    fail_cmd(p_uas, lun);
+  }
+  else if ( nbytes == 0 )
+  {
+    // zero means not ready -> simulate an transfer complete so that this driver callback will fired again
+    dcd_event_xfer_complete(rhport, p_uas->ep_data_in, 0, XFER_RESULT_SUCCESS, false);
+  }
+  else
+  {
+    TU_ASSERT( usbd_edpt_xfer(rhport, p_uas->ep_data_in, _uasd_buf, (uint16_t) nbytes), );
+  }
+}
+
+static void proc_write_cmd(uint8_t rhport, uasd_interface_t* p_uas)
+{
+  // remaining bytes capped at class buffer
+  uint16_t const nbytes = (uint16_t) tu_min32(sizeof(_uasd_buf), p_uas->total_len - p_uas->xferred_len);
+
+  // Write10/Write16 callback will be called later when usb transfer complete
+  TU_ASSERT( usbd_edpt_xfer(rhport, p_uas->ep_data_out, _uasd_buf, nbytes), );
+}
+
+// process new data arrived from WRITE10/WRITE16
+static void proc_write_new_data(uint8_t rhport, uasd_interface_t* p_uas, uint32_t xferred_bytes)
+{
+  uasd_cmd_t const* cmd = cmd_queue_head(p_uas);
+
+  // Adjust lba with transferred bytes
+  uint64_t const lba    = mscd_scsi_rdwr_lba(cmd->cdb) + (p_uas->xferred_len / p_uas->block_size);
+  uint32_t const offset = p_uas->xferred_len % p_uas->block_size;
+
+  // armed before callback since application may invoke tud_msc_async_io_done() before it returns
+  p_uas->pending_io     = true;
+  p_uas->pending_io_len = xferred_bytes;
+  int32_t const nbytes = mscd_scsi_rdwr_io(cmd->lun, cmd->cdb, p_uas->block_size, lba, offset, _uasd_buf, xferred_bytes);
+
+  // otherwise application will invoke tud_msc_async_io_done() when buffer is consumed
+  if ( nbytes != TUD_MSC_RET_ASYNC )
+  {
+    p_uas->pending_io = false;
+    proc_write_io_data(rhport, p_uas, xferred_bytes, nbytes);
+  }
+}
+
+// process result of WRITE10/WRITE16 callback (synchronous or asynchronous)
+static void proc_write_io_data(uint8_t rhport, uasd_interface_t* p_uas, uint32_t xferred_bytes, int32_t nbytes)
+{
+  if ( nbytes < 0 )
+  {
+    // negative means error -> command is completed with CHECK CONDITION
+    TU_LOG(UAS_DEBUG, "  tud_msc_write10_cb() or tud_msc_write16_cb() return -1\r\n");
+
+    p_uas->xferred_len += xferred_bytes;
+
+    uint8_t const lun = cmd_queue_head(p_uas)->lun;
+    tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+    fail_cmd(p_uas, lun);
+  }
+  else if ( (uint32_t) nbytes < xferred_bytes )
+  {
+    // Application consume less than what we got (including zero)
+    uint32_t const left_over = xferred_bytes - (uint32_t) nbytes;
+    if ( nbytes > 0 )
+    {
+      p_uas->xferred_len += (uint32_t) nbytes;
+      memmove(_uasd_buf, _uasd_buf+nbytes, left_over);
+    }
+
+    // simulate an transfer complete with adjusted parameters --> callback will be invoked with adjusted parameter
+    dcd_event_xfer_complete(rhport, p_uas->ep_data_out, left_over, XFER_RESULT_SUCCESS, false);
+  }
+  else
+  {
+    // Application consume all bytes in our buffer
+    p_uas->xferred_len += xferred_bytes;
+
+    if ( p_uas->xferred_len >= p_uas->total_len )
+    {
+      p_uas->stage = UAS_STAGE_STATUS;
+    }else
+    {
+      // prepare to receive more data from host
+      proc_write_cmd(rhport, p_uas);
+    }
+  }
+}
+
+// Deferred from tud_msc_async_io_done(), running in usbd task context
+static void proc_async_io_done(void* param)
+{
+  uasd_interface_t* p_uas = (uasd_interface_t*) param;
+
+  // I/O is aborted by reset in the mean time
+  if ( !(p_uas->pending_io && p_uas->stage == UAS_STAGE_DATA) ) return;
+  p_uas->pending_io = false;
+
+  int32_t const nbytes = p_uas->pending_io_result;
+
+  if ( p_uas->data_in )
+  {
+    proc_read_io_data(p_uas->rhport, p_uas, nbytes);
+  }else
+  {
+    proc_write_io_data(p_uas->rhport, p_uas, p_uas->pending_io_len, nbytes);
+  }
+
+  // Data stage may be completed by this I/O
+  schedule_status(p_uas->rhport, p_uas);
+}
+
+#if CFG_TUD_MSC_CACHE
+void uasd_sof_isr(uint8_t rhport, uint32_t frame_count)
+{
+  (void) rhport;
+  (void) frame_count;
+
+  // command waiting for busy storage is executed again in usbd task context
+  if ( _uasd_itf.retry_cmd )
+  {
+    _uasd_itf.retry_cmd = false;
+    usbd_defer_func(proc_retry_cmd, &_uasd_itf, true);
+  }
+}
+
+// Deferred from SOF, execute again the command postponed since storage was busy
+static void proc_retry_cmd(void* param)
+{
+  uasd_interface_t* p_uas = (uasd_interface_t*) param;
+
+  // SOF is enabled again if storage is still busy
+  usbd_sof_enable(p_uas->rhport, SOF_CONSUMER_UAS, false);
+
+  // command is aborted or dropped by reset in the mean time
+  if ( p_uas->stage != UAS_STAGE_BUSY ) return;
+
+  // command is still at head of queue and started again
+  p_uas->stage = UAS_STAGE_IDLE;
+  schedule_status(p_uas->rhport, p_uas);
+}
+#endif
+
+#endif
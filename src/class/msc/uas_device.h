@@ -0,0 +1,103 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_UAS_DEVICE_H_
+#define _TUSB_UAS_DEVICE_H_
+
+#include "common/tusb_common.h"
+#include "uas.h"
+#include "msc_device.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Class Driver Configuration
+//--------------------------------------------------------------------+
+
+// UAS driver reuses SCSI command set and storage callbacks tud_msc_*() of MSC driver
+#if !CFG_TUD_MSC
+  #error CFG_TUD_MSC must be enabled for CFG_TUD_UAS
+#endif
+
+// Number of commands host can queue, more commands are rejected with TASK SET FULL status
+#ifndef CFG_TUD_UAS_QUEUE_DEPTH
+  #define CFG_TUD_UAS_QUEUE_DEPTH   4
+#endif
+
+// Data pipes buffer size, value of a block size should work well, the more the better
+#ifndef CFG_TUD_UAS_EP_BUFSIZE
+  #define CFG_TUD_UAS_EP_BUFSIZE    CFG_TUD_MSC_EP_BUFSIZE
+#endif
+
+TU_VERIFY_STATIC(CFG_TUD_UAS_EP_BUFSIZE < UINT16_MAX, "Size is not correct");
+TU_VERIFY_STATIC(CFG_TUD_UAS_QUEUE_DEPTH > 0 && CFG_TUD_UAS_QUEUE_DEPTH < 256, "Queue depth is not correct");
+
+//--------------------------------------------------------------------+
+// Application API
+//--------------------------------------------------------------------+
+
+// Number of commands queued by host and not yet completed
+uint8_t tud_uas_queued_count(void);
+
+// Tag of the command being executed, valid within storage callbacks e.g tud_msc_read10_cb()
+uint16_t tud_uas_current_tag(void);
+
+//--------------------------------------------------------------------+
+// Application Callbacks
+// Commands are executed one at a time in queued order, using the same callbacks
+// as MSC driver e.g tud_msc_read10_cb(), tud_msc_write10_cb(), tud_msc_scsi_cb()
+// including asynchronous I/O with tud_msc_async_io_done().
+//--------------------------------------------------------------------+
+
+// Invoked when a command is queued by host, can be used to prefetch storage
+TU_ATTR_WEAK void tud_uas_command_queued_cb(uint8_t lun, uint16_t tag, uint8_t const scsi_cmd[16]);
+
+//--------------------------------------------------------------------+
+// Internal Class Driver API
+//--------------------------------------------------------------------+
+void     uasd_init            (void);
+void     uasd_reset           (uint8_t rhport);
+uint16_t uasd_open            (uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t max_len);
+bool     uasd_control_xfer_cb (uint8_t rhport, uint8_t stage, tusb_control_request_t const * p_request);
+bool     uasd_xfer_cb         (uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes);
+
+#if CFG_TUD_MSC_CACHE
+void     uasd_sof_isr         (uint8_t rhport, uint32_t frame_count);
+#endif
+
+// Complete asynchronous I/O issued by UAS driver, return false if there is none pending
+bool     uasd_async_io_done   (int32_t nbytes, bool in_isr);
+
+// Return true if a command is in data stage i.e storage callbacks could be in progress
+bool     uasd_busy            (void);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_UAS_DEVICE_H_ */
@@ -61,8 +61,12 @@ typedef struct
 #define CFG_TUD_NET_PACKET_PREFIX_LEN sizeof(rndis_data_packet_t)
 #define CFG_TUD_NET_PACKET_SUFFIX_LEN 0
 
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t received[CFG_TUD_NET_PACKET_PREFIX_LEN + CFG_TUD_NET_MTU + CFG_TUD_NET_PACKET_PREFIX_LEN];
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t transmitted[CFG_TUD_NET_PACKET_PREFIX_LEN + CFG_TUD_NET_MTU + CFG_TUD_NET_PACKET_PREFIX_LEN];
+// RNDIS messages concatenated in one transfer are 4-byte aligned
+#define NETD_RNDIS_MSG_MAX_LEN  ((CFG_TUD_NET_PACKET_PREFIX_LEN + CFG_TUD_NET_MTU + 3) & ~3u)
+#define NETD_XFER_MAX_LEN       (CFG_TUD_RNDIS_PACKETS_PER_XFER * NETD_RNDIS_MSG_MAX_LEN)
+
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t received[CFG_TUD_ECM_RNDIS_OUT_BUF_N][NETD_XFER_MAX_LEN];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t transmitted[2][NETD_XFER_MAX_LEN];
 
 struct ecm_notify_struct
 {
@@ -104,19 +108,317 @@ CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static union
 // TODO remove CFG_TUSB_MEM_SECTION
 CFG_TUSB_MEM_SECTION static netd_interface_t _netd_itf;
 
-static bool can_xmit;
+// Receive ring: OUT endpoint is kept armed with next free buffer while application consumes packets
+typedef struct
+{
+  uint8_t  rd;         // Index in received[] whose packets are handed to application
+  uint8_t  wr;         // Index in received[] to receive next transfer
+  uint8_t  count;      // Number of received transfers not yet consumed
+  bool     armed;      // OUT transfer is armed with received[wr]
+  bool     consuming;  // received[rd] is being consumed
+  uint16_t offset;     // Next RNDIS message in received[rd]
+  uint16_t len[CFG_TUD_ECM_RNDIS_OUT_BUF_N];  // Transferred bytes
+  uint8_t  held[CFG_TUD_ECM_RNDIS_OUT_BUF_N]; // Packets held by tud_network_recv_hold()
+} netd_rx_t;
+
+// Transmit double buffer: frames are queued into transmitted[fill] while the other one is sent.
+// RNDIS concatenates several packets in the queued transfer.
+typedef struct
+{
+  bool     busy;        // IN transfer in progress
+  uint8_t  fill;        // Index in transmitted[] accepting frames
+  uint8_t  max_packets; // Packets per transfer, 0 if IN endpoint is not opened
+  uint8_t  count[2];    // Packets in transmitted[]
+  uint16_t len[2];      // Bytes in transmitted[]
+  uint16_t last_msg;    // Offset of last RNDIS message in transmitted[fill]
+} netd_tx_t;
+
+static netd_rx_t _rx;
+
+// Packets passed to tud_network_recv_batch_cb(), valid until tud_network_recv_renew()
+static tud_network_datagram_t _rx_batch[CFG_TUD_NET_RECV_BATCH_MAX];
+static netd_tx_t _tx;
+
+// Frame transmitted with tud_network_xmit_sg(): USB packets are sent directly from segments,
+// transmitted[] is used as bounce buffer for RNDIS header, data straddling packet boundary and unaligned segments
+typedef struct
+{
+  tud_network_segment_t segs[CFG_TUD_NET_XMIT_SEGMENTS];
+  uint8_t  count;
+  uint8_t  index;      // current segment
+  uint16_t offset;     // bytes of current segment already queued
+  uint16_t bounce_len; // bytes already in transmitted[] (RNDIS header)
+  uint16_t total;      // frame length including header
+  void    *ref;
+  bool     active;
+} xmit_sg_t;
+
+static xmit_sg_t _xmit_sg;
+
+static void netd_start_rx(void)
+{
+  if (_rx.armed || _rx.count >= CFG_TUD_ECM_RNDIS_OUT_BUF_N) return;
+
+  // buffer still referenced by application is skipped and left empty, tud_network_recv_renew() skips it as well
+  uint8_t wr = _rx.wr;
+  while (_rx.held[wr])
+  {
+    wr = (uint8_t) ((wr + 1) % CFG_TUD_ECM_RNDIS_OUT_BUF_N);
+    if (wr == _rx.wr) return;
+  }
+
+  // next free one is not yet consumed
+  if (_rx.len[wr]) return;
+  _rx.wr = wr;
+
+  if (usbd_edpt_xfer(0, _netd_itf.ep_out, received[_rx.wr], NETD_XFER_MAX_LEN))
+  {
+    _rx.armed = true;
+  }
+}
+
+// Next packet of received[rd], return false when all are consumed
+static bool netd_next_packet(uint8_t const **pnt, uint16_t *size)
+{
+  uint8_t const *buf = received[_rx.rd];
+  uint16_t const len = _rx.len[_rx.rd];
+
+  if (_netd_itf.ecm_mode)
+  {
+    // one frame per transfer
+    if (_rx.offset) return false;
+
+    _rx.offset = len;
+    *pnt = buf;
+    *size = len;
+    return true;
+  }
+
+  // RNDIS messages are concatenated, remaining bytes too short for a message e.g padding are ignored
+  uint16_t const remaining = (uint16_t) (len - _rx.offset);
+  if (remaining < sizeof(rndis_data_packet_t)) return false;
+
+  rndis_data_packet_t const *r = (rndis_data_packet_t const *) ((void const *) (buf + _rx.offset));
+  uint32_t const data_offset = r->DataOffset + offsetof(rndis_data_packet_t, DataOffset);
+
+  TU_VERIFY(r->MessageType == REMOTE_NDIS_PACKET_MSG);
+  TU_VERIFY(r->MessageLength >= sizeof(rndis_data_packet_t) && r->MessageLength <= remaining);
+  TU_VERIFY(data_offset + r->DataLength <= r->MessageLength);
+
+  *pnt = buf + _rx.offset + data_offset;
+  *size = (uint16_t) r->DataLength;
+  _rx.offset = (uint16_t) (_rx.offset + r->MessageLength);
+
+  return true;
+}
 
 void tud_network_recv_renew(void)
 {
-  usbd_edpt_xfer(0, _netd_itf.ep_out, received, sizeof(received));
+  for (;;)
+  {
+    if (!_rx.consuming)
+    {
+      netd_start_rx();
+      if (!_rx.count) return;
+
+      while (!_rx.len[_rx.rd]) _rx.rd = (uint8_t) ((_rx.rd + 1) % CFG_TUD_ECM_RNDIS_OUT_BUF_N);
+
+      _rx.consuming = true;
+      _rx.offset = 0;
+    }
+
+    // if packets were never handled by user code, we must move on to the next ones on the user's behalf
+    if (tud_network_recv_batch_cb)
+    {
+      uint8_t count = 0;
+      while (count < CFG_TUD_NET_RECV_BATCH_MAX && netd_next_packet(&_rx_batch[count].buf, &_rx_batch[count].len))
+      {
+        count++;
+      }
+
+      if (count)
+      {
+        if (tud_network_recv_batch_cb(_rx_batch, count)) return;
+        continue;
+      }
+    }
+    else
+    {
+      uint8_t const *pnt;
+      uint16_t size;
+
+      if (netd_next_packet(&pnt, &size))
+      {
+        if (tud_network_recv_cb(pnt, size)) return;
+        continue;
+      }
+    }
+
+    // all packets of this buffer are consumed, it can receive again
+    _rx.consuming = false;
+    _rx.len[_rx.rd] = 0;
+    _rx.rd = (uint8_t) ((_rx.rd + 1) % CFG_TUD_ECM_RNDIS_OUT_BUF_N);
+    _rx.count--;
+  }
+}
+
+uint8_t tud_network_recv_hold(void)
+{
+  TU_ASSERT(_rx.consuming, TUD_NETWORK_RECV_HOLD_INVALID);
+
+  // keep at least one buffer free for reception, a packet held for long (e.g. out-of-order TCP segment)
+  // would stall the receive ring otherwise
+  if (!_rx.held[_rx.rd])
+  {
+    uint8_t held = 0;
+    for (uint8_t i = 0; i < CFG_TUD_ECM_RNDIS_OUT_BUF_N; i++)
+    {
+      if (_rx.held[i]) held++;
+    }
+    if (held + 1 >= CFG_TUD_ECM_RNDIS_OUT_BUF_N) return TUD_NETWORK_RECV_HOLD_INVALID;
+  }
+
+  _rx.held[_rx.rd]++;
+  return _rx.rd;
+}
+
+void tud_network_recv_release(uint8_t buf_id)
+{
+  TU_VERIFY(buf_id < CFG_TUD_ECM_RNDIS_OUT_BUF_N && _rx.held[buf_id], );
+
+  _rx.held[buf_id]--;
+
+  // buffer may be the one OUT endpoint is waiting for
+  netd_start_rx();
 }
 
 static void do_in_xfer(uint8_t *buf, uint16_t len)
 {
-  can_xmit = false;
+  _tx.busy = true;
   usbd_edpt_xfer(0, _netd_itf.ep_in, buf, len);
 }
 
+// Send queued frames, the other buffer accepts new ones
+static void netd_start_tx(void)
+{
+  uint8_t const idx = _tx.fill;
+
+  _tx.fill = (uint8_t) (idx ^ 1);
+  _tx.count[_tx.fill] = 0;
+  _tx.len[_tx.fill] = 0;
+
+  do_in_xfer(transmitted[idx], _tx.len[idx]);
+}
+
+// IN transfer (including ZLP) completed
+static void netd_tx_done(void)
+{
+  _tx.busy = false;
+
+  if (_tx.count[_tx.fill])
+  {
+    netd_start_tx();
+  }
+}
+
+static void rndis_packet_header(uint8_t *buf, uint16_t len)
+{
+  rndis_data_packet_t *hdr = (rndis_data_packet_t *) ((void*) buf);
+  memset(hdr, 0, sizeof(rndis_data_packet_t));
+  hdr->MessageType = REMOTE_NDIS_PACKET_MSG;
+  hdr->MessageLength = len;
+  hdr->DataOffset = sizeof(rndis_data_packet_t) - offsetof(rndis_data_packet_t, DataOffset);
+  hdr->DataLength = len - sizeof(rndis_data_packet_t);
+}
+
+// skip segments that are completely queued
+static void xmit_sg_skip(void)
+{
+  xmit_sg_t *sg = &_xmit_sg;
+  while ( (sg->index < sg->count) && (sg->offset >= sg->segs[sg->index].len) )
+  {
+    sg->index++;
+    sg->offset = 0;
+  }
+}
+
+// Queue next chunk of segmented frame. Every chunk except the last must be a multiple of packet size,
+// otherwise host would see a short packet and end the frame early.
+static void xmit_sg_next(void)
+{
+  xmit_sg_t *sg = &_xmit_sg;
+  uint16_t const pkt_size = CFG_TUD_NET_ENDPOINT_SIZE;
+
+  xmit_sg_skip();
+
+  // data straddling packet boundary or following RNDIS header is gathered into one packet
+  uint32_t end = pkt_size;
+
+  if ( (sg->bounce_len == 0) && (sg->index < sg->count) )
+  {
+    tud_network_segment_t const *seg = &sg->segs[sg->index];
+    uint8_t *src = (uint8_t *) (uintptr_t) seg->buf + sg->offset;
+    uint16_t len = (uint16_t) (seg->len - sg->offset);
+
+    // last segment can end with a short packet
+    if ( sg->index + 1 < sg->count ) len = (uint16_t) (len - (len % pkt_size));
+
+    // send directly from segment if DMA can access it word aligned
+    if ( len && (((uintptr_t) src) & 3u) == 0 )
+    {
+      sg->offset = (uint16_t) (sg->offset + len);
+      do_in_xfer(src, len);
+      return;
+    }
+
+    // unaligned segment: its rest up to the next packet boundary is gathered and sent in one transfer
+    if ( len ) end = tu_div_ceil((uint32_t) (seg->len - sg->offset), pkt_size) * pkt_size;
+  }
+
+  // gather into bounce buffer
+  uint16_t n = sg->bounce_len;
+  while ( (n < end) && (sg->index < sg->count) )
+  {
+    tud_network_segment_t const *seg = &sg->segs[sg->index];
+    uint16_t const chunk = (uint16_t) tu_min32(end - n, (uint32_t) (seg->len - sg->offset));
+
+    memcpy(transmitted[_tx.fill] + n, (uint8_t const *) seg->buf + sg->offset, chunk);
+    n = (uint16_t) (n + chunk);
+    sg->offset = (uint16_t) (sg->offset + chunk);
+
+    xmit_sg_skip();
+  }
+
+  sg->bounce_len = 0;
+  do_in_xfer(transmitted[_tx.fill], n);
+}
+
+// IN transfer of a segmented frame completed
+static void xmit_sg_complete(void)
+{
+  xmit_sg_t *sg = &_xmit_sg;
+
+  xmit_sg_skip();
+
+  if ( sg->index < sg->count )
+  {
+    xmit_sg_next();
+    return;
+  }
+
+  // all data is sent, segments can be released
+  sg->active = false;
+  if (tud_network_xmit_done_cb) tud_network_xmit_done_cb(sg->ref);
+
+  if ( 0 == (sg->total % CFG_TUD_NET_ENDPOINT_SIZE) )
+  {
+    do_in_xfer(NULL, 0); /* a ZLP is needed */
+  }else
+  {
+    netd_tx_done();
+  }
+}
+
 void netd_report(uint8_t *buf, uint16_t len)
 {
   uint8_t const rhport = 0;
@@ -132,6 +434,9 @@ void netd_report(uint8_t *buf, uint16_t len)
 void netd_init(void)
 {
   tu_memclr(&_netd_itf, sizeof(_netd_itf));
+  tu_memclr(&_xmit_sg, sizeof(_xmit_sg));
+  tu_memclr(&_rx, sizeof(_rx));
+  tu_memclr(&_tx, sizeof(_tx));
 }
 
 void netd_reset(uint8_t rhport)
@@ -214,8 +519,8 @@ uint16_t netd_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint1
 
     tud_network_init_cb();
 
-    // we are ready to transmit a packet
-    can_xmit = true;
+    // we are ready to transmit a packet, host tells how many packets per transfer it accepts in REMOTE_NDIS_INITIALIZE_MSG
+    _tx.max_packets = 1;
 
     // prepare for incoming packets
     tud_network_recv_renew();
@@ -279,7 +584,7 @@ bool netd_control_xfer_cb (uint8_t rhport, uint8_t stage, tusb_control_request_t
                 // TODO should be merge with RNDIS's after endpoint opened
                 // Also should have opposite callback for application to disable network !!
                 tud_network_init_cb();
-                can_xmit = true; // we are ready to transmit a packet
+                _tx.max_packets = 1; // we are ready to transmit a packet
                 tud_network_recv_renew(); // prepare for incoming packets
               }
             }else
@@ -340,6 +645,14 @@ bool netd_control_xfer_cb (uint8_t rhport, uint8_t stage, tusb_control_request_t
     {
       if ( !_netd_itf.ecm_mode )
       {
+        rndis_initialize_msg_t const *init = (rndis_initialize_msg_t const *) ((void const*) notify.rndis_buf);
+        if ( init->MessageType == REMOTE_NDIS_INITIALIZE_MSG )
+        {
+          // concatenate packets as many as the host can receive in one transfer
+          uint32_t const max_packets = init->MaxTransferSize / NETD_RNDIS_MSG_MAX_LEN;
+          _tx.max_packets = (uint8_t) tu_max32(1, tu_min32(max_packets, CFG_TUD_RNDIS_PACKETS_PER_XFER));
+        }
+
         rndis_class_set_handler(notify.rndis_buf, request->wLength);
       }
     }
@@ -350,28 +663,21 @@ bool netd_control_xfer_cb (uint8_t rhport, uint8_t stage, tusb_control_request_t
 
 static void handle_incoming_packet(uint32_t len)
 {
-  uint8_t *pnt = received;
-  uint32_t size = 0;
+  _rx.armed = false;
 
-  if (_netd_itf.ecm_mode)
+  if (len)
   {
-    size = len;
-  }
-  else
-  {
-    rndis_data_packet_t *r = (rndis_data_packet_t *) ((void*) pnt);
-    if (len >= sizeof(rndis_data_packet_t))
-      if ( (r->MessageType == REMOTE_NDIS_PACKET_MSG) && (r->MessageLength <= len))
-        if ( (r->DataOffset + offsetof(rndis_data_packet_t, DataOffset) + r->DataLength) <= len)
-        {
-          pnt = &received[r->DataOffset + offsetof(rndis_data_packet_t, DataOffset)];
-          size = r->DataLength;
-        }
+    _rx.len[_rx.wr] = (uint16_t) len;
+    _rx.wr = (uint8_t) ((_rx.wr + 1) % CFG_TUD_ECM_RNDIS_OUT_BUF_N);
+    _rx.count++;
   }
 
-  if (!tud_network_recv_cb(pnt, (uint16_t) size))
+  // keep OUT endpoint busy while application consumes packets
+  netd_start_rx();
+
+  // application will pick up this transfer with tud_network_recv_renew() when done with current one
+  if (!_rx.consuming && _rx.count)
   {
-    /* if a buffer was never handled by user code, we must renew on the user's behalf */
     tud_network_recv_renew();
   }
 }
@@ -392,14 +698,18 @@ bool netd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_
   {
     /* TinyUSB requires the class driver to implement ZLP (since ZLP usage is class-specific) */
 
-    if ( xferred_bytes && (0 == (xferred_bytes % CFG_TUD_NET_ENDPOINT_SIZE)) )
+    if ( _xmit_sg.active )
+    {
+      xmit_sg_complete();
+    }
+    else if ( xferred_bytes && (0 == (xferred_bytes % CFG_TUD_NET_ENDPOINT_SIZE)) )
     {
       do_in_xfer(NULL, 0); /* a ZLP is needed */
     }
     else
     {
       /* we're finally finished */
-      can_xmit = true;
+      netd_tx_done();
     }
   }
 
@@ -415,33 +725,85 @@ bool tud_network_can_xmit(uint16_t size)
 {
   (void)size;
 
-  return can_xmit;
+  // buffers are sized for MTU frames, only the number of queued packets matters
+  if (_xmit_sg.active) return false;
+
+  return _tx.count[_tx.fill] < (_netd_itf.ecm_mode ? 1 : _tx.max_packets);
 }
 
 void tud_network_xmit(void *ref, uint16_t arg)
 {
-  uint8_t *data;
-  uint16_t len;
-
-  if (!can_xmit)
+  if (!tud_network_can_xmit(0))
     return;
 
-  len = (_netd_itf.ecm_mode) ? 0 : CFG_TUD_NET_PACKET_PREFIX_LEN;
-  data = transmitted + len;
+  uint8_t *buf = transmitted[_tx.fill];
+  uint16_t len = _tx.len[_tx.fill];
 
-  len += tud_network_xmit_cb(data, ref, arg);
+  if (_netd_itf.ecm_mode)
+  {
+    len = tud_network_xmit_cb(buf, ref, arg);
+  }
+  else
+  {
+    if (_tx.count[_tx.fill])
+    {
+      // pad previous message so that this one is 4-byte aligned
+      uint16_t const pad = (uint16_t) ((4 - (len & 3u)) & 3u);
+      rndis_data_packet_t *prev = (rndis_data_packet_t *) ((void*) (buf + _tx.last_msg));
+
+      memset(buf + len, 0, pad);
+      prev->MessageLength += pad;
+      len = (uint16_t) (len + pad);
+    }
+
+    uint16_t const msg_len = (uint16_t) (CFG_TUD_NET_PACKET_PREFIX_LEN + tud_network_xmit_cb(buf + len + CFG_TUD_NET_PACKET_PREFIX_LEN, ref, arg));
+    rndis_packet_header(buf + len, msg_len);
+
+    _tx.last_msg = len;
+    len = (uint16_t) (len + msg_len);
+  }
+
+  _tx.len[_tx.fill] = len;
+  _tx.count[_tx.fill]++;
+
+  // otherwise sent after the current transfer, together with packets queued in the meantime
+  if (!_tx.busy)
+  {
+    netd_start_tx();
+  }
+}
+
+bool tud_network_xmit_sg(tud_network_segment_t const* segs, uint8_t count, void *ref)
+{
+  // segments are only sent directly when IN endpoint is idle, transmitted[fill] is used as bounce buffer
+  TU_VERIFY(!_tx.busy && _tx.max_packets && count && count <= CFG_TUD_NET_XMIT_SEGMENTS);
+
+  xmit_sg_t *sg = &_xmit_sg;
+
+  uint32_t size = 0;
+  for (uint8_t i = 0; i < count; i++) size += segs[i].len;
+  TU_VERIFY(size && size <= CFG_TUD_NET_MTU);
+
+  memcpy(sg->segs, segs, count*sizeof(tud_network_segment_t));
+  sg->count      = count;
+  sg->index      = 0;
+  sg->offset     = 0;
+  sg->bounce_len = 0;
+  sg->ref        = ref;
+  sg->total      = (uint16_t) size;
 
   if (!_netd_itf.ecm_mode)
   {
-    rndis_data_packet_t *hdr = (rndis_data_packet_t *) ((void*) transmitted);
-    memset(hdr, 0, sizeof(rndis_data_packet_t));
-    hdr->MessageType = REMOTE_NDIS_PACKET_MSG;
-    hdr->MessageLength = len;
-    hdr->DataOffset = sizeof(rndis_data_packet_t) - offsetof(rndis_data_packet_t, DataOffset);
-    hdr->DataLength = len - sizeof(rndis_data_packet_t);
+    // header is the start of first packet
+    sg->total      = (uint16_t) (sg->total + CFG_TUD_NET_PACKET_PREFIX_LEN);
+    sg->bounce_len = CFG_TUD_NET_PACKET_PREFIX_LEN;
+    rndis_packet_header(transmitted[_tx.fill], sg->total);
   }
 
-  do_in_xfer(transmitted, len);
+  sg->active = true;
+  xmit_sg_next();
+
+  return true;
 }
 
 #endif
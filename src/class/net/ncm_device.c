@@ -38,54 +38,19 @@
 // MACRO CONSTANT TYPEDEF
 //--------------------------------------------------------------------+
 
-#define NTH16_SIGNATURE      0x484D434E
-#define NDP16_SIGNATURE_NCM0 0x304D434E
-#define NDP16_SIGNATURE_NCM1 0x314D434E
-
-typedef struct TU_ATTR_PACKED
-{
-  uint16_t wLength;
-  uint16_t bmNtbFormatsSupported;
-  uint32_t dwNtbInMaxSize;
-  uint16_t wNdbInDivisor;
-  uint16_t wNdbInPayloadRemainder;
-  uint16_t wNdbInAlignment;
-  uint16_t wReserved;
-  uint32_t dwNtbOutMaxSize;
-  uint16_t wNdbOutDivisor;
-  uint16_t wNdbOutPayloadRemainder;
-  uint16_t wNdbOutAlignment;
-  uint16_t wNtbOutMaxDatagrams;
-} ntb_parameters_t;
-
-typedef struct TU_ATTR_PACKED
-{
-  uint32_t dwSignature;
-  uint16_t wHeaderLength;
-  uint16_t wSequence;
-  uint16_t wBlockLength;
-  uint16_t wNdpIndex;
-} nth16_t;
-
-typedef struct TU_ATTR_PACKED
-{
-  uint16_t wDatagramIndex;
-  uint16_t wDatagramLength;
-} ndp16_datagram_t;
-
-typedef struct TU_ATTR_PACKED
-{
-  uint32_t dwSignature;
-  uint16_t wLength;
-  uint16_t wNextNdpIndex;
-  ndp16_datagram_t datagram[];
-} ndp16_t;
+// Largest chunk of an NTB in a single endpoint transfer, NTB32 blocks beyond are chained.
+// Multiple of all bulk packet sizes so that only the last chunk can be short.
+#define NCM_XFER_CHUNK_MAX   0xFE00u
 
 typedef union TU_ATTR_PACKED {
   struct {
     nth16_t nth;
     ndp16_t ndp;
   };
+  struct {
+    nth32_t nth32;
+    ndp32_t ndp32;
+  };
   uint8_t data[CFG_TUD_NCM_IN_NTB_MAX_SIZE];
 } transmit_ntb_t;
 
@@ -103,10 +68,20 @@ typedef struct
   uint8_t ep_notif;
   uint8_t ep_in;
   uint8_t ep_out;
+  uint16_t ep_in_size;  // Packet size of IN endpoint
 
-  const ndp16_t *ndp;
+  const void *ndp;                // NDP16 or NDP32 of receive_ntb[rx_rd]
   uint8_t num_datagrams, current_datagram_index;
 
+  // Ring of received NTBs: next OUT transfer is armed while datagrams of previous NTBs are consumed
+  uint8_t  rx_rd;                 // Index in receive_ntb[] whose datagrams are handed to application
+  uint8_t  rx_wr;                 // Index in receive_ntb[] to receive next NTB
+  uint8_t  rx_count;              // Number of received NTBs not yet released by tud_network_recv_renew()
+  bool     rx_armed;              // OUT transfer is armed with receive_ntb[rx_wr]
+  bool     rx_consuming;          // receive_ntb[rx_rd] is being consumed
+  uint8_t  rx_held[CFG_TUD_NCM_OUT_NTB_N]; // Datagrams of receive_ntb[] held by tud_network_recv_hold()
+  uint32_t rx_len[CFG_TUD_NCM_OUT_NTB_N];  // Received length of NTB, receive_ntb[rx_wr] is filled in chunks
+
   enum {
     REPORT_SPEED,
     REPORT_CONNECTED,
@@ -115,24 +90,47 @@ typedef struct
   bool report_pending;
 
   uint8_t  current_ntb;           // Index in transmit_ntb[] that is currently being filled with datagrams
+  uint8_t  tx_rd;                 // Index in transmit_ntb[] of the oldest NTB queued for transmission
+  uint8_t  tx_count;              // Number of NTBs queued for transmission, including the one being sent
   uint8_t  datagram_count;        // Number of datagrams in transmit_ntb[current_ntb]
-  uint16_t next_datagram_offset;  // Offset in transmit_ntb[current_ntb].data to place the next datagram
-  uint16_t ntb_in_size;           // Maximum size of transmitted (IN to host) NTBs; initially CFG_TUD_NCM_IN_NTB_MAX_SIZE
+  uint32_t next_datagram_offset;  // Offset in transmit_ntb[current_ntb].data to place the next datagram
+  uint32_t tx_offset;             // Bytes of transmit_ntb[tx_rd] already queued, NTB32 is sent in chunks
+  uint32_t ntb_in_max;            // Maximum size of transmitted (IN to host) NTBs set by host; initially CFG_TUD_NCM_IN_NTB_MAX_SIZE
+  uint32_t ntb_input_size;        // Data stage of GET/SET_NTB_INPUT_SIZE
+  uint16_t ntb_format;            // NCM_NTB_FORMAT_16 or NCM_NTB_FORMAT_32 selected by SET_NTB_FORMAT
   uint8_t  max_datagrams_per_ntb; // Maximum number of datagrams per NTB; initially CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB
 
   uint16_t nth_sequence;          // Sequence number counter for transmitted NTBs
 
   bool transferring;
 
+  volatile uint16_t tx_wait_ms;   // Age of transmit_ntb[current_ntb] since its first datagram, counted on SOF
+  uint16_t tx_frame;              // Last SOF frame number
+
 } ncm_interface_t;
 
+// Datagram of tud_network_xmit_sg(), sent from segment memory between the first and the last packet
+// boundary within the datagram. Its head and tail are copied into transmit_ntb[] and sent along with
+// the datagrams before and after it in the same NTB.
+typedef struct
+{
+  tud_network_segment_t segs[CFG_TUD_NET_XMIT_SEGMENTS];
+  uint8_t  count;
+  uint8_t  ntb;       // Index in transmit_ntb[] of the NTB holding the datagram
+  uint32_t index;     // Offset of datagram in NTB
+  uint32_t head_end;  // End of data sent from transmit_ntb[] before the segments
+  uint32_t tail_beg;  // Start of data sent from transmit_ntb[] after the segments, equal to head_end if none
+  void    *ref;
+  bool     active;
+} ncm_xmit_sg_t;
+
 //--------------------------------------------------------------------+
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
 
 CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static const ntb_parameters_t ntb_parameters = {
     .wLength                 = sizeof(ntb_parameters_t),
-    .bmNtbFormatsSupported   = 0x01,
+    .bmNtbFormatsSupported   = 0x03, // NTB16 and NTB32
     .dwNtbInMaxSize          = CFG_TUD_NCM_IN_NTB_MAX_SIZE,
     .wNdbInDivisor           = 4,
     .wNdbInPayloadRemainder  = 0,
@@ -145,55 +143,223 @@ CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static const ntb_parameters_t ntb_parame
     .wNtbOutMaxDatagrams     = 0
 };
 
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static transmit_ntb_t transmit_ntb[2];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static transmit_ntb_t transmit_ntb[CFG_TUD_NCM_IN_NTB_N];
 
-CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t receive_ntb[CFG_TUD_NCM_OUT_NTB_MAX_SIZE];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static uint8_t receive_ntb[CFG_TUD_NCM_OUT_NTB_N][CFG_TUD_NCM_OUT_NTB_MAX_SIZE];
 
 static ncm_interface_t ncm_interface;
 
+static ncm_xmit_sg_t ncm_xmit_sg;
+
+// Datagrams passed to tud_network_recv_batch_cb(), valid until tud_network_recv_renew()
+static tud_network_datagram_t ncm_rx_batch[CFG_TUD_NET_RECV_BATCH_MAX];
+
+// Size limit of transmitted NTBs set by application, survives bus reset
+static uint32_t ncm_ntb_in_limit = CFG_TUD_NCM_IN_NTB_MAX_SIZE;
+
+static bool ncm_ntb32(void) {
+  return ncm_interface.ntb_format == NCM_NTB_FORMAT_32;
+}
+
+/*
+ * Size of NTH, NDP and its datagram table in transmitted NTBs.
+ */
+static uint32_t ncm_ntb_header_len(void) {
+  if (ncm_ntb32()) {
+    return sizeof(nth32_t) + sizeof(ndp32_t) + ((CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB + 1) * sizeof(ndp32_datagram_t));
+  }
+  return sizeof(nth16_t) + sizeof(ndp16_t) + ((CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB + 1) * sizeof(ndp16_datagram_t));
+}
+
+/*
+ * Maximum size of transmitted NTBs: limited by host, application and NTB16 block length.
+ */
+static uint32_t ncm_ntb_in_size(void) {
+  uint32_t size = tu_min32(ncm_interface.ntb_in_max, ncm_ntb_in_limit);
+  return ncm_ntb32() ? size : tu_min32(size, UINT16_MAX);
+}
+
+static uint32_t ncm_ntb_block_length(transmit_ntb_t const *ntb) {
+  return ncm_ntb32() ? ntb->nth32.dwBlockLength : ntb->nth.wBlockLength;
+}
+
 /*
  * Set up the NTB state in ncm_interface to be ready to add datagrams.
  */
 static void ncm_prepare_for_tx(void) {
   ncm_interface.datagram_count = 0;
   // datagrams start after all the headers
-  ncm_interface.next_datagram_offset = sizeof(nth16_t) + sizeof(ndp16_t)
-      + ((CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB + 1) * sizeof(ndp16_datagram_t));
+  ncm_interface.next_datagram_offset = ncm_ntb_header_len();
+
+#if CFG_TUD_NCM_TX_AGGREGATE_MS
+  // nothing to time until the next datagram
+  usbd_sof_enable(0, SOF_CONSUMER_NET, false);
+#endif
+}
+
+/*
+ * Current NTB cannot take another datagram of full MTU.
+ */
+static bool ncm_ntb_full(void) {
+  return (ncm_interface.datagram_count >= ncm_interface.max_datagrams_per_ntb) ||
+         (ncm_interface.next_datagram_offset + CFG_TUD_NET_MTU > ncm_ntb_in_size());
+}
+
+/*
+ * Current NTB has been held open long enough waiting for more datagrams.
+ */
+static bool ncm_tx_timeout_expired(void) {
+#if CFG_TUD_NCM_TX_AGGREGATE_MS
+  return ncm_interface.tx_wait_ms >= CFG_TUD_NCM_TX_AGGREGATE_MS;
+#else
+  return true;
+#endif
+}
+
+/*
+ * Fill in headers of the current NTB and queue it for transmission, then start filling
+ * the next NTB of the pool with datagrams.
+ */
+static void ncm_close_ntb(void) {
+  transmit_ntb_t *ntb = &transmit_ntb[ncm_interface.current_ntb];
+  size_t ntb_length = ncm_interface.next_datagram_offset;
+
+  if (ncm_ntb32()) {
+    // Fill in NTH32 header
+    ntb->nth32.dwSignature = NTH32_SIGNATURE;
+    ntb->nth32.wHeaderLength = sizeof(nth32_t);
+    ntb->nth32.wSequence = ncm_interface.nth_sequence++;
+    ntb->nth32.dwBlockLength = (uint32_t) ntb_length;
+    ntb->nth32.dwNdpIndex = sizeof(nth32_t);
+
+    // Fill in NDP32 header and terminator
+    ntb->ndp32.dwSignature = NDP32_SIGNATURE_NCM0;
+    ntb->ndp32.wLength = (uint16_t) (sizeof(ndp32_t) + (ncm_interface.datagram_count + 1) * sizeof(ndp32_datagram_t));
+    ntb->ndp32.wReserved6 = 0;
+    ntb->ndp32.dwNextNdpIndex = 0;
+    ntb->ndp32.dwReserved12 = 0;
+    ntb->ndp32.datagram[ncm_interface.datagram_count].dwDatagramIndex = 0;
+    ntb->ndp32.datagram[ncm_interface.datagram_count].dwDatagramLength = 0;
+  } else {
+    // Fill in NTB header
+    ntb->nth.dwSignature = NTH16_SIGNATURE;
+    ntb->nth.wHeaderLength = sizeof(nth16_t);
+    ntb->nth.wSequence = ncm_interface.nth_sequence++;
+    ntb->nth.wBlockLength = ntb_length;
+    ntb->nth.wNdpIndex = sizeof(nth16_t);
+
+    // Fill in NDP16 header and terminator
+    ntb->ndp.dwSignature = NDP16_SIGNATURE_NCM0;
+    ntb->ndp.wLength = sizeof(ndp16_t) + (ncm_interface.datagram_count + 1) * sizeof(ndp16_datagram_t);
+    ntb->ndp.wNextNdpIndex = 0;
+    ntb->ndp.datagram[ncm_interface.datagram_count].wDatagramIndex = 0;
+    ntb->ndp.datagram[ncm_interface.datagram_count].wDatagramLength = 0;
+  }
+
+  ncm_interface.tx_count++;
+
+  // Move on to the next NTB and clear it out, there is none left if tx_count reaches pool depth
+  ncm_interface.current_ntb = (uint8_t) ((ncm_interface.current_ntb + 1) % CFG_TUD_NCM_IN_NTB_N);
+  ncm_prepare_for_tx();
 }
 
 /*
- * If not already transmitting, start sending the current NTB to the host and swap buffers
- * to start filling the other one with datagrams.
+ * Copy len bytes of the segmented datagram starting at its offset off to dst.
+ */
+static void ncm_xmit_sg_gather(uint8_t *dst, uint32_t off, uint32_t len) {
+  for (uint8_t i = 0; i < ncm_xmit_sg.count && len; i++) {
+    tud_network_segment_t const *seg = &ncm_xmit_sg.segs[i];
+    if (off >= seg->len) {
+      off -= seg->len;
+      continue;
+    }
+
+    uint32_t const n = tu_min32(seg->len - off, len);
+    memcpy(dst, (uint8_t const *) seg->buf + off, n);
+    dst += n;
+    len -= n;
+    off = 0;
+  }
+}
+
+/*
+ * Next chunk of the segmented datagram to be sent at dst (in transmit_ntb[]), at most *len bytes.
+ * Every chunk except the last must be a multiple of packet size, otherwise host would see a short
+ * packet and end the NTB early.
+ */
+static uint8_t *ncm_xmit_sg_chunk(uint8_t *dst, uint32_t *len) {
+  uint16_t const pkt_size = ncm_interface.ep_in_size;
+  uint32_t off = ncm_interface.tx_offset - ncm_xmit_sg.index;
+  uint8_t i = 0;
+
+  while (off >= ncm_xmit_sg.segs[i].len) {
+    off -= ncm_xmit_sg.segs[i].len;
+    i++;
+  }
+
+  uint8_t *src = (uint8_t *) (uintptr_t) ncm_xmit_sg.segs[i].buf + off;
+  uint32_t const seg_left = ncm_xmit_sg.segs[i].len - off;
+  uint32_t const sg_left  = ncm_xmit_sg.tail_beg - ncm_interface.tx_offset;
+
+  // chunks end on packet boundaries, the tail is sent from the NTB
+  uint32_t n = tu_min32(seg_left, sg_left);
+  n -= n % pkt_size;
+
+  // send directly from segment if DMA can access it word aligned
+  if (n && (((uintptr_t) src) & 3u) == 0) {
+    *len = n;
+    return src;
+  }
+
+  // gather the rest of the segment up to the next packet boundary at its place in the NTB, sent in one transfer
+  // along with the rest of the NTB if no segment data is left
+  n = tu_min32(tu_div_ceil(seg_left, pkt_size) * pkt_size, sg_left);
+  ncm_xmit_sg_gather(dst, ncm_interface.tx_offset - ncm_xmit_sg.index, n);
+  if (n < sg_left) {
+    *len = n;
+  }
+  return dst;
+}
+
+/*
+ * If not already transmitting, start sending (next chunk of) the oldest queued NTB to the host.
  */
 static void ncm_start_tx(void) {
-  if (ncm_interface.transferring) {
+  if (ncm_interface.transferring || !ncm_interface.tx_count) {
     return;
   }
 
-  transmit_ntb_t *ntb = &transmit_ntb[ncm_interface.current_ntb];
-  size_t ntb_length = ncm_interface.next_datagram_offset;
+  transmit_ntb_t *ntb = &transmit_ntb[ncm_interface.tx_rd];
+  uint8_t *buf = ntb->data + ncm_interface.tx_offset;
+  uint32_t len = ncm_ntb_block_length(ntb) - ncm_interface.tx_offset;
 
-  // Fill in NTB header
-  ntb->nth.dwSignature = NTH16_SIGNATURE;
-  ntb->nth.wHeaderLength = sizeof(nth16_t);
-  ntb->nth.wSequence = ncm_interface.nth_sequence++;
-  ntb->nth.wBlockLength = ntb_length;
-  ntb->nth.wNdpIndex = sizeof(nth16_t);
+  if (ncm_xmit_sg.active && ncm_xmit_sg.ntb == ncm_interface.tx_rd &&
+      ncm_interface.tx_offset < ncm_xmit_sg.tail_beg) {
+    if (ncm_interface.tx_offset < ncm_xmit_sg.head_end) {
+      len = ncm_xmit_sg.head_end - ncm_interface.tx_offset;
+    } else {
+      buf = ncm_xmit_sg_chunk(buf, &len);
+    }
+  }
 
-  // Fill in NDP16 header and terminator
-  ntb->ndp.dwSignature = NDP16_SIGNATURE_NCM0;
-  ntb->ndp.wLength = sizeof(ndp16_t) + (ncm_interface.datagram_count + 1) * sizeof(ndp16_datagram_t);
-  ntb->ndp.wNextNdpIndex = 0;
-  ntb->ndp.datagram[ncm_interface.datagram_count].wDatagramIndex = 0;
-  ntb->ndp.datagram[ncm_interface.datagram_count].wDatagramLength = 0;
+  len = tu_min32(len, NCM_XFER_CHUNK_MAX);
 
   // Kick off an endpoint transfer
-  usbd_edpt_xfer(0, ncm_interface.ep_in, ntb->data, ntb_length);
+  usbd_edpt_xfer(0, ncm_interface.ep_in, buf, (uint16_t) len);
+  ncm_interface.tx_offset += len;
   ncm_interface.transferring = true;
+}
 
-  // Swap to the other NTB and clear it out
-  ncm_interface.current_ntb = 1 - ncm_interface.current_ntb;
-  ncm_prepare_for_tx();
+/*
+ * Aggregation timeout expired: send the partially filled NTB (usbd task context).
+ */
+TU_ATTR_UNUSED static void ncm_tx_timeout(void *param) {
+  (void) param;
+
+  if (ncm_interface.datagram_count && ncm_tx_timeout_expired() && ncm_interface.itf_data_alt == 1) {
+    ncm_close_ntb();
+    ncm_start_tx();
+  }
 }
 
 static struct ecm_notify_struct ncm_notify_connected =
@@ -225,20 +391,214 @@ static struct ecm_notify_struct ncm_notify_speed_change =
     .uplink = 10000000,
 };
 
+/*
+ * Arm OUT endpoint with the next free NTB of the receive ring (if any).
+ */
+static void ncm_start_rx(void)
+{
+  if (ncm_interface.rx_armed || ncm_interface.rx_count >= CFG_TUD_NCM_OUT_NTB_N) {
+    return;
+  }
+
+  // NTB still referenced by application is skipped and left empty, tud_network_recv_renew() skips it as well
+  uint8_t wr = ncm_interface.rx_wr;
+  while (ncm_interface.rx_held[wr]) {
+    wr = (uint8_t) ((wr + 1) % CFG_TUD_NCM_OUT_NTB_N);
+    if (wr == ncm_interface.rx_wr) {
+      return;
+    }
+  }
+
+  if (wr != ncm_interface.rx_wr) {
+    // next free one is not yet consumed
+    if (ncm_interface.rx_len[wr]) {
+      return;
+    }
+    ncm_interface.rx_wr = wr;
+  }
+
+  uint32_t const offset = ncm_interface.rx_len[ncm_interface.rx_wr];
+  uint32_t const len = tu_min32(CFG_TUD_NCM_OUT_NTB_MAX_SIZE - offset, NCM_XFER_CHUNK_MAX);
+
+  if (usbd_edpt_xfer(0, ncm_interface.ep_out, receive_ntb[ncm_interface.rx_wr] + offset, (uint16_t) len)) {
+    ncm_interface.rx_armed = true;
+  }
+}
+
+/*
+ * Count valid datagrams of an NDP16, datagrams must lie within the NTB.
+ */
+static uint8_t ncm_count_datagrams16(const ndp16_t *ndp, uint32_t len)
+{
+  int max_datagrams = (ndp->wLength - 12) / 4;
+  uint8_t count = 0;
+  for (int i = 0; i < max_datagrams && count < UINT8_MAX && ndp->datagram[i].wDatagramIndex && ndp->datagram[i].wDatagramLength; i++)
+  {
+    if ((uint32_t) ndp->datagram[i].wDatagramIndex + ndp->datagram[i].wDatagramLength > len) break;
+    count++;
+  }
+  return count;
+}
+
+static uint8_t ncm_count_datagrams32(const ndp32_t *ndp, uint32_t len)
+{
+  int max_datagrams = (ndp->wLength - 16) / 8;
+  uint8_t count = 0;
+  for (int i = 0; i < max_datagrams && count < UINT8_MAX && ndp->datagram[i].dwDatagramIndex && ndp->datagram[i].dwDatagramLength; i++)
+  {
+    if (ndp->datagram[i].dwDatagramIndex > len || ndp->datagram[i].dwDatagramLength > len - ndp->datagram[i].dwDatagramIndex) break;
+    count++;
+  }
+  return count;
+}
+
+/*
+ * Count valid datagrams of a received NTB16 or NTB32, return its NDP or NULL if malformed or empty.
+ */
+static const void *ncm_parse_ntb(const uint8_t *ntb, uint32_t len, uint8_t *num_datagrams)
+{
+  *num_datagrams = 0;
+
+  if (len == 0) {
+    return NULL;
+  }
+
+  TU_ASSERT(len >= sizeof(nth16_t), NULL);
+
+  if (((const nth32_t *) ntb)->dwSignature == NTH32_SIGNATURE) {
+    TU_ASSERT(len >= sizeof(nth32_t), NULL);
+
+    const nth32_t *hdr = (const nth32_t *)ntb;
+    TU_ASSERT(hdr->dwNdpIndex >= sizeof(nth32_t) && hdr->dwNdpIndex <= len - sizeof(ndp32_t), NULL);
+
+    const ndp32_t *ndp = (const ndp32_t *)(ntb + hdr->dwNdpIndex);
+    TU_ASSERT(ndp->dwSignature == NDP32_SIGNATURE_NCM0 || ndp->dwSignature == NDP32_SIGNATURE_NCM1, NULL);
+    TU_ASSERT(hdr->dwNdpIndex + ndp->wLength <= len, NULL);
+
+    *num_datagrams = ncm_count_datagrams32(ndp, len);
+    return *num_datagrams ? ndp : NULL;
+  }
+
+  const nth16_t *hdr = (const nth16_t *)ntb;
+  TU_ASSERT(hdr->dwSignature == NTH16_SIGNATURE, NULL);
+  TU_ASSERT(hdr->wNdpIndex >= sizeof(nth16_t) && (hdr->wNdpIndex + sizeof(ndp16_t)) <= len, NULL);
+
+  const ndp16_t *ndp = (const ndp16_t *)(ntb + hdr->wNdpIndex);
+  TU_ASSERT(ndp->dwSignature == NDP16_SIGNATURE_NCM0 || ndp->dwSignature == NDP16_SIGNATURE_NCM1, NULL);
+  TU_ASSERT(hdr->wNdpIndex + ndp->wLength <= len, NULL);
+
+  *num_datagrams = ncm_count_datagrams16(ndp, len);
+  return *num_datagrams ? ndp : NULL;
+}
+
+/*
+ * Offset and length of datagram i of an NDP returned by ncm_parse_ntb().
+ */
+static void ncm_ndp_datagram(const void *ndp, uint8_t i, uint32_t *index, uint32_t *length)
+{
+  const ndp32_t *ndp32 = (const ndp32_t *) ndp;
+
+  if (ndp32->dwSignature == NDP32_SIGNATURE_NCM0 || ndp32->dwSignature == NDP32_SIGNATURE_NCM1) {
+    *index  = ndp32->datagram[i].dwDatagramIndex;
+    *length = ndp32->datagram[i].dwDatagramLength;
+  } else {
+    const ndp16_t *ndp16 = (const ndp16_t *) ndp;
+    *index  = ndp16->datagram[i].wDatagramIndex;
+    *length = ndp16->datagram[i].wDatagramLength;
+  }
+}
+
 void tud_network_recv_renew(void)
 {
-  if (!ncm_interface.num_datagrams)
+  // client must provide one of the receive callbacks
+  TU_ASSERT(tud_network_recv_batch_cb || tud_network_recv_cb, );
+
+  for (;;)
   {
-    usbd_edpt_xfer(0, ncm_interface.ep_out, receive_ntb, sizeof(receive_ntb));
-    return;
+    if (!ncm_interface.num_datagrams)
+    {
+      // all datagrams of current NTB are consumed, it can receive again
+      if (ncm_interface.rx_consuming) {
+        ncm_interface.rx_consuming = false;
+        ncm_interface.rx_len[ncm_interface.rx_rd] = 0;
+        ncm_interface.rx_rd = (uint8_t) ((ncm_interface.rx_rd + 1) % CFG_TUD_NCM_OUT_NTB_N);
+        ncm_interface.rx_count--;
+      }
+
+      ncm_start_rx();
+
+      if (!ncm_interface.rx_count) {
+        return;
+      }
+
+      while (!ncm_interface.rx_len[ncm_interface.rx_rd]) {
+        ncm_interface.rx_rd = (uint8_t) ((ncm_interface.rx_rd + 1) % CFG_TUD_NCM_OUT_NTB_N);
+      }
+
+      // continue with the next NTB received in the meantime, malformed or empty one is released right away
+      ncm_interface.ndp = ncm_parse_ntb(receive_ntb[ncm_interface.rx_rd], ncm_interface.rx_len[ncm_interface.rx_rd], &ncm_interface.num_datagrams);
+      ncm_interface.current_datagram_index = 0;
+      ncm_interface.rx_consuming = true;
+      continue;
+    }
+
+    uint8_t const *ntb = receive_ntb[ncm_interface.rx_rd];
+    uint32_t index, length;
+
+    // if datagrams were not accepted by user code, they are dropped and we move on to the next ones
+    if (tud_network_recv_batch_cb) {
+      // hand out the rest of NDP (up to batch size) at once
+      uint8_t count = 0;
+      while (count < CFG_TUD_NET_RECV_BATCH_MAX && ncm_interface.num_datagrams) {
+        ncm_ndp_datagram(ncm_interface.ndp, ncm_interface.current_datagram_index, &index, &length);
+        ncm_interface.current_datagram_index++;
+        ncm_interface.num_datagrams--;
+
+        ncm_rx_batch[count].buf = ntb + index;
+        ncm_rx_batch[count].len = (uint16_t) length;
+        count++;
+      }
+
+      if (tud_network_recv_batch_cb(ncm_rx_batch, count)) return;
+      continue;
+    }
+
+    ncm_ndp_datagram(ncm_interface.ndp, ncm_interface.current_datagram_index, &index, &length);
+    ncm_interface.current_datagram_index++;
+    ncm_interface.num_datagrams--;
+
+    if (tud_network_recv_cb(ntb + index, (uint16_t) length)) return;
+  }
+}
+
+uint8_t tud_network_recv_hold(void)
+{
+  TU_ASSERT(ncm_interface.rx_consuming, TUD_NETWORK_RECV_HOLD_INVALID);
+
+  // keep at least one NTB free for reception, a datagram held for long (e.g. out-of-order TCP segment)
+  // would stall the receive ring otherwise
+  if (!ncm_interface.rx_held[ncm_interface.rx_rd]) {
+    uint8_t held = 0;
+    for (uint8_t i = 0; i < CFG_TUD_NCM_OUT_NTB_N; i++) {
+      if (ncm_interface.rx_held[i]) held++;
+    }
+    if (held + 1 >= CFG_TUD_NCM_OUT_NTB_N) {
+      return TUD_NETWORK_RECV_HOLD_INVALID;
+    }
   }
 
-  const ndp16_t *ndp = ncm_interface.ndp;
-  const int i = ncm_interface.current_datagram_index;
-  ncm_interface.current_datagram_index++;
-  ncm_interface.num_datagrams--;
+  ncm_interface.rx_held[ncm_interface.rx_rd]++;
+  return ncm_interface.rx_rd;
+}
+
+void tud_network_recv_release(uint8_t buf_id)
+{
+  TU_VERIFY(buf_id < CFG_TUD_NCM_OUT_NTB_N && ncm_interface.rx_held[buf_id], );
+
+  ncm_interface.rx_held[buf_id]--;
 
-  tud_network_recv_cb(receive_ntb + ndp->datagram[i].wDatagramIndex, ndp->datagram[i].wDatagramLength);
+  // NTB may be the one OUT endpoint is waiting for
+  ncm_start_rx();
 }
 
 //--------------------------------------------------------------------+
@@ -248,7 +608,9 @@ void tud_network_recv_renew(void)
 void netd_init(void)
 {
   tu_memclr(&ncm_interface, sizeof(ncm_interface));
-  ncm_interface.ntb_in_size = CFG_TUD_NCM_IN_NTB_MAX_SIZE;
+  tu_memclr(&ncm_xmit_sg, sizeof(ncm_xmit_sg));
+  ncm_interface.ntb_in_max = CFG_TUD_NCM_IN_NTB_MAX_SIZE;
+  ncm_interface.ntb_format = NCM_NTB_FORMAT_16;
   ncm_interface.max_datagrams_per_ntb = CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB;
   ncm_prepare_for_tx();
 }
@@ -309,11 +671,38 @@ uint16_t netd_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint1
 
   TU_ASSERT(usbd_open_edpt_pair(rhport, p_desc, 2, TUSB_XFER_BULK, &ncm_interface.ep_out, &ncm_interface.ep_in) );
 
+  for (uint8_t i = 0; i < 2; i++) {
+    tusb_desc_endpoint_t const *desc_ep = (tusb_desc_endpoint_t const *) p_desc;
+    if (tu_edpt_dir(desc_ep->bEndpointAddress) == TUSB_DIR_IN) {
+      ncm_interface.ep_in_size = tu_edpt_packet_size(desc_ep);
+    }
+    p_desc = tu_desc_next(p_desc);
+  }
+
   drv_len += 2*sizeof(tusb_desc_endpoint_t);
 
   return drv_len;
 }
 
+#if CFG_TUD_NCM_TX_AGGREGATE_MS
+void netd_sof_isr(uint8_t rhport, uint32_t frame_count)
+{
+  (void) rhport;
+
+  // count 1ms frame, SOF can be invoked for each microframe in highspeed
+  uint16_t const frame = (uint16_t) (frame_count & 0x7FFu);
+  if (frame == ncm_interface.tx_frame) return;
+  ncm_interface.tx_frame = frame;
+
+  if (!ncm_interface.datagram_count || ncm_interface.tx_wait_ms >= CFG_TUD_NCM_TX_AGGREGATE_MS) return;
+
+  ncm_interface.tx_wait_ms++;
+
+  // send in usbd task context
+  if (ncm_interface.tx_wait_ms == CFG_TUD_NCM_TX_AGGREGATE_MS) usbd_defer_func(ncm_tx_timeout, NULL, true);
+}
+#endif
+
 static void ncm_report(void)
 {
   uint8_t const rhport = 0;
@@ -339,6 +728,15 @@ TU_ATTR_WEAK void tud_network_link_state_cb(bool state)
 // return false to stall control endpoint (e.g unsupported request)
 bool netd_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request)
 {
+  if ( stage == CONTROL_STAGE_DATA && request->bmRequestType_bit.type == TUSB_REQ_TYPE_CLASS &&
+       request->bRequest == NCM_SET_NTB_INPUT_SIZE )
+  {
+    // host can receive NTBs of this size, at least 2048 bytes
+    TU_VERIFY(ncm_interface.ntb_input_size >= 2048 && ncm_interface.ntb_input_size <= CFG_TUD_NCM_IN_NTB_MAX_SIZE);
+    ncm_interface.ntb_in_max = ncm_interface.ntb_input_size;
+    return true;
+  }
+
   if ( stage != CONTROL_STAGE_SETUP ) return true;
 
   switch ( request->bmRequestType_bit.type )
@@ -368,11 +766,18 @@ bool netd_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t
 
             if (ncm_interface.itf_data_alt) {
               if (!usbd_edpt_busy(rhport, ncm_interface.ep_out)) {
+                ncm_interface.rx_armed = false;
+                ncm_interface.rx_len[ncm_interface.rx_wr] = 0;
                 tud_network_recv_renew(); // prepare for incoming datagrams
               }
               if (!ncm_interface.report_pending) {
                 ncm_report();
               }
+            } else {
+              // host negotiates NTB format and size again before activating data interface
+              ncm_interface.ntb_format = NCM_NTB_FORMAT_16;
+              ncm_interface.ntb_in_max = CFG_TUD_NCM_IN_NTB_MAX_SIZE;
+              ncm_prepare_for_tx();
             }
 
             tud_network_link_state_cb(ncm_interface.itf_data_alt);
@@ -390,9 +795,36 @@ bool netd_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t
     case TUSB_REQ_TYPE_CLASS:
       TU_VERIFY (ncm_interface.itf_num == request->wIndex);
 
-      if (NCM_GET_NTB_PARAMETERS == request->bRequest)
+      switch (request->bRequest)
       {
-        tud_control_xfer(rhport, request, (void*)&ntb_parameters, sizeof(ntb_parameters));
+        case NCM_GET_NTB_PARAMETERS:
+          tud_control_xfer(rhport, request, (void*)&ntb_parameters, sizeof(ntb_parameters));
+        break;
+
+        case NCM_GET_NTB_FORMAT:
+          tud_control_xfer(rhport, request, &ncm_interface.ntb_format, sizeof(ncm_interface.ntb_format));
+        break;
+
+        case NCM_SET_NTB_FORMAT:
+          // format can only be changed while data interface is inactive
+          TU_VERIFY(request->wValue <= NCM_NTB_FORMAT_32 && ncm_interface.itf_data_alt == 0);
+          ncm_interface.ntb_format = request->wValue;
+          ncm_prepare_for_tx();
+          tud_control_status(rhport, request);
+        break;
+
+        case NCM_GET_NTB_INPUT_SIZE:
+          ncm_interface.ntb_input_size = ncm_interface.ntb_in_max;
+          tud_control_xfer(rhport, request, &ncm_interface.ntb_input_size, sizeof(ncm_interface.ntb_input_size));
+        break;
+
+        case NCM_SET_NTB_INPUT_SIZE:
+          // wNtbInMaxDatagrams is only sent if supported in bmNetworkCapabilities, which it is not
+          TU_VERIFY(request->wLength == sizeof(ncm_interface.ntb_input_size));
+          tud_control_xfer(rhport, request, &ncm_interface.ntb_input_size, sizeof(ncm_interface.ntb_input_size));
+        break;
+
+        default: break;
       }
 
       break;
@@ -406,32 +838,34 @@ bool netd_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t
 
 static void handle_incoming_datagram(uint32_t len)
 {
-  uint32_t size = len;
+  uint8_t num_datagrams;
+  uint8_t const wr = ncm_interface.rx_wr;
+  uint32_t const chunk = tu_min32(CFG_TUD_NCM_OUT_NTB_MAX_SIZE - ncm_interface.rx_len[wr], NCM_XFER_CHUNK_MAX);
 
-  if (len == 0) {
+  ncm_interface.rx_armed = false;
+  ncm_interface.rx_len[wr] += len;
+
+  // NTB larger than a single transfer continues with the next chunk
+  if (len == chunk && ncm_interface.rx_len[wr] < CFG_TUD_NCM_OUT_NTB_MAX_SIZE) {
+    ncm_start_rx();
     return;
   }
 
-  TU_ASSERT(size >= sizeof(nth16_t), );
-
-  const nth16_t *hdr = (const nth16_t *)receive_ntb;
-  TU_ASSERT(hdr->dwSignature == NTH16_SIGNATURE, );
-  TU_ASSERT(hdr->wNdpIndex >= sizeof(nth16_t) && (hdr->wNdpIndex + sizeof(ndp16_t)) <= len, );
+  // malformed or empty NTB is dropped, its buffer is re-used for next transfer
+  if (ncm_parse_ntb(receive_ntb[wr], ncm_interface.rx_len[wr], &num_datagrams)) {
+    ncm_interface.rx_wr = (uint8_t) ((wr + 1) % CFG_TUD_NCM_OUT_NTB_N);
+    ncm_interface.rx_count++;
+  } else {
+    ncm_interface.rx_len[wr] = 0;
+  }
 
-  const ndp16_t *ndp = (const ndp16_t *)(receive_ntb + hdr->wNdpIndex);
-  TU_ASSERT(ndp->dwSignature == NDP16_SIGNATURE_NCM0 || ndp->dwSignature == NDP16_SIGNATURE_NCM1, );
-  TU_ASSERT(hdr->wNdpIndex + ndp->wLength <= len, );
+  // keep OUT endpoint busy while application consumes datagrams
+  ncm_start_rx();
 
-  int num_datagrams = (ndp->wLength - 12) / 4;
-  ncm_interface.current_datagram_index = 0;
-  ncm_interface.num_datagrams = 0;
-  ncm_interface.ndp = ndp;
-  for (int i = 0; i < num_datagrams && ndp->datagram[i].wDatagramIndex && ndp->datagram[i].wDatagramLength; i++)
-  {
-    ncm_interface.num_datagrams++;
+  // application will pick up this NTB with tud_network_recv_renew() when done with current one
+  if (!ncm_interface.rx_consuming && ncm_interface.rx_count) {
+    tud_network_recv_renew();
   }
-  
-  tud_network_recv_renew();
 }
 
 bool netd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
@@ -450,10 +884,30 @@ bool netd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_
   {
     if (ncm_interface.transferring) {
       ncm_interface.transferring = false;
+
+      // NTB is done unless there are chunks left
+      if (ncm_interface.tx_offset >= ncm_ntb_block_length(&transmit_ntb[ncm_interface.tx_rd])) {
+        // all data is sent, segments can be released
+        if (ncm_xmit_sg.active && ncm_xmit_sg.ntb == ncm_interface.tx_rd) {
+          ncm_xmit_sg.active = false;
+          if (tud_network_xmit_done_cb) {
+            tud_network_xmit_done_cb(ncm_xmit_sg.ref);
+          }
+        }
+
+        ncm_interface.tx_offset = 0;
+        ncm_interface.tx_rd = (uint8_t) ((ncm_interface.tx_rd + 1) % CFG_TUD_NCM_IN_NTB_N);
+        ncm_interface.tx_count--;
+      }
     }
 
-    // If there are datagrams queued up that we tried to send while this NTB was being emitted, send them now
-    if (ncm_interface.datagram_count && ncm_interface.itf_data_alt == 1) {
+    if (ncm_interface.itf_data_alt == 1) {
+      // If there are datagrams queued up that we tried to send while this NTB was being emitted, send them now
+      // unless the NTB is still held open for aggregation
+      if (!ncm_interface.tx_count && ncm_interface.datagram_count && ncm_tx_timeout_expired()) {
+        ncm_close_ntb();
+      }
+
       ncm_start_tx();
     }
   }
@@ -472,13 +926,18 @@ bool tud_network_can_xmit(uint16_t size)
 {
   TU_VERIFY(ncm_interface.itf_data_alt == 1);
 
+  if (ncm_interface.tx_count >= CFG_TUD_NCM_IN_NTB_N) {
+    TU_LOG2("NTB pool full\r\n");
+    return false;
+  }
+
   if (ncm_interface.datagram_count >= ncm_interface.max_datagrams_per_ntb) {
     TU_LOG2("NTB full [by count]\r\n");
     return false;
   }
 
   size_t next_datagram_offset = ncm_interface.next_datagram_offset;
-  if (next_datagram_offset + size > ncm_interface.ntb_in_size) {
+  if (next_datagram_offset + size > ncm_ntb_in_size()) {
     TU_LOG2("ntb full [by size]\r\n");
     return false;
   }
@@ -486,15 +945,31 @@ bool tud_network_can_xmit(uint16_t size)
   return true;
 }
 
-void tud_network_xmit(void *ref, uint16_t arg)
+bool tud_network_ncm_set_ntb_in_size(uint32_t size)
+{
+  // must hold at least one datagram of full MTU
+  TU_VERIFY(size >= ncm_ntb_header_len() + CFG_TUD_NET_MTU && size <= CFG_TUD_NCM_IN_NTB_MAX_SIZE);
+  ncm_ntb_in_limit = size;
+
+  // current NTB is closed with the next datagram if it does not fit anymore
+  return true;
+}
+
+/*
+ * Add datagram of size already placed at next_datagram_offset of the current NTB to its NDP.
+ */
+static void ncm_add_datagram(uint16_t size)
 {
   transmit_ntb_t *ntb = &transmit_ntb[ncm_interface.current_ntb];
   size_t next_datagram_offset = ncm_interface.next_datagram_offset;
 
-  uint16_t size = tud_network_xmit_cb(ntb->data + next_datagram_offset, ref, arg);
-
-  ntb->ndp.datagram[ncm_interface.datagram_count].wDatagramIndex = ncm_interface.next_datagram_offset;
-  ntb->ndp.datagram[ncm_interface.datagram_count].wDatagramLength = size;
+  if (ncm_ntb32()) {
+    ntb->ndp32.datagram[ncm_interface.datagram_count].dwDatagramIndex = ncm_interface.next_datagram_offset;
+    ntb->ndp32.datagram[ncm_interface.datagram_count].dwDatagramLength = size;
+  } else {
+    ntb->ndp.datagram[ncm_interface.datagram_count].wDatagramIndex = (uint16_t) ncm_interface.next_datagram_offset;
+    ntb->ndp.datagram[ncm_interface.datagram_count].wDatagramLength = size;
+  }
 
   ncm_interface.datagram_count++;
   next_datagram_offset += size;
@@ -505,7 +980,68 @@ void tud_network_xmit(void *ref, uint16_t arg)
 
   ncm_interface.next_datagram_offset = next_datagram_offset;
 
+  // aggregation timeout starts with the first datagram
+  if (ncm_interface.datagram_count == 1) {
+    ncm_interface.tx_wait_ms = 0;
+  }
+
+  // NTB is sent once full, or right away if IN endpoint is idle and timeout is expired (or disabled)
+  if (ncm_ntb_full() || (!ncm_interface.transferring && ncm_tx_timeout_expired())) {
+    ncm_close_ntb();
+  }
+#if CFG_TUD_NCM_TX_AGGREGATE_MS
+  else {
+    // SOF times aggregation while the NTB is held open
+    usbd_sof_enable(0, SOF_CONSUMER_NET, true);
+  }
+#endif
+
   ncm_start_tx();
 }
 
+void tud_network_xmit(void *ref, uint16_t arg)
+{
+  transmit_ntb_t *ntb = &transmit_ntb[ncm_interface.current_ntb];
+
+  uint16_t size = tud_network_xmit_cb(ntb->data + ncm_interface.next_datagram_offset, ref, arg);
+
+  ncm_add_datagram(size);
+}
+
+bool tud_network_xmit_sg(tud_network_segment_t const* segs, uint8_t count, void *ref)
+{
+  // segments of a single datagram are referenced at a time
+  TU_VERIFY(!ncm_xmit_sg.active && count && count <= CFG_TUD_NET_XMIT_SEGMENTS);
+
+  uint32_t size = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    size += segs[i].len;
+  }
+
+  TU_VERIFY(size && size <= CFG_TUD_NET_MTU && tud_network_can_xmit((uint16_t) size));
+
+  ncm_xmit_sg_t *sg = &ncm_xmit_sg;
+  uint16_t const pkt_size = ncm_interface.ep_in_size;
+
+  memcpy(sg->segs, segs, count*sizeof(tud_network_segment_t));
+  sg->count = count;
+  sg->ref   = ref;
+  sg->ntb   = ncm_interface.current_ntb;
+  sg->index = ncm_interface.next_datagram_offset;
+
+  // start of datagram up to the next packet boundary and its end from the last packet boundary are
+  // copied and sent along with the rest of the NTB, so that other datagrams can share it
+  uint32_t const end = sg->index + size;
+  sg->head_end = tu_min32(tu_div_ceil(sg->index, pkt_size) * pkt_size, end);
+  sg->tail_beg = tu_max32(end - end % pkt_size, sg->head_end);
+  uint8_t *data = transmit_ntb[sg->ntb].data;
+  ncm_xmit_sg_gather(data + sg->index, 0, sg->head_end - sg->index);
+  ncm_xmit_sg_gather(data + sg->tail_beg, sg->tail_beg - sg->index, end - sg->tail_beg);
+
+  sg->active = true;
+  ncm_add_datagram((uint16_t) size);
+
+  return true;
+}
+
 #endif
@@ -44,6 +44,7 @@
 #define CFG_TUD_NET_MTU           1514
 #endif
 
+// Maximum NTB sizes, NTBs beyond 64 KiB require host to select NTB32 format with SET_NTB_FORMAT
 #ifndef CFG_TUD_NCM_IN_NTB_MAX_SIZE
 #define CFG_TUD_NCM_IN_NTB_MAX_SIZE 3200
 #endif
@@ -52,6 +53,23 @@
 #define CFG_TUD_NCM_OUT_NTB_MAX_SIZE 3200
 #endif
 
+// Number of OUT NTBs in receive ring, more than 1 lets host send the next NTB while application
+// is still processing datagrams of the previous one
+#ifndef CFG_TUD_NCM_OUT_NTB_N
+#define CFG_TUD_NCM_OUT_NTB_N 1
+#endif
+
+// Number of IN NTBs in transmit pool, datagrams are aggregated in one NTB while others are queued or sent
+#ifndef CFG_TUD_NCM_IN_NTB_N
+#define CFG_TUD_NCM_IN_NTB_N 2
+#endif
+
+// Time (ms) an NTB is held open waiting for more datagrams before it is sent, unless it is full.
+// 0 sends NTB as soon as IN endpoint is idle, datagrams are only aggregated while previous NTB is being sent
+#ifndef CFG_TUD_NCM_TX_AGGREGATE_MS
+#define CFG_TUD_NCM_TX_AGGREGATE_MS 0
+#endif
+
 #ifndef CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB
 #define CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB 8
 #endif
@@ -60,33 +78,109 @@
 #define CFG_TUD_NCM_ALIGNMENT 4
 #endif
 
+// ECM/RNDIS: number of OUT buffers, more than 1 lets host send the next transfer while application
+// is still processing packets of the previous one
+#ifndef CFG_TUD_ECM_RNDIS_OUT_BUF_N
+#define CFG_TUD_ECM_RNDIS_OUT_BUF_N 2
+#endif
+
+// RNDIS: max number of packets concatenated in one transfer (MaxPacketsPerTransfer) in both directions.
+// Each OUT buffer and both IN buffers are sized to hold this many packets.
+#ifndef CFG_TUD_RNDIS_PACKETS_PER_XFER
+#define CFG_TUD_RNDIS_PACKETS_PER_XFER 1
+#endif
+
+// Max segments of a frame transmitted with tud_network_xmit_sg()
+#ifndef CFG_TUD_NET_XMIT_SEGMENTS
+#define CFG_TUD_NET_XMIT_SEGMENTS 4
+#endif
+
+// Max datagrams passed at once to tud_network_recv_batch_cb(), the rest of an NTB (or RNDIS
+// transfer) follows with the next batch
+#ifndef CFG_TUD_NET_RECV_BATCH_MAX
+#define CFG_TUD_NET_RECV_BATCH_MAX 16
+#endif
+
 #ifdef __cplusplus
  extern "C" {
 #endif
 
+#define TUD_NETWORK_RECV_HOLD_INVALID  0xFFu
+
+// Segment of a frame to transmit e.g a buffer of a network stack's packet chain
+typedef struct
+{
+  void const* buf;
+  uint16_t    len;
+} tud_network_segment_t;
+
+// Received datagram passed to tud_network_recv_batch_cb()
+typedef struct
+{
+  uint8_t const* buf;
+  uint16_t       len;
+} tud_network_datagram_t;
+
 //--------------------------------------------------------------------+
 // Application API
 //--------------------------------------------------------------------+
 
-// indicate to network driver that client has finished with the packet provided to network_recv_cb()
+// indicate to network driver that client has finished with the packet provided to network_recv_cb(),
+// or with all datagrams provided to network_recv_batch_cb()
 void tud_network_recv_renew(void);
 
+// Keep the packet provided to network_recv_cb() valid after tud_network_recv_renew() e.g to pass it
+// to a network stack without copying. Must be called within network_recv_cb() (or network_recv_batch_cb()
+// to keep all datagrams of the batch), return buffer id
+// to be released with tud_network_recv_release(). Driver does not receive into a held buffer:
+// - ECM/RNDIS: the other OUT buffers (CFG_TUD_ECM_RNDIS_OUT_BUF_N) are still used
+// - NCM: the other NTBs of the receive ring (CFG_TUD_NCM_OUT_NTB_N) are still used
+// Return TUD_NETWORK_RECV_HOLD_INVALID if the last buffer free for reception would be held (always
+// with a single buffer), packet must be copied then.
+uint8_t tud_network_recv_hold(void);
+
+// Release buffer held with tud_network_recv_hold()
+void tud_network_recv_release(uint8_t buf_id);
+
 // poll network driver for its ability to accept another packet to transmit
 bool tud_network_can_xmit(uint16_t size);
 
 // if network_can_xmit() returns true, network_xmit() can be called once
 void tud_network_xmit(void *ref, uint16_t arg);
 
+// Transmit a frame made of segments without copying it with tud_network_xmit_cb().
+// Segments must stay valid until tud_network_xmit_done_cb(ref) is invoked.
+// Segments are sent directly from their memory, only data straddling USB packets of consecutive
+// segments (and unaligned data) is copied. Segment memory must be DMA capable.
+// - ECM/RNDIS: only possible while IN endpoint is idle, otherwise tud_network_xmit() queues the frame.
+// - NCM: frame is added to the current NTB like any other datagram. Only one frame can be in flight,
+//   its start up to the next and its end from the last USB packet boundary are copied into the NTB.
+// Return false if driver cannot transmit now (see tud_network_can_xmit()) or too many segments
+bool tud_network_xmit_sg(tud_network_segment_t const* segs, uint8_t count, void *ref);
+
+// NCM: limit size of NTBs sent to host, at most CFG_TUD_NCM_IN_NTB_MAX_SIZE and what host allows with
+// SET_NTB_INPUT_SIZE. Larger NTBs carry more datagrams per transfer, smaller ones are sent sooner.
+// Return false if size cannot hold a datagram of full MTU.
+bool tud_network_ncm_set_ntb_in_size(uint32_t size);
+
 //--------------------------------------------------------------------+
 // Application Callbacks (WEAK is optional)
 //--------------------------------------------------------------------+
 
-// client must provide this: return false if the packet buffer was not accepted
-bool tud_network_recv_cb(const uint8_t *src, uint16_t size);
+// client must provide this or tud_network_recv_batch_cb(): return false if the packet buffer was not accepted
+TU_ATTR_WEAK bool tud_network_recv_cb(const uint8_t *src, uint16_t size);
+
+// Invoked instead of tud_network_recv_cb() with all received datagrams of an NTB (NCM) or transfer
+// (RNDIS) at once, up to CFG_TUD_NET_RECV_BATCH_MAX. Descriptors and datagrams stay valid until
+// tud_network_recv_renew(), which releases the whole batch. Return false if the batch was not accepted.
+TU_ATTR_WEAK bool tud_network_recv_batch_cb(tud_network_datagram_t const* datagrams, uint8_t count);
 
 // client must provide this: copy from network stack packet pointer to dst
 uint16_t tud_network_xmit_cb(uint8_t *dst, void *ref, uint16_t arg);
 
+// Invoked when segments of tud_network_xmit_sg() are no longer used by driver
+TU_ATTR_WEAK void tud_network_xmit_done_cb(void *ref);
+
 //------------- ECM/RNDIS -------------//
 
 // client must provide this: initialize any network state back to the beginning
@@ -109,6 +203,7 @@ void     netd_reset           (uint8_t rhport);
 uint16_t netd_open            (uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t max_len);
 bool     netd_control_xfer_cb (uint8_t rhport, uint8_t stage, tusb_control_request_t const * request);
 bool     netd_xfer_cb         (uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+void     netd_sof_isr         (uint8_t rhport, uint32_t frame_count);
 void     netd_report          (uint8_t *buf, uint16_t len);
 
 #ifdef __cplusplus
@@ -0,0 +1,887 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "tusb_option.h"
+
+#if (CFG_TUH_ENABLED && CFG_TUH_NET)
+
+#include "host/usbh.h"
+#include "host/usbh_classdriver.h"
+
+#include "net_host.h"
+
+//--------------------------------------------------------------------+
+// MACRO CONSTANT TYPEDEF
+//--------------------------------------------------------------------+
+
+// Receive/transmit buffer size, multiple of 4 to keep every buffer aligned
+#define NETH_BUF_SIZE       ((TU_MAX(CFG_TUH_NET_NTB_MAX_SIZE, CFG_TUH_NET_MTU) + 3u) & ~3u)
+
+TU_VERIFY_STATIC(NETH_BUF_SIZE <= UINT16_MAX, "NTB16 and transfer length are limited to 64 KiB");
+
+#define NETH_NOTIF_SIZE     16
+
+// Table 8 ECM Ethernet Packet Filter Bitmap: directed, broadcast and all multicast packets
+#define NETH_PACKET_FILTER  0x000Eu
+
+#define NETH_LANGID_EN_US   0x0409u
+
+typedef struct
+{
+  uint8_t daddr;
+  uint8_t itf_num;        // Communication Interface
+  uint8_t itf_data;       // Data Interface from Union Functional Descriptor
+  uint8_t itf_data_alt;   // Alternate setting of Data Interface with bulk endpoints
+  uint8_t subclass;       // CDC_COMM_SUBCLASS_ETHERNET_CONTROL_MODEL or CDC_COMM_SUBCLASS_NETWORK_CONTROL_MODEL
+  uint8_t mac_str_index;  // iMACAddress of Ethernet Networking Functional Descriptor
+
+  uint8_t  ep_notif;
+  uint8_t  ep_in;
+  uint8_t  ep_out;
+  uint16_t ep_out_size;
+
+  bool    mounted;
+  bool    link_up;
+  uint8_t mac[6];
+
+  // Ring of IN buffers: next IN transfer is queued once a buffer is received while datagrams of
+  // earlier buffers are consumed by application
+  uint8_t  rx_rd;                 // Index in rx[] whose datagrams are handed to application
+  uint8_t  rx_wr;                 // Index in rx[] to receive next transfer
+  uint8_t  rx_count;              // Number of received buffers not yet released by tuh_network_recv_renew()
+  bool     rx_armed;              // IN transfer is queued with rx[rx_wr]
+  bool     rx_consuming;          // rx[rx_rd] is being consumed
+  uint16_t rx_len[CFG_TUH_NET_RX_BUF_N];
+  uint16_t rx_ndp;                // NCM: offset of current NDP16 in rx[rx_rd], 0 if there is none left
+  uint16_t rx_datagram;           // Index of next datagram in current NDP16, ECM: 1 once frame is consumed
+
+  // Double buffered OUT: datagrams are put into tx[tx_fill] while the other buffer is being sent
+  uint8_t  tx_fill;
+  bool     tx_busy;
+  bool     tx_zlp;                // Zero length packet is pending to terminate the transfer
+  uint8_t  tx_datagrams[2];       // NCM: number of datagrams in NTB
+  uint16_t tx_len[2];
+  uint16_t nth_sequence;
+
+  // NCM: from GET_NTB_PARAMETERS
+  uint16_t ntb_out_max;           // Maximum NTB size accepted by device, at most NETH_BUF_SIZE
+  uint16_t ndb_out_divisor;       // Datagram offset modulus
+  uint16_t ndb_out_remainder;     // Datagram offset remainder
+  uint16_t ndp_out_offset;        // Offset of NDP16 after NTH16, aligned as required by device
+  uint8_t  ntb_out_max_datagrams;
+} neth_interface_t;
+
+typedef struct
+{
+  uint8_t rx[CFG_TUH_NET_RX_BUF_N][NETH_BUF_SIZE];
+  uint8_t tx[2][NETH_BUF_SIZE];
+  uint8_t notif[NETH_NOTIF_SIZE];
+} neth_epbuf_t;
+
+//--------------------------------------------------------------------+
+// INTERNAL OBJECT & FUNCTION DECLARATION
+//--------------------------------------------------------------------+
+
+static neth_interface_t _neth_itf[CFG_TUH_NET];
+
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN static neth_epbuf_t _neth_epbuf[CFG_TUH_NET];
+
+static void neth_start_rx(neth_interface_t* itf);
+static void neth_start_tx(neth_interface_t* itf);
+static void neth_recv_next(neth_interface_t* itf);
+
+TU_ATTR_ALWAYS_INLINE static inline uint8_t get_index(neth_interface_t const* itf)
+{
+  return (uint8_t) (itf - _neth_itf);
+}
+
+TU_ATTR_ALWAYS_INLINE static inline neth_epbuf_t* get_epbuf(neth_interface_t const* itf)
+{
+  return &_neth_epbuf[get_index(itf)];
+}
+
+static neth_interface_t* get_itf_by_daddr(uint8_t daddr)
+{
+  for (uint8_t i = 0; i < CFG_TUH_NET; i++)
+  {
+    if (_neth_itf[i].daddr == daddr && _neth_itf[i].mounted) return &_neth_itf[i];
+  }
+  return NULL;
+}
+
+static neth_interface_t* get_itf_by_itfnum(uint8_t daddr, uint8_t itf_num)
+{
+  for (uint8_t i = 0; i < CFG_TUH_NET; i++)
+  {
+    neth_interface_t* itf = &_neth_itf[i];
+    if (itf->daddr == daddr && (itf->itf_num == itf_num || itf->itf_data == itf_num)) return itf;
+  }
+  return NULL;
+}
+
+static neth_interface_t* get_itf_by_epaddr(uint8_t daddr, uint8_t ep_addr)
+{
+  for (uint8_t i = 0; i < CFG_TUH_NET; i++)
+  {
+    neth_interface_t* itf = &_neth_itf[i];
+    if (itf->daddr == daddr && (ep_addr == itf->ep_in || ep_addr == itf->ep_out || ep_addr == itf->ep_notif)) return itf;
+  }
+  return NULL;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline bool is_ncm(neth_interface_t const* itf)
+{
+  return itf->subclass == CDC_COMM_SUBCLASS_NETWORK_CONTROL_MODEL;
+}
+
+//--------------------------------------------------------------------+
+// Receive
+//--------------------------------------------------------------------+
+
+static void neth_start_rx(neth_interface_t* itf)
+{
+  // ring is full, IN transfer is queued again by tuh_network_recv_renew()
+  if (itf->rx_armed || itf->rx_count >= CFG_TUH_NET_RX_BUF_N) return;
+
+  TU_VERIFY(usbh_edpt_claim(itf->daddr, itf->ep_in), );
+
+  if ( !usbh_edpt_xfer(itf->daddr, itf->ep_in, get_epbuf(itf)->rx[itf->rx_wr], NETH_BUF_SIZE) )
+  {
+    usbh_edpt_release(itf->daddr, itf->ep_in);
+    return;
+  }
+
+  itf->rx_armed = true;
+}
+
+// Start consuming rx[rx_rd], NCM: locate first NDP16 of NTB
+static void neth_rx_begin(neth_interface_t* itf)
+{
+  itf->rx_consuming = true;
+  itf->rx_datagram  = 0;
+  itf->rx_ndp       = 0;
+
+  if (!is_ncm(itf)) return;
+
+  uint8_t const* ntb = get_epbuf(itf)->rx[itf->rx_rd];
+  uint16_t const len = itf->rx_len[itf->rx_rd];
+  nth16_t const* nth = (nth16_t const*) ntb;
+
+  if ( len < sizeof(nth16_t) || nth->dwSignature != NTH16_SIGNATURE ||
+       nth->wHeaderLength != sizeof(nth16_t) || nth->wBlockLength > len )
+  {
+    TU_LOG2("  NET: dropped invalid NTB\r\n");
+    return;
+  }
+
+  itf->rx_ndp = nth->wNdpIndex;
+}
+
+// Get next datagram of rx[rx_rd], false if all datagrams are consumed
+static bool neth_rx_datagram(neth_interface_t* itf, uint8_t const** buf, uint16_t* len)
+{
+  uint8_t const* rx = get_epbuf(itf)->rx[itf->rx_rd];
+  uint16_t const rx_len = itf->rx_len[itf->rx_rd];
+
+  if (!is_ncm(itf))
+  {
+    // ECM: whole transfer is one Ethernet frame
+    if (itf->rx_datagram) return false;
+
+    itf->rx_datagram = 1;
+    *buf = rx;
+    *len = rx_len;
+    return true;
+  }
+
+  while (itf->rx_ndp)
+  {
+    ndp16_t const* ndp = (ndp16_t const*) (rx + itf->rx_ndp);
+
+    // NDP must be 4-byte aligned and must not overlap NTH
+    if ( (itf->rx_ndp & 3u) || itf->rx_ndp < sizeof(nth16_t) ||
+         (uint32_t) itf->rx_ndp + sizeof(ndp16_t) > rx_len ||
+         (ndp->dwSignature != NDP16_SIGNATURE_NCM0 && ndp->dwSignature != NDP16_SIGNATURE_NCM1) ||
+         ndp->wLength < sizeof(ndp16_t) || (uint32_t) itf->rx_ndp + ndp->wLength > rx_len )
+    {
+      TU_LOG2("  NET: dropped invalid NDP\r\n");
+      return false;
+    }
+
+    uint16_t const count = (uint16_t) ((ndp->wLength - sizeof(ndp16_t)) / sizeof(ndp16_datagram_t));
+
+    if (itf->rx_datagram < count)
+    {
+      ndp16_datagram_t const* datagram = &ndp->datagram[itf->rx_datagram];
+
+      // null entry terminates datagram list of this NDP
+      if (datagram->wDatagramIndex && datagram->wDatagramLength)
+      {
+        itf->rx_datagram++;
+
+        // skip datagrams beyond received data
+        if ((uint32_t) datagram->wDatagramIndex + datagram->wDatagramLength > rx_len) continue;
+
+        *buf = rx + datagram->wDatagramIndex;
+        *len = datagram->wDatagramLength;
+        return true;
+      }
+    }
+
+    // continue with next NDP of the NTB (if any), it must follow the current one so that NTB can't loop
+    if (ndp->wNextNdpIndex && ndp->wNextNdpIndex <= itf->rx_ndp)
+    {
+      TU_LOG2("  NET: dropped NTB with NDP loop\r\n");
+      return false;
+    }
+
+    itf->rx_ndp      = ndp->wNextNdpIndex;
+    itf->rx_datagram = 0;
+  }
+
+  return false;
+}
+
+static void neth_recv_next(neth_interface_t* itf)
+{
+  uint8_t const* buf = NULL;
+  uint16_t len = 0;
+
+  while (1)
+  {
+    if (!itf->rx_consuming)
+    {
+      if (!itf->rx_count) return;
+      neth_rx_begin(itf);
+    }
+
+    if (neth_rx_datagram(itf, &buf, &len)) break;
+
+    // all datagrams of this buffer are consumed, it can receive again
+    itf->rx_consuming = false;
+    itf->rx_len[itf->rx_rd] = 0;
+    itf->rx_rd = (uint8_t) ((itf->rx_rd + 1) % CFG_TUH_NET_RX_BUF_N);
+    itf->rx_count--;
+
+    neth_start_rx(itf);
+  }
+
+  tuh_network_recv_cb(itf->daddr, buf, len);
+}
+
+static void neth_rx_complete(neth_interface_t* itf, xfer_result_t result, uint32_t xferred_bytes)
+{
+  itf->rx_armed = false;
+
+  if (result == XFER_RESULT_SUCCESS && xferred_bytes)
+  {
+    itf->rx_len[itf->rx_wr] = (uint16_t) xferred_bytes;
+    itf->rx_wr = (uint8_t) ((itf->rx_wr + 1) % CFG_TUH_NET_RX_BUF_N);
+    itf->rx_count++;
+  }
+
+  // queue next IN transfer before handing datagrams to application
+  neth_start_rx(itf);
+
+  if (!itf->rx_consuming) neth_recv_next(itf);
+}
+
+//--------------------------------------------------------------------+
+// Transmit
+//--------------------------------------------------------------------+
+
+// First datagram offset of an NTB: NTH16 followed by NDP16 with room for all entries and null terminator
+TU_ATTR_ALWAYS_INLINE static inline uint16_t neth_ntb_header_len(neth_interface_t const* itf)
+{
+  return (uint16_t) (itf->ndp_out_offset + sizeof(ndp16_t) + (itf->ntb_out_max_datagrams + 1u) * sizeof(ndp16_datagram_t));
+}
+
+// Datagram must be placed at offset where (offset % wNdpOutDivisor) == wNdpOutPayloadRemainder
+TU_ATTR_ALWAYS_INLINE static inline uint16_t neth_datagram_offset(neth_interface_t const* itf, uint16_t offset)
+{
+  uint16_t const divisor   = itf->ndb_out_divisor;
+  uint16_t const remainder = itf->ndb_out_remainder;
+  return (uint16_t) (((offset + divisor - 1u - remainder) / divisor) * divisor + remainder);
+}
+
+static void neth_start_tx(neth_interface_t* itf)
+{
+  uint8_t const idx = itf->tx_fill;
+  uint16_t const len = itf->tx_len[idx];
+
+  if (itf->tx_busy || !len) return;
+
+  uint8_t* buf = get_epbuf(itf)->tx[idx];
+
+  if (is_ncm(itf))
+  {
+    nth16_t* nth = (nth16_t*) buf;
+    ndp16_t* ndp = (ndp16_t*) (buf + itf->ndp_out_offset);
+    uint8_t const count = itf->tx_datagrams[idx];
+
+    nth->dwSignature   = NTH16_SIGNATURE;
+    nth->wHeaderLength = sizeof(nth16_t);
+    nth->wSequence     = itf->nth_sequence++;
+    nth->wBlockLength  = len;
+    nth->wNdpIndex     = itf->ndp_out_offset;
+
+    ndp->dwSignature   = NDP16_SIGNATURE_NCM0;
+    ndp->wLength       = (uint16_t) (sizeof(ndp16_t) + (count + 1u) * sizeof(ndp16_datagram_t));
+    ndp->wNextNdpIndex = 0;
+    ndp->datagram[count].wDatagramIndex  = 0;
+    ndp->datagram[count].wDatagramLength = 0;
+  }
+
+  TU_VERIFY(usbh_edpt_claim(itf->daddr, itf->ep_out), );
+
+  if ( !usbh_edpt_xfer(itf->daddr, itf->ep_out, buf, len) )
+  {
+    usbh_edpt_release(itf->daddr, itf->ep_out);
+    return;
+  }
+
+  // Transfer must be terminated with ZLP unless it is short, NCM: or it is an NTB of maximum size
+  itf->tx_zlp  = !(len % itf->ep_out_size) && !(is_ncm(itf) && len == itf->ntb_out_max);
+  itf->tx_busy = true;
+
+  // continue filling the other buffer
+  itf->tx_fill = (uint8_t) (idx ^ 1);
+  itf->tx_len[itf->tx_fill]       = 0;
+  itf->tx_datagrams[itf->tx_fill] = 0;
+}
+
+static void neth_tx_complete(neth_interface_t* itf)
+{
+  if (itf->tx_zlp)
+  {
+    itf->tx_zlp = false;
+
+    if ( usbh_edpt_claim(itf->daddr, itf->ep_out) )
+    {
+      if ( usbh_edpt_xfer(itf->daddr, itf->ep_out, NULL, 0) ) return;
+      usbh_edpt_release(itf->daddr, itf->ep_out);
+    }
+  }
+
+  itf->tx_busy = false;
+
+  // send datagrams queued in the meantime
+  neth_start_tx(itf);
+}
+
+//--------------------------------------------------------------------+
+// Notification
+//--------------------------------------------------------------------+
+
+static void neth_start_notif(neth_interface_t* itf)
+{
+  if (!itf->ep_notif) return;
+
+  TU_VERIFY(usbh_edpt_claim(itf->daddr, itf->ep_notif), );
+
+  if ( !usbh_edpt_xfer(itf->daddr, itf->ep_notif, get_epbuf(itf)->notif, NETH_NOTIF_SIZE) )
+  {
+    usbh_edpt_release(itf->daddr, itf->ep_notif);
+  }
+}
+
+static void neth_notif_complete(neth_interface_t* itf, xfer_result_t result, uint32_t xferred_bytes)
+{
+  // endpoint is not polled anymore if device stalls it
+  TU_VERIFY(result == XFER_RESULT_SUCCESS, );
+
+  tusb_control_request_t const* notif = (tusb_control_request_t const*) get_epbuf(itf)->notif;
+
+  if (xferred_bytes >= sizeof(tusb_control_request_t) && notif->bRequest == CDC_NOTIF_NETWORK_CONNECTION)
+  {
+    itf->link_up = (tu_le16toh(notif->wValue) != 0);
+    TU_LOG2("  NET: link %s\r\n", itf->link_up ? "up" : "down");
+
+    if (tuh_network_link_state_cb) tuh_network_link_state_cb(itf->daddr, itf->link_up);
+  }
+
+  neth_start_notif(itf);
+}
+
+//--------------------------------------------------------------------+
+// APPLICATION API
+//--------------------------------------------------------------------+
+
+bool tuh_network_mounted(uint8_t daddr)
+{
+  return get_itf_by_daddr(daddr) != NULL;
+}
+
+bool tuh_network_is_ncm(uint8_t daddr)
+{
+  neth_interface_t const* itf = get_itf_by_daddr(daddr);
+  return itf && is_ncm(itf);
+}
+
+bool tuh_network_link_up(uint8_t daddr)
+{
+  neth_interface_t const* itf = get_itf_by_daddr(daddr);
+  return itf && itf->link_up;
+}
+
+void tuh_network_recv_renew(uint8_t daddr)
+{
+  neth_interface_t* itf = get_itf_by_daddr(daddr);
+  TU_VERIFY(itf, );
+
+  neth_recv_next(itf);
+}
+
+bool tuh_network_can_xmit(uint8_t daddr, uint16_t size)
+{
+  neth_interface_t const* itf = get_itf_by_daddr(daddr);
+  TU_VERIFY(itf && size <= CFG_TUH_NET_MTU);
+
+  uint8_t const idx = itf->tx_fill;
+
+  if (!is_ncm(itf)) return itf->tx_len[idx] == 0;
+
+  if (itf->tx_datagrams[idx] >= itf->ntb_out_max_datagrams) return false;
+
+  uint16_t const offset = itf->tx_datagrams[idx] ? itf->tx_len[idx] : neth_ntb_header_len(itf);
+  return (uint32_t) neth_datagram_offset(itf, offset) + size <= itf->ntb_out_max;
+}
+
+bool tuh_network_xmit(uint8_t daddr, void *ref, uint16_t arg)
+{
+  // datagram size is only known after it is copied, reserve room for a full MTU
+  TU_VERIFY(tuh_network_can_xmit(daddr, CFG_TUH_NET_MTU));
+
+  neth_interface_t* itf = get_itf_by_daddr(daddr);
+  uint8_t const idx = itf->tx_fill;
+  uint8_t* buf = get_epbuf(itf)->tx[idx];
+
+  if (is_ncm(itf))
+  {
+    uint16_t const offset = neth_datagram_offset(itf, itf->tx_datagrams[idx] ? itf->tx_len[idx] : neth_ntb_header_len(itf));
+    uint16_t const len = tuh_network_xmit_cb(daddr, buf + offset, ref, arg);
+
+    ndp16_t* ndp = (ndp16_t*) (buf + itf->ndp_out_offset);
+    ndp->datagram[itf->tx_datagrams[idx]].wDatagramIndex  = offset;
+    ndp->datagram[itf->tx_datagrams[idx]].wDatagramLength = len;
+
+    itf->tx_datagrams[idx]++;
+    itf->tx_len[idx] = (uint16_t) (offset + len);
+  }else
+  {
+    itf->tx_len[idx] = tuh_network_xmit_cb(daddr, buf, ref, arg);
+  }
+
+  neth_start_tx(itf);
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// USBH-CLASS DRIVER API
+//--------------------------------------------------------------------+
+
+void neth_init(void)
+{
+  tu_memclr(_neth_itf, sizeof(_neth_itf));
+}
+
+// Open bulk endpoints of Data Interface (all alternate settings within len), return false if there are none
+static bool neth_open_data(neth_interface_t* itf, uint8_t const* p_desc, uint16_t len)
+{
+  uint8_t const* desc_end = p_desc + len;
+
+  while (p_desc < desc_end)
+  {
+    if (TUSB_DESC_INTERFACE == tu_desc_type(p_desc))
+    {
+      tusb_desc_interface_t const* desc_itf = (tusb_desc_interface_t const*) p_desc;
+
+      // a different interface follows
+      if (desc_itf->bInterfaceNumber != itf->itf_data || TUSB_CLASS_CDC_DATA != desc_itf->bInterfaceClass) break;
+
+      if (desc_itf->bNumEndpoints == 2) itf->itf_data_alt = desc_itf->bAlternateSetting;
+    }
+    else if (TUSB_DESC_ENDPOINT == tu_desc_type(p_desc))
+    {
+      tusb_desc_endpoint_t const* desc_ep = (tusb_desc_endpoint_t const*) p_desc;
+      TU_ASSERT(TUSB_XFER_BULK == desc_ep->bmAttributes.xfer);
+      TU_ASSERT(tuh_edpt_open(itf->daddr, desc_ep));
+
+      if (tu_edpt_dir(desc_ep->bEndpointAddress) == TUSB_DIR_IN)
+      {
+        itf->ep_in = desc_ep->bEndpointAddress;
+      }else
+      {
+        itf->ep_out      = desc_ep->bEndpointAddress;
+        itf->ep_out_size = tu_edpt_packet_size(desc_ep);
+      }
+    }
+
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  return itf->ep_in && itf->ep_out;
+}
+
+bool neth_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *itf_desc, uint16_t max_len)
+{
+  (void) rhport;
+
+  uint8_t const* p_desc = (uint8_t const*) itf_desc;
+
+  //------------- Data Interface without IAD, Communication Interface is already opened -------------//
+  if (TUSB_CLASS_CDC_DATA == itf_desc->bInterfaceClass)
+  {
+    neth_interface_t* itf = get_itf_by_itfnum(dev_addr, itf_desc->bInterfaceNumber);
+    TU_VERIFY(itf && !itf->ep_in && itf->itf_data == itf_desc->bInterfaceNumber);
+
+    return neth_open_data(itf, p_desc, max_len);
+  }
+
+  TU_VERIFY(TUSB_CLASS_CDC == itf_desc->bInterfaceClass &&
+            (CDC_COMM_SUBCLASS_ETHERNET_CONTROL_MODEL == itf_desc->bInterfaceSubClass ||
+             CDC_COMM_SUBCLASS_NETWORK_CONTROL_MODEL  == itf_desc->bInterfaceSubClass));
+
+  // not enough interface, try to increase CFG_TUH_NET
+  neth_interface_t* itf = NULL;
+  for (uint8_t i = 0; i < CFG_TUH_NET; i++)
+  {
+    if (!_neth_itf[i].daddr)
+    {
+      itf = &_neth_itf[i];
+      break;
+    }
+  }
+  TU_ASSERT(itf);
+
+  TU_LOG2("[%u] NET opening Interface %u\r\n", dev_addr, itf_desc->bInterfaceNumber);
+
+  tu_memclr(itf, sizeof(neth_interface_t));
+  itf->daddr    = dev_addr;
+  itf->itf_num  = itf_desc->bInterfaceNumber;
+  itf->itf_data = (uint8_t) (itf_desc->bInterfaceNumber + 1);
+  itf->subclass = itf_desc->bInterfaceSubClass;
+
+  //------------- Communication Interface -------------//
+  uint16_t drv_len = tu_desc_len(p_desc);
+  p_desc = tu_desc_next(p_desc);
+
+  // Communication Functional Descriptors
+  while (TUSB_DESC_CS_INTERFACE == tu_desc_type(p_desc) && drv_len < max_len)
+  {
+    switch (cdc_functional_desc_typeof(p_desc))
+    {
+      case CDC_FUNC_DESC_UNION:
+        itf->itf_data = ((cdc_desc_func_union_t const*) p_desc)->bSubordinateInterface;
+      break;
+
+      case CDC_FUNC_DESC_ETHERNET_NETWORKING:
+        itf->mac_str_index = ((cdc_desc_func_ethernet_networking_t const*) p_desc)->iMACAddress;
+      break;
+
+      default: break;
+    }
+
+    drv_len = (uint16_t) (drv_len + tu_desc_len(p_desc));
+    p_desc  = tu_desc_next(p_desc);
+  }
+
+  if (TUSB_DESC_ENDPOINT == tu_desc_type(p_desc) && drv_len < max_len)
+  {
+    // notification endpoint
+    tusb_desc_endpoint_t const * desc_ep = (tusb_desc_endpoint_t const *) p_desc;
+
+    TU_ASSERT( tuh_edpt_open(dev_addr, desc_ep) );
+    itf->ep_notif = desc_ep->bEndpointAddress;
+
+    drv_len = (uint16_t) (drv_len + tu_desc_len(p_desc));
+    p_desc  = tu_desc_next(p_desc);
+  }
+
+  //------------- Data Interface within IAD (if any) -------------//
+  if (drv_len < max_len) neth_open_data(itf, p_desc, (uint16_t) (max_len - drv_len));
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Set Configure
+//--------------------------------------------------------------------+
+
+enum {
+  CONFIG_GET_NTB_PARAMETERS,
+  CONFIG_SET_NTB_INPUT_SIZE,
+  CONFIG_SET_PACKET_FILTER,
+  CONFIG_SET_INTERFACE,
+  CONFIG_GET_MAC_ADDRESS,
+  CONFIG_COMPLETE
+};
+
+static void process_set_config(tuh_xfer_t* xfer);
+static void config_request(neth_interface_t* itf, uint8_t state);
+
+// Control transfer of configuration sequence, data stage uses usbh enumeration buffer
+static bool config_control_xfer(neth_interface_t const* itf, uint8_t type, uint8_t direction, uint8_t request_code,
+                                uint16_t value, uint16_t index, uint16_t length, uint8_t state)
+{
+  tusb_control_request_t const request =
+  {
+    .bmRequestType_bit =
+    {
+      .recipient = TUSB_REQ_RCPT_INTERFACE,
+      .type      = type & 0x03u,
+      .direction = direction & 0x01u
+    },
+    .bRequest = request_code,
+    .wValue   = tu_htole16(value),
+    .wIndex   = tu_htole16(index),
+    .wLength  = tu_htole16(length)
+  };
+
+  tuh_xfer_t xfer =
+  {
+    .daddr       = itf->daddr,
+    .ep_addr     = 0,
+    .setup       = &request,
+    .buffer      = length ? usbh_get_enum_buf() : NULL,
+    .complete_cb = process_set_config,
+    .user_data   = (uintptr_t) ((get_index(itf) << 8) | state)
+  };
+
+  return tuh_control_xfer(&xfer);
+}
+
+static void config_driver_mount_complete(neth_interface_t* itf, bool success)
+{
+  uint8_t const daddr = itf->daddr;
+
+  if (success)
+  {
+    itf->mounted = true;
+    TU_LOG2("[%u] NET %s mounted\r\n", daddr, is_ncm(itf) ? "NCM" : "ECM");
+
+    if (tuh_network_mount_cb) tuh_network_mount_cb(daddr, itf->mac);
+
+    neth_start_rx(itf);
+    neth_start_notif(itf);
+  }
+
+  // notify usbh that driver enumeration is complete, Data Interface is configured as well
+  usbh_driver_set_config_complete(daddr, tu_max8(itf->itf_num, itf->itf_data));
+}
+
+static void config_request(neth_interface_t* itf, uint8_t state)
+{
+  bool ret = true;
+
+  switch (state)
+  {
+    case CONFIG_GET_NTB_PARAMETERS:
+      ret = config_control_xfer(itf, TUSB_REQ_TYPE_CLASS, TUSB_DIR_IN, NCM_GET_NTB_PARAMETERS,
+                                0, itf->itf_num, sizeof(ntb_parameters_t), state);
+    break;
+
+    case CONFIG_SET_NTB_INPUT_SIZE:
+    {
+      // dwNtbInMaxSize, device must not send NTBs larger than our receive buffer
+      uint32_t const ntb_in_size = tu_htole32(NETH_BUF_SIZE);
+      memcpy(usbh_get_enum_buf(), &ntb_in_size, 4);
+
+      ret = config_control_xfer(itf, TUSB_REQ_TYPE_CLASS, TUSB_DIR_OUT, NCM_SET_NTB_INPUT_SIZE,
+                                0, itf->itf_num, 4, state);
+    }
+    break;
+
+    case CONFIG_SET_PACKET_FILTER:
+      ret = config_control_xfer(itf, TUSB_REQ_TYPE_CLASS, TUSB_DIR_OUT, CDC_REQUEST_SET_ETHERNET_PACKET_FILTER,
+                                NETH_PACKET_FILTER, itf->itf_num, 0, state);
+    break;
+
+    case CONFIG_SET_INTERFACE:
+      // Data Interface has no alternate setting e.g endpoints are always active
+      if (!itf->itf_data_alt)
+      {
+        config_request(itf, CONFIG_GET_MAC_ADDRESS);
+        return;
+      }
+
+      ret = config_control_xfer(itf, TUSB_REQ_TYPE_STANDARD, TUSB_DIR_OUT, TUSB_REQ_SET_INTERFACE,
+                                itf->itf_data_alt, itf->itf_data, 0, state);
+    break;
+
+    case CONFIG_GET_MAC_ADDRESS:
+      if (!itf->mac_str_index)
+      {
+        config_driver_mount_complete(itf, true);
+        return;
+      }
+
+      // bLength, bDescriptorType followed by 12 UTF-16 hex digits
+      ret = tuh_descriptor_get_string(itf->daddr, itf->mac_str_index, NETH_LANGID_EN_US, usbh_get_enum_buf(), 2 + 2*12,
+                                      process_set_config, (uintptr_t) ((get_index(itf) << 8) | state));
+    break;
+
+    default: break;
+  }
+
+  if (!ret) config_driver_mount_complete(itf, false);
+}
+
+static uint8_t hex_digit(uint8_t c)
+{
+  if (c >= '0' && c <= '9') return (uint8_t) (c - '0');
+  if (c >= 'a' && c <= 'f') return (uint8_t) (c - 'a' + 10);
+  if (c >= 'A' && c <= 'F') return (uint8_t) (c - 'A' + 10);
+  return 0;
+}
+
+static void process_set_config(tuh_xfer_t* xfer)
+{
+  uint8_t const state = (uint8_t) (xfer->user_data & 0xffu);
+  neth_interface_t* itf = &_neth_itf[xfer->user_data >> 8];
+  uint8_t const* buf = usbh_get_enum_buf();
+  bool const success = (xfer->result == XFER_RESULT_SUCCESS);
+
+  switch (state)
+  {
+    case CONFIG_GET_NTB_PARAMETERS:
+    {
+      ntb_parameters_t const* param = (ntb_parameters_t const*) buf;
+
+      if (!success || xfer->actual_len < sizeof(ntb_parameters_t) || !(param->bmNtbFormatsSupported & 0x01))
+      {
+        TU_LOG2("  NET: NTB16 is not supported\r\n");
+        config_driver_mount_complete(itf, false);
+        return;
+      }
+
+      itf->ntb_out_max       = (uint16_t) tu_min32(param->dwNtbOutMaxSize, NETH_BUF_SIZE);
+      itf->ndb_out_divisor   = param->wNdbOutDivisor ? param->wNdbOutDivisor : 1;
+      itf->ndb_out_remainder = (uint16_t) (param->wNdbOutPayloadRemainder % itf->ndb_out_divisor);
+
+      // wNdpOutAlignment is a power of 2 not smaller than 4
+      uint16_t const ndp_align = tu_max16(param->wNdbOutAlignment, 4);
+      itf->ndp_out_offset = (uint16_t) ((sizeof(nth16_t) + ndp_align - 1u) & ~(ndp_align - 1u));
+
+      itf->ntb_out_max_datagrams = CFG_TUH_NET_MAX_DATAGRAMS_PER_NTB;
+      if (param->wNtbOutMaxDatagrams && param->wNtbOutMaxDatagrams < itf->ntb_out_max_datagrams)
+      {
+        itf->ntb_out_max_datagrams = (uint8_t) param->wNtbOutMaxDatagrams;
+      }
+
+      config_request(itf, (param->dwNtbInMaxSize > NETH_BUF_SIZE) ? CONFIG_SET_NTB_INPUT_SIZE : CONFIG_SET_PACKET_FILTER);
+    }
+    break;
+
+    case CONFIG_SET_NTB_INPUT_SIZE:
+      if (!success)
+      {
+        TU_LOG2("  NET: SET_NTB_INPUT_SIZE failed, NTBs may be truncated\r\n");
+      }
+      config_request(itf, CONFIG_SET_PACKET_FILTER);
+    break;
+
+    case CONFIG_SET_PACKET_FILTER:
+      // packet filter is optional, stall is a valid response
+      config_request(itf, CONFIG_SET_INTERFACE);
+    break;
+
+    case CONFIG_SET_INTERFACE:
+      if (!success)
+      {
+        config_driver_mount_complete(itf, false);
+        return;
+      }
+      config_request(itf, CONFIG_GET_MAC_ADDRESS);
+    break;
+
+    case CONFIG_GET_MAC_ADDRESS:
+      if (success && xfer->actual_len >= 2 + 2*12)
+      {
+        for (uint8_t i = 0; i < 6; i++)
+        {
+          itf->mac[i] = (uint8_t) ((hex_digit(buf[2 + 4*i]) << 4) | hex_digit(buf[2 + 4*i + 2]));
+        }
+      }
+      config_driver_mount_complete(itf, true);
+    break;
+
+    default: break;
+  }
+}
+
+bool neth_set_config(uint8_t dev_addr, uint8_t itf_num)
+{
+  neth_interface_t* itf = get_itf_by_itfnum(dev_addr, itf_num);
+  TU_ASSERT(itf);
+
+  // Data Interface is configured together with its Communication Interface
+  if (itf_num != itf->itf_num || !itf->ep_in)
+  {
+    usbh_driver_set_config_complete(dev_addr, itf_num);
+    return true;
+  }
+
+  config_request(itf, is_ncm(itf) ? CONFIG_GET_NTB_PARAMETERS : CONFIG_SET_PACKET_FILTER);
+  return true;
+}
+
+bool neth_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+  neth_interface_t* itf = get_itf_by_epaddr(dev_addr, ep_addr);
+  TU_VERIFY(itf && itf->mounted);
+
+  if (ep_addr == itf->ep_in)
+  {
+    neth_rx_complete(itf, result, xferred_bytes);
+  }
+  else if (ep_addr == itf->ep_out)
+  {
+    neth_tx_complete(itf);
+  }
+  else
+  {
+    neth_notif_complete(itf, result, xferred_bytes);
+  }
+
+  return true;
+}
+
+void neth_close(uint8_t dev_addr)
+{
+  for (uint8_t i = 0; i < CFG_TUH_NET; i++)
+  {
+    neth_interface_t* itf = &_neth_itf[i];
+    if (itf->daddr != dev_addr) continue;
+
+    if (itf->mounted && tuh_network_umount_cb) tuh_network_umount_cb(dev_addr);
+
+    tu_memclr(itf, sizeof(neth_interface_t));
+  }
+}
+
+#endif
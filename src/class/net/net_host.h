@@ -0,0 +1,119 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Ha Thach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#ifndef _TUSB_NET_HOST_H_
+#define _TUSB_NET_HOST_H_
+
+#include "class/cdc/cdc.h"
+#include "ncm.h"
+
+//--------------------------------------------------------------------+
+// Class Driver Configuration
+//--------------------------------------------------------------------+
+
+// Maximum Transmission Unit (in bytes) of the network, including Ethernet header
+#ifndef CFG_TUH_NET_MTU
+#define CFG_TUH_NET_MTU                   1514
+#endif
+
+// NCM: size of each receive and transmit buffer i.e maximum NTB size in both directions. Device is asked
+// with SET_NTB_INPUT_SIZE to not send larger NTBs. ECM buffers are at least CFG_TUH_NET_MTU.
+#ifndef CFG_TUH_NET_NTB_MAX_SIZE
+#define CFG_TUH_NET_NTB_MAX_SIZE          3200
+#endif
+
+// Number of receive buffers per interface, the next bulk IN transfer is queued as soon as one is
+// received so that device can keep sending while application is still processing earlier datagrams
+#ifndef CFG_TUH_NET_RX_BUF_N
+#define CFG_TUH_NET_RX_BUF_N              2
+#endif
+
+// NCM: maximum number of datagrams aggregated in one transmitted NTB
+#ifndef CFG_TUH_NET_MAX_DATAGRAMS_PER_NTB
+#define CFG_TUH_NET_MAX_DATAGRAMS_PER_NTB 8
+#endif
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Application API
+//--------------------------------------------------------------------+
+
+// Check if device has a mounted CDC-ECM or CDC-NCM interface
+bool tuh_network_mounted(uint8_t daddr);
+
+// Check if interface uses NCM (datagrams are aggregated in NTBs) rather than ECM
+bool tuh_network_is_ncm(uint8_t daddr);
+
+// Last link state reported by device with NETWORK_CONNECTION notification
+bool tuh_network_link_up(uint8_t daddr);
+
+// indicate to network driver that client has finished with the datagram provided to tuh_network_recv_cb(),
+// next received datagram (if any) is provided before returning
+void tuh_network_recv_renew(uint8_t daddr);
+
+// poll network driver for its ability to accept another datagram to transmit
+bool tuh_network_can_xmit(uint8_t daddr, uint16_t size);
+
+// Transmit a datagram copied with tuh_network_xmit_cb(). NCM aggregates datagrams queued while
+// the previous NTB is being sent. Return false if driver cannot accept a datagram now.
+bool tuh_network_xmit(uint8_t daddr, void *ref, uint16_t arg);
+
+//--------------------------------------------------------------------+
+// Application Callbacks (WEAK is optional)
+//--------------------------------------------------------------------+
+
+// Invoked when a network interface is mounted, mac is all zeros if device does not report it
+TU_ATTR_WEAK void tuh_network_mount_cb(uint8_t daddr, uint8_t const mac[6]);
+
+// Invoked when a network interface is unmounted
+TU_ATTR_WEAK void tuh_network_umount_cb(uint8_t daddr);
+
+// Invoked when device reports a change of its network connection
+TU_ATTR_WEAK void tuh_network_link_state_cb(uint8_t daddr, bool state);
+
+// client must provide this: datagram stays valid until tuh_network_recv_renew() is called
+bool tuh_network_recv_cb(uint8_t daddr, uint8_t const* src, uint16_t size);
+
+// client must provide this: copy from network stack packet pointer to dst, at most CFG_TUH_NET_MTU bytes
+uint16_t tuh_network_xmit_cb(uint8_t daddr, uint8_t *dst, void *ref, uint16_t arg);
+
+//--------------------------------------------------------------------+
+// Internal Class Driver API
+//--------------------------------------------------------------------+
+void neth_init       (void);
+bool neth_open       (uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *itf_desc, uint16_t max_len);
+bool neth_set_config (uint8_t dev_addr, uint8_t itf_num);
+bool neth_xfer_cb    (uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+void neth_close      (uint8_t dev_addr);
+
+#ifdef __cplusplus
+ }
+#endif
+
+#endif /* _TUSB_NET_HOST_H_ */
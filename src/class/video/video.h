@@ -231,6 +231,16 @@ typedef struct TU_ATTR_PACKED {
   };
 } tusb_video_payload_header_t;
 
+/* 2.4.3.3 with PTS and SCR fields */
+typedef struct TU_ATTR_PACKED {
+  tusb_video_payload_header_t hdr;
+  uint32_t dwPresentationTime;
+  uint32_t dwSourceClockTime;  /* SCR: source time clock */
+  uint16_t wSOFCounter;        /* SCR: bit 10..0 1KHz SOF token counter */
+} tusb_video_payload_header_pts_scr_t;
+
+TU_VERIFY_STATIC( sizeof(tusb_video_payload_header_pts_scr_t) == 12, "size is not correct");
+
 /* 3.9.2.1 */
 typedef struct TU_ATTR_PACKED {
   uint8_t  bLength;
@@ -47,6 +47,12 @@ typedef struct {
   tusb_desc_cs_video_stm_itf_hdr_t stm;
 } tusb_desc_vs_itf_t;
 
+#if CFG_TUD_VIDEO_STREAMING_TIMESTAMP
+#define PAYLOAD_HEADER_SIZE  sizeof(tusb_video_payload_header_pts_scr_t)
+#else
+#define PAYLOAD_HEADER_SIZE  sizeof(tusb_video_payload_header_t)
+#endif
+
 typedef union {
   tusb_desc_cs_video_ctl_itf_hdr_t ctl;
   tusb_desc_cs_video_stm_itf_hdr_t stm;
@@ -101,6 +107,14 @@ typedef struct TU_ATTR_PACKED {
   uint32_t bufsize;  /* frame buffer size */
   uint32_t offset;   /* offset for the next payload transfer */
   uint32_t max_payload_transfer_size;
+  bool     inplace;  /* frame buffer has a header slot at the beginning of each payload, no copy into ep_buf */
+  bool     multi_payload; /* bulk: payloads are multiple of packet size, one transfer carries several payloads */
+  uint16_t bulk_packet_size; /* bulk: packet size of the endpoint, 0 for isochronous */
+  bool     zlp;      /* bulk: the last payload sent ends on a packet boundary, a zero length packet terminates it */
+  bool     chunked;  /* frame is given by chunks with tud_video_n_frame_append(). offset is used for the head chunk */
+  volatile bool frame_end; /* no more chunks are appended to the current frame */
+  bool     pts_set;  /* pts is given by application for the next frame */
+  uint32_t pts;      /* presentation time stamp of the next frame */
   uint8_t  error_code;/* error code */
   /*------------- From this point, data is not cleared by bus reset -------------*/
   CFG_TUSB_MEM_ALIGN uint8_t ep_buf[CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE]; /* EP transfer buffer for streaming */
@@ -122,11 +136,50 @@ typedef struct TU_ATTR_PACKED {
 
 #define ITF_STM_MEM_RESET_SIZE   offsetof(videod_streaming_interface_t, ep_buf)
 
+/* frame chunk appended by tud_video_n_frame_append() */
+typedef struct {
+  void const *buf;
+  uint32_t    len;
+} videod_chunk_t;
+
+/* queue of frame chunks of a streaming interface, written by application (possibly in ISR) and read in usbd task */
+typedef struct {
+  tu_fifo_t      ff;
+  videod_chunk_t items[CFG_TUD_VIDEO_STREAMING_CHUNK_N];
+} videod_chunk_queue_t;
+
+#if CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE
+/* frame waiting for the current one to complete */
+typedef struct {
+  void    *buf;
+  uint32_t len;
+  uint32_t pts;
+  bool     inplace;
+} videod_frame_t;
+
+typedef struct {
+  tu_fifo_t      ff;
+  videod_frame_t items[CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE];
+} videod_frame_queue_t;
+#endif
+
 //--------------------------------------------------------------------+
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
 CFG_TUSB_MEM_SECTION static videod_interface_t _videod_itf[CFG_TUD_VIDEO];
 CFG_TUSB_MEM_SECTION static videod_streaming_interface_t _videod_streaming_itf[CFG_TUD_VIDEO_STREAMING];
+static videod_chunk_queue_t _videod_chunk_q[CFG_TUD_VIDEO_STREAMING];
+#if CFG_TUD_VIDEO_STREAMING_TIMESTAMP
+/* source clock sampled at the start of the latest (1ms) frame, seq is odd while the ISR is writing */
+static struct {
+  volatile uint32_t stc;
+  volatile uint16_t sof;
+  volatile uint8_t  seq;
+} _videod_scr;
+#endif
+#if CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE
+static videod_frame_queue_t _videod_frame_q[CFG_TUD_VIDEO_STREAMING];
+#endif
 
 static uint8_t const _cap_get     = 0x1u; /* support for GET */
 static uint8_t const _cap_get_set = 0x3u; /* support for GET and SET */
@@ -308,6 +361,87 @@ static inline void const* _end_of_streaming_descriptor(void const *desc)
   return desc + vs->std.bLength + vs->stm.wTotalLength;
 }
 
+/** Return the number of bytes an isochronous endpoint can carry in one service interval.
+ *
+ * High-bandwidth endpoints carry up to 3 transactions per microframe at high speed. */
+static uint_fast32_t _desc_ep_iso_bandwidth(tusb_desc_endpoint_t const *ep)
+{
+  uint_fast32_t size = tu_edpt_packet_size(ep);
+  if (TUSB_SPEED_HIGH == tud_speed_get()) {
+    size *= 1u + ((tu_le16toh(ep->wMaxPacketSize) >> 11) & 0x3u);
+  }
+  return size;
+}
+
+/** Find the isochronous endpoint with the largest bandwidth among all alternate settings of the streaming interface.
+ *
+ * @return The pointer for endpoint descriptor.
+ * @retval NULL  the streaming interface has no isochronous endpoint */
+static tusb_desc_endpoint_t const* _find_desc_ep_iso_max(videod_streaming_interface_t const *stm)
+{
+  void const *desc = _videod_itf[stm->index_vc].beg;
+  void const *end  = desc + stm->desc.end;
+  tusb_desc_endpoint_t const *found = NULL;
+  for (void const *cur = _find_desc(desc + stm->desc.beg, end, TUSB_DESC_ENDPOINT); cur < end;
+       cur = _find_desc(tu_desc_next(cur), end, TUSB_DESC_ENDPOINT)) {
+    tusb_desc_endpoint_t const *ep = (tusb_desc_endpoint_t const *)cur;
+    if (TUSB_XFER_ISOCHRONOUS != ep->bmAttributes.xfer) continue;
+    if (!found || _desc_ep_iso_bandwidth(found) < _desc_ep_iso_bandwidth(ep)) found = ep;
+  }
+  return found;
+}
+
+/** Find the bulk endpoint of a streaming interface, NULL if it streams isochronously. */
+static tusb_desc_endpoint_t const* _find_desc_ep_bulk(videod_streaming_interface_t const *stm)
+{
+  void const *desc = _videod_itf[stm->index_vc].beg;
+  void const *end  = desc + stm->desc.end;
+  for (void const *cur = _find_desc(desc + stm->desc.beg, end, TUSB_DESC_ENDPOINT); cur < end;
+       cur = _find_desc(tu_desc_next(cur), end, TUSB_DESC_ENDPOINT)) {
+    tusb_desc_endpoint_t const *ep = (tusb_desc_endpoint_t const *)cur;
+    if (TUSB_XFER_BULK == ep->bmAttributes.xfer) return ep;
+  }
+  return NULL;
+}
+
+/** Calculate the payload size needed to send a frame within the frame interval.
+ *
+ * One payload is sent per service interval of the streaming endpoint, i.e. per (micro)frame
+ * for isochronous endpoints with bInterval 1. Bulk endpoints are assumed to get one payload per frame.
+ * Bulk payloads are rounded to full packets so that several of them can be sent in one transfer.
+ *
+ * @param[in] frame_size  Maximum video frame size
+ * @param[in] interval    Frame interval in 100ns units
+ *
+ * @return Payload size including the header, limited by the EP buffer and the bandwidth of the largest alternate setting */
+static uint_fast32_t _calc_payload_size(videod_streaming_interface_t const *stm, uint_fast32_t frame_size, uint_fast32_t interval)
+{
+  uint_fast32_t max_size     = CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE;
+  uint_fast32_t service_intv = 10000; /* 1ms in 100ns units */
+
+  tusb_desc_endpoint_t const *ep = _find_desc_ep_iso_max(stm);
+  if (ep) {
+    uint_fast8_t const exp = ep->bInterval ? (uint_fast8_t) (tu_min8(ep->bInterval, 16) - 1) : 0;
+    service_intv = (TUSB_SPEED_HIGH == tud_speed_get() ? 1250u : 10000u) << exp;
+    uint_fast32_t const bandwidth = _desc_ep_iso_bandwidth(ep);
+    if (bandwidth < max_size) max_size = bandwidth;
+  }
+
+  uint_fast32_t const num_payloads = interval / service_intv;
+  uint_fast32_t payload_size = PAYLOAD_HEADER_SIZE;
+  payload_size += num_payloads ? (frame_size + num_payloads - 1) / num_payloads : frame_size;
+  if (max_size < payload_size) payload_size = max_size;
+
+  ep = _find_desc_ep_bulk(stm);
+  if (ep) {
+    uint_fast16_t const mps = tu_edpt_packet_size(ep);
+    if (mps < payload_size) {
+      payload_size = tu_min32(tu_div_ceil(payload_size, mps), max_size / mps) * mps;
+    }
+  }
+  return payload_size;
+}
+
 /** Find the first format descriptor with the specified format number. */
 static inline void const *_find_desc_format(void const *beg, void const *end, uint_fast8_t fmtnum)
 {
@@ -419,12 +553,8 @@ static bool _update_streaming_parameters(videod_streaming_interface_t const *stm
     interval = frm->uncompressed.dwFrameInterval[0];
     param->dwFrameInterval = interval;
   }
-  uint_fast32_t interval_ms = interval / 10000;
-  TU_ASSERT(interval_ms);
-  uint_fast32_t payload_size = (frame_size + interval_ms - 1) / interval_ms + 2;
-  if (CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE < payload_size)
-    payload_size = CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE;
-  param->dwMaxPayloadTransferSize = payload_size;
+  TU_ASSERT(interval);
+  param->dwMaxPayloadTransferSize = _calc_payload_size(stm, frame_size, interval);
   return true;
 }
 
@@ -515,7 +645,7 @@ static bool _negotiate_streaming_parameters(videod_streaming_interface_t const *
     tusb_desc_cs_video_fmt_t const *fmt = _find_desc_format(tu_desc_next(vs), end, fmtnum);
     tusb_desc_cs_video_frm_t const *frm = _find_desc_frame(tu_desc_next(fmt), end, frmnum);
 
-    uint_fast32_t interval, interval_ms;
+    uint_fast32_t interval, payload_interval = 0; /* interval used for the payload size */
     switch (request) {
       case VIDEO_REQUEST_GET_MAX:
         {
@@ -524,7 +654,7 @@ static bool _negotiate_streaming_parameters(videod_streaming_interface_t const *
           max_interval = num_intervals ? frm->uncompressed.dwFrameInterval[num_intervals - 1]: frm->uncompressed.dwFrameInterval[1];
           min_interval = frm->uncompressed.dwFrameInterval[0];
           interval = max_interval;
-          interval_ms = min_interval / 10000;
+          payload_interval = min_interval;
         }
         break;
       case VIDEO_REQUEST_GET_MIN:
@@ -534,12 +664,12 @@ static bool _negotiate_streaming_parameters(videod_streaming_interface_t const *
           max_interval = num_intervals ? frm->uncompressed.dwFrameInterval[num_intervals - 1]: frm->uncompressed.dwFrameInterval[1];
           min_interval = frm->uncompressed.dwFrameInterval[0];
           interval = min_interval;
-          interval_ms = max_interval / 10000;
+          payload_interval = max_interval;
         }
         break;
       case VIDEO_REQUEST_GET_DEF:
         interval = frm->uncompressed.dwDefaultFrameInterval;
-        interval_ms = interval / 10000;
+        payload_interval = interval;
         break;
       case VIDEO_REQUEST_GET_RES:
         {
@@ -548,7 +678,7 @@ static bool _negotiate_streaming_parameters(videod_streaming_interface_t const *
             interval = 0;
           } else {
             interval = frm->uncompressed.dwFrameInterval[2];
-            interval_ms = interval / 10000;
+            payload_interval = interval;
           }
         }
         break;
@@ -558,16 +688,7 @@ static bool _negotiate_streaming_parameters(videod_streaming_interface_t const *
     if (!interval) {
       param->dwMaxPayloadTransferSize = 0;
     } else {
-      uint_fast32_t frame_size = param->dwMaxVideoFrameSize;
-      uint_fast32_t payload_size;
-      if (!interval_ms) {
-        payload_size = frame_size + 2;
-      } else {
-        payload_size = (frame_size + interval_ms - 1) / interval_ms + 2;
-      }
-      if (CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE < payload_size)
-        payload_size = CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE;
-      param->dwMaxPayloadTransferSize = payload_size;
+      param->dwMaxPayloadTransferSize = _calc_payload_size(stm, param->dwMaxVideoFrameSize, payload_interval);
     }
     return true;
   }
@@ -635,6 +756,121 @@ static bool _open_vc_itf(uint8_t rhport, videod_interface_t *self, uint_fast8_t
   return true;
 }
 
+/** Set the payload size of the streaming endpoint from the negotiated value. */
+static bool _set_max_payload_size(videod_streaming_interface_t *stm, tusb_desc_endpoint_t const *ep, uint32_t max_size)
+{
+  if (TUSB_XFER_ISOCHRONOUS == ep->bmAttributes.xfer) {
+    /* The host selects the alternate setting by the committed payload size. If it chose one with
+     * less bandwidth, a payload must still fit into one service interval of the endpoint. */
+    uint32_t const bandwidth = (uint32_t) _desc_ep_iso_bandwidth(ep);
+    if (bandwidth < max_size) max_size = bandwidth;
+  }
+  TU_VERIFY(PAYLOAD_HEADER_SIZE < max_size);
+  /* Set the negotiated value */
+  stm->max_payload_transfer_size = max_size;
+  /* Host splits a bulk transfer into payloads at dwMaxPayloadTransferSize boundaries unless a short packet ends it */
+  stm->bulk_packet_size = (TUSB_XFER_BULK == ep->bmAttributes.xfer) ? tu_edpt_packet_size(ep) : 0;
+  stm->multi_payload = stm->bulk_packet_size && !(max_size % stm->bulk_packet_size);
+  return true;
+}
+
+/** Mark whether a zero length packet has to follow the bulk transfer ending with a payload of len bytes.
+ *
+ * The host reads a payload of up to dwMaxPayloadTransferSize bytes, a shorter one ends only with a short packet. */
+static void _set_zlp(videod_streaming_interface_t *stm, uint32_t len)
+{
+  uint_fast16_t const mps = stm->bulk_packet_size;
+  stm->zlp = mps && (len < stm->max_payload_transfer_size) && !(len % mps);
+}
+
+/** Drop the frame being sent and all queued frames and chunks. */
+static void _clear_xfer(videod_streaming_interface_t *stm)
+{
+  stm->buffer  = NULL;
+  stm->bufsize = 0;
+  stm->offset  = 0;
+  stm->inplace = false;
+  stm->chunked = false;
+  stm->zlp     = false;
+  tu_fifo_clear(&_videod_chunk_q[stm - _videod_streaming_itf].ff);
+#if CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE
+  tu_fifo_clear(&_videod_frame_q[stm - _videod_streaming_itf].ff);
+#endif
+}
+
+static void _init_payload_header(videod_streaming_interface_t *stm)
+{
+  tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
+  hdr->bHeaderLength = PAYLOAD_HEADER_SIZE;
+  hdr->bmHeaderInfo  = 0;
+#if CFG_TUD_VIDEO_STREAMING_TIMESTAMP
+  hdr->PresentationTime     = 1;
+  hdr->SourceClockReference = 1;
+#endif
+}
+
+/** Return the presentation time stamp of a frame given now. */
+static uint32_t _take_frame_pts(videod_streaming_interface_t *stm)
+{
+#if CFG_TUD_VIDEO_STREAMING_TIMESTAMP
+  if (stm->pts_set) {
+    stm->pts_set = false;
+    return stm->pts;
+  }
+  return tud_video_clock_cb();
+#else
+  (void) stm;
+  return 0;
+#endif
+}
+
+/** Update the header template for the first payload of a frame. */
+static void _begin_payload_header(videod_streaming_interface_t *stm, uint32_t pts)
+{
+  tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
+  hdr->FrameID   ^= 1;
+  hdr->EndOfFrame = 0;
+#if CFG_TUD_VIDEO_STREAMING_TIMESTAMP
+  /* PTS is the same in all payloads of a frame */
+  ((tusb_video_payload_header_pts_scr_t*)stm->ep_buf)->dwPresentationTime = pts;
+#else
+  (void) pts;
+#endif
+}
+
+/** Put the source clock reference of the latest SOF into the header template. */
+static void _stamp_payload_header(videod_streaming_interface_t *stm)
+{
+#if CFG_TUD_VIDEO_STREAMING_TIMESTAMP
+  tusb_video_payload_header_pts_scr_t *hdr = (tusb_video_payload_header_pts_scr_t*)stm->ep_buf;
+  uint8_t seq;
+  do {
+    seq = _videod_scr.seq;
+    hdr->dwSourceClockTime = _videod_scr.stc;
+    hdr->wSOFCounter       = _videod_scr.sof;
+  } while ((seq & 1) || seq != _videod_scr.seq);
+#else
+  (void) stm;
+#endif
+}
+
+/** Keep SOF interrupt enabled while any interface is streaming with timestamps. */
+static void _update_sof(uint8_t rhport)
+{
+#if CFG_TUD_VIDEO_STREAMING_TIMESTAMP
+  bool streaming = false;
+  for (uint_fast8_t i = 0; i < CFG_TUD_VIDEO_STREAMING; ++i) {
+    if (_videod_streaming_itf[i].max_payload_transfer_size) {
+      streaming = true;
+      break;
+    }
+  }
+  usbd_sof_enable(rhport, SOF_CONSUMER_VIDEO, streaming);
+#else
+  (void) rhport;
+#endif
+}
+
 /** Set the alternate setting to own video streaming interface.
  *
  * @param[in,out] stm      Streaming interface context.
@@ -654,10 +890,8 @@ static bool _open_vs_itf(uint8_t rhport, videod_streaming_interface_t *stm, uint
     stm->desc.ep[i] = 0;
     TU_LOG2("    close EP%02x\n", ep_adr);
   }
-  /* clear transfer management information */
-  stm->buffer  = NULL;
-  stm->bufsize = 0;
-  stm->offset  = 0;
+  _clear_xfer(stm);
+  stm->multi_payload = false;
 
   /* Find a alternate interface */
   void const *beg = desc + stm->desc.beg;
@@ -673,59 +907,187 @@ static bool _open_vs_itf(uint8_t rhport, videod_streaming_interface_t *stm, uint
     video_probe_and_commit_control_t *param =
       (video_probe_and_commit_control_t *)&stm->ep_buf;
     tu_memclr(param, sizeof(*param));
-    TU_LOG2("    done 0\n");
-    return _update_streaming_parameters(stm, param);
+    TU_VERIFY(_update_streaming_parameters(stm, param));
   }
-  /* Open endpoints of the new settings. */
+  /* Open endpoints of the new settings. A bulk endpoint in alternate setting 0 starts streaming on commit. */
   for (i = 0, cur = tu_desc_next(cur); i < numeps; ++i, cur = tu_desc_next(cur)) {
     cur = _find_desc_ep(cur, end);
     TU_ASSERT(cur < end);
     tusb_desc_endpoint_t const *ep = (tusb_desc_endpoint_t const*)cur;
-    if (!stm->max_payload_transfer_size) {
+    if (altnum && !stm->max_payload_transfer_size) {
       video_probe_and_commit_control_t const *param = (video_probe_and_commit_control_t const*)&stm->ep_buf;
-      uint_fast32_t max_size = param->dwMaxPayloadTransferSize;
-      if ((TUSB_XFER_ISOCHRONOUS == ep->bmAttributes.xfer) &&
-          (tu_edpt_packet_size(ep) < max_size))
-      {
-        /* FS must be less than or equal to max packet size */
-        return false;
-      }
-      /* Set the negotiated value */
-      stm->max_payload_transfer_size = max_size;
+      TU_VERIFY(_set_max_payload_size(stm, ep, param->dwMaxPayloadTransferSize));
     }
     TU_ASSERT(usbd_edpt_open(rhport, ep));
     stm->desc.ep[i] = (uint16_t) (cur - desc);
     TU_LOG2("    open EP%02x\n", _desc_ep_addr(cur));
   }
   /* initialize payload header */
-  tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
-  hdr->bHeaderLength = sizeof(*hdr);
-  hdr->bmHeaderInfo  = 0;
+  if (altnum) _init_payload_header(stm);
+  _update_sof(rhport);
 
   TU_LOG2("    done\n");
   return true;
 }
 
-/** Prepare the next packet payload. */
-static uint_fast16_t _prepare_in_payload(videod_streaming_interface_t *stm)
+/** Start streaming on the bulk endpoint of alternate setting 0 with the committed parameters. */
+static bool _commit_bulk(uint8_t rhport, videod_streaming_interface_t *stm, video_probe_and_commit_control_t const *param)
 {
-  uint_fast16_t remaining = stm->bufsize - stm->offset;
-  uint_fast16_t hdr_len   = stm->ep_buf[0];
-  uint_fast16_t pkt_len   = stm->max_payload_transfer_size;
-  if (hdr_len + remaining < pkt_len) {
-    pkt_len = hdr_len + remaining;
+  tusb_desc_vs_itf_t const *vs = _get_desc_vs(stm);
+  if (!vs || vs->std.bAlternateSetting || !stm->desc.ep[0]) return true;
+
+  void const *desc = _videod_itf[stm->index_vc].beg;
+  tusb_desc_endpoint_t const *ep = (tusb_desc_endpoint_t const*)(desc + stm->desc.ep[0]);
+  /* Re-commit restarts the stream */
+  _clear_xfer(stm);
+  TU_VERIFY(_set_max_payload_size(stm, ep, param->dwMaxPayloadTransferSize));
+  _init_payload_header(stm);
+  _update_sof(rhport);
+  return true;
+}
+
+/** Prepare the next packet payload.
+ *
+ * @param[out] pkt_len    Byte length of the payload including the header
+ *
+ * @return Pointer of the payload to be transferred */
+static uint8_t* _prepare_in_payload(videod_streaming_interface_t *stm, uint16_t *pkt_len)
+{
+  uint32_t const hdr_len  = stm->ep_buf[0];
+  uint32_t const max_size = stm->max_payload_transfer_size;
+  tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
+  /* The header slot is part of the frame buffer for in-place frames, otherwise payloads are built in ep_buf */
+  uint8_t *xfer_buf = stm->inplace ? stm->buffer + stm->offset : stm->ep_buf;
+  uint32_t const xfer_max = stm->inplace ? UINT16_MAX : CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE;
+  uint32_t xfer_len = 0;
+  uint32_t len;
+
+  _stamp_payload_header(stm);
+  /* Bulk transfers carry as many full payloads as fit, others one payload */
+  do {
+    uint8_t *payload = xfer_buf + xfer_len;
+    uint32_t const remaining = stm->bufsize - stm->offset;
+    if (stm->inplace) {
+      len = tu_min32(remaining, max_size);
+      stm->offset += len;
+    } else {
+      uint32_t const data_len = tu_min32(remaining, max_size - hdr_len);
+      memcpy(payload + hdr_len, stm->buffer + stm->offset, data_len);
+      stm->offset += data_len;
+      len = hdr_len + data_len;
+    }
+    if (stm->offset == stm->bufsize) hdr->EndOfFrame = 1;
+    if (payload != stm->ep_buf) memcpy(payload, hdr, hdr_len);
+    xfer_len += len;
+  } while (stm->multi_payload && (len == max_size) && (stm->offset < stm->bufsize) &&
+           (xfer_len + max_size <= xfer_max));
+  _set_zlp(stm, len);
+
+  *pkt_len = (uint16_t) xfer_len;
+  return xfer_buf;
+}
+
+/** Prepare the next packet payload from the queued frame chunks.
+ *
+ * Data of consecutive chunks is gathered into ep_buf, a chunk is released as soon as it is copied.
+ *
+ * @return Byte length of the payload including the header, 0 if there is nothing to send yet */
+static uint16_t _prepare_in_payload_chunks(videod_streaming_interface_t *stm)
+{
+  videod_chunk_queue_t *q = &_videod_chunk_q[stm - _videod_streaming_itf];
+  /* read before the queue, chunks are always appended before the frame is ended */
+  bool const end = stm->frame_end;
+  uint_fast16_t hdr_len  = stm->ep_buf[0];
+  uint_fast16_t data_len = 0;
+  uint_fast16_t capacity = stm->max_payload_transfer_size - hdr_len;
+  videod_chunk_t chunk;
+
+  while ((data_len < capacity) && tu_fifo_peek(&q->ff, &chunk)) {
+    uint_fast32_t n = chunk.len - stm->offset;
+    if (capacity - data_len < n) n = capacity - data_len;
+    memcpy(&stm->ep_buf[hdr_len + data_len], (uint8_t const*) chunk.buf + stm->offset, n);
+    data_len    += n;
+    stm->offset += n;
+    if (stm->offset == chunk.len) {
+      tu_fifo_read(&q->ff, &chunk);
+      stm->offset = 0;
+      if (tud_video_frame_chunk_done_cb) {
+        tud_video_frame_chunk_done_cb(stm->index_vc, stm->index_vs, chunk.buf);
+      }
+    }
   }
-  uint_fast16_t data_len = pkt_len - hdr_len;
-  memcpy(&stm->ep_buf[hdr_len], stm->buffer + stm->offset, data_len);
-  stm->offset += data_len;
-  remaining -= data_len;
-  if (!remaining) {
-    tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
+
+  tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
+  _stamp_payload_header(stm);
+  if (end && tu_fifo_empty(&q->ff)) {
+    /* a payload of only the header is sent if the last chunk already went out */
     hdr->EndOfFrame = 1;
+  } else if (!data_len) {
+    return 0;
   }
-  return hdr_len + data_len;
+  _set_zlp(stm, hdr_len + data_len);
+  return (uint16_t) (hdr_len + data_len);
+}
+
+/** Return the address of the streaming endpoint, 0 if not opened */
+static uint8_t _get_stm_ep_addr(videod_streaming_interface_t const *stm)
+{
+  uint_fast16_t ofs_ep = stm->desc.ep[0];
+  if (!ofs_ep) return 0;
+  void const *desc = _videod_itf[stm->index_vc].beg;
+  return _desc_ep_addr(desc + ofs_ep);
 }
 
+/** Send the next payload of a chunked frame if the endpoint is idle. Run in usbd task. */
+static void _xfer_chunks(void *param)
+{
+  videod_streaming_interface_t *stm = (videod_streaming_interface_t*) param;
+  if (!stm->chunked) return;
+  uint8_t const ep_addr = _get_stm_ep_addr(stm);
+  if (!ep_addr) return;
+
+  /* Busy endpoint continues in videod_xfer_cb() */
+  TU_VERIFY(usbd_edpt_claim(0, ep_addr), );
+  uint16_t const pkt_len = _prepare_in_payload_chunks(stm);
+  if (!pkt_len) {
+    usbd_edpt_release(0, ep_addr);
+    return;
+  }
+  TU_ASSERT(usbd_edpt_xfer(0, ep_addr, stm->ep_buf, pkt_len), );
+}
+
+/** Start sending a frame on the idle streaming endpoint. */
+static bool _start_frame(videod_streaming_interface_t *stm, void *buffer, size_t bufsize, bool inplace, uint32_t pts)
+{
+  uint8_t ep_addr = _get_stm_ep_addr(stm);
+  if (!ep_addr) return false;
+
+  TU_VERIFY( usbd_edpt_claim(0, ep_addr) );
+  /* update the packet header */
+  _begin_payload_header(stm, pts);
+  /* update the packet data */
+  stm->buffer     = (uint8_t*)buffer;
+  stm->bufsize    = bufsize;
+  stm->offset     = 0;
+  stm->inplace    = inplace;
+  uint16_t pkt_len;
+  uint8_t *payload = _prepare_in_payload(stm, &pkt_len);
+  TU_ASSERT( usbd_edpt_xfer(0, ep_addr, payload, pkt_len), 0);
+  return true;
+}
+
+#if CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE
+/** Start the next queued frame if no frame is in flight. Run in usbd task. */
+static void _xfer_queued_frame(void *param)
+{
+  videod_streaming_interface_t *stm = (videod_streaming_interface_t*) param;
+  if (stm->buffer || !stm->max_payload_transfer_size) return;
+  videod_frame_t item;
+  if (!tu_fifo_read(&_videod_frame_q[stm - _videod_streaming_itf].ff, &item)) return;
+  TU_ASSERT(_start_frame(stm, item.buf, item.len, item.inplace, item.pts), );
+}
+#endif
+
 /** Handle a standard request to the video control interface. */
 static int handle_video_ctl_std_req(uint8_t rhport, uint8_t stage,
                                     tusb_control_request_t const *request,
@@ -976,10 +1338,14 @@ static int handle_video_stm_cs_req(uint8_t rhport, uint8_t stage,
             TU_VERIFY(sizeof(video_probe_and_commit_control_t) == request->wLength, VIDEO_ERROR_UNKNOWN);
             TU_VERIFY(tud_control_xfer(rhport, request, self->ep_buf, sizeof(video_probe_and_commit_control_t)), VIDEO_ERROR_UNKNOWN);
           } else if (stage == CONTROL_STAGE_DATA) {
-            TU_VERIFY(_update_streaming_parameters(self, (video_probe_and_commit_control_t*)self->ep_buf), VIDEO_ERROR_INVALID_VALUE_WITHIN_RANGE);
+            video_probe_and_commit_control_t *param = (video_probe_and_commit_control_t*)self->ep_buf;
+            TU_VERIFY(_update_streaming_parameters(self, param), VIDEO_ERROR_INVALID_VALUE_WITHIN_RANGE);
             if (tud_video_commit_cb) {
-              return tud_video_commit_cb(self->index_vc, self->index_vs, (video_probe_and_commit_control_t*)self->ep_buf);
+              int const err = tud_video_commit_cb(self->index_vc, self->index_vs, param);
+              if (err) return err;
             }
+            /* The header template overwrites the parameters in ep_buf */
+            TU_VERIFY(_commit_bulk(rhport, self, param), VIDEO_ERROR_INVALID_VALUE_WITHIN_RANGE);
           }
           return VIDEO_ERROR_NONE;
 
@@ -1063,39 +1429,117 @@ bool tud_video_n_streaming(uint_fast8_t ctl_idx, uint_fast8_t stm_idx)
   TU_ASSERT(ctl_idx < CFG_TUD_VIDEO);
   TU_ASSERT(stm_idx < CFG_TUD_VIDEO_STREAMING);
   videod_streaming_interface_t *stm = _get_instance_streaming(ctl_idx, stm_idx);
-  if (!stm || !stm->desc.ep[0]) return false;
+  if (!stm || !stm->desc.ep[0] || !stm->max_payload_transfer_size) return false;
   return true;
 }
 
-bool tud_video_n_frame_xfer(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize)
+uint32_t tud_video_n_payload_size(uint_fast8_t ctl_idx, uint_fast8_t stm_idx)
+{
+  TU_ASSERT(ctl_idx < CFG_TUD_VIDEO, 0);
+  TU_ASSERT(stm_idx < CFG_TUD_VIDEO_STREAMING, 0);
+  videod_streaming_interface_t *stm = _get_instance_streaming(ctl_idx, stm_idx);
+  if (!stm || !stm->desc.ep[0]) return 0;
+  return stm->max_payload_transfer_size;
+}
+
+uint_fast8_t tud_video_n_payload_header_size(uint_fast8_t ctl_idx, uint_fast8_t stm_idx)
+{
+  (void) ctl_idx;
+  (void) stm_idx;
+  return PAYLOAD_HEADER_SIZE;
+}
+
+bool tud_video_n_frame_pts(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, uint32_t pts)
+{
+  TU_ASSERT(ctl_idx < CFG_TUD_VIDEO);
+  TU_ASSERT(stm_idx < CFG_TUD_VIDEO_STREAMING);
+  TU_VERIFY(CFG_TUD_VIDEO_STREAMING_TIMESTAMP);
+  videod_streaming_interface_t *stm = _get_instance_streaming(ctl_idx, stm_idx);
+  if (!stm) return false;
+  stm->pts     = pts;
+  stm->pts_set = true;
+  return true;
+}
+
+static bool _frame_xfer(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize, bool inplace)
 {
   TU_ASSERT(ctl_idx < CFG_TUD_VIDEO);
   TU_ASSERT(stm_idx < CFG_TUD_VIDEO_STREAMING);
   if (!buffer || !bufsize) return false;
   videod_streaming_interface_t *stm = _get_instance_streaming(ctl_idx, stm_idx);
-  if (!stm || !stm->desc.ep[0] || stm->buffer) return false;
+  if (!stm || !stm->desc.ep[0] || !stm->max_payload_transfer_size || stm->chunked) return false;
 
-  /* Find EP address */
-  void const *desc = _videod_itf[stm->index_vc].beg;
-  uint8_t ep_addr = 0;
-  for (uint_fast8_t i = 0; i < CFG_TUD_VIDEO_STREAMING; ++i) {
-    uint_fast16_t ofs_ep = stm->desc.ep[i];
-    if (!ofs_ep) continue;
-    ep_addr = _desc_ep_addr(desc + ofs_ep);
-    break;
+  if (inplace) {
+    /* Every payload including the last one needs room for its header */
+    uint_fast32_t const last = bufsize % stm->max_payload_transfer_size;
+    TU_VERIFY(!last || last >= stm->ep_buf[0]);
   }
-  if (!ep_addr) return false;
 
-  TU_VERIFY( usbd_edpt_claim(0, ep_addr) );
+#if CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE
+  tu_fifo_t *ff = &_videod_frame_q[stm - _videod_streaming_itf].ff;
+  if (stm->buffer || !tu_fifo_empty(ff)) {
+    videod_frame_t const item = { .buf = buffer, .len = (uint32_t) bufsize, .pts = _take_frame_pts(stm), .inplace = inplace };
+    TU_VERIFY(tu_fifo_write(ff, &item));
+    /* The frame in flight may have completed meanwhile */
+    if (!stm->buffer) usbd_defer_func(_xfer_queued_frame, stm, false);
+    return true;
+  }
+#else
+  if (stm->buffer) return false;
+#endif
+
+  return _start_frame(stm, buffer, bufsize, inplace, _take_frame_pts(stm));
+}
+
+bool tud_video_n_frame_xfer(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize)
+{
+  return _frame_xfer(ctl_idx, stm_idx, buffer, bufsize, false);
+}
+
+bool tud_video_n_frame_xfer_inplace(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize)
+{
+  return _frame_xfer(ctl_idx, stm_idx, buffer, bufsize, true);
+}
+
+bool tud_video_n_frame_begin(uint_fast8_t ctl_idx, uint_fast8_t stm_idx)
+{
+  TU_ASSERT(ctl_idx < CFG_TUD_VIDEO);
+  TU_ASSERT(stm_idx < CFG_TUD_VIDEO_STREAMING);
+  videod_streaming_interface_t *stm = _get_instance_streaming(ctl_idx, stm_idx);
+  if (!stm || !stm->desc.ep[0] || stm->buffer || stm->chunked) return false;
+
   /* update the packet header */
-  tusb_video_payload_header_t *hdr = (tusb_video_payload_header_t*)stm->ep_buf;
-  hdr->FrameID   ^= 1;
-  hdr->EndOfFrame = 0;
-  /* update the packet data */
-  stm->buffer     = (uint8_t*)buffer;
-  stm->bufsize    = bufsize;
-  uint_fast16_t pkt_len = _prepare_in_payload(stm);
-  TU_ASSERT( usbd_edpt_xfer(0, ep_addr, stm->ep_buf, (uint16_t) pkt_len), 0);
+  _begin_payload_header(stm, _take_frame_pts(stm));
+
+  stm->offset    = 0;
+  stm->frame_end = false;
+  stm->chunked   = true;
+  return true;
+}
+
+bool tud_video_n_frame_append(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void const *chunk, size_t size, bool in_isr)
+{
+  TU_ASSERT(ctl_idx < CFG_TUD_VIDEO);
+  TU_ASSERT(stm_idx < CFG_TUD_VIDEO_STREAMING);
+  if (!chunk || !size) return false;
+  videod_streaming_interface_t *stm = _get_instance_streaming(ctl_idx, stm_idx);
+  if (!stm || !stm->chunked || stm->frame_end) return false;
+
+  videod_chunk_t const item = { .buf = chunk, .len = (uint32_t) size };
+  TU_VERIFY(tu_fifo_write(&_videod_chunk_q[stm - _videod_streaming_itf].ff, &item));
+  usbd_defer_func(_xfer_chunks, stm, in_isr);
+  return true;
+}
+
+bool tud_video_n_frame_end(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, bool in_isr)
+{
+  TU_ASSERT(ctl_idx < CFG_TUD_VIDEO);
+  TU_ASSERT(stm_idx < CFG_TUD_VIDEO_STREAMING);
+  videod_streaming_interface_t *stm = _get_instance_streaming(ctl_idx, stm_idx);
+  if (!stm || !stm->chunked || stm->frame_end) return false;
+
+  stm->frame_end = true;
+  usbd_defer_func(_xfer_chunks, stm, in_isr);
   return true;
 }
 
@@ -1111,6 +1555,12 @@ void videod_init(void)
   for (uint_fast8_t i = 0; i < CFG_TUD_VIDEO_STREAMING; ++i) {
     videod_streaming_interface_t *stm = &_videod_streaming_itf[i];
     tu_memclr(stm, ITF_STM_MEM_RESET_SIZE);
+    videod_chunk_queue_t *q = &_videod_chunk_q[i];
+    tu_fifo_config(&q->ff, q->items, CFG_TUD_VIDEO_STREAMING_CHUNK_N, sizeof(videod_chunk_t), false);
+#if CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE
+    videod_frame_queue_t *fq = &_videod_frame_q[i];
+    tu_fifo_config(&fq->ff, fq->items, CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE, sizeof(videod_frame_t), false);
+#endif
   }
 }
 
@@ -1124,6 +1574,7 @@ void videod_reset(uint8_t rhport)
   for (uint_fast8_t i = 0; i < CFG_TUD_VIDEO_STREAMING; ++i) {
     videod_streaming_interface_t *stm = &_videod_streaming_itf[i];
     tu_memclr(stm, ITF_STM_MEM_RESET_SIZE);
+    _clear_xfer(stm);
   }
 }
 
@@ -1167,17 +1618,47 @@ uint16_t videod_open(uint8_t rhport, tusb_desc_interface_t const * itf_desc, uin
     stm->desc.beg = (uint16_t) ((uintptr_t)cur - (uintptr_t)itf_desc);
     cur = _next_desc_itf(cur, end);
     stm->desc.end = (uint16_t) ((uintptr_t)cur - (uintptr_t)itf_desc);
+    /* Alternate setting 0 is active without SET_INTERFACE, it has the endpoint of a bulk stream */
+    TU_VERIFY(_open_vs_itf(rhport, stm, 0), 0);
   }
   self->len = (uint16_t) ((uintptr_t)cur - (uintptr_t)itf_desc);
   return (uint16_t) ((uintptr_t)cur - (uintptr_t)itf_desc);
 }
 
+/** Handle a standard request forwarded from usbd to a streaming endpoint.
+ *
+ * The host stops a bulk stream by CLEAR_FEATURE(ENDPOINT_HALT). Streaming resumes on the next commit. */
+static bool _handle_video_ep_std_req(uint8_t rhport, uint8_t stage, tusb_control_request_t const *request)
+{
+  if (stage != CONTROL_STAGE_SETUP) return true;
+  TU_VERIFY(request->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD &&
+            request->bRequest == TUSB_REQ_CLEAR_FEATURE &&
+            request->wValue == TUSB_REQ_FEATURE_EDPT_HALT);
+  uint_fast8_t const ep_addr = tu_u16_low(request->wIndex);
+  for (uint_fast8_t i = 0; i < CFG_TUD_VIDEO_STREAMING; ++i) {
+    videod_streaming_interface_t *stm = &_videod_streaming_itf[i];
+    if (!stm->desc.beg || ep_addr != _get_stm_ep_addr(stm)) continue;
+    tusb_desc_vs_itf_t const *vs = _get_desc_vs(stm);
+    if (vs && !vs->std.bAlternateSetting) {
+      _clear_xfer(stm);
+      stm->max_payload_transfer_size = 0;
+      stm->multi_payload = false;
+      _update_sof(rhport);
+    }
+    return true;
+  }
+  return false;
+}
+
 // Invoked when a control transfer occurred on an interface of this class
 // Driver response accordingly to the request and the transfer stage (setup/data/ack)
 // return false to stall control endpoint (e.g unsupported request)
 bool videod_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request)
 {
   int err;
+  if (request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_ENDPOINT) {
+    return _handle_video_ep_std_req(rhport, stage, request);
+  }
   TU_VERIFY(request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_INTERFACE);
   uint_fast8_t itfnum = tu_u16_low(request->wIndex);
 
@@ -1231,15 +1712,40 @@ bool videod_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint3
   }
 
   TU_ASSERT(itf < CFG_TUD_VIDEO_STREAMING);
-  if (stm->offset < stm->bufsize) {
+  /* Transfer aborted by stream stop or restart */
+  if (!stm->buffer && !stm->chunked) return true;
+  if (stm->zlp) {
+    /* Terminate the payload before the next one or the end of frame is handled */
+    stm->zlp = false;
+    TU_VERIFY( usbd_edpt_claim(rhport, ep_addr), 0);
+    TU_ASSERT( usbd_edpt_xfer(rhport, ep_addr, NULL, 0), 0);
+    return true;
+  }
+  if (stm->chunked) {
+    tusb_video_payload_header_t const *hdr = (tusb_video_payload_header_t const*)stm->ep_buf;
+    if (!hdr->EndOfFrame) {
+      _xfer_chunks(stm);
+      return true;
+    }
+    stm->chunked = false;
+    if (tud_video_frame_xfer_complete_cb) {
+      tud_video_frame_xfer_complete_cb(stm->index_vc, stm->index_vs);
+    }
+  } else if (stm->offset < stm->bufsize) {
     /* Claim the endpoint */
     TU_VERIFY( usbd_edpt_claim(rhport, ep_addr), 0);
-    uint_fast16_t pkt_len = _prepare_in_payload(stm);
-    TU_ASSERT( usbd_edpt_xfer(rhport, ep_addr, stm->ep_buf, (uint16_t) pkt_len), 0);
+    uint16_t pkt_len;
+    uint8_t *payload = _prepare_in_payload(stm, &pkt_len);
+    TU_ASSERT( usbd_edpt_xfer(rhport, ep_addr, payload, pkt_len), 0);
   } else {
     stm->buffer  = NULL;
     stm->bufsize = 0;
     stm->offset  = 0;
+    stm->inplace = false;
+#if CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE
+    /* Keep the endpoint busy, the completed buffer is released after the next frame started */
+    _xfer_queued_frame(stm);
+#endif
     if (tud_video_frame_xfer_complete_cb) {
       tud_video_frame_xfer_complete_cb(stm->index_vc, stm->index_vs);
     }
@@ -1247,4 +1753,20 @@ bool videod_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint3
   return true;
 }
 
+#if CFG_TUD_VIDEO_STREAMING_TIMESTAMP
+void videod_sof_isr(uint8_t rhport, uint32_t frame_count)
+{
+  (void) rhport;
+
+  // sample at the first SOF of a 1ms frame, SOF can be invoked for each microframe in highspeed
+  uint16_t const frame = (uint16_t) (frame_count & 0x7FFu);
+  if (frame == _videod_scr.sof) return;
+
+  _videod_scr.seq++;
+  _videod_scr.stc = tud_video_clock_cb();
+  _videod_scr.sof = frame;
+  _videod_scr.seq++;
+}
+#endif
+
 #endif
@@ -31,6 +31,28 @@
 #include "common/tusb_common.h"
 #include "video.h"
 
+//--------------------------------------------------------------------+
+// Class Driver Configuration
+//--------------------------------------------------------------------+
+
+// Number of frame chunks which can be queued with tud_video_n_frame_append() per streaming interface
+#ifndef CFG_TUD_VIDEO_STREAMING_CHUNK_N
+#define CFG_TUD_VIDEO_STREAMING_CHUNK_N  4
+#endif
+
+// Number of frames which can be queued with tud_video_n_frame_xfer() behind the frame being sent.
+// The next frame starts from the transfer complete interrupt handling without waiting for the application.
+#ifndef CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE
+#define CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE  0
+#endif
+
+// Send presentation time stamp (PTS) and source clock reference (SCR) in payload headers. The SCR pairs
+// tud_video_clock_cb() sampled at SOF with the SOF counter, so that the host can recover the device clock
+// and relate the capture time of a frame to its own time base.
+#ifndef CFG_TUD_VIDEO_STREAMING_TIMESTAMP
+#define CFG_TUD_VIDEO_STREAMING_TIMESTAMP  0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -47,6 +69,9 @@ extern "C" {
 bool tud_video_n_streaming(uint_fast8_t ctl_idx, uint_fast8_t stm_idx);
 
 /** Transfer a frame
+ *
+ * With CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE the frame is queued if another one is being sent,
+ * tud_video_frame_xfer_complete_cb() is invoked for each frame in order.
  *
  * @param[in] ctl_idx    Destination control interface index
  * @param[in] stm_idx    Destination streaming interface index
@@ -54,6 +79,71 @@ bool tud_video_n_streaming(uint_fast8_t ctl_idx, uint_fast8_t stm_idx);
  * @param[in] bufsize    Byte size of the frame buffer */
 bool tud_video_n_frame_xfer(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize);
 
+/** Transfer a frame which has a slot for the payload header at the beginning of every payload
+ *
+ * The frame is divided into payloads of tud_video_n_payload_size() bytes, the last one may be shorter.
+ * The first tud_video_n_payload_header_size() bytes of each payload are overwritten with the header,
+ * the rest is frame data. Payloads are transferred directly from the buffer without copying, so
+ * the buffer must meet DMA requirements of the DCD (alignment of each payload, memory region).
+ *
+ * @param[in] ctl_idx    Destination control interface index
+ * @param[in] stm_idx    Destination streaming interface index
+ * @param[in] buffer     Frame buffer with header slots. The caller must not use this buffer until the operation is completed.
+ * @param[in] bufsize    Byte size of the frame buffer including header slots */
+bool tud_video_n_frame_xfer_inplace(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *buffer, size_t bufsize);
+
+/** Begin a frame which is transferred chunk by chunk as it is produced
+ *
+ * Payloads are sent as soon as chunks are appended, so the application needs buffers for a few
+ * chunks (e.g. groups of lines or parts of a JPEG stream) instead of a whole frame.
+ *
+ * @param[in] ctl_idx    Destination control interface index
+ * @param[in] stm_idx    Destination streaming interface index */
+bool tud_video_n_frame_begin(uint_fast8_t ctl_idx, uint_fast8_t stm_idx);
+
+/** Append a chunk to the frame started by tud_video_n_frame_begin(), can be called from ISR
+ *
+ * @param[in] ctl_idx    Destination control interface index
+ * @param[in] stm_idx    Destination streaming interface index
+ * @param[in] chunk      Chunk data. The caller must not use this buffer until tud_video_frame_chunk_done_cb() is invoked.
+ * @param[in] size       Byte size of the chunk
+ * @param[in] in_isr     true if called from interrupt context
+ * @return false if CFG_TUD_VIDEO_STREAMING_CHUNK_N chunks are already queued */
+bool tud_video_n_frame_append(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void const *chunk, size_t size, bool in_isr);
+
+/** End the frame, the last payload is sent with EndOfFrame set. Can be called from ISR
+ *
+ * @param[in] ctl_idx    Destination control interface index
+ * @param[in] stm_idx    Destination streaming interface index
+ * @param[in] in_isr     true if called from interrupt context */
+bool tud_video_n_frame_end(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, bool in_isr);
+
+/** Return the negotiated byte size of a payload including its header, 0 if not streaming
+ *
+ * @param[in] ctl_idx    Destination control interface index
+ * @param[in] stm_idx    Destination streaming interface index */
+uint32_t tud_video_n_payload_size(uint_fast8_t ctl_idx, uint_fast8_t stm_idx);
+
+/** Return the byte size of the payload header
+ *
+ * @param[in] ctl_idx    Destination control interface index
+ * @param[in] stm_idx    Destination streaming interface index */
+uint_fast8_t tud_video_n_payload_header_size(uint_fast8_t ctl_idx, uint_fast8_t stm_idx);
+
+/** Set the presentation time stamp of the next frame given to tud_video_n_frame_xfer(),
+ * tud_video_n_frame_xfer_inplace() or tud_video_n_frame_begin(). Requires CFG_TUD_VIDEO_STREAMING_TIMESTAMP.
+ *
+ * Without this, the frame is stamped with tud_video_clock_cb() at the time it is given.
+ *
+ * @param[in] ctl_idx    Destination control interface index
+ * @param[in] stm_idx    Destination streaming interface index
+ * @param[in] pts        Source clock when capture of the frame began */
+bool tud_video_n_frame_pts(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, uint32_t pts);
+
+/** Return the source clock, a counter at dwClockFrequency of the video control interface e.g. a free running timer.
+ * Invoked from SOF interrupt and when a frame is given. Required with CFG_TUD_VIDEO_STREAMING_TIMESTAMP */
+uint32_t tud_video_clock_cb(void);
+
 /*------------- Optional callbacks -------------*/
 /** Invoked when compeletion of a frame transfer
  *
@@ -61,6 +151,13 @@ bool tud_video_n_frame_xfer(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void *bu
  * @param[in] stm_idx    Destination streaming interface index */
 TU_ATTR_WEAK void tud_video_frame_xfer_complete_cb(uint_fast8_t ctl_idx, uint_fast8_t stm_idx);
 
+/** Invoked when a chunk appended with tud_video_n_frame_append() has been consumed and can be reused
+ *
+ * @param[in] ctl_idx    Destination control interface index
+ * @param[in] stm_idx    Destination streaming interface index
+ * @param[in] chunk      The chunk buffer */
+TU_ATTR_WEAK void tud_video_frame_chunk_done_cb(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void const *chunk);
+
 //--------------------------------------------------------------------+
 // Application Callback API (weak is optional)
 //--------------------------------------------------------------------+
@@ -89,6 +186,7 @@ void     videod_reset          (uint8_t rhport);
 uint16_t videod_open           (uint8_t rhport, tusb_desc_interface_t const * itf_desc, uint16_t max_len);
 bool     videod_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request);
 bool     videod_xfer_cb        (uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+void     videod_sof_isr        (uint8_t rhport, uint32_t frame_count);
 
 #ifdef __cplusplus
  }
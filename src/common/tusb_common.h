@@ -114,11 +114,13 @@ TU_ATTR_ALWAYS_INLINE static inline bool     tu_bit_test (uint32_t value, uint8_
 TU_ATTR_ALWAYS_INLINE static inline uint8_t  tu_min8  (uint8_t  x, uint8_t y ) { return (x < y) ? x : y; }
 TU_ATTR_ALWAYS_INLINE static inline uint16_t tu_min16 (uint16_t x, uint16_t y) { return (x < y) ? x : y; }
 TU_ATTR_ALWAYS_INLINE static inline uint32_t tu_min32 (uint32_t x, uint32_t y) { return (x < y) ? x : y; }
+TU_ATTR_ALWAYS_INLINE static inline uint64_t tu_min64 (uint64_t x, uint64_t y) { return (x < y) ? x : y; }
 
 //------------- Max -------------//
 TU_ATTR_ALWAYS_INLINE static inline uint8_t  tu_max8  (uint8_t  x, uint8_t y ) { return (x > y) ? x : y; }
 TU_ATTR_ALWAYS_INLINE static inline uint16_t tu_max16 (uint16_t x, uint16_t y) { return (x > y) ? x : y; }
 TU_ATTR_ALWAYS_INLINE static inline uint32_t tu_max32 (uint32_t x, uint32_t y) { return (x > y) ? x : y; }
+TU_ATTR_ALWAYS_INLINE static inline uint64_t tu_max64 (uint64_t x, uint64_t y) { return (x > y) ? x : y; }
 
 //------------- Align -------------//
 TU_ATTR_ALWAYS_INLINE static inline uint32_t tu_align(uint32_t value, uint32_t alignment)
@@ -69,6 +69,8 @@ typedef struct
   volatile uint8_t cfg_num; // current active configuration (0x00 is not configured)
   uint8_t speed;
 
+  uint8_t sof_consumer; // bitmap of sof_consumer_t requiring SOF interrupt
+
   uint8_t itf2drv[CFG_TUD_INTERFACE_MAX];   // map interface number to driver (0xff is invalid)
   uint8_t ep2drv[CFG_TUD_ENDPPOINT_MAX][2]; // map endpoint to driver ( 0xff is invalid ), can use only 4-bit each
 
@@ -110,7 +112,27 @@ static usbd_class_driver_t const _usbd_driver[] =
     .open             = mscd_open,
     .control_xfer_cb  = mscd_control_xfer_cb,
     .xfer_cb          = mscd_xfer_cb,
+    #if CFG_TUD_MSC_CACHE
+    .sof              = mscd_sof_isr
+    #else
+    .sof              = NULL
+    #endif
+  },
+  #endif
+
+  #if CFG_TUD_UAS
+  {
+    DRIVER_NAME("UAS")
+    .init             = uasd_init,
+    .reset            = uasd_reset,
+    .open             = uasd_open,
+    .control_xfer_cb  = uasd_control_xfer_cb,
+    .xfer_cb          = uasd_xfer_cb,
+    #if CFG_TUD_MSC_CACHE
+    .sof              = uasd_sof_isr
+    #else
     .sof              = NULL
+    #endif
   },
   #endif
 
@@ -146,7 +168,11 @@ static usbd_class_driver_t const _usbd_driver[] =
     .open             = videod_open,
     .control_xfer_cb  = videod_control_xfer_cb,
     .xfer_cb          = videod_xfer_cb,
+    #if CFG_TUD_VIDEO_STREAMING_TIMESTAMP
+    .sof              = videod_sof_isr
+    #else
     .sof              = NULL
+    #endif
   },
   #endif
 
@@ -218,7 +244,11 @@ static usbd_class_driver_t const _usbd_driver[] =
     .open             = netd_open,
     .control_xfer_cb  = netd_control_xfer_cb,
     .xfer_cb          = netd_xfer_cb,
-    .sof                  = NULL,
+    #if CFG_TUD_NCM && CFG_TUD_NCM_TX_AGGREGATE_MS
+    .sof              = netd_sof_isr
+    #else
+    .sof              = NULL
+    #endif
   },
   #endif
 
@@ -1377,13 +1407,25 @@ void usbd_edpt_close(uint8_t rhport, uint8_t ep_addr)
   return;
 }
 
-void usbd_sof_enable(uint8_t rhport, bool en)
+void usbd_sof_enable(uint8_t rhport, sof_consumer_t consumer, bool en)
 {
   rhport = _usbd_rhport;
 
-  // TODO: Check needed if all drivers including the user sof_cb does not need an active SOF ISR any more.
-  // Only if all drivers switched off SOF calls the SOF interrupt may be disabled
-  dcd_sof_enable(rhport, en);
+  uint8_t const consumer_old = _usbd_dev.sof_consumer;
+
+  if ( en )
+  {
+    _usbd_dev.sof_consumer |= (uint8_t) TU_BIT(consumer);
+  }else
+  {
+    _usbd_dev.sof_consumer &= (uint8_t) ~TU_BIT(consumer);
+  }
+
+  // SOF interrupt is only switched when the first consumer enables it or the last one disables it
+  if ( (_usbd_dev.sof_consumer != 0) != (consumer_old != 0) )
+  {
+    dcd_sof_enable(rhport, _usbd_dev.sof_consumer != 0);
+  }
 }
 
 #endif
@@ -246,6 +246,31 @@ TU_ATTR_WEAK bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb
   /* Endpoint In */\
   7, TUSB_DESC_ENDPOINT, _epin, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0
 
+//--------------------------------------------------------------------+
+// UAS Descriptor Templates
+//--------------------------------------------------------------------+
+
+// Length of template descriptor: 53 bytes
+#define TUD_UAS_DESC_LEN    (9 + 4*(7 + 4))
+
+// Interface number, string index, EP Command Out, EP Status In, EP Data In & EP Data Out address, EP size
+// Each endpoint is followed by a Pipe Usage descriptor. Streams (USB 3) are not supported.
+#define TUD_UAS_DESCRIPTOR(_itfnum, _stridx, _ep_cmd, _ep_status, _ep_datain, _ep_dataout, _epsize) \
+  /* Interface */\
+  9, TUSB_DESC_INTERFACE, _itfnum, 0, 4, TUSB_CLASS_MSC, MSC_SUBCLASS_SCSI, MSC_PROTOCOL_UAS, _stridx,\
+  /* Endpoint Command Out */\
+  7, TUSB_DESC_ENDPOINT, _ep_cmd, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,\
+  4, TUSB_DESC_CS_INTERFACE, UAS_PIPE_ID_COMMAND, 0,\
+  /* Endpoint Status In */\
+  7, TUSB_DESC_ENDPOINT, _ep_status, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,\
+  4, TUSB_DESC_CS_INTERFACE, UAS_PIPE_ID_STATUS, 0,\
+  /* Endpoint Data In */\
+  7, TUSB_DESC_ENDPOINT, _ep_datain, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,\
+  4, TUSB_DESC_CS_INTERFACE, UAS_PIPE_ID_DATA_IN, 0,\
+  /* Endpoint Data Out */\
+  7, TUSB_DESC_ENDPOINT, _ep_dataout, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,\
+  4, TUSB_DESC_CS_INTERFACE, UAS_PIPE_ID_DATA_OUT, 0
+
 
 //--------------------------------------------------------------------+
 // HID Descriptor Templates
@@ -103,8 +103,18 @@ bool usbd_edpt_ready(uint8_t rhport, uint8_t ep_addr)
   return !usbd_edpt_busy(rhport, ep_addr) && !usbd_edpt_stalled(rhport, ep_addr);
 }
 
-// Enable SOF interrupt
-void usbd_sof_enable(uint8_t rhport, bool en);
+// Class drivers sharing the SOF interrupt
+typedef enum
+{
+  SOF_CONSUMER_AUDIO = 0,
+  SOF_CONSUMER_VIDEO,
+  SOF_CONSUMER_MSC,
+  SOF_CONSUMER_UAS,
+  SOF_CONSUMER_NET,
+} sof_consumer_t;
+
+// Enable/disable SOF interrupt for a consumer, interrupt is kept enabled as long as any consumer needs it
+void usbd_sof_enable(uint8_t rhport, sof_consumer_t consumer, bool en);
 
 /*------------------------------------------------------------------*/
 /* Helper
@@ -144,6 +144,17 @@ static usbh_class_driver_t const usbh_class_drivers[] =
     },
   #endif
 
+  #if CFG_TUH_NET
+    {
+      DRIVER_NAME("NET")
+      .init       = neth_init,
+      .open       = neth_open,
+      .set_config = neth_set_config,
+      .xfer_cb    = neth_xfer_cb,
+      .close      = neth_close
+    },
+  #endif
+
   #if CFG_TUH_MSC
     {
       DRIVER_NAME("MSC")
@@ -350,7 +350,8 @@ bool dcd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const * p_endpoint_desc)
   p_qhd->max_packet_size         = tu_edpt_packet_size(p_endpoint_desc);
   if (p_endpoint_desc->bmAttributes.xfer == TUSB_XFER_ISOCHRONOUS)
   {
-    p_qhd->iso_mult = 1;
+    // high-bandwidth endpoint: number of transactions per microframe
+    p_qhd->iso_mult = 1 + ((tu_le16toh(p_endpoint_desc->wMaxPacketSize) >> 11) & 0x3u);
   }
 
   p_qhd->qtd_overlay.next        = QTD_NEXT_INVALID;
@@ -56,6 +56,10 @@
     #include "class/cdc/cdc_host.h"
   #endif
 
+  #if CFG_TUH_NET
+    #include "class/net/net_host.h"
+  #endif
+
   #if CFG_TUH_VENDOR
     #include "class/vendor/vendor_host.h"
   #endif
@@ -78,6 +82,10 @@
     #include "class/msc/msc_device.h"
   #endif
 
+  #if CFG_TUD_UAS
+    #include "class/msc/uas_device.h"
+  #endif
+
   #if CFG_TUD_AUDIO
     #include "class/audio/audio_device.h"
   #endif
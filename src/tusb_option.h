@@ -322,6 +322,10 @@ typedef int make_iso_compilers_happy;
   #define CFG_TUD_MSC             0
 #endif
 
+#ifndef CFG_TUD_UAS
+  #define CFG_TUD_UAS             0
+#endif
+
 #ifndef CFG_TUD_HID
   #define CFG_TUD_HID             0
 #endif
@@ -406,6 +410,10 @@ typedef int make_iso_compilers_happy;
 #define CFG_TUH_MSC    0
 #endif
 
+#ifndef CFG_TUH_NET
+#define CFG_TUH_NET    0
+#endif
+
 #ifndef CFG_TUH_VENDOR
 #define CFG_TUH_VENDOR 0
 #endif
@@ -0,0 +1,348 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "unity.h"
+
+// Files to test
+#include "audio_asrc.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  N_IN  = 8192,
+  N_OUT = 9000,
+  DELAY = AUDIOD_ASRC_TAPS/2,   // Output 0 is centered at input frame -DELAY
+};
+
+static int32_t in_s32[N_IN];
+static int32_t out_s32[N_OUT];
+static float   in_f32[N_IN];
+static float   out_f32[N_OUT];
+
+static audiod_asrc_t asrc;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Sine of amplitude 0.5 full scale
+static void make_sine(double freq, double rate)
+{
+  for (int i = 0; i < N_IN; i++)
+  {
+    double const v = 0.5 * sin(2 * M_PI * freq * i / rate);
+    in_f32[i] = (float) v;
+    in_s32[i] = (int32_t) lround(v * 2147483648.0);
+  }
+}
+
+// THD+N in dB: residual after removing a least squares fit of the fundamental, relative to total.
+// Output frame m is at input position m*ratio - DELAY, frames depending on history before input start are skipped.
+static double thd_n(float const* y_f32, int32_t const* y_s32, uint16_t n, double ratio, double freq, double rate)
+{
+  double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0;
+  uint16_t m0 = (uint16_t) ceil(2 * DELAY / ratio);
+
+  for (uint16_t m = m0; m < n; m++)
+  {
+    double const w = 2 * M_PI * freq * (m * ratio - DELAY) / rate;
+    double const y = y_f32 ? y_f32[m] : y_s32[m] / 2147483648.0;
+    double const s = sin(w), c = cos(w);
+    ss += s*s; cc += c*c; sc += s*c; ys += y*s; yc += y*c;
+  }
+
+  double const det = ss*cc - sc*sc;
+  double const a = (ys*cc - yc*sc) / det;
+  double const b = (yc*ss - ys*sc) / det;
+
+  double err = 0, total = 0;
+  for (uint16_t m = m0; m < n; m++)
+  {
+    double const w = 2 * M_PI * freq * (m * ratio - DELAY) / rate;
+    double const y = y_f32 ? y_f32[m] : y_s32[m] / 2147483648.0;
+    double const r = y - a*sin(w) - b*cos(w);
+    err += r*r;
+    total += y*y;
+  }
+
+  return 10 * log10(err / total);
+}
+
+//--------------------------------------------------------------------+
+// Resampler
+//--------------------------------------------------------------------+
+
+void test_asrc_ratio(void)
+{
+  TEST_ASSERT_EQUAL_HEX32(0x40000000, audiod_asrc_ratio(48000, 48000));
+  TEST_ASSERT_EQUAL_HEX32(0x80000000, audiod_asrc_ratio(96000, 48000));
+  TEST_ASSERT_EQUAL_UINT32(986500300, audiod_asrc_ratio(44100, 48000));
+}
+
+void test_asrc_dc_gain(void)
+{
+  for (int i = 0; i < N_IN; i++) in_s32[i] = 0x40000000;
+
+  audiod_asrc_init(&asrc, 1, audiod_asrc_ratio(44100, 48000));
+  uint16_t n_in = 1000;
+  uint16_t const n = audiod_asrc_process_s32(&asrc, out_s32, N_OUT, in_s32, &n_in);
+
+  TEST_ASSERT_EQUAL_UINT16(1000, n_in);
+  TEST_ASSERT_INT32_WITHIN(1 << 16, 0x40000000, out_s32[n - 1]);
+}
+
+void test_asrc_consumes_by_ratio(void)
+{
+  audiod_asrc_init(&asrc, 2, audiod_asrc_ratio(44100, 48000));
+
+  // Output is limited by input
+  uint16_t n_in = 441 * 2;
+  uint16_t n = audiod_asrc_process_s32(&asrc, out_s32, N_OUT / 2, in_s32, &n_in);
+  TEST_ASSERT_EQUAL_UINT16(441 * 2, n_in);
+  TEST_ASSERT_UINT16_WITHIN(1, 480 * 2, n);
+
+  // Input is limited by output
+  n_in = 1000;
+  n = audiod_asrc_process_s32(&asrc, out_s32, 480, in_s32, &n_in);
+  TEST_ASSERT_EQUAL_UINT16(480, n);
+  TEST_ASSERT_UINT16_WITHIN(1, 441, n_in);
+}
+
+void test_asrc_chunks_equal_block(void)
+{
+  static int32_t out_ref[N_OUT];
+
+  make_sine(1000, 48000);
+  audiod_asrc_init(&asrc, 1, audiod_asrc_ratio(48000, 44100));
+  uint16_t n_in = 4000;
+  uint16_t const n_ref = audiod_asrc_process_s32(&asrc, out_ref, N_OUT, in_s32, &n_in);
+
+  // Irregular input and output chunks as from a FIFO with wrap
+  audiod_asrc_init(&asrc, 1, audiod_asrc_ratio(48000, 44100));
+  uint16_t in_pos = 0, out_pos = 0;
+  for (uint16_t i = 1; in_pos < 4000; i++)
+  {
+    uint16_t n_chunk = tu_min16((uint16_t) (i * 7 % 61), (uint16_t) (4000 - in_pos));
+    out_pos += audiod_asrc_process_s32(&asrc, &out_s32[out_pos], (uint16_t) (i * 13 % 47 + 1), &in_s32[in_pos], &n_chunk);
+    in_pos += n_chunk;
+  }
+
+  TEST_ASSERT_EQUAL_UINT16(n_ref, out_pos);
+  TEST_ASSERT_EQUAL_INT32_ARRAY(out_ref, out_s32, n_ref);
+}
+
+void test_asrc_channels_independent(void)
+{
+  // Channel 1 is the negated channel 0
+  static int32_t in2[2 * 1000];
+  static int32_t out2[2 * 1200];
+
+  make_sine(3000, 48000);
+  for (int i = 0; i < 1000; i++)
+  {
+    in2[2*i]   = in_s32[i];
+    in2[2*i+1] = -in_s32[i];
+  }
+
+  audiod_asrc_init(&asrc, 2, audiod_asrc_ratio(44100, 48000));
+  uint16_t n_in = 1000;
+  uint16_t const n = audiod_asrc_process_s32(&asrc, out2, 1200, in2, &n_in);
+
+  // Arithmetic shifts round toward negative infinity, allow a few LSB
+  for (uint16_t i = 0; i < n; i++) TEST_ASSERT_INT32_WITHIN(4, -out2[2*i], out2[2*i+1]);
+}
+
+typedef struct
+{
+  uint32_t in_rate;
+  double   out_rate;
+  double   freq;
+} thd_case_t;
+
+static thd_case_t const thd_cases[] =
+{
+  { 44100, 48000        , 1000  },
+  { 44100, 48000        , 10000 },
+  { 48000, 44100        , 1000  },
+  { 48000, 44100        , 10000 },
+  { 48000, 48000 * 1.001, 1000  },  // clock drift of 1000 ppm
+  { 48000, 48000 * 1.001, 15000 },
+};
+
+static void check_thd_n(bool use_float)
+{
+  for (size_t i = 0; i < TU_ARRAY_SIZE(thd_cases); i++)
+  {
+    thd_case_t const* tc = &thd_cases[i];
+    uint32_t const step = (uint32_t) llround(tc->in_rate / tc->out_rate * (1 << 30));
+
+    make_sine(tc->freq, tc->in_rate);
+    audiod_asrc_init(&asrc, 1, step);
+
+    uint16_t n_in = N_IN;
+    uint16_t const n = use_float ? audiod_asrc_process_f32(&asrc, out_f32, N_OUT, in_f32, &n_in)
+                                 : audiod_asrc_process_s32(&asrc, out_s32, N_OUT, in_s32, &n_in);
+    double const db = thd_n(use_float ? out_f32 : NULL, out_s32, n, (double) step / (1 << 30), tc->freq, tc->in_rate);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s %lu -> %.0f Hz, %5.0f Hz sine: THD+N %.1f dB",
+             use_float ? "f32" : "s32", (unsigned long) tc->in_rate, tc->out_rate, tc->freq, db);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_LESS_THAN_INT(-80, (int) db);
+  }
+}
+
+void test_asrc_thd_n_s32(void)
+{
+  check_thd_n(false);
+}
+
+void test_asrc_thd_n_f32(void)
+{
+  check_thd_n(true);
+}
+
+//--------------------------------------------------------------------+
+// Ratio tracking: host sends at its rate, application reads at its own clock through the converter
+//--------------------------------------------------------------------+
+
+static void simulate_tracking(uint32_t host_rate, uint32_t dev_rate, int32_t skew_ppm)
+{
+  enum { SECONDS = 20, DEPTH = 400 };
+  audiod_asrc_tracker_t tr;
+  uint16_t const target = DEPTH / 2;
+
+  audiod_asrc_tracker_init(&tr, host_rate, dev_rate, target);
+  audiod_asrc_init(&asrc, 1, tr.step);
+
+  uint32_t level = target;
+  uint64_t host_acc = 0, dev_acc = 0;
+  uint16_t lvl_min = UINT16_MAX, lvl_max = 0;
+  uint32_t underruns = 0;
+  uint64_t step_sum = 0;
+
+  for (uint32_t ms = 0; ms < SECONDS * 1000; ms++)
+  {
+    // Host packet
+    host_acc += host_rate;
+    level += (uint32_t) (host_acc / 1000);
+    host_acc %= 1000;
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(DEPTH, level);
+
+    // Application reads one ms of its own clock through converter
+    dev_acc += (uint64_t) dev_rate * (uint64_t) (1000000 + skew_ppm);
+    uint16_t const n_req = (uint16_t) (dev_acc / 1000000000ULL);
+    dev_acc %= 1000000000ULL;
+
+    uint16_t n_in = (uint16_t) level;
+    uint16_t const n = audiod_asrc_process_s32(&asrc, out_s32, n_req, in_s32, &n_in);
+    if (n < n_req) underruns++;
+    level -= n_in;
+
+    // SOF
+    asrc.step = audiod_asrc_tracker_update(&tr, (uint16_t) level);
+
+    if (ms >= (SECONDS - 5) * 1000)
+    {
+      if (level < lvl_min) lvl_min = (uint16_t) level;
+      if (level > lvl_max) lvl_max = (uint16_t) level;
+      step_sum += tr.step;
+    }
+  }
+
+  // Ratio averaged over the settled period, single updates carry the jitter of packet sizes
+  double const ratio = (double) step_sum / (5 * 1000) / (1 << 30);
+  double const ideal = (double) host_rate / (dev_rate * (1 + skew_ppm * 1e-6));
+  float const error_ppm = (float) ((ratio / ideal - 1) * 1e6);
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "%lu -> %lu Hz %+ld ppm: level %u..%u (target %u), ratio error %.1f ppm",
+           (unsigned long) host_rate, (unsigned long) dev_rate, (long) skew_ppm, lvl_min, lvl_max, target, (double) error_ppm);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_EQUAL_UINT32(0, underruns);
+  TEST_ASSERT_UINT16_WITHIN(100, target, lvl_min);
+  TEST_ASSERT_UINT16_WITHIN(100, target, lvl_max);
+  TEST_ASSERT_FLOAT_WITHIN(10, 0, error_ppm);
+}
+
+void test_asrc_tracker_follows_skew(void)
+{
+  simulate_tracking(48000, 48000, 0);
+  simulate_tracking(48000, 48000, 1000);
+  simulate_tracking(48000, 48000, -1000);
+  simulate_tracking(44100, 48000, 300);
+  simulate_tracking(96000, 48000, -300);
+}
+
+//--------------------------------------------------------------------+
+// Benchmark: frames per microsecond of 2 channels, reported only
+//--------------------------------------------------------------------+
+
+static void bench(bool use_float)
+{
+  enum { FRAMES = 2000, ITERATIONS = 200 };
+
+  audiod_asrc_init(&asrc, 2, audiod_asrc_ratio(44100, 48000));
+  clock_t const start = clock();
+
+  uint32_t produced = 0;
+  for (int i = 0; i < ITERATIONS; i++)
+  {
+    uint16_t n_in = FRAMES;
+    produced += use_float ? audiod_asrc_process_f32(&asrc, out_f32, N_OUT / 2, in_f32, &n_in)
+                          : audiod_asrc_process_s32(&asrc, out_s32, N_OUT / 2, in_s32, &n_in);
+  }
+
+  double const us = (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC;
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "%s 2ch 44.1 -> 48 kHz: %.2f frames/us (%.1f%% of a core for 48 kHz)",
+           use_float ? "f32" : "s32", us > 0 ? produced / us : 0, us > 0 ? 100.0 * 48000 * 1e-6 / (produced / us) : 0);
+  TEST_MESSAGE(msg);
+}
+
+void test_asrc_benchmark_s32(void)
+{
+  bench(false);
+}
+
+void test_asrc_benchmark_f32(void)
+{
+  bench(true);
+}
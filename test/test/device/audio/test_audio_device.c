@@ -0,0 +1,413 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("audio_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT = 0x00,
+  EDPT_CTRL_IN  = 0x80,
+
+  EDPT_AUDIO_OUT_1 = 0x01,
+  EDPT_AUDIO_OUT_2 = 0x02,
+};
+
+uint8_t const rhport = 0;
+
+enum
+{
+  ITF_NUM_AUDIO_CONTROL,
+  ITF_NUM_AUDIO_STREAMING_1,
+  ITF_NUM_AUDIO_STREAMING_2,
+  ITF_NUM_TOTAL
+};
+
+// One speaker function with two independent streaming interfaces, each with its own OUT endpoint
+#define AUDIO_AS_DESC_LEN (TUD_AUDIO_DESC_STD_AS_INT_LEN\
+  + TUD_AUDIO_DESC_STD_AS_INT_LEN\
+  + TUD_AUDIO_DESC_CS_AS_INT_LEN\
+  + TUD_AUDIO_DESC_TYPE_I_FORMAT_LEN\
+  + TUD_AUDIO_DESC_STD_AS_ISO_EP_LEN\
+  + TUD_AUDIO_DESC_CS_AS_ISO_EP_LEN)
+
+#define AUDIO_DESC_LEN (TUD_AUDIO_DESC_IAD_LEN\
+  + TUD_AUDIO_DESC_STD_AC_LEN\
+  + TUD_AUDIO_DESC_CS_AC_LEN\
+  + TUD_AUDIO_DESC_CLK_SRC_LEN\
+  + 2*TUD_AUDIO_DESC_INPUT_TERM_LEN\
+  + 2*TUD_AUDIO_DESC_OUTPUT_TERM_LEN\
+  + 2*AUDIO_AS_DESC_LEN)
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + AUDIO_DESC_LEN)
+
+#define AUDIO_AS_DESCRIPTOR(_itfnum, _termid, _epout) \
+  TUD_AUDIO_DESC_STD_AS_INT(_itfnum, 0x00, 0x00, 0x00),\
+  TUD_AUDIO_DESC_STD_AS_INT(_itfnum, 0x01, 0x01, 0x00),\
+  TUD_AUDIO_DESC_CS_AS_INT(_termid, AUDIO_CTRL_NONE, AUDIO_FORMAT_TYPE_I, AUDIO_DATA_FORMAT_TYPE_I_PCM, 0x01, AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, 0x00),\
+  TUD_AUDIO_DESC_TYPE_I_FORMAT(2, 16),\
+  TUD_AUDIO_DESC_STD_AS_ISO_EP(_epout, (TUSB_XFER_ISOCHRONOUS | TUSB_ISO_EP_ATT_ADAPTIVE | TUSB_ISO_EP_ATT_DATA), CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, 0x01),\
+  TUD_AUDIO_DESC_CS_AS_ISO_EP(AUDIO_CS_AS_ISO_DATA_EP_ATT_NON_MAX_PACKETS_OK, AUDIO_CTRL_NONE, AUDIO_CS_AS_ISO_DATA_EP_LOCK_DELAY_UNIT_UNDEFINED, 0x0000)
+
+uint8_t const data_desc_configuration[] =
+{
+  // Config number, interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0x00, 100),
+
+  TUD_AUDIO_DESC_IAD(ITF_NUM_AUDIO_CONTROL, ITF_NUM_TOTAL, 0x00),
+  TUD_AUDIO_DESC_STD_AC(ITF_NUM_AUDIO_CONTROL, 0x00, 0x00),
+  TUD_AUDIO_DESC_CS_AC(0x0200, AUDIO_FUNC_DESKTOP_SPEAKER, TUD_AUDIO_DESC_CLK_SRC_LEN + 2*TUD_AUDIO_DESC_INPUT_TERM_LEN + 2*TUD_AUDIO_DESC_OUTPUT_TERM_LEN, AUDIO_CS_AS_INTERFACE_CTRL_LATENCY_POS),
+  TUD_AUDIO_DESC_CLK_SRC(0x04, AUDIO_CLOCK_SOURCE_ATT_INT_FIX_CLK, (AUDIO_CTRL_R << AUDIO_CLOCK_SOURCE_CTRL_CLK_FRQ_POS), 0x01, 0x00),
+  TUD_AUDIO_DESC_INPUT_TERM(0x01, AUDIO_TERM_TYPE_USB_STREAMING, 0x00, 0x04, 0x01, AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, 0x00, 0x0000, 0x00),
+  TUD_AUDIO_DESC_OUTPUT_TERM(0x03, AUDIO_TERM_TYPE_OUT_DESKTOP_SPEAKER, 0x01, 0x01, 0x04, 0x0000, 0x00),
+  TUD_AUDIO_DESC_INPUT_TERM(0x05, AUDIO_TERM_TYPE_USB_STREAMING, 0x00, 0x04, 0x01, AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, 0x00, 0x0000, 0x00),
+  TUD_AUDIO_DESC_OUTPUT_TERM(0x07, AUDIO_TERM_TYPE_OUT_DESKTOP_SPEAKER, 0x05, 0x05, 0x04, 0x0000, 0x00),
+
+  AUDIO_AS_DESCRIPTOR(ITF_NUM_AUDIO_STREAMING_1, 0x01, EDPT_AUDIO_OUT_1),
+  AUDIO_AS_DESCRIPTOR(ITF_NUM_AUDIO_STREAMING_2, 0x05, EDPT_AUDIO_OUT_2),
+};
+
+TU_VERIFY_STATIC(AUDIO_DESC_LEN == CFG_TUD_AUDIO_FUNC_1_DESC_LEN, "CFG_TUD_AUDIO_FUNC_1_DESC_LEN mismatch");
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+uint8_t const* desc_configuration;
+
+// application owned ring used as EP OUT FIFO, not a multiple of EP size to exercise wrap around
+uint8_t app_ring[100];
+
+// trace timestamp, advanced by test
+uint32_t trace_time;
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  return desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+  (void) langid;
+
+  return NULL;
+}
+
+uint32_t tud_audio_trace_timestamp_cb(void)
+{
+  return trace_time;
+}
+
+bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request)
+{
+  return tud_audio_trace_control_xfer(rhport, stage, request);
+}
+
+void setUp(void)
+{
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+  dcd_sof_enable_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_reset(rhport, TUSB_SPEED_FULL, false);
+  tud_task();
+
+  // back to internal FIFO buffers
+  TEST_ASSERT_TRUE( tud_audio_stream_set_ep_out_ff_buf(0, NULL, 0) );
+  TEST_ASSERT_TRUE( tud_audio_stream_set_ep_out_ff_buf(1, NULL, 0) );
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+// find the standard endpoint descriptor of an AS interface's alternate 1
+static tusb_desc_endpoint_t const* find_ep_desc(uint8_t ep_addr)
+{
+  uint8_t const* p_desc = desc_configuration;
+  uint8_t const* desc_end = desc_configuration + CONFIG_TOTAL_LEN;
+
+  while (p_desc < desc_end)
+  {
+    if (tu_desc_type(p_desc) == TUSB_DESC_ENDPOINT && ((tusb_desc_endpoint_t const*) p_desc)->bEndpointAddress == ep_addr)
+    {
+      return (tusb_desc_endpoint_t const*) p_desc;
+    }
+    p_desc = tu_desc_next(p_desc);
+  }
+
+  return NULL;
+}
+
+// data is what the host sends into the first transfer scheduled after opening the endpoint
+static void set_interface(uint8_t itf, uint8_t alt, uint8_t ep_addr, uint8_t const* data, uint16_t len)
+{
+  tusb_control_request_t const request_set_interface =
+  {
+    .bmRequestType = 0x01,
+    .bRequest      = TUSB_REQ_SET_INTERFACE,
+    .wValue        = alt,
+    .wIndex        = itf,
+    .wLength       = 0
+  };
+
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_set_interface, false);
+
+  if (alt)
+  {
+    dcd_edpt_open_ExpectAndReturn(rhport, find_ep_desc(ep_addr), true);
+    dcd_edpt_xfer_ExpectAndReturn(rhport, ep_addr, NULL, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, true);
+    dcd_edpt_xfer_IgnoreArg_buffer();
+    dcd_edpt_xfer_ReturnMemThruPtr_buffer((uint8_t*) data, len);
+  }
+  else
+  {
+    dcd_edpt_close_Expect(rhport, ep_addr);
+  }
+
+  // control status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+}
+
+static void mount(void)
+{
+  desc_configuration = data_desc_configuration;
+
+  // AS interfaces start at alternate 0, no endpoint is opened yet
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_set_configuration, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+}
+
+void test_audio_multiple_out_streams(void)
+{
+  uint8_t const data_1[] = { 0x11, 0x12, 0x13, 0x14, 0x15, 0x16 };
+  uint8_t const data_2[] = { 0x21, 0x22, 0x23, 0x24 };
+  uint8_t buf[16];
+
+  mount();
+  TEST_ASSERT_FALSE( tud_audio_mounted() );
+
+  // streaming interface 2 opened first: stream index follows descriptor order, not opening order
+  set_interface(ITF_NUM_AUDIO_STREAMING_2, 1, EDPT_AUDIO_OUT_2, data_2, sizeof(data_2));
+  TEST_ASSERT_FALSE( tud_audio_mounted() );
+
+  set_interface(ITF_NUM_AUDIO_STREAMING_1, 1, EDPT_AUDIO_OUT_1, data_1, sizeof(data_1));
+  TEST_ASSERT_TRUE( tud_audio_mounted() );
+
+  // packets received on both endpoints, each endpoint is re-armed
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT_2, NULL, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer((uint8_t*) data_2, sizeof(data_2));
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_OUT_2, sizeof(data_2), 0, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT_1, NULL, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_OUT_1, sizeof(data_1), 0, false);
+  tud_task();
+
+  // each endpoint has its own FIFO
+  TEST_ASSERT_EQUAL(sizeof(data_1), tud_audio_stream_available(0));
+  TEST_ASSERT_EQUAL(sizeof(data_2), tud_audio_stream_available(1));
+  TEST_ASSERT_EQUAL(sizeof(data_1), tud_audio_available());
+  TEST_ASSERT_EQUAL(0, tud_audio_stream_available(2));
+
+  TEST_ASSERT_EQUAL(sizeof(data_2), tud_audio_stream_read(1, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_MEMORY(data_2, buf, sizeof(data_2));
+
+  TEST_ASSERT_EQUAL(sizeof(data_1), tud_audio_stream_read(0, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_MEMORY(data_1, buf, sizeof(data_1));
+
+  // closing one stream leaves the other running
+  set_interface(ITF_NUM_AUDIO_STREAMING_1, 0, EDPT_AUDIO_OUT_1, NULL, 0);
+  TEST_ASSERT_FALSE( tud_audio_mounted() );
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT_2, NULL, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_OUT_2, sizeof(data_2), 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(0, tud_audio_stream_available(0));
+  TEST_ASSERT_EQUAL(sizeof(data_2), tud_audio_stream_available(1));
+}
+
+void test_audio_out_app_ring(void)
+{
+  uint8_t const data_1[] = { 0x11, 0x12, 0x13, 0x14, 0x15, 0x16 };
+  uint8_t const data_2[] = { 0x21, 0x22, 0x23, 0x24 };
+  uint8_t data_3[CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX];
+  uint8_t buf[128];
+
+  for (uint8_t i = 0; i < sizeof(data_3); i++) data_3[i] = i;
+  memset(app_ring, 0, sizeof(app_ring));
+
+  TEST_ASSERT_TRUE( tud_audio_stream_set_ep_out_ff_buf(0, app_ring, sizeof(app_ring)) );
+  TEST_ASSERT_FALSE( tud_audio_stream_set_ep_out_ff_buf(CFG_TUD_AUDIO_FUNC_1_N_EP_OUT, app_ring, sizeof(app_ring)) );
+
+  mount();
+
+  // first packet is received straight into the ring, but not committed before transfer completes
+  set_interface(ITF_NUM_AUDIO_STREAMING_1, 1, EDPT_AUDIO_OUT_1, data_1, sizeof(data_1));
+  TEST_ASSERT_EQUAL_MEMORY(data_1, app_ring, sizeof(data_1));
+  TEST_ASSERT_EQUAL(0, tud_audio_stream_available(0));
+
+  // buffer can not be exchanged while streaming
+  TEST_ASSERT_FALSE( tud_audio_stream_set_ep_out_ff_buf(0, NULL, 0) );
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT_1, NULL, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer((uint8_t*) data_2, sizeof(data_2));
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_OUT_1, sizeof(data_1), 0, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT_1, NULL, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(data_3, sizeof(data_3));
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_OUT_1, sizeof(data_2), 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(sizeof(data_1) + sizeof(data_2), tud_audio_stream_available(0));
+  TEST_ASSERT_EQUAL_MEMORY(data_2, app_ring + sizeof(data_1), sizeof(data_2));
+  TEST_ASSERT_EQUAL_MEMORY(data_3, app_ring + sizeof(data_1) + sizeof(data_2), sizeof(data_3));
+
+  // a full packet does not fit into the rest of the ring anymore: received into linear buffer and copied with wrap around
+  uint16_t const wr = sizeof(data_1) + sizeof(data_2) + sizeof(data_3);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT_1, NULL, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(data_3, sizeof(data_3));
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_OUT_1, sizeof(data_3), 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(0, app_ring[wr]);
+
+  // application consumes from the ring to make room for the wrapping packet
+  TEST_ASSERT_EQUAL(wr, tud_audio_stream_read(0, buf, wr));
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT_1, NULL, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_OUT_1, sizeof(data_3), 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(sizeof(data_3), tud_audio_stream_available(0));
+  TEST_ASSERT_EQUAL_MEMORY(data_3, app_ring + wr, sizeof(app_ring) - wr);
+  TEST_ASSERT_EQUAL_MEMORY(data_3 + sizeof(app_ring) - wr, app_ring, sizeof(data_3) - (sizeof(app_ring) - wr));
+}
+
+void test_audio_trace(void)
+{
+  uint8_t const data_1[] = { 0x11, 0x12, 0x13, 0x14, 0x15, 0x16 };
+  uint8_t const data_2[] = { 0x21, 0x22, 0x23, 0x24 };
+  audio_trace_record_t rec[4];
+
+  tud_audio_trace_clear();
+  trace_time = 0;
+
+  mount();
+  set_interface(ITF_NUM_AUDIO_STREAMING_1, 1, EDPT_AUDIO_OUT_1, data_1, sizeof(data_1));
+
+  // packet handled 250 ticks after SOF of frame 5
+  trace_time = 1000;
+  dcd_event_sof(rhport, 5, true);
+  trace_time = 1250;
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT_1, NULL, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer((uint8_t*) data_2, sizeof(data_2));
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_OUT_1, sizeof(data_1), 0, false);
+  tud_task();
+
+  trace_time = 2100;
+  dcd_event_sof(rhport, 6, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_OUT_1, NULL, CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_OUT_1, sizeof(data_2), 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, tud_audio_trace_read(rec, 1));
+  TEST_ASSERT_EQUAL(5, rec[0].frame);
+  TEST_ASSERT_EQUAL(0, rec[0].func_id);
+  TEST_ASSERT_EQUAL(EDPT_AUDIO_OUT_1, rec[0].ep);
+  TEST_ASSERT_EQUAL(sizeof(data_1), rec[0].n_bytes);
+  TEST_ASSERT_EQUAL(sizeof(data_1), rec[0].ff_count);
+  TEST_ASSERT_EQUAL(250, rec[0].sof_offset);
+  TEST_ASSERT_EQUAL(0, rec[0].proc_time);
+
+  // remaining record is read by host with vendor request
+  tusb_control_request_t const request_trace =
+  {
+    .bmRequestType = 0xC1,
+    .bRequest      = 0x01,
+    .wValue        = 0,
+    .wIndex        = ITF_NUM_AUDIO_STREAMING_1,
+    .wLength       = sizeof(rec)
+  };
+
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_trace, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, sizeof(audio_trace_record_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  tud_task();
+
+  TEST_ASSERT_EQUAL(0, tud_audio_trace_read(rec, 4));
+}
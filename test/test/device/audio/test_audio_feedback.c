@@ -0,0 +1,249 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+
+#include "unity.h"
+
+// Files to test
+#include "audio_feedback.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+// Full speed 48 kHz stereo 16 bit: 48 samples of 4 bytes per frame, feedback every frame
+enum
+{
+  FS_RATE   = 48000,
+  FS_SLOT   = 4,
+  FS_DEPTH  = 8 * 48 * FS_SLOT,
+  FS_TARGET = FS_DEPTH / 2,
+};
+
+static uint32_t const fs_nominal = (48UL << 16);
+
+static audiod_fb_fifo_count_t fc;
+
+void setUp(void)
+{
+  audiod_fb_fifo_count_init(&fc, fs_nominal, FS_TARGET, FS_SLOT, 0);
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Controller
+//--------------------------------------------------------------------+
+
+void test_fb_nominal_at_target(void)
+{
+  uint32_t fb = 0;
+  for (int i = 0; i < 200; i++) fb = audiod_fb_fifo_count_update(&fc, FS_TARGET, fs_nominal - (1UL << 16), fs_nominal + (1UL << 16));
+
+  TEST_ASSERT_UINT32_WITHIN(16, fs_nominal, fb);
+}
+
+void test_fb_clamped(void)
+{
+  uint32_t const min_value = fs_nominal - (1UL << 16);
+  uint32_t const max_value = fs_nominal + (1UL << 16);
+  uint32_t fb = 0;
+
+  // Empty FIFO asks for more samples
+  for (int i = 0; i < 1000; i++) fb = audiod_fb_fifo_count_update(&fc, 0, min_value, max_value);
+  TEST_ASSERT_EQUAL_UINT32(max_value, fb);
+
+  // Integral did not wind up while saturated: one update at target level already drops below maximum
+  for (int i = 0; i < 100; i++) fb = audiod_fb_fifo_count_update(&fc, FS_TARGET, min_value, max_value);
+  TEST_ASSERT_UINT32_WITHIN(1UL << 14, fs_nominal, fb);
+
+  // Full FIFO asks for less
+  for (int i = 0; i < 1000; i++) fb = audiod_fb_fifo_count_update(&fc, FS_DEPTH, min_value, max_value);
+  TEST_ASSERT_EQUAL_UINT32(min_value, fb);
+}
+
+void test_fb_large_fifo_no_overflow(void)
+{
+  audiod_fb_fifo_count_init(&fc, fs_nominal, 0xF000, FS_SLOT, 0);
+
+  uint32_t fb = 0;
+  for (int i = 0; i < 200; i++) fb = audiod_fb_fifo_count_update(&fc, 0xFFFF, fs_nominal - (1UL << 16), fs_nominal + (1UL << 16));
+  TEST_ASSERT_EQUAL_UINT32(fs_nominal - (1UL << 16), fb);
+}
+
+//--------------------------------------------------------------------+
+// Simulation of host and device with skewed sample clocks
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+  uint32_t sample_rate;
+  uint16_t slot_size;
+  uint16_t depth;
+  uint8_t  high_speed;
+  uint8_t  update_shift;  // log2 of (micro)frames per feedback update
+  int32_t  skew_ppm;      // device sample clock relative to host
+} sim_cfg_t;
+
+typedef struct
+{
+  float    mean;          // average level in last second
+  uint16_t min;           // levels after settling
+  uint16_t max;
+  uint32_t underruns;     // device found less than one slot after playback started
+  uint32_t overruns;      // host packet did not fit into FIFO
+} sim_result_t;
+
+enum
+{
+  SIM_SECONDS       = 20,
+  SIM_SETTLE_SECOND = 5,
+  SIM_HOST_DELAY    = 2   // updates until host applies a new feedback value
+};
+
+static sim_result_t simulate(sim_cfg_t const* cfg)
+{
+  sim_result_t res = { .min = UINT16_MAX };
+
+  uint32_t const fps     = cfg->high_speed ? 8000 : 1000;
+  uint32_t const nominal = (uint32_t) (((uint64_t) cfg->sample_rate << 16) / fps);
+  uint32_t const min_value = nominal - (1UL << 16);
+  uint32_t const max_value = nominal + (1UL << 16);
+  uint16_t const target  = cfg->depth / 2;
+
+  audiod_fb_fifo_count_init(&fc, nominal, target, cfg->slot_size, cfg->update_shift);
+
+  uint32_t fb_queue[SIM_HOST_DELAY + 1];
+  for (int i = 0; i <= SIM_HOST_DELAY; i++) fb_queue[i] = nominal;
+
+  uint32_t level    = 0;
+  uint32_t host_acc = 0;
+  uint64_t dev_acc  = 0;
+  uint64_t const dev_div = (uint64_t) fps * 1000000;
+  bool playing = false;
+  uint64_t sum = 0;
+
+  for (uint32_t uf = 0; uf < SIM_SECONDS * fps; uf++)
+  {
+    // Host sends feedback rate with fractional samples carried to next packet
+    host_acc += fb_queue[0];
+    uint32_t const n_tx = (host_acc >> 16) * cfg->slot_size;
+    host_acc &= 0xFFFF;
+
+    if (level + n_tx > cfg->depth)
+    {
+      res.overruns++;
+    }
+    else
+    {
+      level += n_tx;
+    }
+
+    // Device consumes at its own clock once the FIFO was filled up to target
+    if (level >= target) playing = true;
+    if (playing)
+    {
+      dev_acc += (uint64_t) cfg->sample_rate * (uint64_t) (1000000 + cfg->skew_ppm);
+      uint32_t const n_rx = (uint32_t) (dev_acc / dev_div) * cfg->slot_size;
+      dev_acc %= dev_div;
+
+      if (n_rx > level)
+      {
+        res.underruns++;
+        level = 0;
+      }
+      else
+      {
+        level -= n_rx;
+      }
+    }
+
+    // Feedback update on SOF
+    if ((uf & ((1UL << cfg->update_shift) - 1)) == 0)
+    {
+      for (int i = 0; i < SIM_HOST_DELAY; i++) fb_queue[i] = fb_queue[i + 1];
+      fb_queue[SIM_HOST_DELAY] = audiod_fb_fifo_count_update(&fc, (uint16_t) level, min_value, max_value);
+    }
+
+    if (uf >= SIM_SETTLE_SECOND * fps)
+    {
+      if (level < res.min) res.min = (uint16_t) level;
+      if (level > res.max) res.max = (uint16_t) level;
+    }
+    if (uf >= (SIM_SECONDS - 1) * fps) sum += level;
+  }
+
+  res.mean = (float) sum / (float) fps;
+  return res;
+}
+
+static void check_convergence(sim_cfg_t const* cfg)
+{
+  sim_result_t const res = simulate(cfg);
+  uint16_t const target = cfg->depth / 2;
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "%s skew %+ld ppm: level mean %.1f (target %u), range %u..%u bytes",
+           cfg->high_speed ? "HS" : "FS", (long) cfg->skew_ppm, (double) res.mean, target, res.min, res.max);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_EQUAL_UINT32(0, res.underruns);
+  TEST_ASSERT_EQUAL_UINT32(0, res.overruns);
+
+  // Settles at target, a single slot off at most on average
+  TEST_ASSERT_FLOAT_WITHIN((float) cfg->slot_size, (float) target, res.mean);
+
+  // Only jitter of about a packet remains after settling
+  uint16_t const packet = (uint16_t) (cfg->sample_rate / (cfg->high_speed ? 8000 : 1000) * cfg->slot_size);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT16(target - 2*packet, res.min);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT16(target + 2*packet, res.max);
+}
+
+void test_sim_full_speed_converges_under_skew(void)
+{
+  int32_t const skews[] = { -1000, -100, 0, 100, 1000 };
+
+  for (size_t i = 0; i < sizeof(skews)/sizeof(skews[0]); i++)
+  {
+    sim_cfg_t const cfg = { .sample_rate = FS_RATE, .slot_size = FS_SLOT, .depth = FS_DEPTH, .high_speed = 0, .update_shift = 0, .skew_ppm = skews[i] };
+    check_convergence(&cfg);
+  }
+}
+
+void test_sim_high_speed_converges_under_skew(void)
+{
+  // 96 kHz 8 channels 24 bit, feedback every 8 micro frames
+  int32_t const skews[] = { -1000, 1000 };
+
+  for (size_t i = 0; i < sizeof(skews)/sizeof(skews[0]); i++)
+  {
+    sim_cfg_t const cfg = { .sample_rate = 96000, .slot_size = 24, .depth = 8 * 96 * 24, .high_speed = 1, .update_shift = 3, .skew_ppm = skews[i] };
+    check_convergence(&cfg);
+  }
+}
@@ -0,0 +1,198 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("audio_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT = 0x00,
+  EDPT_CTRL_IN  = 0x80,
+
+  EDPT_AUDIO_IN = 0x81,
+};
+
+uint8_t const rhport = 0;
+
+enum
+{
+  ITF_NUM_AUDIO_CONTROL,
+  ITF_NUM_AUDIO_STREAMING,
+  ITF_NUM_TOTAL
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_AUDIO_MIC_ONE_CH_DESC_LEN)
+
+uint8_t const data_desc_configuration[] =
+{
+  // Config number, interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0x00, 100),
+
+  TUD_AUDIO_MIC_ONE_CH_DESCRIPTOR(ITF_NUM_AUDIO_CONTROL, 0, 2, 16, EDPT_AUDIO_IN, CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX),
+};
+
+TU_VERIFY_STATIC(TUD_AUDIO_MIC_ONE_CH_DESC_LEN == CFG_TUD_AUDIO_FUNC_1_DESC_LEN, "CFG_TUD_AUDIO_FUNC_1_DESC_LEN mismatch");
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+// application owned ring used as EP IN FIFO
+uint8_t app_ring[100];
+
+// bytes handed back by tud_audio_ep_in_ff_consumed_cb()
+uint16_t consumed;
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  (void) index;
+  return data_desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+  (void) index;
+  (void) langid;
+  return NULL;
+}
+
+void tud_audio_ep_in_ff_consumed_cb(uint8_t func_id, uint8_t stream, uint16_t n_bytes)
+{
+  (void) func_id;
+  (void) stream;
+  consumed += n_bytes;
+}
+
+void setUp(void)
+{
+  consumed = 0;
+
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+  dcd_sof_enable_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_reset(rhport, TUSB_SPEED_FULL, false);
+  tud_task();
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+// application announces n bytes written into its ring
+static void ring_write(uint16_t n)
+{
+  tu_fifo_advance_write_pointer(tud_audio_get_ep_in_ff(), n);
+}
+
+static void expect_in_xfer(uint16_t len)
+{
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_AUDIO_IN, NULL, len, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+}
+
+// Clearing the FIFO while a packet is sent straight out of the ring must not release that packet twice
+void test_audio_in_app_ring_clear_in_flight(void)
+{
+  tusb_control_request_t const request_set_interface =
+  {
+    .bmRequestType = 0x01,
+    .bRequest      = TUSB_REQ_SET_INTERFACE,
+    .wValue        = 1,
+    .wIndex        = ITF_NUM_AUDIO_STREAMING,
+    .wLength       = 0
+  };
+
+  TEST_ASSERT_TRUE( tud_audio_stream_set_ep_in_ff_buf(0, app_ring, sizeof(app_ring)) );
+
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_set_configuration, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  ring_write(CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX);
+
+  // first packet goes out of the ring as soon as the AS interface is selected
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_set_interface, false);
+  dcd_edpt_open_IgnoreAndReturn(true);
+  expect_in_xfer(CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  TEST_ASSERT_TRUE( tud_audio_clear_ep_in_ff() );
+  TEST_ASSERT_EQUAL(0, tu_fifo_count(tud_audio_get_ep_in_ff()));
+
+  // only data written after the clear is sent next
+  ring_write(16);
+
+  expect_in_xfer(16);
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_IN, CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX, 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX, consumed);
+
+  expect_in_xfer(0);
+  dcd_event_xfer_complete(rhport, EDPT_AUDIO_IN, 16, 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX + 16, consumed);
+  TEST_ASSERT_EQUAL(0, tu_fifo_count(tud_audio_get_ep_in_ff()));
+}
@@ -0,0 +1,439 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "unity.h"
+
+// Files to test
+#include "audio_pcm.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  MAX_BYTES    = 8,
+  MAX_FF       = 8,
+  MAX_SAMPLES  = 13,
+  STREAM_SIZE  = MAX_BYTES * MAX_FF * MAX_SAMPLES + 16,
+
+  // UAC2 8 channels of 24 bit at 96 kHz, one FIFO per channel: 96 samples per channel in a 1 ms frame
+  BENCH_CHANNELS   = 8,
+  BENCH_BYTES      = 3,
+  BENCH_SAMPLES    = 96,
+  BENCH_ITERATIONS = 20000
+};
+
+static uint8_t stream[STREAM_SIZE];
+static uint8_t stream_ref[STREAM_SIZE];
+static uint8_t fifo[STREAM_SIZE];
+static uint8_t fifo_ref[STREAM_SIZE];
+
+static void fill_random(uint8_t* buf, uint32_t len)
+{
+  for (uint32_t i = 0; i < len; i++) buf[i] = (uint8_t) rand();
+}
+
+// Reference implementation: one sample at a time
+static uint8_t const* ref_deinterleave(uint8_t* dst, uint8_t const* src, uint16_t n_samples, uint8_t n_bytes, uint8_t n_ff_used)
+{
+  for (uint16_t i = 0; i < n_samples; i++)
+  {
+    for (uint8_t b = 0; b < n_bytes; b++) *dst++ = src[b];
+    src += n_bytes * n_ff_used;
+  }
+  return src;
+}
+
+static uint8_t* ref_interleave(uint8_t* dst, uint8_t const* src, uint16_t n_samples, uint8_t n_bytes, uint8_t n_ff_used)
+{
+  for (uint16_t i = 0; i < n_samples; i++)
+  {
+    for (uint8_t b = 0; b < n_bytes; b++) dst[b] = *src++;
+    dst += n_bytes * n_ff_used;
+  }
+  return dst;
+}
+
+void setUp(void)
+{
+  srand(1);
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+// Bit exactness
+//--------------------------------------------------------------------+
+
+void test_deinterleave_matches_reference(void)
+{
+  for (uint8_t n_bytes = 1; n_bytes <= MAX_BYTES; n_bytes++)
+  {
+    for (uint8_t n_ff = 1; n_ff <= MAX_FF; n_ff++)
+    {
+      for (uint16_t n_samples = 0; n_samples <= MAX_SAMPLES; n_samples++)
+      {
+        // odd offset to exercise unaligned access
+        uint8_t const offset = (uint8_t) (n_samples & 1);
+
+        fill_random(stream, sizeof(stream));
+        fill_random(fifo, sizeof(fifo));
+        memcpy(fifo_ref, fifo, sizeof(fifo));
+
+        uint8_t const* end     = audiod_pcm_deinterleave(fifo + offset, stream + offset, n_samples, n_bytes, n_ff);
+        uint8_t const* end_ref = ref_deinterleave(fifo_ref + offset, stream + offset, n_samples, n_bytes, n_ff);
+
+        TEST_ASSERT_EQUAL_PTR(end_ref, end);
+        TEST_ASSERT_EQUAL_MEMORY(fifo_ref, fifo, sizeof(fifo));
+      }
+    }
+  }
+}
+
+void test_interleave_matches_reference(void)
+{
+  for (uint8_t n_bytes = 1; n_bytes <= MAX_BYTES; n_bytes++)
+  {
+    for (uint8_t n_ff = 1; n_ff <= MAX_FF; n_ff++)
+    {
+      for (uint16_t n_samples = 0; n_samples <= MAX_SAMPLES; n_samples++)
+      {
+        uint8_t const offset = (uint8_t) (n_samples & 1);
+
+        fill_random(fifo, sizeof(fifo));
+        fill_random(stream, sizeof(stream));
+        memcpy(stream_ref, stream, sizeof(stream));
+
+        uint8_t* end     = audiod_pcm_interleave(stream + offset, fifo + offset, n_samples, n_bytes, n_ff);
+        uint8_t* end_ref = ref_interleave(stream_ref + offset, fifo + offset, n_samples, n_bytes, n_ff);
+
+        TEST_ASSERT_EQUAL_PTR(end_ref - stream_ref, end - stream);
+        TEST_ASSERT_EQUAL_MEMORY(stream_ref, stream, sizeof(stream));
+      }
+    }
+  }
+}
+
+void test_interleave_deinterleave_roundtrip(void)
+{
+  static uint8_t ff[BENCH_CHANNELS][BENCH_SAMPLES*BENCH_BYTES];
+  static uint8_t ff_out[BENCH_CHANNELS][BENCH_SAMPLES*BENCH_BYTES];
+  static uint8_t frame[BENCH_CHANNELS*BENCH_SAMPLES*BENCH_BYTES];
+
+  fill_random(&ff[0][0], sizeof(ff));
+
+  for (uint8_t ch = 0; ch < BENCH_CHANNELS; ch++)
+  {
+    audiod_pcm_interleave(&frame[ch*BENCH_BYTES], ff[ch], BENCH_SAMPLES, BENCH_BYTES, BENCH_CHANNELS);
+  }
+
+  for (uint8_t ch = 0; ch < BENCH_CHANNELS; ch++)
+  {
+    audiod_pcm_deinterleave(ff_out[ch], &frame[ch*BENCH_BYTES], BENCH_SAMPLES, BENCH_BYTES, BENCH_CHANNELS);
+  }
+
+  TEST_ASSERT_EQUAL_MEMORY(ff, ff_out, sizeof(ff));
+
+  // first sample of channel 1 follows first sample of channel 0 in the stream
+  TEST_ASSERT_EQUAL_MEMORY(ff[1], &frame[BENCH_BYTES], BENCH_BYTES);
+}
+
+//--------------------------------------------------------------------+
+// Sample format conversion
+//--------------------------------------------------------------------+
+
+static audiod_pcm_conv_t conv_init(uint8_t format, uint8_t dither, uint8_t n_bytes, uint8_t n_channels)
+{
+  audiod_pcm_conv_t conv = { .format = format, .dither = dither, .n_bytes = n_bytes, .n_channels = n_channels, .seed = 1 };
+  return conv;
+}
+
+void test_convert_wire_format_is_plain_copy(void)
+{
+  audiod_pcm_conv_t conv = conv_init(AUDIO_PCM_FORMAT_WIRE, AUDIO_PCM_DITHER_TPDF, 3, 2);
+
+  fill_random(stream, sizeof(stream));
+  memset(fifo, 0, sizeof(fifo));
+  memset(fifo_ref, 0, sizeof(fifo_ref));
+
+  uint8_t const* end = audiod_pcm_deinterleave_convert(fifo, stream + 6, 7, 3, &conv);
+  uint8_t const* end_ref = ref_deinterleave(fifo_ref, stream + 6, 7, 6, 3);
+
+  TEST_ASSERT_EQUAL_PTR(end_ref, end);
+  TEST_ASSERT_EQUAL_MEMORY(fifo_ref, fifo, sizeof(fifo));
+  TEST_ASSERT_EQUAL_UINT8(3, audiod_pcm_format_size(AUDIO_PCM_FORMAT_WIRE, 3));
+}
+
+void test_convert_decode_16bit(void)
+{
+  // 2 FIFOs of 2 channels, samples of second FIFO must be skipped
+  uint8_t const src[] = { 0xff, 0x7f, 0x00, 0x80,  0xaa, 0xaa, 0xaa, 0xaa,
+                          0x00, 0x40, 0xff, 0xff,  0xaa, 0xaa, 0xaa, 0xaa };
+  audiod_pcm_conv_t conv;
+
+  int32_t s32[4];
+  conv = conv_init(AUDIO_PCM_FORMAT_S32, AUDIO_PCM_DITHER_TPDF, 2, 2);
+  TEST_ASSERT_EQUAL_PTR(src + 16, audiod_pcm_deinterleave_convert(s32, src, 2, 2, &conv));
+  TEST_ASSERT_EQUAL_INT32(0x7fff0000, s32[0]);
+  TEST_ASSERT_EQUAL_INT32(INT32_MIN , s32[1]);
+  TEST_ASSERT_EQUAL_INT32(0x40000000, s32[2]);
+  TEST_ASSERT_EQUAL_INT32(-0x10000  , s32[3]);
+
+  float f32[4];
+  conv = conv_init(AUDIO_PCM_FORMAT_F32, AUDIO_PCM_DITHER_NONE, 2, 2);
+  audiod_pcm_deinterleave_convert(f32, src, 2, 2, &conv);
+  TEST_ASSERT_EQUAL_FLOAT(32767.0f/32768, f32[0]);
+  TEST_ASSERT_EQUAL_FLOAT(-1.0f         , f32[1]);
+  TEST_ASSERT_EQUAL_FLOAT(0.5f          , f32[2]);
+  TEST_ASSERT_EQUAL_FLOAT(-1.0f/32768   , f32[3]);
+
+  uint8_t s24[12];
+  conv = conv_init(AUDIO_PCM_FORMAT_S24, AUDIO_PCM_DITHER_NONE, 2, 2);
+  audiod_pcm_deinterleave_convert(s24, src, 2, 2, &conv);
+  uint8_t const s24_ref[] = { 0x00, 0xff, 0x7f,  0x00, 0x00, 0x80,  0x00, 0x00, 0x40,  0x00, 0xff, 0xff };
+  TEST_ASSERT_EQUAL_MEMORY(s24_ref, s24, sizeof(s24));
+}
+
+void test_convert_decode_24bit_to_s16_truncates(void)
+{
+  uint8_t const src[] = { 0x56, 0x34, 0x12,  0xff, 0xff, 0xff,  0x00, 0x00, 0x80 };
+  int16_t s16[3];
+  audiod_pcm_conv_t conv = conv_init(AUDIO_PCM_FORMAT_S16, AUDIO_PCM_DITHER_NONE, 3, 1);
+
+  audiod_pcm_deinterleave_convert(s16, src, 3, 1, &conv);
+  TEST_ASSERT_EQUAL_INT16(0x1234   , s16[0]);
+  TEST_ASSERT_EQUAL_INT16(-1       , s16[1]);
+  TEST_ASSERT_EQUAL_INT16(INT16_MIN, s16[2]);
+}
+
+void test_convert_encode(void)
+{
+  uint8_t dst[16];
+  audiod_pcm_conv_t conv;
+
+  // float saturates, 2 channels of first of 2 FIFOs
+  float const f32[] = { 1.5f, -2.0f, 0.5f, -1.0f/32768 };
+  memset(dst, 0xaa, sizeof(dst));
+  conv = conv_init(AUDIO_PCM_FORMAT_F32, AUDIO_PCM_DITHER_NONE, 2, 2);
+  TEST_ASSERT_EQUAL_PTR(dst + 16, audiod_pcm_interleave_convert(dst, f32, 2, 2, &conv));
+  uint8_t const f32_ref[] = { 0xff, 0x7f, 0x00, 0x80,  0xaa, 0xaa, 0xaa, 0xaa,
+                              0x00, 0x40, 0xff, 0xff,  0xaa, 0xaa, 0xaa, 0xaa };
+  TEST_ASSERT_EQUAL_MEMORY(f32_ref, dst, sizeof(f32_ref));
+
+  // 16 bit is padded with trailing zeros in a 24 bit subslot
+  int16_t const s16[] = { 0x1234, -2 };
+  memset(dst, 0xaa, sizeof(dst));
+  conv = conv_init(AUDIO_PCM_FORMAT_S16, AUDIO_PCM_DITHER_TPDF, 3, 1);
+  audiod_pcm_interleave_convert(dst, s16, 2, 1, &conv);
+  uint8_t const s16_ref[] = { 0x00, 0x34, 0x12,  0x00, 0xfe, 0xff,  0xaa };
+  TEST_ASSERT_EQUAL_MEMORY(s16_ref, dst, sizeof(s16_ref));
+
+  // 32 bit truncated into 8 bit subslot
+  int32_t const s32[] = { 0x12ffffff, INT32_MIN };
+  conv = conv_init(AUDIO_PCM_FORMAT_S32, AUDIO_PCM_DITHER_NONE, 1, 1);
+  audiod_pcm_interleave_convert(dst, s32, 2, 1, &conv);
+  TEST_ASSERT_EQUAL_HEX8(0x12, dst[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x80, dst[1]);
+}
+
+void test_convert_roundtrip_lossless(void)
+{
+  static uint8_t const formats[] = { AUDIO_PCM_FORMAT_S16, AUDIO_PCM_FORMAT_S24, AUDIO_PCM_FORMAT_S32, AUDIO_PCM_FORMAT_F32 };
+  static uint32_t ff[MAX_SAMPLES * 4];
+
+  for (uint8_t f = 0; f < TU_ARRAY_SIZE(formats); f++)
+  {
+    // Only stream resolutions the FIFO format can hold exactly
+    uint8_t const max_bytes = (formats[f] == AUDIO_PCM_FORMAT_F32) ? 3 : audiod_pcm_format_size(formats[f], 0);
+
+    for (uint8_t n_bytes = 1; n_bytes <= max_bytes; n_bytes++)
+    {
+      for (uint8_t n_channels = 1; n_channels <= 3; n_channels++)
+      {
+        for (uint8_t n_ff = 1; n_ff <= 3; n_ff++)
+        {
+          // Rectangular dither does not alter samples without bits below target resolution
+          audiod_pcm_conv_t conv = conv_init(formats[f], AUDIO_PCM_DITHER_RPDF, n_bytes, n_channels);
+          uint16_t const len = (uint16_t) (MAX_SAMPLES * n_bytes * n_channels * n_ff);
+
+          fill_random(stream_ref, len);
+          memset(stream, 0, len);
+
+          // Convert samples of every FIFO back and forth
+          for (uint8_t i = 0; i < n_ff; i++)
+          {
+            uint16_t const offset = (uint16_t) (i * n_bytes * n_channels);
+            audiod_pcm_deinterleave_convert(ff, stream_ref + offset, MAX_SAMPLES, n_ff, &conv);
+            audiod_pcm_interleave_convert(stream + offset, ff, MAX_SAMPLES, n_ff, &conv);
+          }
+
+          TEST_ASSERT_EQUAL_MEMORY(stream_ref, stream, len);
+        }
+      }
+    }
+  }
+}
+
+// Mean of n samples of a constant 24 bit stream value decoded to 16 bit, in 16 bit LSB
+static float dither_mean(uint8_t dither, int32_t value_24, int16_t* min, int16_t* max)
+{
+  enum { N = 4096 };
+  static uint8_t src[N*3];
+  static int16_t s16[N];
+
+  for (uint16_t i = 0; i < N; i++)
+  {
+    src[3*i]   = (uint8_t) value_24;
+    src[3*i+1] = (uint8_t) (value_24 >> 8);
+    src[3*i+2] = (uint8_t) (value_24 >> 16);
+  }
+
+  audiod_pcm_conv_t conv = conv_init(AUDIO_PCM_FORMAT_S16, dither, 3, 1);
+  audiod_pcm_deinterleave_convert(s16, src, N, 1, &conv);
+
+  int32_t sum = 0;
+  *min = INT16_MAX;
+  *max = INT16_MIN;
+  for (uint16_t i = 0; i < N; i++)
+  {
+    sum += s16[i];
+    if (s16[i] < *min) *min = s16[i];
+    if (s16[i] > *max) *max = s16[i];
+  }
+  return (float) sum / N;
+}
+
+void test_convert_dither(void)
+{
+  int16_t min, max;
+
+  // Quarter LSB is lost by truncation
+  TEST_ASSERT_EQUAL_FLOAT(0, dither_mean(AUDIO_PCM_DITHER_NONE, 0x40, &min, &max));
+
+  // but kept on average with dither
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 0.25f, dither_mean(AUDIO_PCM_DITHER_RPDF, 0x40, &min, &max));
+  TEST_ASSERT_EQUAL_INT16(0, min);
+  TEST_ASSERT_EQUAL_INT16(1, max);
+
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 0.25f, dither_mean(AUDIO_PCM_DITHER_TPDF, 0x40, &min, &max));
+  TEST_ASSERT_EQUAL_INT16(-1, min);
+  TEST_ASSERT_EQUAL_INT16(1, max);
+
+  // Silence stays unbiased, full scale saturates instead of wrapping
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 0, dither_mean(AUDIO_PCM_DITHER_TPDF, 0, &min, &max));
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, INT16_MAX, dither_mean(AUDIO_PCM_DITHER_TPDF, 0x7fffff, &min, &max));
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, max);
+}
+
+//--------------------------------------------------------------------+
+// Benchmark: samples per microsecond of decoding 8 channel 24-bit frames, reported only
+//--------------------------------------------------------------------+
+
+static double bench_rate(clock_t ticks)
+{
+  double const us = (double) ticks * 1e6 / CLOCKS_PER_SEC;
+  double const samples = (double) BENCH_ITERATIONS * BENCH_CHANNELS * BENCH_SAMPLES;
+  return us > 0 ? samples / us : 0;
+}
+
+void test_benchmark_decode_8ch_24bit(void)
+{
+  static uint8_t frame[BENCH_CHANNELS*BENCH_SAMPLES*BENCH_BYTES];
+  static uint8_t ff[BENCH_CHANNELS][BENCH_SAMPLES*BENCH_BYTES];
+  static uint8_t ff_ref[BENCH_CHANNELS][BENCH_SAMPLES*BENCH_BYTES];
+
+  fill_random(frame, sizeof(frame));
+
+  clock_t start = clock();
+  for (uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+  {
+    for (uint8_t ch = 0; ch < BENCH_CHANNELS; ch++)
+    {
+      ref_deinterleave(ff_ref[ch], &frame[ch*BENCH_BYTES], BENCH_SAMPLES, BENCH_BYTES, BENCH_CHANNELS);
+    }
+  }
+  clock_t const ticks_ref = clock() - start;
+
+  start = clock();
+  for (uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+  {
+    for (uint8_t ch = 0; ch < BENCH_CHANNELS; ch++)
+    {
+      audiod_pcm_deinterleave(ff[ch], &frame[ch*BENCH_BYTES], BENCH_SAMPLES, BENCH_BYTES, BENCH_CHANNELS);
+    }
+  }
+  clock_t const ticks = clock() - start;
+
+  TEST_ASSERT_EQUAL_MEMORY(ff_ref, ff, sizeof(ff));
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "decode 8ch 24-bit: %.1f samples/us, byte-wise reference %.1f samples/us",
+           bench_rate(ticks), bench_rate(ticks_ref));
+  TEST_MESSAGE(msg);
+}
+
+void test_benchmark_encode_8ch_24bit(void)
+{
+  static uint8_t frame[BENCH_CHANNELS*BENCH_SAMPLES*BENCH_BYTES];
+  static uint8_t frame_ref[BENCH_CHANNELS*BENCH_SAMPLES*BENCH_BYTES];
+  static uint8_t ff[BENCH_CHANNELS][BENCH_SAMPLES*BENCH_BYTES];
+
+  fill_random(&ff[0][0], sizeof(ff));
+
+  clock_t start = clock();
+  for (uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+  {
+    for (uint8_t ch = 0; ch < BENCH_CHANNELS; ch++)
+    {
+      ref_interleave(&frame_ref[ch*BENCH_BYTES], ff[ch], BENCH_SAMPLES, BENCH_BYTES, BENCH_CHANNELS);
+    }
+  }
+  clock_t const ticks_ref = clock() - start;
+
+  start = clock();
+  for (uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+  {
+    for (uint8_t ch = 0; ch < BENCH_CHANNELS; ch++)
+    {
+      audiod_pcm_interleave(&frame[ch*BENCH_BYTES], ff[ch], BENCH_SAMPLES, BENCH_BYTES, BENCH_CHANNELS);
+    }
+  }
+  clock_t const ticks = clock() - start;
+
+  TEST_ASSERT_EQUAL_MEMORY(frame_ref, frame, sizeof(frame));
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "encode 8ch 24-bit: %.1f samples/us, byte-wise reference %.1f samples/us",
+           bench_rate(ticks), bench_rate(ticks_ref));
+  TEST_MESSAGE(msg);
+}
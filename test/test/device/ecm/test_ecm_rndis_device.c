@@ -0,0 +1,591 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+#include "rndis_protocol.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("ecm_rndis_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT  = 0x00,
+  EDPT_CTRL_IN   = 0x80,
+
+  EDPT_ECM_NOTIF = 0x81,
+  EDPT_ECM_OUT   = 0x02,
+  EDPT_ECM_IN    = 0x82,
+};
+
+uint8_t const rhport = 0;
+
+enum
+{
+  ITF_NUM_ECM,
+  ITF_NUM_ECM_DATA,
+  ITF_NUM_TOTAL
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_CDC_ECM_DESC_LEN)
+#define RNDIS_TOTAL_LEN     (TUD_CONFIG_DESC_LEN + TUD_RNDIS_DESC_LEN)
+
+uint8_t const data_desc_configuration[] =
+{
+  // Config number, interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+
+  // Interface number, description string index, MAC address string index, EP notification address and size, EP data address (out, in), and size, max segment size.
+  TUD_CDC_ECM_DESCRIPTOR(ITF_NUM_ECM, 0, 0, EDPT_ECM_NOTIF, 64, EDPT_ECM_OUT, EDPT_ECM_IN, CFG_TUD_NET_ENDPOINT_SIZE, CFG_TUD_NET_MTU),
+};
+
+uint8_t const rndis_desc_configuration[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, RNDIS_TOTAL_LEN, 0, 100),
+
+  // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
+  TUD_RNDIS_DESCRIPTOR(ITF_NUM_ECM, 0, EDPT_ECM_NOTIF, 8, EDPT_ECM_OUT, EDPT_ECM_IN, CFG_TUD_NET_ENDPOINT_SIZE),
+};
+
+uint8_t const* desc_configuration;
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+// activate data interface
+tusb_control_request_t const request_set_interface =
+{
+  .bmRequestType = 0x01,
+  .bRequest      = TUSB_REQ_SET_INTERFACE,
+  .wValue        = 1,
+  .wIndex        = ITF_NUM_ECM_DATA,
+  .wLength       = 0
+};
+
+const uint8_t tud_network_mac_address[6] = {0x02,0x02,0x84,0x6A,0x96,0x00};
+
+// IN transfers of data endpoint
+typedef struct
+{
+  uint8_t* buffer;
+  uint16_t len;
+} in_xfer_t;
+
+in_xfer_t in_xfer[8];
+uint8_t   in_xfer_count;
+void*     xmit_done_ref;
+
+// OUT transfers of data endpoint
+uint8_t*  out_buf;
+uint8_t   out_xfer_count;
+
+// data of control OUT transfer
+void const* ctrl_out_data;
+
+// first byte and size of received packets
+uint8_t   recv_first[8];
+uint16_t  recv_size[8];
+uint8_t   recv_count;
+
+// hold next received packet
+bool      recv_hold;
+uint8_t   recv_buf_id;
+
+void rndis_class_set_handler(uint8_t *data, int size)
+{
+  (void) data;
+  (void) size;
+}
+
+void tud_network_init_cb(void)
+{
+}
+
+bool tud_network_recv_cb(const uint8_t *src, uint16_t size)
+{
+  recv_first[recv_count] = src[0];
+  recv_size[recv_count] = size;
+  recv_count++;
+
+  if (recv_hold)
+  {
+    recv_hold = false;
+    recv_buf_id = tud_network_recv_hold();
+  }
+
+  return true;
+}
+
+// frame of arg bytes
+uint16_t tud_network_xmit_cb(uint8_t *dst, void *ref, uint16_t arg)
+{
+  (void) ref;
+  memset(dst, 0xCC, arg);
+  return arg;
+}
+
+void tud_network_xmit_done_cb(void *ref)
+{
+  xmit_done_ref = ref;
+}
+
+static bool stub_edpt_xfer(uint8_t port, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes, int num_calls)
+{
+  (void) port;
+  (void) num_calls;
+
+  switch (ep_addr)
+  {
+    case EDPT_CTRL_OUT:
+      memcpy(buffer, ctrl_out_data, total_bytes);
+    break;
+
+    case EDPT_ECM_OUT:
+      out_buf = buffer;
+      out_xfer_count++;
+    break;
+
+    case EDPT_ECM_IN:
+      in_xfer[in_xfer_count].buffer = buffer;
+      in_xfer[in_xfer_count].len    = total_bytes;
+      in_xfer_count++;
+    break;
+
+    default: break;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  (void) index;
+  return desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+  (void) index;
+  (void) langid;
+  return NULL;
+}
+
+void setUp(void)
+{
+  in_xfer_count = 0;
+  xmit_done_ref = NULL;
+  out_xfer_count = 0;
+  recv_count = 0;
+  recv_hold = false;
+  desc_configuration = data_desc_configuration;
+
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_reset(rhport, TUSB_SPEED_HIGH, false);
+  tud_task();
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+// data interface is activated: OUT is armed, IN transfers are recorded
+static void activate_data_interface(void)
+{
+  dcd_edpt_open_IgnoreAndReturn(true);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_interface, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_ECM_OUT, NULL, 0, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_IgnoreArg_total_bytes();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+}
+
+// Frame of 2 segments: packets are sent from segment memory, only the one straddling both is copied
+void test_ecm_xmit_sg(void)
+{
+  enum { PKT = CFG_TUD_NET_ENDPOINT_SIZE };
+  TEST_ASSERT_EQUAL(512, PKT);
+
+  TU_ATTR_ALIGNED(4) uint8_t seg0[PKT + 100];
+  TU_ATTR_ALIGNED(4) uint8_t seg1[800];
+  memset(seg0, 0xAA, sizeof(seg0));
+  memset(seg1, 0xBB, sizeof(seg1));
+
+  tud_network_segment_t const segs[2] =
+  {
+    { .buf = seg0, .len = sizeof(seg0) },
+    { .buf = seg1, .len = sizeof(seg1) },
+  };
+
+  activate_data_interface();
+
+  TEST_ASSERT_TRUE( tud_network_xmit_sg(segs, 2, (void*) segs) );
+  TEST_ASSERT_FALSE( tud_network_can_xmit(64) );
+
+  for(uint8_t i=0; i<3; i++)
+  {
+    dcd_event_xfer_complete(rhport, EDPT_ECM_IN, in_xfer[in_xfer_count-1].len, 0, true);
+    tud_task();
+  }
+
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+
+  // 1st packet directly from seg0
+  TEST_ASSERT_EQUAL_PTR(seg0, in_xfer[0].buffer);
+  TEST_ASSERT_EQUAL(PKT, in_xfer[0].len);
+
+  // tail of seg0 and head of seg1 are copied into one packet
+  TEST_ASSERT_EQUAL(PKT, in_xfer[1].len);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xAA, in_xfer[1].buffer, 100);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xBB, in_xfer[1].buffer + 100, PKT - 100);
+
+  // rest of seg1 directly ending with short packet
+  TEST_ASSERT_EQUAL_PTR(seg1 + PKT - 100, in_xfer[2].buffer);
+  TEST_ASSERT_EQUAL(sizeof(seg1) - (PKT - 100), in_xfer[2].len);
+
+  TEST_ASSERT_EQUAL_PTR(segs, xmit_done_ref);
+  TEST_ASSERT_TRUE( tud_network_can_xmit(64) );
+}
+
+// Unaligned segment is gathered up to the next packet boundary in one transfer instead of one per packet
+void test_ecm_xmit_sg_unaligned(void)
+{
+  enum { PKT = CFG_TUD_NET_ENDPOINT_SIZE };
+
+  TU_ATTR_ALIGNED(4) uint8_t seg0_mem[PKT + 100 + 4];
+  TU_ATTR_ALIGNED(4) uint8_t seg1[900];
+  uint8_t* seg0 = seg0_mem + 1;
+  memset(seg0, 0xAA, PKT + 100);
+  memset(seg1, 0xBB, sizeof(seg1));
+
+  tud_network_segment_t const segs[2] =
+  {
+    { .buf = seg0, .len = PKT + 100 },
+    { .buf = seg1, .len = sizeof(seg1) },
+  };
+
+  activate_data_interface();
+
+  TEST_ASSERT_TRUE( tud_network_xmit_sg(segs, 2, (void*) segs) );
+
+  // seg0 and head of seg1 up to the 2nd packet boundary are copied
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+  TEST_ASSERT_EQUAL(2*PKT, in_xfer[0].len);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xAA, in_xfer[0].buffer, PKT + 100);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xBB, in_xfer[0].buffer + PKT + 100, PKT - 100);
+
+  // rest of aligned seg1 directly ending with short packet
+  dcd_event_xfer_complete(rhport, EDPT_ECM_IN, in_xfer[0].len, 0, true);
+  tud_task();
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+  TEST_ASSERT_EQUAL_PTR(seg1 + PKT - 100, in_xfer[1].buffer);
+  TEST_ASSERT_EQUAL(sizeof(seg1) - (PKT - 100), in_xfer[1].len);
+
+  dcd_event_xfer_complete(rhport, EDPT_ECM_IN, in_xfer[1].len, 0, true);
+  tud_task();
+  TEST_ASSERT_EQUAL_PTR(segs, xmit_done_ref);
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+}
+
+// Host sends next frame while application is still processing the previous one,
+// frame transmitted while IN endpoint is busy is queued in the other buffer
+void test_ecm_double_buffer(void)
+{
+  dcd_edpt_open_IgnoreAndReturn(true);
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  tud_task();
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_interface, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, out_xfer_count);
+
+  // 1st frame: OUT is re-armed with the other buffer right away
+  uint8_t* buf1 = out_buf;
+  memset(buf1, 0x11, 100);
+  dcd_event_xfer_complete(rhport, EDPT_ECM_OUT, 100, 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x11, recv_first[0]);
+  TEST_ASSERT_EQUAL(100, recv_size[0]);
+  TEST_ASSERT_EQUAL(2, out_xfer_count);
+  TEST_ASSERT_NOT_EQUAL(buf1, out_buf);
+
+  // 2nd frame: both buffers are in use
+  memset(out_buf, 0x22, 80);
+  dcd_event_xfer_complete(rhport, EDPT_ECM_OUT, 80, 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, recv_count);
+  TEST_ASSERT_EQUAL(2, out_xfer_count);
+
+  // application is done with 1st frame: its buffer is re-armed, 2nd frame follows
+  tud_network_recv_renew();
+
+  TEST_ASSERT_EQUAL(2, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x22, recv_first[1]);
+  TEST_ASSERT_EQUAL(80, recv_size[1]);
+  TEST_ASSERT_EQUAL(3, out_xfer_count);
+  TEST_ASSERT_EQUAL_PTR(buf1, out_buf);
+
+  // 1st frame is sent right away, 2nd is queued
+  TEST_ASSERT_TRUE( tud_network_can_xmit(60) );
+  tud_network_xmit(NULL, 60);
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+
+  TEST_ASSERT_TRUE( tud_network_can_xmit(70) );
+  tud_network_xmit(NULL, 70);
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+  TEST_ASSERT_FALSE( tud_network_can_xmit(70) );
+
+  dcd_event_xfer_complete(rhport, EDPT_ECM_IN, 60, 0, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+  TEST_ASSERT_EQUAL(70, in_xfer[1].len);
+  TEST_ASSERT_NOT_EQUAL(in_xfer[0].buffer, in_xfer[1].buffer);
+
+  dcd_event_xfer_complete(rhport, EDPT_ECM_IN, 70, 0, true);
+  tud_task();
+
+  TEST_ASSERT_TRUE( tud_network_can_xmit(60) );
+}
+
+// Held frame keeps its buffer, the other one is used for reception meanwhile and can't be held
+void test_ecm_rx_hold(void)
+{
+  dcd_edpt_open_IgnoreAndReturn(true);
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  tud_task();
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_interface, false);
+  tud_task();
+
+  // 1st frame is held
+  uint8_t* buf1 = out_buf;
+  memset(buf1, 0x11, 100);
+  recv_hold = true;
+  dcd_event_xfer_complete(rhport, EDPT_ECM_OUT, 100, 0, false);
+  tud_task();
+
+  uint8_t const held_id = recv_buf_id;
+  TEST_ASSERT_NOT_EQUAL(TUD_NETWORK_RECV_HOLD_INVALID, held_id);
+  uint8_t* buf2 = out_buf;
+  TEST_ASSERT_NOT_EQUAL(buf1, buf2);
+  tud_network_recv_renew();
+
+  // 2nd frame is in the last free buffer: it can't be held
+  memset(buf2, 0x22, 80);
+  recv_hold = true;
+  dcd_event_xfer_complete(rhport, EDPT_ECM_OUT, 80, 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(2, recv_count);
+  TEST_ASSERT_EQUAL(TUD_NETWORK_RECV_HOLD_INVALID, recv_buf_id);
+  TEST_ASSERT_EQUAL(2, out_xfer_count);
+
+  // 2nd frame consumed: OUT is armed with its buffer, skipping the held one
+  tud_network_recv_renew();
+  TEST_ASSERT_EQUAL(3, out_xfer_count);
+  TEST_ASSERT_EQUAL_PTR(buf2, out_buf);
+
+  // 3rd frame is received while 1st is still held
+  memset(buf2, 0x33, 60);
+  dcd_event_xfer_complete(rhport, EDPT_ECM_OUT, 60, 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(3, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x33, recv_first[2]);
+  TEST_ASSERT_EQUAL(60, recv_size[2]);
+  tud_network_recv_renew();
+
+  // released: OUT is already armed
+  tud_network_recv_release(held_id);
+  TEST_ASSERT_EQUAL(4, out_xfer_count);
+  TEST_ASSERT_EQUAL_PTR(buf2, out_buf);
+}
+
+// RNDIS packet message of size bytes filled with value, return message length padded to 4 bytes
+static uint16_t build_rndis_msg(uint8_t* buf, uint16_t size, uint8_t value)
+{
+  rndis_data_packet_t* hdr = (rndis_data_packet_t*) buf;
+  uint16_t const len = (uint16_t) ((sizeof(rndis_data_packet_t) + size + 3) & ~3u);
+
+  memset(hdr, 0, sizeof(rndis_data_packet_t));
+  hdr->MessageType   = REMOTE_NDIS_PACKET_MSG;
+  hdr->MessageLength = len;
+  hdr->DataOffset    = sizeof(rndis_data_packet_t) - offsetof(rndis_data_packet_t, DataOffset);
+  hdr->DataLength    = size;
+  memset(buf + sizeof(rndis_data_packet_t), value, size);
+
+  return len;
+}
+
+// Several RNDIS packets are concatenated in one transfer in both directions
+void test_rndis_multi_packet(void)
+{
+  TEST_ASSERT_EQUAL(4, CFG_TUD_RNDIS_PACKETS_PER_XFER);
+
+  desc_configuration = rndis_desc_configuration;
+
+  dcd_edpt_open_IgnoreAndReturn(true);
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+
+  // RNDIS data endpoints are opened with configuration, OUT is armed
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, out_xfer_count);
+
+  // REMOTE_NDIS_INITIALIZE_MSG: host accepts 16 KB transfers
+  rndis_initialize_msg_t const init =
+  {
+    .MessageType     = REMOTE_NDIS_INITIALIZE_MSG,
+    .MessageLength   = sizeof(rndis_initialize_msg_t),
+    .RequestId       = 1,
+    .MajorVersion    = 1,
+    .MinorVersion    = 0,
+    .MaxTransferSize = 0x4000
+  };
+
+  tusb_control_request_t const request_send_encapsulated =
+  {
+    .bmRequestType = 0x21,
+    .bRequest      = 0 /* SEND_ENCAPSULATED_COMMAND */,
+    .wValue        = 0,
+    .wIndex        = ITF_NUM_ECM,
+    .wLength       = sizeof(rndis_initialize_msg_t)
+  };
+
+  ctrl_out_data = &init;
+  dcd_event_setup_received(rhport, (uint8_t*) &request_send_encapsulated, false);
+  tud_task();
+  dcd_event_xfer_complete(rhport, EDPT_CTRL_OUT, sizeof(rndis_initialize_msg_t), 0, false);
+  tud_task();
+
+  //------------- Receive -------------//
+  uint16_t xfer_len = build_rndis_msg(out_buf, 100, 0x11);
+  xfer_len += build_rndis_msg(out_buf + xfer_len, 61, 0x22);
+
+  dcd_event_xfer_complete(rhport, EDPT_ECM_OUT, xfer_len, 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x11, recv_first[0]);
+  TEST_ASSERT_EQUAL(100, recv_size[0]);
+
+  tud_network_recv_renew();
+  TEST_ASSERT_EQUAL(2, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x22, recv_first[1]);
+  TEST_ASSERT_EQUAL(61, recv_size[1]);
+
+  tud_network_recv_renew();
+  TEST_ASSERT_EQUAL(2, recv_count);
+
+  //------------- Transmit -------------//
+  uint16_t const msg_len = (uint16_t) (sizeof(rndis_data_packet_t) + 62);
+
+  // 1st packet is sent right away
+  tud_network_xmit(NULL, 62);
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+  TEST_ASSERT_EQUAL(msg_len, in_xfer[0].len);
+
+  // next ones are concatenated until transfer is full
+  for(uint8_t i=0; i<CFG_TUD_RNDIS_PACKETS_PER_XFER; i++)
+  {
+    TEST_ASSERT_TRUE( tud_network_can_xmit(62) );
+    tud_network_xmit(NULL, 62);
+  }
+
+  TEST_ASSERT_FALSE( tud_network_can_xmit(62) );
+
+  dcd_event_xfer_complete(rhport, EDPT_ECM_IN, msg_len, 0, true);
+  tud_task();
+
+  // messages are padded to 4 bytes except the last one
+  uint16_t const padded_len = (uint16_t) ((msg_len + 3) & ~3u);
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+  TEST_ASSERT_EQUAL((CFG_TUD_RNDIS_PACKETS_PER_XFER-1)*padded_len + msg_len, in_xfer[1].len);
+
+  for(uint8_t i=0; i<CFG_TUD_RNDIS_PACKETS_PER_XFER; i++)
+  {
+    rndis_data_packet_t const* hdr = (rndis_data_packet_t const*) (in_xfer[1].buffer + i*padded_len);
+    TEST_ASSERT_EQUAL_HEX32(REMOTE_NDIS_PACKET_MSG, hdr->MessageType);
+    TEST_ASSERT_EQUAL(i < CFG_TUD_RNDIS_PACKETS_PER_XFER-1 ? padded_len : msg_len, hdr->MessageLength);
+    TEST_ASSERT_EQUAL(62, hdr->DataLength);
+  }
+}
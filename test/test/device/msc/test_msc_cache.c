@@ -0,0 +1,391 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+#include "msc_cache.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("msc_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT = 0x00,
+  EDPT_CTRL_IN  = 0x80,
+
+  EDPT_MSC_OUT  = 0x01,
+  EDPT_MSC_IN   = 0x81,
+};
+
+uint8_t const rhport = 0;
+
+uint8_t const data_desc_configuration[] =
+{
+  // Config number, interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(1, 1, 0, TUD_CONFIG_DESC_LEN + TUD_MSC_DESC_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
+
+  // Interface number, string index, EP Out & EP In address, EP size
+  TUD_MSC_DESCRIPTOR(0, 0, EDPT_MSC_OUT, EDPT_MSC_IN, 512),
+};
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+enum
+{
+  DISK_BLOCK_NUM  = 64,
+  DISK_BLOCK_SIZE = 512,
+  LINE_BLOCKS     = CFG_TUD_MSC_CACHE_LINE_SIZE / DISK_BLOCK_SIZE
+};
+
+uint8_t msc_disk[DISK_BLOCK_NUM][DISK_BLOCK_SIZE];
+
+// storage access statistic, each write is an erase/program cycle on flash
+uint32_t read_count;
+uint32_t write_count;
+uint32_t write_bytes;
+uint32_t last_write_lba;
+
+// number of following WRITE callbacks reporting busy storage
+uint32_t write_busy;
+
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
+{
+  (void) lun;
+  (void) vendor_id;
+  (void) product_id;
+  (void) product_rev;
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun)
+{
+  (void) lun;
+  return true;
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size)
+{
+  (void) lun;
+
+  *block_count = DISK_BLOCK_NUM;
+  *block_size  = DISK_BLOCK_SIZE;
+}
+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+{
+  (void) lun;
+
+  read_count++;
+  memcpy(buffer, msc_disk[lba] + offset, bufsize);
+
+  return bufsize;
+}
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  (void) lun;
+
+  if ( write_busy )
+  {
+    write_busy--;
+    return TUD_MSC_RET_BUSY;
+  }
+
+  write_count++;
+  write_bytes += bufsize;
+  last_write_lba = lba;
+  memcpy(msc_disk[lba] + offset, buffer, bufsize);
+
+  return bufsize;
+}
+
+int32_t tud_msc_scsi_cb (uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, uint16_t bufsize)
+{
+  (void) lun;
+  (void) scsi_cmd;
+  (void) buffer;
+  (void) bufsize;
+
+  return -1;
+}
+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  (void) index;
+  return data_desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+  (void) index;
+  (void) langid;
+  return NULL;
+}
+
+void setUp(void)
+{
+  for(uint32_t i=0; i<DISK_BLOCK_NUM; i++) memset(msc_disk[i], (int) i, DISK_BLOCK_SIZE);
+
+  read_count     = 0;
+  write_count    = 0;
+  write_bytes    = 0;
+  last_write_lba = 0;
+  write_busy     = 0;
+
+  mscd_cache_init();
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+// Write block by block as host filesystem does, data is filled with value
+static void write_blocks(uint32_t lba, uint32_t count, uint8_t value)
+{
+  uint8_t buf[DISK_BLOCK_SIZE];
+  memset(buf, value, sizeof(buf));
+
+  for(uint32_t i=0; i<count; i++)
+  {
+    TEST_ASSERT_EQUAL(DISK_BLOCK_SIZE, mscd_cache_write(0, DISK_BLOCK_SIZE, lba+i, 0, buf, DISK_BLOCK_SIZE));
+  }
+}
+
+// 24 single block writes to 2 erase blocks become 2 line writes
+void test_cache_write_amplification(void)
+{
+  write_blocks(0, 2*LINE_BLOCKS, 0xAA);
+  write_blocks(0, LINE_BLOCKS  , 0xBB);
+
+  // everything is in cache
+  TEST_ASSERT_EQUAL(0, write_count);
+  TEST_ASSERT_EQUAL(0, read_count);
+
+  TEST_ASSERT_TRUE( tud_msc_cache_flush(0) );
+
+  TEST_ASSERT_EQUAL(2, write_count);
+  TEST_ASSERT_EQUAL(2*CFG_TUD_MSC_CACHE_LINE_SIZE, write_bytes);
+
+  // fully written lines do not need to be read
+  TEST_ASSERT_EQUAL(0, read_count);
+
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xBB, msc_disk[0]          , CFG_TUD_MSC_CACHE_LINE_SIZE);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xAA, msc_disk[LINE_BLOCKS], CFG_TUD_MSC_CACHE_LINE_SIZE);
+
+  // clean lines are not written again
+  TEST_ASSERT_TRUE( tud_msc_cache_flush(0) );
+  TEST_ASSERT_EQUAL(2, write_count);
+}
+
+// Misaligned write keeps the rest of block, READ is served from cache or storage
+void test_cache_partial_write_read_through(void)
+{
+  uint8_t buf[DISK_BLOCK_SIZE];
+  memset(buf, 0xCC, sizeof(buf));
+
+  // 100 bytes at offset 10 of lba 3: block is filled from storage first
+  TEST_ASSERT_EQUAL(100, mscd_cache_write(0, DISK_BLOCK_SIZE, 3, 10, buf, 100));
+  TEST_ASSERT_EQUAL(1, read_count);
+
+  // lba 2 to 4: lba 2 is read through storage, only up to cached lba 3
+  uint8_t rd[3*DISK_BLOCK_SIZE];
+  TEST_ASSERT_EQUAL(DISK_BLOCK_SIZE, mscd_cache_read(0, DISK_BLOCK_SIZE, 2, 0, rd, sizeof(rd)));
+  TEST_ASSERT_EQUAL(2, read_count);
+  TEST_ASSERT_EACH_EQUAL_HEX8(2, rd, DISK_BLOCK_SIZE);
+
+  // lba 3 from cache
+  TEST_ASSERT_EQUAL(DISK_BLOCK_SIZE, mscd_cache_read(0, DISK_BLOCK_SIZE, 3, 0, rd, sizeof(rd)));
+  TEST_ASSERT_EQUAL(2, read_count);
+  TEST_ASSERT_EACH_EQUAL_HEX8(3   , rd     , 10);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xCC, rd + 10, 100);
+  TEST_ASSERT_EACH_EQUAL_HEX8(3   , rd+110 , DISK_BLOCK_SIZE-110);
+
+  // storage is untouched
+  TEST_ASSERT_EQUAL(0, write_count);
+  TEST_ASSERT_EACH_EQUAL_HEX8(3, msc_disk[3], DISK_BLOCK_SIZE);
+
+  // write back fills up the rest of line then programs it at once
+  TEST_ASSERT_TRUE( tud_msc_cache_flush(0) );
+  TEST_ASSERT_EQUAL(1, write_count);
+  TEST_ASSERT_EQUAL(CFG_TUD_MSC_CACHE_LINE_SIZE, write_bytes);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xCC, msc_disk[3] + 10, 100);
+  TEST_ASSERT_EACH_EQUAL_HEX8(4, msc_disk[4], DISK_BLOCK_SIZE);
+}
+
+// Least recently used line is written back when a new line is needed
+void test_cache_lru_eviction(void)
+{
+  write_blocks(0*LINE_BLOCKS, 1, 0x11);
+  write_blocks(1*LINE_BLOCKS, 1, 0x22);
+
+  // touch line 0, line 1 becomes least recently used
+  write_blocks(0*LINE_BLOCKS + 1, 1, 0x11);
+  TEST_ASSERT_EQUAL(0, write_count);
+
+  write_blocks(2*LINE_BLOCKS, 1, 0x33);
+  TEST_ASSERT_EQUAL(1, write_count);
+  TEST_ASSERT_EQUAL(1*LINE_BLOCKS, last_write_lba);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0x22, msc_disk[LINE_BLOCKS], DISK_BLOCK_SIZE);
+}
+
+// Postponed idle write back fires again after another idle period
+void test_cache_idle_restart(void)
+{
+  write_blocks(0, 1, 0xAA);
+
+  uint32_t frame = 1;
+  for(uint32_t i=1; i<CFG_TUD_MSC_CACHE_IDLE_MS; i++)
+  {
+    TEST_ASSERT_FALSE( mscd_cache_sof_isr(frame++) );
+  }
+  TEST_ASSERT_TRUE( mscd_cache_sof_isr(frame++) );
+
+  // storage is busy: write back is postponed
+  mscd_cache_idle_restart();
+
+  for(uint32_t i=1; i<CFG_TUD_MSC_CACHE_IDLE_MS; i++)
+  {
+    TEST_ASSERT_FALSE( mscd_cache_sof_isr(frame++) );
+  }
+  TEST_ASSERT_TRUE( mscd_cache_sof_isr(frame++) );
+
+  TEST_ASSERT_TRUE( mscd_cache_idle_flush() );
+  TEST_ASSERT_EQUAL(1, write_count);
+  TEST_ASSERT_FALSE( mscd_cache_sof_isr(frame++) );
+}
+
+// Busy storage is not waited for, flush is retried later on
+void test_cache_flush_busy(void)
+{
+  write_blocks(0*LINE_BLOCKS, 1, 0x11);
+  write_blocks(1*LINE_BLOCKS, 1, 0x22);
+
+  write_busy = 1;
+  TEST_ASSERT_EQUAL(TUD_MSC_RET_BUSY, tud_msc_cache_flush(0));
+  TEST_ASSERT_EQUAL(0, write_count);
+
+  TEST_ASSERT_EQUAL(1, tud_msc_cache_flush(0));
+  TEST_ASSERT_EQUAL(2, write_count);
+
+  // clean lines are not written again
+  TEST_ASSERT_EQUAL(1, tud_msc_cache_flush(0));
+  TEST_ASSERT_EQUAL(2, write_count);
+}
+
+// SYNCHRONIZE CACHE with busy storage completes on a later SOF instead of blocking usbd task
+void test_cache_synchronize_busy(void)
+{
+  msc_cbw_t cbw =
+  {
+    .signature   = MSC_CBW_SIGNATURE,
+    .tag         = 0xCAFECAFE,
+    .total_bytes = 0,
+    .lun         = 0,
+    .dir         = 0,
+    .cmd_len     = 10
+  };
+  cbw.command[0] = SCSI_CMD_SYNCHRONIZE_CACHE_10;
+
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+  dcd_sof_enable_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_reset(rhport, TUSB_SPEED_HIGH, false);
+  tud_task();
+
+  write_blocks(0, 1, 0xAA);
+  write_busy = 2;
+
+  // configure device and receive command block
+  uint8_t const* desc_ep = tu_desc_next(tu_desc_next(data_desc_configuration));
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+
+  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) desc_ep, true);
+  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) tu_desc_next(desc_ep), true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer( (uint8_t*) &cbw, sizeof(msc_cbw_t));
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, sizeof(msc_cbw_t), 0, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  // storage is busy: no status yet
+  tud_task();
+  TEST_ASSERT_EQUAL(1, write_busy);
+  TEST_ASSERT_EQUAL(0, write_count);
+
+  // executed again on SOF, still busy
+  dcd_event_sof(rhport, 1, true);
+  tud_task();
+  TEST_ASSERT_EQUAL(0, write_busy);
+  TEST_ASSERT_EQUAL(0, write_count);
+
+  // storage is ready: line is written back and status is sent
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, sizeof(msc_csw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  dcd_event_sof(rhport, 2, true);
+  tud_task();
+  TEST_ASSERT_EQUAL(1, write_count);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xAA, msc_disk[0], DISK_BLOCK_SIZE);
+
+  // no more retry
+  dcd_event_sof(rhport, 3, true);
+  tud_task();
+}
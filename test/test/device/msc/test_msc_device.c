@@ -89,6 +89,19 @@ enum
 
 uint8_t msc_disk[DISK_BLOCK_NUM][DISK_BLOCK_SIZE];
 
+// READ10 callback returns TUD_MSC_RET_ASYNC instead of copying data
+bool read10_async;
+
+// READ10 callback completes the I/O before returning TUD_MSC_RET_ASYNC e.g DMA finished early
+bool read10_async_early;
+
+// block count reported by 64-bit capacity callback
+uint64_t disk_block_count64;
+
+// last range deallocated by UNMAP
+uint64_t unmap_lba;
+uint32_t unmap_count;
+
 // Invoked when received SCSI_CMD_INQUIRY
 // Application fill vendor id, product id and revision with string up to 8, 16, 4 characters respectively
 void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
@@ -123,6 +136,15 @@ void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_siz
   *block_size  = DISK_BLOCK_SIZE;
 }
 
+// Invoked for all capacity commands instead of tud_msc_capacity_cb()
+void tud_msc_capacity16_cb(uint8_t lun, uint64_t* block_count, uint32_t* block_size)
+{
+  (void) lun;
+
+  *block_count = disk_block_count64;
+  *block_size  = DISK_BLOCK_SIZE;
+}
+
 // Invoked when received Start Stop Unit command
 // - Start = 0 : stopped power mode, if load_eject = 1 : unload disk storage
 // - Start = 1 : active mode, if load_eject = 1 : load disk storage
@@ -140,9 +162,17 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buff
 {
   (void) lun;
 
+  if (read10_async) return TUD_MSC_RET_ASYNC;
+
   uint8_t const* addr = msc_disk[lba] + offset;
   memcpy(buffer, addr, bufsize);
 
+  if (read10_async_early)
+  {
+    TEST_ASSERT_TRUE( tud_msc_async_io_done(lun, (int32_t) bufsize, true) );
+    return TUD_MSC_RET_ASYNC;
+  }
+
   return bufsize;
 }
 
@@ -171,6 +201,16 @@ int32_t tud_msc_scsi_cb (uint8_t lun, uint8_t const scsi_cmd[16], void* buffer,
   return resplen;
 }
 
+bool tud_msc_unmap_cb(uint8_t lun, uint64_t lba, uint32_t block_count)
+{
+  (void) lun;
+
+  unmap_lba    = lba;
+  unmap_count += block_count;
+
+  return true;
+}
+
 //--------------------------------------------------------------------+
 //
 //--------------------------------------------------------------------+
@@ -193,6 +233,12 @@ uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
 
 void setUp(void)
 {
+  read10_async = false;
+  read10_async_early = false;
+  disk_block_count64 = DISK_BLOCK_NUM;
+  unmap_lba    = 0;
+  unmap_count  = 0;
+
   dcd_int_disable_Ignore();
   dcd_int_enable_Ignore();
 
@@ -213,6 +259,30 @@ void tearDown(void)
 //--------------------------------------------------------------------+
 //
 //--------------------------------------------------------------------+
+// Configure device and receive a command block
+static void receive_cbw(msc_cbw_t const* cbw)
+{
+  desc_configuration = data_desc_configuration;
+  uint8_t const* desc_ep = tu_desc_next(tu_desc_next(desc_configuration));
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+
+  // open endpoints
+  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) desc_ep, true);
+  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) tu_desc_next(desc_ep), true);
+
+  // Prepare SCSI command
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer( (uint8_t*) cbw, sizeof(msc_cbw_t));
+
+  // command received
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, sizeof(msc_cbw_t), 0, true);
+
+  // control status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+}
+
 void test_msc(void)
 {
   // Read 1 LBA = 0, Block count = 1
@@ -235,29 +305,155 @@ void test_msc(void)
 
   memcpy(cbw_read10.command, &cmd_read10, cbw_read10.cmd_len);
 
-  desc_configuration = data_desc_configuration;
-  uint8_t const* desc_ep = tu_desc_next(tu_desc_next(desc_configuration));
+  receive_cbw(&cbw_read10);
 
-  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  // SCSI Data transfer
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 512, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 512, 0, true); // complete
 
-  // open endpoints
-  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) desc_ep, true);
-  dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) tu_desc_next(desc_ep), true);
+  // SCSI Status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 13, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, 0, true);
 
-  // Prepare SCSI command
+  // Prepare for next command
   dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
   dcd_edpt_xfer_IgnoreArg_buffer();
-  dcd_edpt_xfer_ReturnMemThruPtr_buffer( (uint8_t*) &cbw_read10, sizeof(msc_cbw_t));
 
-  // command received
-  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, sizeof(msc_cbw_t), 0, true);
+  tud_task();
+}
 
-  // control status
-  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+void test_msc_read10_async(void)
+{
+  read10_async = true;
+
+  // Read 1 LBA = 0, Block count = 1
+  msc_cbw_t cbw_read10 =
+  {
+    .signature = MSC_CBW_SIGNATURE,
+    .tag = 0xCAFECAFE,
+    .total_bytes = 512,
+    .lun = 0,
+    .dir = TUSB_DIR_IN_MASK,
+    .cmd_len = sizeof(scsi_read10_t)
+  };
+
+  scsi_read10_t cmd_read10 =
+  {
+      .cmd_code    = SCSI_CMD_READ_10,
+      .lba         = tu_htonl(0),
+      .block_count = tu_htons(1)
+  };
+
+  memcpy(cbw_read10.command, &cmd_read10, cbw_read10.cmd_len);
+
+  receive_cbw(&cbw_read10);
+
+  // READ10 callback is pending: no data transfer and no polling event queued
+  tud_task();
+
+  // application completes the I/O e.g from DMA interrupt
+  TEST_ASSERT_TRUE( tud_msc_async_io_done(0, 512, true) );
 
   // SCSI Data transfer
   dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 512, true);
   dcd_edpt_xfer_IgnoreArg_buffer();
+  tud_task();
+
+  // no more pending I/O
+  TEST_ASSERT_FALSE( tud_msc_async_io_done(0, 512, true) );
+
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 512, 0, true); // complete
+
+  // SCSI Status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 13, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, 0, true);
+
+  // Prepare for next command
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+}
+
+// tud_msc_async_io_done() invoked before READ10 callback returns must not be lost
+void test_msc_read10_async_done_early(void)
+{
+  read10_async_early = true;
+
+  // Read 1 LBA = 0, Block count = 1
+  msc_cbw_t cbw_read10 =
+  {
+    .signature = MSC_CBW_SIGNATURE,
+    .tag = 0xCAFECAFE,
+    .total_bytes = 512,
+    .lun = 0,
+    .dir = TUSB_DIR_IN_MASK,
+    .cmd_len = sizeof(scsi_read10_t)
+  };
+
+  scsi_read10_t cmd_read10 =
+  {
+      .cmd_code    = SCSI_CMD_READ_10,
+      .lba         = tu_htonl(0),
+      .block_count = tu_htons(1)
+  };
+
+  memcpy(cbw_read10.command, &cmd_read10, cbw_read10.cmd_len);
+
+  receive_cbw(&cbw_read10);
+
+  // SCSI Data transfer once the deferred completion is processed
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 512, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  tud_task();
+
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 512, 0, true); // complete
+
+  // SCSI Status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 13, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, 0, true);
+
+  // Prepare for next command
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+}
+
+void test_msc_read16(void)
+{
+  // Read 1 LBA = 1, Block count = 1
+  msc_cbw_t cbw_read16 =
+  {
+    .signature = MSC_CBW_SIGNATURE,
+    .tag = 0xCAFECAFE,
+    .total_bytes = 512,
+    .lun = 0,
+    .dir = TUSB_DIR_IN_MASK,
+    .cmd_len = sizeof(scsi_read16_t)
+  };
+
+  scsi_read16_t cmd_read16 =
+  {
+      .cmd_code    = SCSI_CMD_READ_16,
+      .block_count = tu_htonl(1)
+  };
+
+  // 64-bit lba in Big Endian
+  uint8_t const lba_be[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+  memcpy(&cmd_read16.lba, lba_be, sizeof(lba_be));
+
+  memcpy(cbw_read16.command, &cmd_read16, cbw_read16.cmd_len);
+
+  receive_cbw(&cbw_read16);
+
+  // SCSI Data transfer: forwarded to READ10 callback since lba fits 32-bit
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 512, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
   dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 512, 0, true); // complete
 
   // SCSI Status
@@ -271,3 +467,188 @@ void test_msc(void)
 
   tud_task();
 }
+
+void test_msc_unmap(void)
+{
+  // Parameter list with 1 block descriptor: LBA = 4, Block count = 8
+  uint8_t param[sizeof(scsi_unmap_param_header_t) + sizeof(scsi_unmap_block_desc_t)] =
+  {
+    0, 22, 0, 16, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 4,  0, 0, 0, 8,  0, 0, 0, 0
+  };
+
+  msc_cbw_t cbw_unmap =
+  {
+    .signature = MSC_CBW_SIGNATURE,
+    .tag = 0xCAFECAFE,
+    .total_bytes = sizeof(param),
+    .lun = 0,
+    .dir = 0,
+    .cmd_len = sizeof(scsi_unmap_t)
+  };
+
+  scsi_unmap_t cmd_unmap =
+  {
+      .cmd_code          = SCSI_CMD_UNMAP,
+      .param_list_length = tu_htons(sizeof(param))
+  };
+
+  memcpy(cbw_unmap.command, &cmd_unmap, cbw_unmap.cmd_len);
+
+  receive_cbw(&cbw_unmap);
+
+  // SCSI Data-Out: parameter list
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(param), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(param, sizeof(param));
+  dcd_event_xfer_complete(rhport, EDPT_MSC_OUT, sizeof(param), 0, true);
+
+  // SCSI Status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 13, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, 0, true);
+
+  // Prepare for next command
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+
+  TEST_ASSERT_EQUAL(4, unmap_lba);
+  TEST_ASSERT_EQUAL(8, unmap_count);
+}
+
+// Block Limits VPD page: UNMAP limits, no limit for WRITE SAME since only its UNMAP variant is supported
+void test_msc_inquiry_vpd_block_limits(void)
+{
+  msc_cbw_t cbw =
+  {
+    .signature = MSC_CBW_SIGNATURE,
+    .tag = 0xCAFECAFE,
+    .total_bytes = sizeof(scsi_vpd_block_limits_t),
+    .lun = 0,
+    .dir = TUSB_DIR_IN_MASK,
+    .cmd_len = sizeof(scsi_inquiry_t)
+  };
+
+  // EVPD, page 0xB0, allocation length 64
+  uint8_t const cmd[] = { SCSI_CMD_INQUIRY, 0x01, SCSI_VPD_PAGE_BLOCK_LIMITS, 0, sizeof(scsi_vpd_block_limits_t), 0 };
+  memcpy(cbw.command, cmd, sizeof(cmd));
+
+  uint32_t const max_desc = (CFG_TUD_MSC_EP_BUFSIZE - sizeof(scsi_unmap_param_header_t)) / sizeof(scsi_unmap_block_desc_t);
+  uint8_t resp[sizeof(scsi_vpd_block_limits_t)];
+  memset(resp, 0, sizeof(resp));
+  resp[1] = SCSI_VPD_PAGE_BLOCK_LIMITS;
+  resp[3] = sizeof(resp) - 4;
+  resp[4] = 1;                          // WSNZ
+  memset(resp + 20, 0xFF, 4);           // max unmap lba count
+  tu_unaligned_write32(resp + 24, tu_htonl(max_desc));
+
+  receive_cbw(&cbw);
+
+  // SCSI Data: max write same length (offset 36) is zero
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_MSC_IN, resp, sizeof(resp), sizeof(resp), true);
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, sizeof(resp), 0, true);
+
+  // SCSI Status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 13, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, 0, true);
+
+  // Prepare for next command
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+}
+
+// Disk larger than 2TiB reports its 64-bit last LBA
+void test_msc_read_capacity16(void)
+{
+  disk_block_count64 = 0x100000010ull;
+
+  msc_cbw_t cbw =
+  {
+    .signature = MSC_CBW_SIGNATURE,
+    .tag = 0xCAFECAFE,
+    .total_bytes = sizeof(scsi_read_capacity16_resp_t),
+    .lun = 0,
+    .dir = TUSB_DIR_IN_MASK,
+    .cmd_len = sizeof(scsi_read_capacity16_t)
+  };
+
+  scsi_read_capacity16_t cmd =
+  {
+      .cmd_code       = SCSI_CMD_SERVICE_ACTION_IN_16,
+      .service_action = SCSI_SERVICE_ACTION_READ_CAPACITY_16,
+      .alloc_length   = tu_htonl(sizeof(scsi_read_capacity16_resp_t))
+  };
+  memcpy(cbw.command, &cmd, cbw.cmd_len);
+
+  // last lba 0x10000000F, block size 512, LBPME since UNMAP is supported
+  uint8_t resp[sizeof(scsi_read_capacity16_resp_t)] =
+  {
+    0, 0, 0, 1, 0, 0, 0, 0x0F,  0, 0, 2, 0,  0, 0, 0x80, 0
+  };
+
+  receive_cbw(&cbw);
+
+  // SCSI Data
+  dcd_edpt_xfer_ExpectWithArrayAndReturn(rhport, EDPT_MSC_IN, resp, sizeof(resp), sizeof(resp), true);
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, sizeof(resp), 0, true);
+
+  // SCSI Status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_IN, NULL, 13, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_MSC_IN, 13, 0, true);
+
+  // Prepare for next command
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_MSC_OUT, NULL, sizeof(msc_cbw_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+}
+
+// READ16 beyond 32-bit lba without tud_msc_read16_cb() fails instead of reading a truncated lba
+void test_msc_read16_lba_above_2tib(void)
+{
+  msc_cbw_t cbw =
+  {
+    .signature = MSC_CBW_SIGNATURE,
+    .tag = 0xCAFECAFE,
+    .total_bytes = 2*512,
+    .lun = 0,
+    .dir = TUSB_DIR_IN_MASK,
+    .cmd_len = sizeof(scsi_read16_t)
+  };
+
+  scsi_read16_t cmd =
+  {
+      .cmd_code    = SCSI_CMD_READ_16,
+      .block_count = tu_htonl(2)
+  };
+
+  // lba + block count wraps around 64-bit
+  uint8_t const lba_be[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+  memcpy(&cmd.lba, lba_be, sizeof(lba_be));
+  memcpy(cbw.command, &cmd, cbw.cmd_len);
+
+  receive_cbw(&cbw);
+
+  // Data stage is stalled, status is sent after host clears the stall
+  dcd_edpt_stall_Expect(rhport, EDPT_MSC_IN);
+
+  tud_task();
+
+  TEST_ASSERT_TRUE( mscd_scsi_has_sense(0) );
+
+  // last block of 32-bit lba range is still accessible, zero blocks at lba 0 is valid
+  uint8_t cmd16[16] = { SCSI_CMD_READ_16, 0, 0, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 1, 0, 0 };
+  TEST_ASSERT_TRUE( mscd_scsi_rdwr_lba_supported(cmd16) );
+  cmd16[13] = 2;
+  TEST_ASSERT_FALSE( mscd_scsi_rdwr_lba_supported(cmd16) );
+  memset(cmd16 + 2, 0, 12);
+  TEST_ASSERT_TRUE( mscd_scsi_rdwr_lba_supported(cmd16) );
+  cmd16[5] = 1; // lba 2^32: above 2TiB with 512-byte blocks
+  TEST_ASSERT_FALSE( mscd_scsi_rdwr_lba_supported(cmd16) );
+}
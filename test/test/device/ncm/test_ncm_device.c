@@ -0,0 +1,782 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("ncm_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT  = 0x00,
+  EDPT_CTRL_IN   = 0x80,
+
+  EDPT_NCM_NOTIF = 0x81,
+  EDPT_NCM_OUT   = 0x02,
+  EDPT_NCM_IN    = 0x82,
+};
+
+uint8_t const rhport = 0;
+
+enum
+{
+  ITF_NUM_NCM,
+  ITF_NUM_NCM_DATA,
+  ITF_NUM_TOTAL
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_CDC_NCM_DESC_LEN)
+
+uint8_t const data_desc_configuration[] =
+{
+  // Config number, interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+
+  // Interface number, description string index, MAC address string index, EP notification address and size, EP data address (out, in), and size, max segment size.
+  TUD_CDC_NCM_DESCRIPTOR(ITF_NUM_NCM, 0, 0, EDPT_NCM_NOTIF, 64, EDPT_NCM_OUT, EDPT_NCM_IN, 512, CFG_TUD_NET_MTU),
+};
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+// activate data interface
+tusb_control_request_t const request_set_interface =
+{
+  .bmRequestType = 0x01,
+  .bRequest      = TUSB_REQ_SET_INTERFACE,
+  .wValue        = 1,
+  .wIndex        = ITF_NUM_NCM_DATA,
+  .wLength       = 0
+};
+
+// first byte of datagrams in received order
+uint8_t recv_datagram[8];
+uint8_t recv_count;
+
+// hold next received datagram
+bool    recv_hold;
+uint8_t recv_buf_id;
+
+bool tud_network_recv_cb(const uint8_t *src, uint16_t size)
+{
+  TEST_ASSERT_EQUAL(64, size);
+  if (recv_count < sizeof(recv_datagram)) recv_datagram[recv_count] = src[0];
+  recv_count++;
+
+  if (recv_hold)
+  {
+    recv_hold = false;
+    recv_buf_id = tud_network_recv_hold();
+  }
+
+  return true;
+}
+
+// frame of xmit_len bytes is filled with arg as value
+uint16_t xmit_len;
+
+uint16_t tud_network_xmit_cb(uint8_t *dst, void *ref, uint16_t arg)
+{
+  (void) ref;
+  memset(dst, arg, xmit_len);
+  return xmit_len;
+}
+
+void* xmit_done_ref;
+
+void tud_network_xmit_done_cb(void *ref)
+{
+  xmit_done_ref = ref;
+}
+
+// IN transfers of data endpoint
+uint8_t* in_xfer_buf[32];
+uint16_t in_xfer_len[32];
+uint8_t  in_xfer_count;
+uint8_t  in_done_count;
+
+// simulated bus: armed OUT transfer completes SIM_XFER_ITER task iterations later
+#define SIM_XFER_ITER   2
+uint8_t* out_xfer_buf;
+uint16_t out_xfer_due;
+uint16_t sim_iter;
+
+static bool stub_edpt_xfer(uint8_t port, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes, int num_calls)
+{
+  (void) port;
+  (void) num_calls;
+
+  if (ep_addr == EDPT_NCM_IN)
+  {
+    in_xfer_buf[in_xfer_count] = buffer;
+    in_xfer_len[in_xfer_count] = total_bytes;
+    in_xfer_count++;
+  }
+
+  if (ep_addr == EDPT_NCM_OUT)
+  {
+    out_xfer_buf = buffer;
+    out_xfer_due = (uint16_t) (sim_iter + SIM_XFER_ITER);
+  }
+
+  return true;
+}
+
+static void complete_in_xfer(void)
+{
+  dcd_event_xfer_complete(rhport, EDPT_NCM_IN, in_xfer_len[in_done_count], 0, false);
+  in_done_count++;
+  tud_task();
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  (void) index;
+  return data_desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+  (void) index;
+  (void) langid;
+  return NULL;
+}
+
+void setUp(void)
+{
+  recv_count = 0;
+  recv_hold = false;
+  xmit_len = 64;
+  in_xfer_count = 0;
+  in_done_count = 0;
+  out_xfer_buf = NULL;
+  sim_iter = 0;
+  xmit_done_ref = NULL;
+
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+  dcd_sof_enable_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_reset(rhport, TUSB_SPEED_HIGH, false);
+  tud_task();
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+// NTB16 with datagrams of 64 bytes filled with value, value+1 ...
+static uint16_t build_ntb(uint8_t* ntb, uint8_t count, uint8_t value)
+{
+  uint16_t const offset = 64;
+  uint16_t const len = (uint16_t) (offset + count*64);
+
+  memset(ntb, 0, len);
+
+  // NTH16
+  tu_unaligned_write32(ntb + 0, 0x484D434E);
+  tu_unaligned_write16(ntb + 4, 12);
+  tu_unaligned_write16(ntb + 8, len);
+  tu_unaligned_write16(ntb + 10, 12);
+
+  // NDP16 with zero terminator
+  tu_unaligned_write32(ntb + 12, 0x304D434E);
+  tu_unaligned_write16(ntb + 16, (uint16_t) (8 + (count+1)*4));
+
+  for(uint8_t i=0; i<count; i++)
+  {
+    tu_unaligned_write16(ntb + 20 + 4*i, (uint16_t) (offset + i*64));
+    tu_unaligned_write16(ntb + 22 + 4*i, 64);
+    memset(ntb + offset + i*64, value + i, 64);
+  }
+
+  return len;
+}
+
+// NTB32 with datagrams of 64 bytes filled with value, value+1 ...
+static uint16_t build_ntb32(uint8_t* ntb, uint8_t count, uint8_t value)
+{
+  uint16_t const offset = 128;
+  uint16_t const len = (uint16_t) (offset + count*64);
+
+  memset(ntb, 0, len);
+
+  // NTH32
+  tu_unaligned_write32(ntb + 0, 0x686D636E);
+  tu_unaligned_write16(ntb + 4, 16);
+  tu_unaligned_write32(ntb + 8, len);
+  tu_unaligned_write32(ntb + 12, 16);
+
+  // NDP32 with zero terminator
+  tu_unaligned_write32(ntb + 16, 0x306D636E);
+  tu_unaligned_write16(ntb + 20, (uint16_t) (16 + (count+1)*8));
+
+  for(uint8_t i=0; i<count; i++)
+  {
+    tu_unaligned_write32(ntb + 32 + 8*i, (uint32_t) (offset + i*64));
+    tu_unaligned_write32(ntb + 36 + 8*i, 64);
+    memset(ntb + offset + i*64, value + i, 64);
+  }
+
+  return len;
+}
+
+static void activate_data_interface(void)
+{
+  dcd_edpt_open_IgnoreAndReturn(true);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_interface, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_NOTIF, NULL, 16, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+}
+
+// Host sends next NTB while application is still consuming datagrams of previous one
+void test_ncm_rx_ring(void)
+{
+  uint8_t ntb1[256], ntb2[256];
+  uint16_t const ntb1_len = build_ntb(ntb1, 2, 0x10);
+  uint16_t const ntb2_len = build_ntb(ntb2, 1, 0x20);
+
+  dcd_edpt_open_IgnoreAndReturn(true);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  // data interface is activated: OUT is armed with 1st NTB, then connection notification
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_interface, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(ntb1, ntb1_len);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_NOTIF, NULL, 16, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+
+  // 1st NTB received: OUT is re-armed right away before its datagrams are consumed
+  dcd_event_xfer_complete(rhport, EDPT_NCM_OUT, ntb1_len, 0, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(ntb2, ntb2_len);
+
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x10, recv_datagram[0]);
+
+  // 2nd NTB received while 1st is still consumed: ring is full, no more transfer
+  dcd_event_xfer_complete(rhport, EDPT_NCM_OUT, ntb2_len, 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, recv_count);
+
+  // application is done with 1st datagram
+  tud_network_recv_renew();
+  TEST_ASSERT_EQUAL(2, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x11, recv_datagram[1]);
+
+  // 1st NTB is released and re-armed, datagram of 2nd NTB follows
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_network_recv_renew();
+  TEST_ASSERT_EQUAL(3, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x20, recv_datagram[2]);
+
+  // nothing left, OUT is already armed
+  tud_network_recv_renew();
+  TEST_ASSERT_EQUAL(3, recv_count);
+}
+
+// Host streams NTBs of 2 datagrams while application consumes one datagram per task iteration.
+// Return number of NTBs received within iterations.
+static uint16_t simulate_rx(uint16_t iterations)
+{
+  uint8_t ntb[256];
+  uint16_t const ntb_len = build_ntb(ntb, 2, 0x10);
+  uint16_t ntb_count = 0;
+
+  dcd_edpt_open_IgnoreAndReturn(true);
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  tud_task();
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_interface, false);
+  tud_task();
+
+  for (sim_iter = 0; sim_iter < iterations; sim_iter++)
+  {
+    if (out_xfer_buf && sim_iter >= out_xfer_due)
+    {
+      memcpy(out_xfer_buf, ntb, ntb_len);
+      out_xfer_buf = NULL;
+      dcd_event_xfer_complete(rhport, EDPT_NCM_OUT, ntb_len, 0, false);
+      ntb_count++;
+    }
+
+    tud_task();
+
+    // application is done with one datagram
+    tud_network_recv_renew();
+  }
+
+  return ntb_count;
+}
+
+// With a ring of 2 NTBs the next transfer runs while datagrams are consumed: one NTB (128 bytes of datagrams)
+// every 2 iterations, the application is the bottleneck. A single NTB (see test_ncm_rx_single.c) only gets
+// 13 NTBs in 40 iterations since the bus idles until the application released it.
+void test_ncm_rx_throughput(void)
+{
+  TEST_ASSERT_EQUAL(2, CFG_TUD_NCM_OUT_NTB_N);
+
+  uint16_t const ntb_count = simulate_rx(40);
+  // first transfer completes after SIM_XFER_ITER iterations
+  TEST_ASSERT_EQUAL(19, ntb_count);
+  TEST_ASSERT_EQUAL(2*19, recv_count);
+}
+
+// Held NTB is not received into until application releases it, other NTB of the ring is used meanwhile.
+// Last free NTB can't be held so that reception goes on while a datagram is kept.
+void test_ncm_rx_hold(void)
+{
+  uint8_t ntb1[256], ntb2[256], ntb3[256];
+  uint16_t const ntb1_len = build_ntb(ntb1, 1, 0x10);
+  uint16_t const ntb2_len = build_ntb(ntb2, 1, 0x20);
+  uint16_t const ntb3_len = build_ntb(ntb3, 1, 0x30);
+
+  dcd_edpt_open_IgnoreAndReturn(true);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_interface, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(ntb1, ntb1_len);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_NOTIF, NULL, 16, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+
+  // datagram of 1st NTB is held by application
+  recv_hold = true;
+  dcd_event_xfer_complete(rhport, EDPT_NCM_OUT, ntb1_len, 0, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(ntb2, ntb2_len);
+
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, recv_count);
+  TEST_ASSERT_NOT_EQUAL(TUD_NETWORK_RECV_HOLD_INVALID, recv_buf_id);
+  tud_network_recv_renew();
+
+  // 2nd NTB received: 1st NTB is still held, OUT is not armed. 2nd NTB is the last free one, it can't be held
+  uint8_t const held_id = recv_buf_id;
+  recv_hold = true;
+  dcd_event_xfer_complete(rhport, EDPT_NCM_OUT, ntb2_len, 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(2, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x20, recv_datagram[1]);
+  TEST_ASSERT_EQUAL(TUD_NETWORK_RECV_HOLD_INVALID, recv_buf_id);
+
+  // 2nd NTB is consumed: OUT is armed with it, skipping the held one
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(ntb3, ntb3_len);
+
+  tud_network_recv_renew();
+
+  // 3rd NTB is received while 1st is still held
+  dcd_event_xfer_complete(rhport, EDPT_NCM_OUT, ntb3_len, 0, false);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(3, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x30, recv_datagram[2]);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_network_recv_renew();
+
+  // released: OUT is already armed
+  tud_network_recv_release(held_id);
+  TEST_ASSERT_EQUAL(3, recv_count);
+}
+
+// 64-byte frames are aggregated until NTB is full by count or held open long enough
+void test_ncm_tx_aggregation(void)
+{
+  // NTH16 + NDP16 with terminator entry
+  uint16_t const header_len = 12 + 8 + (CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB+1)*4;
+  uint8_t xfer_count = 0;
+
+  activate_data_interface();
+
+  // full by count: 8 datagrams in a single transfer
+  for(uint8_t i=0; i<CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB; i++)
+  {
+    TEST_ASSERT_TRUE( tud_network_can_xmit(64) );
+
+    if ( i == CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB-1 )
+    {
+      dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_IN, NULL, header_len + CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB*64, true);
+      dcd_edpt_xfer_IgnoreArg_buffer();
+      xfer_count++;
+    }
+
+    tud_network_xmit(NULL, i);
+  }
+
+  // 3 more while 1st NTB is being sent
+  for(uint8_t i=0; i<3; i++)
+  {
+    TEST_ASSERT_TRUE( tud_network_can_xmit(64) );
+    tud_network_xmit(NULL, i);
+  }
+
+  // aggregation timeout closes 2nd NTB, sent after the 1st one
+  dcd_event_sof(rhport, 1, true);
+  dcd_event_sof(rhport, 2, true);
+  tud_task();
+
+  dcd_event_xfer_complete(rhport, EDPT_NCM_IN, header_len + CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB*64, 0, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_IN, NULL, header_len + 3*64, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  xfer_count++;
+
+  tud_task();
+
+  // 11 frames in 2 transfers instead of 11
+  TEST_ASSERT_EQUAL(2, xfer_count);
+}
+
+// Host selects NTB32 and input size before activating data interface
+void test_ncm_ntb32(void)
+{
+  uint8_t ntb[256];
+  uint16_t const ntb_len = build_ntb32(ntb, 2, 0x30);
+  uint32_t const in_size = 4096;
+
+  tusb_control_request_t const request_set_ntb_format =
+  {
+    .bmRequestType = 0x21,
+    .bRequest      = NCM_SET_NTB_FORMAT,
+    .wValue        = NCM_NTB_FORMAT_32,
+    .wIndex        = ITF_NUM_NCM,
+    .wLength       = 0
+  };
+
+  tusb_control_request_t const request_set_ntb_input_size =
+  {
+    .bmRequestType = 0x21,
+    .bRequest      = NCM_SET_NTB_INPUT_SIZE,
+    .wValue        = 0,
+    .wIndex        = ITF_NUM_NCM,
+    .wLength       = 4
+  };
+
+  dcd_edpt_open_IgnoreAndReturn(true);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_ntb_format, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_ntb_input_size, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_OUT, NULL, 4, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer((uint8_t*) &in_size, 4);
+  tud_task();
+
+  dcd_event_xfer_complete(rhport, EDPT_CTRL_OUT, 4, 0, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  // data interface is activated
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_interface, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(ntb, ntb_len);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_NOTIF, NULL, 16, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+
+  //------------- Receive -------------//
+  dcd_event_xfer_complete(rhport, EDPT_NCM_OUT, ntb_len, 0, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+  tud_network_recv_renew();
+
+  TEST_ASSERT_EQUAL(2, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x30, recv_datagram[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x31, recv_datagram[1]);
+
+  //------------- Transmit -------------//
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+
+  // 2 full frames fit into 4096 bytes NTB set by host
+  xmit_len = CFG_TUD_NET_MTU;
+  tud_network_xmit(NULL, 1);
+  TEST_ASSERT_EQUAL(0, in_xfer_count);
+  tud_network_xmit(NULL, 2);
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+
+  // NTH32 + NDP32 with terminator entry
+  uint16_t const header_len = 16 + 16 + (CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB+1)*8;
+  uint16_t const datagram_len = (CFG_TUD_NET_MTU + 3) & ~3u;
+  uint8_t const* buf = in_xfer_buf[0];
+
+  TEST_ASSERT_EQUAL(header_len + 2*datagram_len, in_xfer_len[0]);
+  TEST_ASSERT_EQUAL_HEX32(0x686D636E, tu_unaligned_read32(buf));
+  TEST_ASSERT_EQUAL(in_xfer_len[0], tu_unaligned_read32(buf + 8));
+  TEST_ASSERT_EQUAL_HEX32(0x306D636E, tu_unaligned_read32(buf + 16));
+  TEST_ASSERT_EQUAL(header_len, tu_unaligned_read32(buf + 32));
+  TEST_ASSERT_EQUAL(CFG_TUD_NET_MTU, tu_unaligned_read32(buf + 36));
+  TEST_ASSERT_EQUAL(header_len + datagram_len, tu_unaligned_read32(buf + 40));
+  TEST_ASSERT_EQUAL_HEX8(2, buf[header_len + datagram_len]);
+}
+
+// Full MTU frames need fewer transfers with larger NTBs
+void test_ncm_ntb_in_size(void)
+{
+  uint32_t const ntb_size[]  = { 2048, 4096, 8192 };
+  uint8_t  const xfer_count[] = { 10, 5, 2 };
+
+  TEST_ASSERT_EQUAL(8192, CFG_TUD_NCM_IN_NTB_MAX_SIZE);
+  TEST_ASSERT_FALSE( tud_network_ncm_set_ntb_in_size(1024) );
+  TEST_ASSERT_FALSE( tud_network_ncm_set_ntb_in_size(CFG_TUD_NCM_IN_NTB_MAX_SIZE + 1) );
+
+  activate_data_interface();
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+
+  xmit_len = CFG_TUD_NET_MTU;
+
+  for(uint8_t n=0; n<TU_ARRAY_SIZE(ntb_size); n++)
+  {
+    uint8_t const start = in_xfer_count;
+    TEST_ASSERT_TRUE( tud_network_ncm_set_ntb_in_size(ntb_size[n]) );
+
+    for(uint8_t i=0; i<10; i++)
+    {
+      while ( !tud_network_can_xmit(CFG_TUD_NET_MTU) ) complete_in_xfer();
+      tud_network_xmit(NULL, i);
+    }
+
+    while ( in_done_count < in_xfer_count ) complete_in_xfer();
+
+    TEST_ASSERT_EQUAL(xfer_count[n], in_xfer_count - start);
+    TEST_ASSERT_LESS_OR_EQUAL(ntb_size[n], in_xfer_len[in_xfer_count-1]);
+  }
+
+  TEST_ASSERT_TRUE( tud_network_ncm_set_ntb_in_size(CFG_TUD_NCM_IN_NTB_MAX_SIZE) );
+}
+
+// Frame of 2 segments shares its NTB with a copied frame: headers and start of the frame up to the first packet
+// boundary are sent from the NTB, then packets from segment memory, then the end of the frame from its last packet
+// boundary along with the following datagram
+void test_ncm_xmit_sg(void)
+{
+  // NTH16 + NDP16 with terminator entry
+  uint16_t const header_len = 12 + 8 + (CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB+1)*4;
+  uint16_t const pkt = 512;
+
+  static uint32_t seg1_mem[300];
+  static uint32_t seg2_mem[50];
+  uint8_t* seg1 = (uint8_t*) seg1_mem;
+  uint8_t* seg2 = (uint8_t*) seg2_mem;
+  for(uint16_t i=0; i<sizeof(seg1_mem); i++) seg1[i] = (uint8_t) i;
+  memset(seg2, 0xEE, sizeof(seg2_mem));
+
+  tud_network_segment_t const segs[2] =
+  {
+    { .buf = seg1, .len = sizeof(seg1_mem) },
+    { .buf = seg2, .len = sizeof(seg2_mem) },
+  };
+  uint16_t const total = sizeof(seg1_mem) + sizeof(seg2_mem);
+  uint16_t const end = header_len + total;
+
+  activate_data_interface();
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+
+  TEST_ASSERT_TRUE( tud_network_xmit_sg(segs, 2, (void*) segs) );
+
+  // only one frame of segments at a time
+  TEST_ASSERT_FALSE( tud_network_xmit_sg(segs, 2, NULL) );
+
+  // NTB is held open for the next datagram, closed by aggregation timeout
+  tud_network_xmit(NULL, 0x55);
+  TEST_ASSERT_EQUAL(0, in_xfer_count);
+
+  dcd_event_sof(rhport, 1, true);
+  dcd_event_sof(rhport, 2, true);
+  tud_task();
+
+  // NTB up to the first packet boundary, datagram starts right after the headers
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+  TEST_ASSERT_EQUAL(pkt, in_xfer_len[0]);
+
+  uint8_t const* ntb = in_xfer_buf[0];
+  TEST_ASSERT_EQUAL(end + 64, tu_unaligned_read16(ntb + 8));
+  TEST_ASSERT_EQUAL(header_len, tu_unaligned_read16(ntb + 20));
+  TEST_ASSERT_EQUAL(total, tu_unaligned_read16(ntb + 22));
+  TEST_ASSERT_EQUAL(end, tu_unaligned_read16(ntb + 24));
+  TEST_ASSERT_EQUAL(64, tu_unaligned_read16(ntb + 26));
+  TEST_ASSERT_EQUAL_MEMORY(seg1, ntb + header_len, pkt - header_len);
+
+  // 1 packet directly from 1st segment
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+  TEST_ASSERT_EQUAL_PTR(seg1 + pkt - header_len, in_xfer_buf[1]);
+  TEST_ASSERT_EQUAL(pkt, in_xfer_len[1]);
+
+  // rest of 1st segment, 2nd segment and the copied datagram go out from the NTB
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+  TEST_ASSERT_EQUAL_PTR(ntb + 2*pkt, in_xfer_buf[2]);
+  TEST_ASSERT_EQUAL(end + 64 - 2*pkt, in_xfer_len[2]);
+
+  uint16_t const tail1 = (uint16_t) (sizeof(seg1_mem) - (2*pkt - header_len));
+  TEST_ASSERT_EQUAL_MEMORY(seg1 + sizeof(seg1_mem) - tail1, in_xfer_buf[2], tail1);
+  TEST_ASSERT_EQUAL_MEMORY(seg2, in_xfer_buf[2] + tail1, sizeof(seg2_mem));
+  TEST_ASSERT_EQUAL_HEX8(0x55, ntb[end]);
+
+  // segments are released once sent
+  TEST_ASSERT_NULL(xmit_done_ref);
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL_PTR(segs, xmit_done_ref);
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+}
+
+// Unaligned segment is gathered into the NTB in one transfer instead of one per packet
+void test_ncm_xmit_sg_unaligned(void)
+{
+  uint16_t const header_len = 12 + 8 + (CFG_TUD_NCM_MAX_DATAGRAMS_PER_NTB+1)*4;
+  uint16_t const pkt = 512;
+  uint16_t const total = 1500;
+
+  static uint32_t seg_mem[(1500 + 4)/4];
+  uint8_t* seg = (uint8_t*) seg_mem + 1;
+  for(uint16_t i=0; i<total; i++) seg[i] = (uint8_t) i;
+
+  tud_network_segment_t const segs[1] = { { .buf = seg, .len = total } };
+
+  activate_data_interface();
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+
+  TEST_ASSERT_TRUE( tud_network_xmit_sg(segs, 1, (void*) segs) );
+  dcd_event_sof(rhport, 1, true);
+  dcd_event_sof(rhport, 2, true);
+  tud_task();
+
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+  TEST_ASSERT_EQUAL(pkt, in_xfer_len[0]);
+  uint8_t const* ntb = in_xfer_buf[0];
+
+  // rest of the datagram is gathered and sent along with the end of the NTB
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+  TEST_ASSERT_EQUAL_PTR(ntb + pkt, in_xfer_buf[1]);
+  TEST_ASSERT_EQUAL(header_len + total - pkt, in_xfer_len[1]);
+  TEST_ASSERT_EQUAL_MEMORY(seg + pkt - header_len, in_xfer_buf[1], total - (pkt - header_len));
+
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL_PTR(segs, xmit_done_ref);
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+}
@@ -0,0 +1,271 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("ncm_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT  = 0x00,
+  EDPT_CTRL_IN   = 0x80,
+
+  EDPT_NCM_NOTIF = 0x81,
+  EDPT_NCM_OUT   = 0x02,
+  EDPT_NCM_IN    = 0x82,
+};
+
+uint8_t const rhport = 0;
+
+enum
+{
+  ITF_NUM_NCM,
+  ITF_NUM_NCM_DATA,
+  ITF_NUM_TOTAL
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_CDC_NCM_DESC_LEN)
+
+uint8_t const data_desc_configuration[] =
+{
+  // Config number, interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+
+  // Interface number, description string index, MAC address string index, EP notification address and size, EP data address (out, in), and size, max segment size.
+  TUD_CDC_NCM_DESCRIPTOR(ITF_NUM_NCM, 0, 0, EDPT_NCM_NOTIF, 64, EDPT_NCM_OUT, EDPT_NCM_IN, 512, CFG_TUD_NET_MTU),
+};
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+// activate data interface
+tusb_control_request_t const request_set_interface =
+{
+  .bmRequestType = 0x01,
+  .bRequest      = TUSB_REQ_SET_INTERFACE,
+  .wValue        = 1,
+  .wIndex        = ITF_NUM_NCM_DATA,
+  .wLength       = 0
+};
+
+// datagrams of received batches
+uint8_t batch_count;
+uint8_t batch_size[4];
+uint8_t batch_first[4][8];
+bool batch_accept;
+
+bool tud_network_recv_batch_cb(tud_network_datagram_t const* datagrams, uint8_t count)
+{
+  for(uint8_t i=0; i<count; i++)
+  {
+    TEST_ASSERT_EQUAL(64, datagrams[i].len);
+    batch_first[batch_count][i] = datagrams[i].buf[0];
+  }
+
+  batch_size[batch_count++] = count;
+  return batch_accept;
+}
+
+uint16_t tud_network_xmit_cb(uint8_t *dst, void *ref, uint16_t arg)
+{
+  (void) dst;
+  (void) ref;
+  (void) arg;
+  return 0;
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  (void) index;
+  return data_desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+  (void) index;
+  (void) langid;
+  return NULL;
+}
+
+void setUp(void)
+{
+  batch_count = 0;
+  batch_accept = true;
+
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+  dcd_sof_enable_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_reset(rhport, TUSB_SPEED_HIGH, false);
+  tud_task();
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+// NTB16 with datagrams of 64 bytes filled with value, value+1 ...
+static uint16_t build_ntb(uint8_t* ntb, uint8_t count, uint8_t value)
+{
+  uint16_t const offset = 64;
+  uint16_t const len = (uint16_t) (offset + count*64);
+
+  memset(ntb, 0, len);
+
+  // NTH16
+  tu_unaligned_write32(ntb + 0, 0x484D434E);
+  tu_unaligned_write16(ntb + 4, 12);
+  tu_unaligned_write16(ntb + 8, len);
+  tu_unaligned_write16(ntb + 10, 12);
+
+  // NDP16 with zero terminator
+  tu_unaligned_write32(ntb + 12, 0x304D434E);
+  tu_unaligned_write16(ntb + 16, (uint16_t) (8 + (count+1)*4));
+
+  for(uint8_t i=0; i<count; i++)
+  {
+    tu_unaligned_write16(ntb + 20 + 4*i, (uint16_t) (offset + i*64));
+    tu_unaligned_write16(ntb + 22 + 4*i, 64);
+    memset(ntb + offset + i*64, value + i, 64);
+  }
+
+  return len;
+}
+
+// Activate data interface and receive the NTB
+static void receive_ntb(uint8_t* ntb, uint16_t ntb_len)
+{
+  dcd_edpt_open_IgnoreAndReturn(true);
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+  tud_task();
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_interface, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer(ntb, ntb_len);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_NOTIF, NULL, 16, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+
+  // NTB received, datagrams are handed out
+  dcd_event_xfer_complete(rhport, EDPT_NCM_OUT, ntb_len, 0, false);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_NCM_OUT, NULL, CFG_TUD_NCM_OUT_NTB_MAX_SIZE, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+}
+
+// All datagrams of an NTB are handed out in batches of CFG_TUD_NET_RECV_BATCH_MAX, released with one renew
+void test_ncm_recv_batch(void)
+{
+  uint8_t ntb[512];
+  uint16_t const ntb_len = build_ntb(ntb, 6, 0x10);
+
+  TEST_ASSERT_EQUAL(4, CFG_TUD_NET_RECV_BATCH_MAX);
+
+  receive_ntb(ntb, ntb_len);
+
+  TEST_ASSERT_EQUAL(1, batch_count);
+  TEST_ASSERT_EQUAL(4, batch_size[0]);
+  for(uint8_t i=0; i<4; i++) TEST_ASSERT_EQUAL_HEX8(0x10 + i, batch_first[0][i]);
+
+  // remaining 2
+  tud_network_recv_renew();
+
+  TEST_ASSERT_EQUAL(2, batch_count);
+  TEST_ASSERT_EQUAL(2, batch_size[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x14, batch_first[1][0]);
+  TEST_ASSERT_EQUAL_HEX8(0x15, batch_first[1][1]);
+
+  // NTB is released, nothing left
+  tud_network_recv_renew();
+  TEST_ASSERT_EQUAL(2, batch_count);
+}
+
+// Batch not accepted by the client is dropped, the next one is handed out right away
+void test_ncm_recv_batch_not_accepted(void)
+{
+  uint8_t ntb[512];
+  uint16_t const ntb_len = build_ntb(ntb, 6, 0x10);
+
+  batch_accept = false;
+  receive_ntb(ntb, ntb_len);
+
+  // both batches are offered, then NTB is released
+  TEST_ASSERT_EQUAL(2, batch_count);
+  TEST_ASSERT_EQUAL(4, batch_size[0]);
+  TEST_ASSERT_EQUAL(2, batch_size[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x14, batch_first[1][0]);
+
+  batch_accept = true;
+  tud_network_recv_renew();
+  TEST_ASSERT_EQUAL(2, batch_count);
+}
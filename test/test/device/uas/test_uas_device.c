@@ -0,0 +1,372 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("msc_device.c")
+TEST_FILE("uas_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT     = 0x00,
+  EDPT_CTRL_IN      = 0x80,
+
+  EDPT_UAS_CMD      = 0x01,
+  EDPT_UAS_STATUS   = 0x82,
+  EDPT_UAS_DATA_IN  = 0x83,
+  EDPT_UAS_DATA_OUT = 0x04,
+};
+
+uint8_t const rhport = 0;
+
+enum
+{
+  ITF_NUM_UAS,
+  ITF_NUM_TOTAL
+};
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_UAS_DESC_LEN)
+
+uint8_t const data_desc_configuration[] =
+{
+  // Config number, interface count, string index, total length, attribute, power in mA
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
+
+  // Interface number, string index, EP Command, Status, Data In & Data Out address, EP size
+  TUD_UAS_DESCRIPTOR(ITF_NUM_UAS, 0, EDPT_UAS_CMD, EDPT_UAS_STATUS, EDPT_UAS_DATA_IN, EDPT_UAS_DATA_OUT, 512),
+};
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+uint8_t const* desc_configuration;
+
+enum
+{
+  DISK_BLOCK_NUM  = 16,
+  DISK_BLOCK_SIZE = 512
+};
+
+uint8_t msc_disk[DISK_BLOCK_NUM][DISK_BLOCK_SIZE];
+
+// lba of READ10 callbacks in invoked order
+uint32_t read10_lba[4];
+uint8_t  read10_count;
+uint8_t  queued_count;
+
+// READ10 callback completes the I/O before returning TUD_MSC_RET_ASYNC e.g DMA finished early
+bool read10_async_early;
+
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
+{
+  (void) lun;
+  (void) vendor_id;
+  (void) product_id;
+  (void) product_rev;
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun)
+{
+  (void) lun;
+  return true;
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size)
+{
+  (void) lun;
+
+  *block_count = DISK_BLOCK_NUM;
+  *block_size  = DISK_BLOCK_SIZE;
+}
+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+{
+  (void) lun;
+
+  read10_lba[read10_count++] = lba;
+  memcpy(buffer, msc_disk[lba] + offset, bufsize);
+
+  if (read10_async_early)
+  {
+    TEST_ASSERT_TRUE( tud_msc_async_io_done(lun, (int32_t) bufsize, true) );
+    return TUD_MSC_RET_ASYNC;
+  }
+
+  return bufsize;
+}
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+  (void) lun;
+
+  memcpy(msc_disk[lba] + offset, buffer, bufsize);
+
+  return bufsize;
+}
+
+int32_t tud_msc_scsi_cb (uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, uint16_t bufsize)
+{
+  (void) lun;
+  (void) scsi_cmd;
+  (void) buffer;
+  (void) bufsize;
+
+  return 0;
+}
+
+void tud_uas_command_queued_cb(uint8_t lun, uint16_t tag, uint8_t const scsi_cmd[16])
+{
+  (void) lun;
+  (void) tag;
+  (void) scsi_cmd;
+
+  queued_count++;
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  return desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+  (void) langid;
+
+  return NULL;
+}
+
+void setUp(void)
+{
+  read10_count = 0;
+  queued_count = 0;
+  read10_async_early = false;
+
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_reset(rhport, TUSB_SPEED_HIGH, false);
+  tud_task();
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+static void build_read10_iu(uas_command_iu_t* iu, uint16_t tag, uint32_t lba)
+{
+  scsi_read10_t cmd_read10 =
+  {
+      .cmd_code    = SCSI_CMD_READ_10,
+      .lba         = tu_htonl(lba),
+      .block_count = tu_htons(1)
+  };
+
+  memset(iu, 0, sizeof(uas_command_iu_t));
+  iu->iu_id = UAS_IU_ID_COMMAND;
+  iu->tag   = tu_htons(tag);
+  memcpy(iu->cdb, &cmd_read10, sizeof(cmd_read10));
+}
+
+// Host queues 2 READ10 commands before the first one is completed
+void test_uas_queued_read10(void)
+{
+  uas_command_iu_t iu1, iu2;
+  build_read10_iu(&iu1, 1, 3);
+  build_read10_iu(&iu2, 2, 5);
+
+  desc_configuration = data_desc_configuration;
+  uint8_t const* p_desc = tu_desc_next(tu_desc_next(desc_configuration));
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+
+  // open endpoints, each is followed by pipe usage descriptor
+  for(uint8_t i=0; i<4; i++)
+  {
+    dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) p_desc, true);
+    p_desc = tu_desc_next(tu_desc_next(p_desc));
+  }
+
+  // Prepare Command IU
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_CMD, NULL, 32, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer( (uint8_t*) &iu1, sizeof(iu1));
+
+  // control status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+
+  // 1st command received: command pipe is re-armed, then Read Ready IU
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_CMD, NULL, 32, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer( (uint8_t*) &iu2, sizeof(iu2));
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_STATUS, NULL, sizeof(uas_ready_iu_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+
+  // 2nd command is queued while status pipe is busy
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_CMD, NULL, 32, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+
+  TEST_ASSERT_EQUAL(2, queued_count);
+  TEST_ASSERT_EQUAL(2, tud_uas_queued_count());
+  TEST_ASSERT_EQUAL(1, tud_uas_current_tag());
+
+  // Execute both commands in queued order: Read Ready -> Data -> Sense
+  for(uint8_t i=0; i<2; i++)
+  {
+    dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_ready_iu_t), 0, true);
+
+    dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_DATA_IN, NULL, 512, true);
+    dcd_edpt_xfer_IgnoreArg_buffer();
+    dcd_event_xfer_complete(rhport, EDPT_UAS_DATA_IN, 512, 0, true);
+
+    // Sense IU with GOOD status has no sense data
+    dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_STATUS, NULL, 16, true);
+    dcd_edpt_xfer_IgnoreArg_buffer();
+    dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, 16, 0, true);
+
+    // Read Ready IU of next command
+    if ( i == 0 )
+    {
+      dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_STATUS, NULL, sizeof(uas_ready_iu_t), true);
+      dcd_edpt_xfer_IgnoreArg_buffer();
+    }
+
+    tud_task();
+  }
+
+  TEST_ASSERT_EQUAL(0, tud_uas_queued_count());
+  TEST_ASSERT_EQUAL(2, read10_count);
+  TEST_ASSERT_EQUAL(3, read10_lba[0]);
+  TEST_ASSERT_EQUAL(5, read10_lba[1]);
+}
+
+// tud_msc_async_io_done() invoked before READ10 callback returns must not be lost
+void test_uas_read10_async_done_early(void)
+{
+  read10_async_early = true;
+
+  uas_command_iu_t iu;
+  build_read10_iu(&iu, 1, 3);
+
+  desc_configuration = data_desc_configuration;
+  uint8_t const* p_desc = tu_desc_next(tu_desc_next(desc_configuration));
+
+  dcd_event_setup_received(rhport, (uint8_t*) &request_set_configuration, false);
+
+  // open endpoints, each is followed by pipe usage descriptor
+  for(uint8_t i=0; i<4; i++)
+  {
+    dcd_edpt_open_ExpectAndReturn(rhport, (tusb_desc_endpoint_t const *) p_desc, true);
+    p_desc = tu_desc_next(tu_desc_next(p_desc));
+  }
+
+  // Prepare Command IU
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_CMD, NULL, 32, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_edpt_xfer_ReturnMemThruPtr_buffer( (uint8_t*) &iu, sizeof(iu));
+
+  // control status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_CTRL_IN, NULL, 0, true);
+
+  tud_task();
+
+  // command received: command pipe is re-armed, then Read Ready IU
+  dcd_event_xfer_complete(rhport, EDPT_UAS_CMD, sizeof(uas_command_iu_t), 0, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_CMD, NULL, 32, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_STATUS, NULL, sizeof(uas_ready_iu_t), true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+
+  // Read Ready sent: data is transferred once the deferred completion is processed
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, sizeof(uas_ready_iu_t), 0, true);
+
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_DATA_IN, NULL, 512, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+
+  tud_task();
+
+  dcd_event_xfer_complete(rhport, EDPT_UAS_DATA_IN, 512, 0, true);
+
+  // Sense IU with GOOD status
+  dcd_edpt_xfer_ExpectAndReturn(rhport, EDPT_UAS_STATUS, NULL, 16, true);
+  dcd_edpt_xfer_IgnoreArg_buffer();
+  dcd_event_xfer_complete(rhport, EDPT_UAS_STATUS, 16, 0, true);
+
+  tud_task();
+
+  TEST_ASSERT_EQUAL(0, tud_uas_queued_count());
+  TEST_ASSERT_EQUAL(1, read10_count);
+}
@@ -28,6 +28,7 @@
 #include "tusb_fifo.h"
 #include "tusb.h"
 #include "usbd.h"
+#include "device/usbd_pvt.h"
 TEST_FILE("usbd_control.c")
 
 // Mock File
@@ -241,3 +242,25 @@ void test_usbd_control_in_zlp(void)
 
   tud_task();
 }
+
+//--------------------------------------------------------------------+
+// SOF
+//--------------------------------------------------------------------+
+
+// SOF interrupt is shared by class drivers, one releasing it must not stop it for the others
+void test_usbd_sof_enable_shared(void)
+{
+  // first consumer enables SOF interrupt
+  dcd_sof_enable_Expect(rhport, true);
+  usbd_sof_enable(rhport, SOF_CONSUMER_MSC, true);
+
+  // no change with another consumer, also released more than once e.g audio on every SET_INTERFACE
+  usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, true);
+  usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, false);
+  usbd_sof_enable(rhport, SOF_CONSUMER_AUDIO, false);
+  usbd_sof_enable(rhport, SOF_CONSUMER_MSC, true);
+
+  // last consumer disables SOF interrupt
+  dcd_sof_enable_Expect(rhport, false);
+  usbd_sof_enable(rhport, SOF_CONSUMER_MSC, false);
+}
@@ -0,0 +1,679 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("video_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT  = 0x00,
+  EDPT_CTRL_IN   = 0x80,
+
+  EDPT_VIDEO_IN  = 0x81,
+};
+
+uint8_t const rhport = 0;
+
+enum
+{
+  ITF_NUM_VIDEO_CONTROL,
+  ITF_NUM_VIDEO_STREAMING,
+  ITF_NUM_TOTAL
+};
+
+#define UVC_ENTITY_CAP_INPUT_TERMINAL  0x01
+#define UVC_ENTITY_CAP_OUTPUT_TERMINAL 0x02
+
+// 128x96 MJPEG at 60 fps, at full speed payload size is limited by the largest ISO endpoint
+#define FRAME_WIDTH    128
+#define FRAME_HEIGHT   96
+#define FRAME_INTERVAL (10000000/60)
+#define PAYLOAD_SIZE   64
+
+// alternate settings with increasing bandwidth, the last one has 3 transactions per microframe at high speed
+enum
+{
+  ALT_ISO_32 = 1,
+  ALT_ISO_64,
+  ALT_ISO_3x64
+};
+
+#define VIDEO_DESC_LEN (\
+    TUD_VIDEO_DESC_IAD_LEN\
+    + TUD_VIDEO_DESC_STD_VC_LEN\
+    + (TUD_VIDEO_DESC_CS_VC_LEN + 1)\
+    + TUD_VIDEO_DESC_CAMERA_TERM_LEN\
+    + TUD_VIDEO_DESC_OUTPUT_TERM_LEN\
+    + TUD_VIDEO_DESC_STD_VS_LEN\
+    + (TUD_VIDEO_DESC_CS_VS_IN_LEN + 1)\
+    + TUD_VIDEO_DESC_CS_VS_FMT_MJPEG_LEN\
+    + TUD_VIDEO_DESC_CS_VS_FRM_MJPEG_CONT_LEN\
+    + 3 * (TUD_VIDEO_DESC_STD_VS_LEN + 7)\
+  )
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + VIDEO_DESC_LEN)
+
+uint8_t const data_desc_configuration[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 500),
+
+  TUD_VIDEO_DESC_IAD(ITF_NUM_VIDEO_CONTROL, 0x02, 0),
+  TUD_VIDEO_DESC_STD_VC(ITF_NUM_VIDEO_CONTROL, 0, 0),
+    TUD_VIDEO_DESC_CS_VC(0x0150, TUD_VIDEO_DESC_CAMERA_TERM_LEN + TUD_VIDEO_DESC_OUTPUT_TERM_LEN,
+                         27000000, ITF_NUM_VIDEO_STREAMING),
+      TUD_VIDEO_DESC_CAMERA_TERM(UVC_ENTITY_CAP_INPUT_TERMINAL, 0, 0, 0, 0, 0, 0),
+      TUD_VIDEO_DESC_OUTPUT_TERM(UVC_ENTITY_CAP_OUTPUT_TERMINAL, VIDEO_TT_STREAMING, 0, 1, 0),
+
+  TUD_VIDEO_DESC_STD_VS(ITF_NUM_VIDEO_STREAMING, 0, 0, 0),
+    TUD_VIDEO_DESC_CS_VS_INPUT(1, TUD_VIDEO_DESC_CS_VS_FMT_MJPEG_LEN + TUD_VIDEO_DESC_CS_VS_FRM_MJPEG_CONT_LEN,
+                               EDPT_VIDEO_IN, 0, UVC_ENTITY_CAP_OUTPUT_TERMINAL, 0, 0, 0, 0),
+      TUD_VIDEO_DESC_CS_VS_FMT_MJPEG(1, 1, 0, 1, 0, 0, 0, 0),
+        TUD_VIDEO_DESC_CS_VS_FRM_MJPEG_CONT(1, 0, FRAME_WIDTH, FRAME_HEIGHT,
+                                            FRAME_WIDTH * FRAME_HEIGHT * 16, FRAME_WIDTH * FRAME_HEIGHT * 16 * 60,
+                                            FRAME_WIDTH * FRAME_HEIGHT * 2,
+                                            FRAME_INTERVAL, FRAME_INTERVAL, FRAME_INTERVAL, FRAME_INTERVAL),
+
+  TUD_VIDEO_DESC_STD_VS(ITF_NUM_VIDEO_STREAMING, ALT_ISO_32, 1, 0),
+    TUD_VIDEO_DESC_EP_ISO(EDPT_VIDEO_IN, 32, 1),
+  TUD_VIDEO_DESC_STD_VS(ITF_NUM_VIDEO_STREAMING, ALT_ISO_64, 1, 0),
+    TUD_VIDEO_DESC_EP_ISO(EDPT_VIDEO_IN, PAYLOAD_SIZE, 1),
+  TUD_VIDEO_DESC_STD_VS(ITF_NUM_VIDEO_STREAMING, ALT_ISO_3x64, 1, 0),
+    TUD_VIDEO_DESC_EP_ISO(EDPT_VIDEO_IN, (2 << 11) | PAYLOAD_SIZE, 1),
+};
+
+// same camera streaming over a bulk endpoint in alternate setting 0
+#define VIDEO_BULK_DESC_LEN (\
+    TUD_VIDEO_DESC_IAD_LEN\
+    + TUD_VIDEO_DESC_STD_VC_LEN\
+    + (TUD_VIDEO_DESC_CS_VC_LEN + 1)\
+    + TUD_VIDEO_DESC_CAMERA_TERM_LEN\
+    + TUD_VIDEO_DESC_OUTPUT_TERM_LEN\
+    + TUD_VIDEO_DESC_STD_VS_LEN\
+    + (TUD_VIDEO_DESC_CS_VS_IN_LEN + 1)\
+    + TUD_VIDEO_DESC_CS_VS_FMT_MJPEG_LEN\
+    + TUD_VIDEO_DESC_CS_VS_FRM_MJPEG_CONT_LEN\
+    + 7\
+  )
+
+uint8_t const data_desc_configuration_bulk[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, TUD_CONFIG_DESC_LEN + VIDEO_BULK_DESC_LEN, 0, 500),
+
+  TUD_VIDEO_DESC_IAD(ITF_NUM_VIDEO_CONTROL, 0x02, 0),
+  TUD_VIDEO_DESC_STD_VC(ITF_NUM_VIDEO_CONTROL, 0, 0),
+    TUD_VIDEO_DESC_CS_VC(0x0150, TUD_VIDEO_DESC_CAMERA_TERM_LEN + TUD_VIDEO_DESC_OUTPUT_TERM_LEN,
+                         27000000, ITF_NUM_VIDEO_STREAMING),
+      TUD_VIDEO_DESC_CAMERA_TERM(UVC_ENTITY_CAP_INPUT_TERMINAL, 0, 0, 0, 0, 0, 0),
+      TUD_VIDEO_DESC_OUTPUT_TERM(UVC_ENTITY_CAP_OUTPUT_TERMINAL, VIDEO_TT_STREAMING, 0, 1, 0),
+
+  TUD_VIDEO_DESC_STD_VS(ITF_NUM_VIDEO_STREAMING, 0, 1, 0),
+    TUD_VIDEO_DESC_CS_VS_INPUT(1, TUD_VIDEO_DESC_CS_VS_FMT_MJPEG_LEN + TUD_VIDEO_DESC_CS_VS_FRM_MJPEG_CONT_LEN,
+                               EDPT_VIDEO_IN, 0, UVC_ENTITY_CAP_OUTPUT_TERMINAL, 0, 0, 0, 0),
+      TUD_VIDEO_DESC_CS_VS_FMT_MJPEG(1, 1, 0, 1, 0, 0, 0, 0),
+        TUD_VIDEO_DESC_CS_VS_FRM_MJPEG_CONT(1, 0, FRAME_WIDTH, FRAME_HEIGHT,
+                                            FRAME_WIDTH * FRAME_HEIGHT * 16, FRAME_WIDTH * FRAME_HEIGHT * 16 * 60,
+                                            FRAME_WIDTH * FRAME_HEIGHT * 2,
+                                            FRAME_INTERVAL, FRAME_INTERVAL, FRAME_INTERVAL, FRAME_INTERVAL),
+    TUD_VIDEO_DESC_EP_BULK(EDPT_VIDEO_IN, PAYLOAD_SIZE, 1),
+};
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+tusb_control_request_t const request_commit =
+{
+  .bmRequestType = 0x21,
+  .bRequest      = VIDEO_REQUEST_SET_CUR,
+  .wValue        = VIDEO_VS_CTL_COMMIT << 8,
+  .wIndex        = ITF_NUM_VIDEO_STREAMING,
+  .wLength       = sizeof(video_probe_and_commit_control_t)
+};
+
+uint8_t const* desc_configuration;
+
+// data of control OUT transfer
+void const* ctrl_out_data;
+
+// streaming IN transfers
+struct
+{
+  uint8_t* buffer;
+  uint16_t len;
+  uint8_t  head[4]; // copy of header and first data bytes at time of transfer
+} in_xfer[16];
+uint8_t in_xfer_count;
+
+uint8_t frame_complete_count;
+
+// released frame chunks
+void const* chunk_done[8];
+uint8_t chunk_done_count;
+
+void tud_video_frame_chunk_done_cb(uint_fast8_t ctl_idx, uint_fast8_t stm_idx, void const *chunk)
+{
+  (void) ctl_idx;
+  (void) stm_idx;
+  chunk_done[chunk_done_count++] = chunk;
+}
+
+void tud_video_frame_xfer_complete_cb(uint_fast8_t ctl_idx, uint_fast8_t stm_idx)
+{
+  (void) ctl_idx;
+  (void) stm_idx;
+  frame_complete_count++;
+}
+
+static bool stub_edpt_xfer(uint8_t port, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes, int num_calls)
+{
+  (void) port;
+  (void) num_calls;
+
+  switch (ep_addr)
+  {
+    case EDPT_CTRL_OUT:
+      if (ctrl_out_data) memcpy(buffer, ctrl_out_data, total_bytes);
+    break;
+
+    case EDPT_VIDEO_IN:
+      in_xfer[in_xfer_count].buffer = buffer;
+      in_xfer[in_xfer_count].len    = total_bytes;
+      memcpy(in_xfer[in_xfer_count].head, buffer, tu_min16(total_bytes, 4));
+      in_xfer_count++;
+    break;
+
+    default: break;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  (void) index;
+  return desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+  (void) index;
+  (void) langid;
+  return NULL;
+}
+
+void setUp(void)
+{
+  in_xfer_count = 0;
+  frame_complete_count = 0;
+  chunk_done_count = 0;
+  ctrl_out_data = NULL;
+  desc_configuration = data_desc_configuration;
+
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_reset(rhport, TUSB_SPEED_FULL, false);
+  tud_task();
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+static void set_interface(uint8_t alt)
+{
+  tusb_control_request_t const request_set_interface =
+  {
+    .bmRequestType = 0x01,
+    .bRequest      = TUSB_REQ_SET_INTERFACE,
+    .wValue        = alt,
+    .wIndex        = ITF_NUM_VIDEO_STREAMING,
+    .wLength       = 0
+  };
+
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_set_interface, false);
+  tud_task();
+}
+
+static void commit(video_probe_and_commit_control_t const *param)
+{
+  ctrl_out_data = param;
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_commit, false);
+  tud_task();
+  dcd_event_xfer_complete(rhport, EDPT_CTRL_OUT, sizeof(*param), 0, false);
+  tud_task();
+}
+
+// Configure, commit streaming parameters and select the streaming alternate setting
+static void start_streaming(uint8_t alt)
+{
+  video_probe_and_commit_control_t param;
+  tu_memclr(&param, sizeof(param));
+  param.bFormatIndex    = 1;
+  param.bFrameIndex     = 1;
+  param.dwFrameInterval = FRAME_INTERVAL;
+
+  dcd_edpt_open_IgnoreAndReturn(true);
+  dcd_edpt_close_Ignore();
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_set_configuration, false);
+  tud_task();
+
+  set_interface(0);
+  commit(&param);
+
+  // bulk streams in alternate setting 0 once committed
+  if (alt) set_interface(alt);
+  TEST_ASSERT_TRUE( tud_video_n_streaming(0, 0) );
+}
+
+static void complete_in_xfer(void)
+{
+  dcd_event_xfer_complete(rhport, EDPT_VIDEO_IN, in_xfer[in_xfer_count-1].len, 0, false);
+  tud_task();
+}
+
+// Frame data is copied behind the header in the endpoint buffer
+void test_video_frame_xfer(void)
+{
+  uint8_t frame[150];
+  memset(frame, 0xAA, sizeof(frame));
+
+  start_streaming(ALT_ISO_64);
+  TEST_ASSERT_EQUAL(PAYLOAD_SIZE, tud_video_n_payload_size(0, 0));
+  TEST_ASSERT_EQUAL(2, tud_video_n_payload_header_size(0, 0));
+
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer(0, 0, frame, sizeof(frame)) );
+  complete_in_xfer();
+  complete_in_xfer();
+  complete_in_xfer();
+
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+  TEST_ASSERT_EQUAL(1, frame_complete_count);
+
+  TEST_ASSERT_EQUAL(PAYLOAD_SIZE, in_xfer[0].len);
+  TEST_ASSERT_EQUAL(PAYLOAD_SIZE, in_xfer[1].len);
+  TEST_ASSERT_EQUAL(2 + sizeof(frame) - 2*(PAYLOAD_SIZE-2), in_xfer[2].len);
+
+  for(uint8_t i=0; i<3; i++)
+  {
+    TEST_ASSERT_TRUE(in_xfer[i].buffer < frame || in_xfer[i].buffer >= frame + sizeof(frame));
+  }
+
+  // last payload has EOF set
+  TEST_ASSERT_EQUAL_HEX8(0x03, in_xfer[2].buffer[1]);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xAA, in_xfer[2].buffer + 2, in_xfer[2].len - 2);
+}
+
+// Payloads are sent straight from the frame buffer, only the header slots are written
+void test_video_frame_xfer_inplace(void)
+{
+  uint8_t frame[2*PAYLOAD_SIZE + 30];
+  memset(frame, 0xAA, sizeof(frame));
+
+  start_streaming(ALT_ISO_64);
+
+  // the last payload is too short for its header
+  TEST_ASSERT_FALSE( tud_video_n_frame_xfer_inplace(0, 0, frame, 2*PAYLOAD_SIZE + 1) );
+
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer_inplace(0, 0, frame, sizeof(frame)) );
+  complete_in_xfer();
+  complete_in_xfer();
+  complete_in_xfer();
+
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+  TEST_ASSERT_EQUAL(1, frame_complete_count);
+
+  TEST_ASSERT_EQUAL_PTR(frame, in_xfer[0].buffer);
+  TEST_ASSERT_EQUAL(PAYLOAD_SIZE, in_xfer[0].len);
+  TEST_ASSERT_EQUAL_PTR(frame + PAYLOAD_SIZE, in_xfer[1].buffer);
+  TEST_ASSERT_EQUAL(PAYLOAD_SIZE, in_xfer[1].len);
+  TEST_ASSERT_EQUAL_PTR(frame + 2*PAYLOAD_SIZE, in_xfer[2].buffer);
+  TEST_ASSERT_EQUAL(30, in_xfer[2].len);
+
+  // header slots, frame data is left untouched
+  uint8_t const fid = frame[1] & 0x01;
+  TEST_ASSERT_EQUAL(2, frame[0]);
+  TEST_ASSERT_EQUAL_HEX8(fid, frame[PAYLOAD_SIZE + 1]);
+  TEST_ASSERT_EQUAL_HEX8(fid | 0x02, frame[2*PAYLOAD_SIZE + 1]);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xAA, frame + 2, PAYLOAD_SIZE - 2);
+  TEST_ASSERT_EACH_EQUAL_HEX8(0xAA, frame + 2*PAYLOAD_SIZE + 2, 30 - 2);
+}
+
+// Host selected an alternate setting with less bandwidth than committed: payloads fit into one packet
+void test_video_iso_alt_bandwidth(void)
+{
+  uint8_t frame[100];
+  memset(frame, 0xAA, sizeof(frame));
+
+  start_streaming(ALT_ISO_32);
+  TEST_ASSERT_EQUAL(32, tud_video_n_payload_size(0, 0));
+
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer(0, 0, frame, sizeof(frame)) );
+  TEST_ASSERT_EQUAL(32, in_xfer[0].len);
+}
+
+// High speed: payload size is spread over the microframes of a frame interval, a payload
+// larger than the packet size is sent as multiple transactions in one microframe
+void test_video_iso_high_bandwidth(void)
+{
+  uint8_t frame[400];
+  memset(frame, 0xAA, sizeof(frame));
+
+  dcd_event_bus_reset(rhport, TUSB_SPEED_HIGH, false);
+  tud_task();
+
+  start_streaming(ALT_ISO_3x64);
+
+  // 133 microframes per frame interval
+  uint32_t const payload_size = 2 + (FRAME_WIDTH*FRAME_HEIGHT*2 + 132) / 133;
+  TEST_ASSERT_EQUAL(payload_size, tud_video_n_payload_size(0, 0));
+  TEST_ASSERT_GREATER_THAN(PAYLOAD_SIZE, payload_size);
+
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer(0, 0, frame, sizeof(frame)) );
+  complete_in_xfer();
+  complete_in_xfer();
+  complete_in_xfer();
+
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+  TEST_ASSERT_EQUAL(payload_size, in_xfer[0].len);
+  TEST_ASSERT_EQUAL(payload_size, in_xfer[1].len);
+  TEST_ASSERT_EQUAL(2 + sizeof(frame) - 2*(payload_size-2), in_xfer[2].len);
+  TEST_ASSERT_EQUAL(1, frame_complete_count);
+}
+
+// Frame is sent chunk by chunk as the application appends them, payloads may span chunks
+void test_video_frame_chunks(void)
+{
+  uint8_t chunk_a[40];
+  uint8_t chunk_b[100];
+  uint8_t chunk_c[30];
+  memset(chunk_a, 0x11, sizeof(chunk_a));
+  memset(chunk_b, 0x22, sizeof(chunk_b));
+  memset(chunk_c, 0x33, sizeof(chunk_c));
+
+  start_streaming(ALT_ISO_64);
+
+  TEST_ASSERT_FALSE( tud_video_n_frame_append(0, 0, chunk_a, sizeof(chunk_a), false) );
+  TEST_ASSERT_TRUE( tud_video_n_frame_begin(0, 0) );
+  TEST_ASSERT_FALSE( tud_video_n_frame_xfer(0, 0, chunk_a, sizeof(chunk_a)) );
+
+  // available data is sent right away
+  TEST_ASSERT_TRUE( tud_video_n_frame_append(0, 0, chunk_a, sizeof(chunk_a), false) );
+  tud_task();
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+  TEST_ASSERT_EQUAL(2 + sizeof(chunk_a), in_xfer[0].len);
+  TEST_ASSERT_EQUAL(1, chunk_done_count);
+  TEST_ASSERT_EQUAL_PTR(chunk_a, chunk_done[0]);
+  uint8_t const fid = in_xfer[0].head[1];
+
+  // chunks appended while endpoint is busy go out in full payloads
+  TEST_ASSERT_TRUE( tud_video_n_frame_append(0, 0, chunk_b, sizeof(chunk_b), true) );
+  TEST_ASSERT_TRUE( tud_video_n_frame_append(0, 0, chunk_c, sizeof(chunk_c), true) );
+  complete_in_xfer();
+  complete_in_xfer();
+  complete_in_xfer();
+
+  TEST_ASSERT_EQUAL(4, in_xfer_count);
+  TEST_ASSERT_EQUAL(PAYLOAD_SIZE, in_xfer[1].len);
+  TEST_ASSERT_EQUAL_HEX8(0x22, in_xfer[1].head[2]);
+  TEST_ASSERT_EQUAL(PAYLOAD_SIZE, in_xfer[2].len);
+  TEST_ASSERT_EQUAL_HEX8(0x22, in_xfer[2].head[2]);
+  TEST_ASSERT_EQUAL(2 + sizeof(chunk_b) + sizeof(chunk_c) - 2*(PAYLOAD_SIZE-2), in_xfer[3].len);
+  TEST_ASSERT_EQUAL_HEX8(0x33, in_xfer[3].head[2]);
+  TEST_ASSERT_EQUAL(3, chunk_done_count);
+  TEST_ASSERT_EQUAL_PTR(chunk_c, chunk_done[2]);
+
+  // nothing queued: endpoint idles until frame is ended
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(4, in_xfer_count);
+  TEST_ASSERT_EQUAL(0, frame_complete_count);
+
+  TEST_ASSERT_TRUE( tud_video_n_frame_end(0, 0, false) );
+  tud_task();
+  TEST_ASSERT_EQUAL(5, in_xfer_count);
+  TEST_ASSERT_EQUAL(2, in_xfer[4].len);
+  TEST_ASSERT_EQUAL_HEX8(fid | 0x02, in_xfer[4].head[1]);
+  for(uint8_t i=0; i<4; i++) TEST_ASSERT_EQUAL_HEX8(fid, in_xfer[i].head[1]);
+
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(1, frame_complete_count);
+
+  // next frame toggles FID
+  TEST_ASSERT_TRUE( tud_video_n_frame_begin(0, 0) );
+  TEST_ASSERT_TRUE( tud_video_n_frame_append(0, 0, chunk_c, sizeof(chunk_c), false) );
+  TEST_ASSERT_TRUE( tud_video_n_frame_end(0, 0, false) );
+  tud_task();
+  TEST_ASSERT_EQUAL(6, in_xfer_count);
+  TEST_ASSERT_EQUAL(2 + sizeof(chunk_c), in_xfer[5].len);
+  TEST_ASSERT_EQUAL_HEX8((fid ^ 0x01) | 0x02, in_xfer[5].head[1]);
+}
+
+// Frames submitted while one is in flight are queued and started without waiting for the application
+void test_video_frame_queue(void)
+{
+  uint8_t frame_a[100];
+  uint8_t frame_b[40];
+  uint8_t frame_c[40];
+  memset(frame_a, 0x11, sizeof(frame_a));
+  memset(frame_b, 0x22, sizeof(frame_b));
+  memset(frame_c, 0x33, sizeof(frame_c));
+
+  start_streaming(ALT_ISO_64);
+
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer(0, 0, frame_a, sizeof(frame_a)) );
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer(0, 0, frame_b, sizeof(frame_b)) );
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer(0, 0, frame_c, sizeof(frame_c)) );
+  // CFG_TUD_VIDEO_STREAMING_FRAME_QUEUE is 2
+  TEST_ASSERT_FALSE( tud_video_n_frame_xfer(0, 0, frame_c, sizeof(frame_c)) );
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+  uint8_t const fid = in_xfer[0].head[1];
+
+  complete_in_xfer();
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(1, frame_complete_count);
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+  TEST_ASSERT_EQUAL(2 + sizeof(frame_b), in_xfer[2].len);
+  TEST_ASSERT_EQUAL_HEX8((fid ^ 0x01) | 0x02, in_xfer[2].head[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x22, in_xfer[2].head[2]);
+
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(2, frame_complete_count);
+  TEST_ASSERT_EQUAL(4, in_xfer_count);
+  TEST_ASSERT_EQUAL_HEX8(fid | 0x02, in_xfer[3].head[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x33, in_xfer[3].head[2]);
+
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(3, frame_complete_count);
+  TEST_ASSERT_EQUAL(4, in_xfer_count);
+}
+
+// Bulk: full packet payloads of an in-place frame go out in one transfer, host stops with CLEAR_FEATURE(HALT)
+void test_video_bulk_multi_payload(void)
+{
+  desc_configuration = data_desc_configuration_bulk;
+  start_streaming(0);
+
+  // payload is a multiple of the packet size, limited by CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE
+  uint32_t const payload_size = CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE;
+  TEST_ASSERT_EQUAL(payload_size, tud_video_n_payload_size(0, 0));
+
+  uint8_t frame[2*CFG_TUD_VIDEO_STREAMING_EP_BUFSIZE + 50];
+  memset(frame, 0xAA, sizeof(frame));
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer_inplace(0, 0, frame, sizeof(frame)) );
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+  TEST_ASSERT_EQUAL_PTR(frame, in_xfer[0].buffer);
+  TEST_ASSERT_EQUAL(sizeof(frame), in_xfer[0].len);
+
+  uint8_t const fid = frame[1] & 0x01;
+  TEST_ASSERT_EQUAL(2, frame[payload_size]);
+  TEST_ASSERT_EQUAL_HEX8(fid, frame[payload_size + 1]);
+  TEST_ASSERT_EQUAL(2, frame[2*payload_size]);
+  TEST_ASSERT_EQUAL_HEX8(fid | 0x02, frame[2*payload_size + 1]);
+
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(1, frame_complete_count);
+
+  // copied frames are limited by the endpoint buffer
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer(0, 0, frame, 100) );
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+  TEST_ASSERT_EQUAL(2 + 100, in_xfer[1].len);
+
+  tusb_control_request_t const request_clear_halt =
+  {
+    .bmRequestType = 0x02,
+    .bRequest      = TUSB_REQ_CLEAR_FEATURE,
+    .wValue        = TUSB_REQ_FEATURE_EDPT_HALT,
+    .wIndex        = EDPT_VIDEO_IN,
+    .wLength       = 0
+  };
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_clear_halt, false);
+  tud_task();
+  TEST_ASSERT_FALSE( tud_video_n_streaming(0, 0) );
+
+  // the aborted transfer does not complete the frame
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(1, frame_complete_count);
+  TEST_ASSERT_FALSE( tud_video_n_frame_xfer(0, 0, frame, 100) );
+
+  // commit restarts streaming
+  video_probe_and_commit_control_t param;
+  tu_memclr(&param, sizeof(param));
+  param.bFormatIndex    = 1;
+  param.bFrameIndex     = 1;
+  param.dwFrameInterval = FRAME_INTERVAL;
+  commit(&param);
+  TEST_ASSERT_TRUE( tud_video_n_streaming(0, 0) );
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer(0, 0, frame, 100) );
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+}
+
+// Bulk: a payload shorter than dwMaxPayloadTransferSize ending on a packet boundary is terminated by a ZLP
+void test_video_bulk_zlp(void)
+{
+  desc_configuration = data_desc_configuration_bulk;
+  start_streaming(0);
+
+  uint32_t const payload_size = tud_video_n_payload_size(0, 0);
+  TEST_ASSERT_EQUAL(3*PAYLOAD_SIZE, payload_size);
+
+  // last payload is two packets
+  uint8_t frame[3*PAYLOAD_SIZE + 2*PAYLOAD_SIZE];
+  memset(frame, 0xAA, sizeof(frame));
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer_inplace(0, 0, frame, sizeof(frame)) );
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+  TEST_ASSERT_EQUAL(sizeof(frame), in_xfer[0].len);
+
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+  TEST_ASSERT_EQUAL(0, in_xfer[1].len);
+  TEST_ASSERT_EQUAL(0, frame_complete_count);
+
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(1, frame_complete_count);
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+
+  // a frame ending with a full payload needs no ZLP
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer_inplace(0, 0, frame, payload_size) );
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(2, frame_complete_count);
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+}
+
+// Bulk: a chunk payload ending on a packet boundary is terminated by a ZLP before the next payload
+void test_video_bulk_chunks_zlp(void)
+{
+  uint8_t chunk_a[PAYLOAD_SIZE - 2];
+  uint8_t chunk_b[10];
+  memset(chunk_a, 0x11, sizeof(chunk_a));
+  memset(chunk_b, 0x22, sizeof(chunk_b));
+
+  desc_configuration = data_desc_configuration_bulk;
+  start_streaming(0);
+
+  TEST_ASSERT_TRUE( tud_video_n_frame_begin(0, 0) );
+  TEST_ASSERT_TRUE( tud_video_n_frame_append(0, 0, chunk_a, sizeof(chunk_a), false) );
+  tud_task();
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+  TEST_ASSERT_EQUAL(PAYLOAD_SIZE, in_xfer[0].len);
+
+  // chunk appended while the payload is in flight waits for the ZLP
+  TEST_ASSERT_TRUE( tud_video_n_frame_append(0, 0, chunk_b, sizeof(chunk_b), false) );
+  TEST_ASSERT_TRUE( tud_video_n_frame_end(0, 0, false) );
+  tud_task();
+  TEST_ASSERT_EQUAL(1, in_xfer_count);
+
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(2, in_xfer_count);
+  TEST_ASSERT_EQUAL(0, in_xfer[1].len);
+
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+  TEST_ASSERT_EQUAL(2 + sizeof(chunk_b), in_xfer[2].len);
+  TEST_ASSERT_EQUAL_HEX8(0x22, in_xfer[2].head[2]);
+
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(1, frame_complete_count);
+  TEST_ASSERT_EQUAL(3, in_xfer_count);
+}
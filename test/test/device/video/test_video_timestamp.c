@@ -0,0 +1,319 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_fifo.h"
+#include "tusb.h"
+#include "usbd.h"
+TEST_FILE("usbd_control.c")
+TEST_FILE("video_device.c")
+
+// Mock File
+#include "mock_dcd.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  EDPT_CTRL_OUT  = 0x00,
+  EDPT_CTRL_IN   = 0x80,
+
+  EDPT_VIDEO_IN  = 0x81,
+};
+
+uint8_t const rhport = 0;
+
+enum
+{
+  ITF_NUM_VIDEO_CONTROL,
+  ITF_NUM_VIDEO_STREAMING,
+  ITF_NUM_TOTAL
+};
+
+#define UVC_ENTITY_CAP_INPUT_TERMINAL  0x01
+#define UVC_ENTITY_CAP_OUTPUT_TERMINAL 0x02
+
+#define FRAME_WIDTH    128
+#define FRAME_HEIGHT   96
+#define FRAME_INTERVAL (10000000/60)
+#define PAYLOAD_SIZE   64
+#define HEADER_SIZE    12
+
+#define VIDEO_DESC_LEN (\
+    TUD_VIDEO_DESC_IAD_LEN\
+    + TUD_VIDEO_DESC_STD_VC_LEN\
+    + (TUD_VIDEO_DESC_CS_VC_LEN + 1)\
+    + TUD_VIDEO_DESC_CAMERA_TERM_LEN\
+    + TUD_VIDEO_DESC_OUTPUT_TERM_LEN\
+    + TUD_VIDEO_DESC_STD_VS_LEN\
+    + (TUD_VIDEO_DESC_CS_VS_IN_LEN + 1)\
+    + TUD_VIDEO_DESC_CS_VS_FMT_MJPEG_LEN\
+    + TUD_VIDEO_DESC_CS_VS_FRM_MJPEG_CONT_LEN\
+    + TUD_VIDEO_DESC_STD_VS_LEN + 7\
+  )
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + VIDEO_DESC_LEN)
+
+uint8_t const desc_configuration[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 500),
+
+  TUD_VIDEO_DESC_IAD(ITF_NUM_VIDEO_CONTROL, 0x02, 0),
+  TUD_VIDEO_DESC_STD_VC(ITF_NUM_VIDEO_CONTROL, 0, 0),
+    TUD_VIDEO_DESC_CS_VC(0x0150, TUD_VIDEO_DESC_CAMERA_TERM_LEN + TUD_VIDEO_DESC_OUTPUT_TERM_LEN,
+                         27000000, ITF_NUM_VIDEO_STREAMING),
+      TUD_VIDEO_DESC_CAMERA_TERM(UVC_ENTITY_CAP_INPUT_TERMINAL, 0, 0, 0, 0, 0, 0),
+      TUD_VIDEO_DESC_OUTPUT_TERM(UVC_ENTITY_CAP_OUTPUT_TERMINAL, VIDEO_TT_STREAMING, 0, 1, 0),
+
+  TUD_VIDEO_DESC_STD_VS(ITF_NUM_VIDEO_STREAMING, 0, 0, 0),
+    TUD_VIDEO_DESC_CS_VS_INPUT(1, TUD_VIDEO_DESC_CS_VS_FMT_MJPEG_LEN + TUD_VIDEO_DESC_CS_VS_FRM_MJPEG_CONT_LEN,
+                               EDPT_VIDEO_IN, 0, UVC_ENTITY_CAP_OUTPUT_TERMINAL, 0, 0, 0, 0),
+      TUD_VIDEO_DESC_CS_VS_FMT_MJPEG(1, 1, 0, 1, 0, 0, 0, 0),
+        TUD_VIDEO_DESC_CS_VS_FRM_MJPEG_CONT(1, 0, FRAME_WIDTH, FRAME_HEIGHT,
+                                            FRAME_WIDTH * FRAME_HEIGHT * 16, FRAME_WIDTH * FRAME_HEIGHT * 16 * 60,
+                                            FRAME_WIDTH * FRAME_HEIGHT * 2,
+                                            FRAME_INTERVAL, FRAME_INTERVAL, FRAME_INTERVAL, FRAME_INTERVAL),
+
+  TUD_VIDEO_DESC_STD_VS(ITF_NUM_VIDEO_STREAMING, 1, 1, 0),
+    TUD_VIDEO_DESC_EP_ISO(EDPT_VIDEO_IN, PAYLOAD_SIZE, 1),
+};
+
+tusb_control_request_t const request_set_configuration =
+{
+  .bmRequestType = 0x00,
+  .bRequest      = TUSB_REQ_SET_CONFIGURATION,
+  .wValue        = 1,
+  .wIndex        = 0,
+  .wLength       = 0
+};
+
+tusb_control_request_t const request_commit =
+{
+  .bmRequestType = 0x21,
+  .bRequest      = VIDEO_REQUEST_SET_CUR,
+  .wValue        = VIDEO_VS_CTL_COMMIT << 8,
+  .wIndex        = ITF_NUM_VIDEO_STREAMING,
+  .wLength       = sizeof(video_probe_and_commit_control_t)
+};
+
+// data of control OUT transfer
+void const* ctrl_out_data;
+
+// streaming IN transfers
+struct
+{
+  uint16_t len;
+  uint8_t  header[HEADER_SIZE]; // copy of header at time of transfer
+} in_xfer[8];
+uint8_t in_xfer_count;
+
+// source clock returned by tud_video_clock_cb()
+uint32_t source_clock;
+
+uint32_t tud_video_clock_cb(void)
+{
+  return source_clock;
+}
+
+static bool stub_edpt_xfer(uint8_t port, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes, int num_calls)
+{
+  (void) port;
+  (void) num_calls;
+
+  switch (ep_addr)
+  {
+    case EDPT_CTRL_OUT:
+      if (ctrl_out_data) memcpy(buffer, ctrl_out_data, total_bytes);
+    break;
+
+    case EDPT_VIDEO_IN:
+      in_xfer[in_xfer_count].len = total_bytes;
+      memcpy(in_xfer[in_xfer_count].header, buffer, HEADER_SIZE);
+      in_xfer_count++;
+    break;
+
+    default: break;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+uint8_t const * tud_descriptor_device_cb(void)
+{
+  return NULL;
+}
+
+uint8_t const * tud_descriptor_configuration_cb(uint8_t index)
+{
+  (void) index;
+  return desc_configuration;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+  (void) index;
+  (void) langid;
+  return NULL;
+}
+
+void setUp(void)
+{
+  in_xfer_count = 0;
+  ctrl_out_data = NULL;
+  source_clock  = 0;
+
+  dcd_int_disable_Ignore();
+  dcd_int_enable_Ignore();
+
+  if ( !tusb_inited() )
+  {
+    dcd_init_Expect(rhport);
+    tusb_init();
+  }
+
+  dcd_event_bus_reset(rhport, TUSB_SPEED_FULL, false);
+  tud_task();
+}
+
+void tearDown(void)
+{
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+static void set_interface(uint8_t alt)
+{
+  tusb_control_request_t const request_set_interface =
+  {
+    .bmRequestType = 0x01,
+    .bRequest      = TUSB_REQ_SET_INTERFACE,
+    .wValue        = alt,
+    .wIndex        = ITF_NUM_VIDEO_STREAMING,
+    .wLength       = 0
+  };
+
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_set_interface, false);
+  tud_task();
+}
+
+// Configure, commit streaming parameters and select the isochronous alternate setting.
+// SOF interrupt is only enabled while streaming.
+static void start_streaming(void)
+{
+  video_probe_and_commit_control_t param;
+  tu_memclr(&param, sizeof(param));
+  param.bFormatIndex    = 1;
+  param.bFrameIndex     = 1;
+  param.dwFrameInterval = FRAME_INTERVAL;
+
+  dcd_edpt_open_IgnoreAndReturn(true);
+  dcd_edpt_close_Ignore();
+  dcd_edpt_xfer_Stub(stub_edpt_xfer);
+
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_set_configuration, false);
+  tud_task();
+
+  set_interface(0);
+
+  ctrl_out_data = &param;
+  dcd_event_setup_received(rhport, (uint8_t const*) &request_commit, false);
+  tud_task();
+  dcd_event_xfer_complete(rhport, EDPT_CTRL_OUT, sizeof(param), 0, false);
+  tud_task();
+
+  dcd_sof_enable_Expect(rhport, true);
+  set_interface(1);
+  TEST_ASSERT_TRUE( tud_video_n_streaming(0, 0) );
+}
+
+static void complete_in_xfer(void)
+{
+  dcd_event_xfer_complete(rhport, EDPT_VIDEO_IN, in_xfer[in_xfer_count-1].len, 0, false);
+  tud_task();
+}
+
+static void assert_header(uint8_t idx, uint8_t info, uint32_t pts, uint32_t stc, uint16_t sof)
+{
+  uint8_t const *header = in_xfer[idx].header;
+  TEST_ASSERT_EQUAL(HEADER_SIZE, header[0]);
+  TEST_ASSERT_EQUAL_HEX8(info, header[1]);
+  TEST_ASSERT_EQUAL_UINT32(pts, tu_unaligned_read32(header + 2));
+  TEST_ASSERT_EQUAL_UINT32(stc, tu_unaligned_read32(header + 6));
+  TEST_ASSERT_EQUAL_UINT16(sof, tu_unaligned_read16(header + 10));
+}
+
+// Every payload carries the PTS of its frame and the source clock sampled at the latest SOF
+void test_video_timestamp_pts_scr(void)
+{
+  uint8_t frame[80];
+  memset(frame, 0xAA, sizeof(frame));
+
+  start_streaming();
+  TEST_ASSERT_EQUAL(HEADER_SIZE, tud_video_n_payload_header_size(0, 0));
+
+  source_clock = 5000;
+  dcd_event_sof(rhport, 100, true);
+  // next microframe of the same frame is not sampled
+  source_clock = 5100;
+  dcd_event_sof(rhport, 100, true);
+
+  TEST_ASSERT_TRUE( tud_video_n_frame_pts(0, 0, 4000) );
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer(0, 0, frame, sizeof(frame)) );
+  TEST_ASSERT_EQUAL(PAYLOAD_SIZE, in_xfer[0].len);
+  uint8_t const fid = in_xfer[0].header[1] & 0x01;
+  assert_header(0, fid | 0x0C, 4000, 5000, 100);
+
+  source_clock = 6000;
+  dcd_event_sof(rhport, 101, true);
+  complete_in_xfer();
+  TEST_ASSERT_EQUAL(HEADER_SIZE + sizeof(frame) - (PAYLOAD_SIZE - HEADER_SIZE), in_xfer[1].len);
+  assert_header(1, fid | 0x0E, 4000, 6000, 101);
+  complete_in_xfer();
+
+  // without given PTS, the frame is stamped when it is submitted
+  source_clock = 7000;
+  TEST_ASSERT_TRUE( tud_video_n_frame_xfer(0, 0, frame, 40) );
+  assert_header(2, (fid ^ 0x01) | 0x0E, 7000, 6000, 101);
+}
+
+// SOF interrupt is disabled when streaming stops
+void test_video_timestamp_sof_disable(void)
+{
+  start_streaming();
+
+  dcd_sof_enable_Expect(rhport, false);
+  set_interface(0);
+  TEST_ASSERT_FALSE( tud_video_n_streaming(0, 0) );
+}
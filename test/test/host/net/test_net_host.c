@@ -0,0 +1,607 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022, hathach (tinyusb.org)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * This file is part of the TinyUSB stack.
+ */
+
+
+#include "unity.h"
+
+// Files to test
+#include "tusb_option.h"
+#include "net_host.h"
+
+// Mock File
+#include "mock_usbh.h"
+#include "host/usbh_classdriver.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  DADDR          = 1,
+
+  EDPT_NET_NOTIF = 0x81,
+  EDPT_NET_OUT   = 0x02,
+  EDPT_NET_IN    = 0x82,
+
+  ITF_NUM_NCM      = 0,
+  ITF_NUM_NCM_DATA = 1,
+
+  MAC_STR_INDEX  = 4,
+  NTB_OUT_MAX    = 2048,
+  RX_BUF_SIZE    = 3200,
+};
+
+// Communication Interface with notification endpoint, Data Interface with bulk endpoints on alternate 1
+uint8_t const desc_ncm[] =
+{
+  9, TUSB_DESC_INTERFACE, ITF_NUM_NCM, 0, 1, TUSB_CLASS_CDC, CDC_COMM_SUBCLASS_NETWORK_CONTROL_MODEL, 0, 0,
+  5, TUSB_DESC_CS_INTERFACE, CDC_FUNC_DESC_HEADER, U16_TO_U8S_LE(0x0110),
+  5, TUSB_DESC_CS_INTERFACE, CDC_FUNC_DESC_UNION, ITF_NUM_NCM, ITF_NUM_NCM_DATA,
+  13, TUSB_DESC_CS_INTERFACE, CDC_FUNC_DESC_ETHERNET_NETWORKING, MAC_STR_INDEX, 0, 0, 0, 0, U16_TO_U8S_LE(1514), 0, 0, 0,
+  6, TUSB_DESC_CS_INTERFACE, CDC_FUNC_DESC_NCM, U16_TO_U8S_LE(0x0100), 0,
+  7, TUSB_DESC_ENDPOINT, EDPT_NET_NOTIF, TUSB_XFER_INTERRUPT, U16_TO_U8S_LE(64), 50,
+
+  9, TUSB_DESC_INTERFACE, ITF_NUM_NCM_DATA, 0, 0, TUSB_CLASS_CDC_DATA, 0, 1, 0,
+  9, TUSB_DESC_INTERFACE, ITF_NUM_NCM_DATA, 1, 2, TUSB_CLASS_CDC_DATA, 0, 1, 0,
+  7, TUSB_DESC_ENDPOINT, EDPT_NET_OUT, TUSB_XFER_BULK, U16_TO_U8S_LE(512), 0,
+  7, TUSB_DESC_ENDPOINT, EDPT_NET_IN, TUSB_XFER_BULK, U16_TO_U8S_LE(512), 0,
+};
+
+//--------------------------------------------------------------------+
+// usbh stubs, class driver API of usbh_classdriver.h is implemented here
+//--------------------------------------------------------------------+
+
+uint8_t enum_buf[256];
+
+// last control transfer of configuration sequence
+tusb_control_request_t ctrl_request;
+uint8_t                ctrl_data[8];
+tuh_xfer_cb_t          ctrl_cb;
+uintptr_t              ctrl_user_data;
+uint8_t                ctrl_count;
+
+// bulk and interrupt transfers
+typedef struct
+{
+  uint8_t  ep_addr;
+  uint8_t* buffer;
+  uint16_t len;
+} bulk_xfer_t;
+
+bulk_xfer_t bulk_xfer[16];
+uint8_t     bulk_count;
+
+uint8_t config_complete_itf;
+uint8_t config_complete_count;
+
+uint8_t* usbh_get_enum_buf(void)
+{
+  return enum_buf;
+}
+
+bool usbh_edpt_claim(uint8_t dev_addr, uint8_t ep_addr)
+{
+  (void) dev_addr;
+  (void) ep_addr;
+  return true;
+}
+
+bool usbh_edpt_release(uint8_t dev_addr, uint8_t ep_addr)
+{
+  (void) dev_addr;
+  (void) ep_addr;
+  return true;
+}
+
+bool usbh_edpt_xfer_with_callback(uint8_t dev_addr, uint8_t ep_addr, uint8_t * buffer, uint16_t total_bytes,
+                                  tuh_xfer_cb_t complete_cb, uintptr_t user_data)
+{
+  (void) complete_cb;
+  (void) user_data;
+  TEST_ASSERT_EQUAL(DADDR, dev_addr);
+  TEST_ASSERT_LESS_THAN(TU_ARRAY_SIZE(bulk_xfer), bulk_count);
+
+  bulk_xfer[bulk_count].ep_addr = ep_addr;
+  bulk_xfer[bulk_count].buffer  = buffer;
+  bulk_xfer[bulk_count].len     = total_bytes;
+  bulk_count++;
+
+  return true;
+}
+
+static bool stub_control_xfer(tuh_xfer_t* xfer, int num_calls)
+{
+  (void) num_calls;
+  TEST_ASSERT_EQUAL(DADDR, xfer->daddr);
+
+  ctrl_request   = *xfer->setup;
+  ctrl_cb        = xfer->complete_cb;
+  ctrl_user_data = xfer->user_data;
+  ctrl_count++;
+
+  // keep data stage of OUT requests
+  if (ctrl_request.wLength && ctrl_request.bmRequestType_bit.direction == TUSB_DIR_OUT)
+  {
+    memcpy(ctrl_data, xfer->buffer, tu_min16(ctrl_request.wLength, sizeof(ctrl_data)));
+  }
+
+  return true;
+}
+
+static bool stub_get_string(uint8_t daddr, uint8_t index, uint16_t language_id, void* buffer, uint16_t len,
+                            tuh_xfer_cb_t complete_cb, uintptr_t user_data, int num_calls)
+{
+  (void) num_calls;
+  TEST_ASSERT_EQUAL(DADDR, daddr);
+  TEST_ASSERT_EQUAL_PTR(enum_buf, buffer);
+
+  tusb_control_request_t const request =
+  {
+    .bmRequestType = 0x80,
+    .bRequest      = TUSB_REQ_GET_DESCRIPTOR,
+    .wValue        = (uint16_t) ((TUSB_DESC_STRING << 8) | index),
+    .wIndex        = language_id,
+    .wLength       = len
+  };
+
+  ctrl_request   = request;
+  ctrl_cb        = complete_cb;
+  ctrl_user_data = user_data;
+  ctrl_count++;
+
+  return true;
+}
+
+void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num)
+{
+  TEST_ASSERT_EQUAL(DADDR, dev_addr);
+  config_complete_itf = itf_num;
+  config_complete_count++;
+}
+
+//--------------------------------------------------------------------+
+// Application callbacks
+//--------------------------------------------------------------------+
+
+bool    mounted;
+uint8_t mount_mac[6];
+
+// first byte and size of received datagrams
+uint8_t  recv_first[8];
+uint16_t recv_size[8];
+uint8_t  recv_count;
+
+void tuh_network_mount_cb(uint8_t daddr, uint8_t const mac[6])
+{
+  TEST_ASSERT_EQUAL(DADDR, daddr);
+  mounted = true;
+  memcpy(mount_mac, mac, 6);
+}
+
+bool tuh_network_recv_cb(uint8_t daddr, uint8_t const* src, uint16_t size)
+{
+  TEST_ASSERT_EQUAL(DADDR, daddr);
+  TEST_ASSERT_LESS_THAN(TU_ARRAY_SIZE(recv_first), recv_count);
+
+  recv_first[recv_count] = src[0];
+  recv_size[recv_count]  = size;
+  recv_count++;
+  return true;
+}
+
+// datagram of arg bytes filled with its low byte
+uint16_t tuh_network_xmit_cb(uint8_t daddr, uint8_t *dst, void *ref, uint16_t arg)
+{
+  (void) daddr;
+  (void) ref;
+  memset(dst, (uint8_t) arg, arg);
+  return arg;
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+void setUp(void)
+{
+  ctrl_count = 0;
+  bulk_count = 0;
+  config_complete_count = 0;
+  mounted = false;
+  recv_count = 0;
+
+  tuh_edpt_open_IgnoreAndReturn(true);
+  tuh_control_xfer_Stub(stub_control_xfer);
+  tuh_descriptor_get_string_Stub(stub_get_string);
+
+  neth_init();
+}
+
+void tearDown(void)
+{
+  neth_close(DADDR);
+}
+
+// device completes the pending control transfer
+static void complete_control(xfer_result_t result, uint32_t len)
+{
+  tuh_xfer_t xfer =
+  {
+    .daddr      = DADDR,
+    .ep_addr    = 0,
+    .result     = result,
+    .actual_len = len,
+    .user_data  = ctrl_user_data
+  };
+
+  ctrl_cb(&xfer);
+}
+
+static void assert_request(uint8_t type, uint8_t code, uint16_t value, uint16_t index, uint16_t length)
+{
+  TEST_ASSERT_EQUAL_HEX8(type, ctrl_request.bmRequestType);
+  TEST_ASSERT_EQUAL_HEX8(code, ctrl_request.bRequest);
+  TEST_ASSERT_EQUAL_HEX16(value, ctrl_request.wValue);
+  TEST_ASSERT_EQUAL(index, ctrl_request.wIndex);
+  TEST_ASSERT_EQUAL(length, ctrl_request.wLength);
+}
+
+static bulk_xfer_t const* last_xfer(uint8_t ep_addr)
+{
+  for (uint8_t i = bulk_count; i > 0; i--)
+  {
+    if (bulk_xfer[i-1].ep_addr == ep_addr) return &bulk_xfer[i-1];
+  }
+  return NULL;
+}
+
+static uint8_t xfer_count(uint8_t ep_addr)
+{
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < bulk_count; i++)
+  {
+    if (bulk_xfer[i].ep_addr == ep_addr) count++;
+  }
+  return count;
+}
+
+// Open NCM interface and go through its configuration sequence, device asks for datagrams
+// at offset % 4 == 2 in NTBs of at most NTB_OUT_MAX bytes
+static void mount_ncm(void)
+{
+  TEST_ASSERT_TRUE( neth_open(0, DADDR, (tusb_desc_interface_t const*) desc_ncm, sizeof(desc_ncm)) );
+  TEST_ASSERT_TRUE( neth_set_config(DADDR, ITF_NUM_NCM) );
+
+  // GET_NTB_PARAMETERS
+  TEST_ASSERT_EQUAL(1, ctrl_count);
+  assert_request(0xA1, NCM_GET_NTB_PARAMETERS, 0, ITF_NUM_NCM, sizeof(ntb_parameters_t));
+
+  ntb_parameters_t const param =
+  {
+    .wLength                 = sizeof(ntb_parameters_t),
+    .bmNtbFormatsSupported   = 0x01,
+    .dwNtbInMaxSize          = 16384,
+    .wNdbInDivisor           = 4,
+    .wNdbInPayloadRemainder  = 0,
+    .wNdbInAlignment         = 4,
+    .dwNtbOutMaxSize         = NTB_OUT_MAX,
+    .wNdbOutDivisor          = 4,
+    .wNdbOutPayloadRemainder = 2,
+    .wNdbOutAlignment        = 4,
+    .wNtbOutMaxDatagrams     = 0
+  };
+  memcpy(enum_buf, &param, sizeof(param));
+  complete_control(XFER_RESULT_SUCCESS, sizeof(param));
+
+  // SET_NTB_INPUT_SIZE: device must not send NTBs larger than receive buffer
+  TEST_ASSERT_EQUAL(2, ctrl_count);
+  assert_request(0x21, NCM_SET_NTB_INPUT_SIZE, 0, ITF_NUM_NCM, 4);
+  TEST_ASSERT_EQUAL(RX_BUF_SIZE, tu_unaligned_read32(ctrl_data));
+  complete_control(XFER_RESULT_SUCCESS, 4);
+
+  // SET_ETHERNET_PACKET_FILTER: directed, broadcast and all multicast
+  TEST_ASSERT_EQUAL(3, ctrl_count);
+  assert_request(0x21, CDC_REQUEST_SET_ETHERNET_PACKET_FILTER, 0x000E, ITF_NUM_NCM, 0);
+  complete_control(XFER_RESULT_SUCCESS, 0);
+
+  // SET_INTERFACE: Data Interface alternate with bulk endpoints
+  TEST_ASSERT_EQUAL(4, ctrl_count);
+  assert_request(0x01, TUSB_REQ_SET_INTERFACE, 1, ITF_NUM_NCM_DATA, 0);
+  complete_control(XFER_RESULT_SUCCESS, 0);
+
+  // MAC address string
+  TEST_ASSERT_EQUAL(5, ctrl_count);
+  assert_request(0x80, TUSB_REQ_GET_DESCRIPTOR, (TUSB_DESC_STRING << 8) | MAC_STR_INDEX, 0x0409, 2 + 2*12);
+
+  char const mac_str[] = "02AABBCCDDEE";
+  enum_buf[0] = 2 + 2*12;
+  enum_buf[1] = TUSB_DESC_STRING;
+  for (uint8_t i = 0; i < 12; i++)
+  {
+    enum_buf[2 + 2*i] = (uint8_t) mac_str[i];
+    enum_buf[3 + 2*i] = 0;
+  }
+  complete_control(XFER_RESULT_SUCCESS, 2 + 2*12);
+
+  TEST_ASSERT_EQUAL(5, ctrl_count);
+  TEST_ASSERT_TRUE( mounted );
+  TEST_ASSERT_TRUE( tuh_network_mounted(DADDR) );
+  TEST_ASSERT_TRUE( tuh_network_is_ncm(DADDR) );
+}
+
+// NTH16 with NDP16 at ndp_index
+static void write_nth(uint8_t* ntb, uint16_t block_len, uint16_t ndp_index)
+{
+  tu_unaligned_write32(ntb + 0, NTH16_SIGNATURE);
+  tu_unaligned_write16(ntb + 4, sizeof(nth16_t));
+  tu_unaligned_write16(ntb + 6, 0);
+  tu_unaligned_write16(ntb + 8, block_len);
+  tu_unaligned_write16(ntb + 10, ndp_index);
+}
+
+// NDP16 at offset with count datagrams {index, length} and null terminator
+static void write_ndp(uint8_t* ntb, uint16_t offset, uint16_t next_ndp, uint8_t count, uint16_t const datagrams[][2])
+{
+  tu_unaligned_write32(ntb + offset, NDP16_SIGNATURE_NCM0);
+  tu_unaligned_write16(ntb + offset + 4, (uint16_t) (8 + (count+1)*4));
+  tu_unaligned_write16(ntb + offset + 6, next_ndp);
+
+  for (uint8_t i = 0; i <= count; i++)
+  {
+    uint16_t const index  = (i < count) ? datagrams[i][0] : 0;
+    uint16_t const length = (i < count) ? datagrams[i][1] : 0;
+    tu_unaligned_write16(ntb + offset + 8 + 4*i, index);
+    tu_unaligned_write16(ntb + offset + 10 + 4*i, length);
+  }
+}
+
+// device sends len bytes into the queued IN buffer
+static void receive(uint8_t const* data, uint16_t len)
+{
+  bulk_xfer_t const* xfer = last_xfer(EDPT_NET_IN);
+  TEST_ASSERT_NOT_NULL(xfer);
+  TEST_ASSERT_EQUAL(RX_BUF_SIZE, xfer->len);
+
+  memcpy(xfer->buffer, data, len);
+  TEST_ASSERT_TRUE( neth_xfer_cb(DADDR, EDPT_NET_IN, XFER_RESULT_SUCCESS, len) );
+}
+
+static void complete_out(void)
+{
+  TEST_ASSERT_TRUE( neth_xfer_cb(DADDR, EDPT_NET_OUT, XFER_RESULT_SUCCESS, last_xfer(EDPT_NET_OUT)->len) );
+}
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+// Configuration sequence: GET_NTB_PARAMETERS, SET_NTB_INPUT_SIZE, packet filter, SET_INTERFACE, MAC string
+void test_net_host_ncm_config(void)
+{
+  mount_ncm();
+
+  uint8_t const mac[6] = { 0x02, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE };
+  TEST_ASSERT_EQUAL_MEMORY(mac, mount_mac, 6);
+
+  // usbh is notified once, Data Interface is configured as well
+  TEST_ASSERT_EQUAL(1, config_complete_count);
+  TEST_ASSERT_EQUAL(ITF_NUM_NCM_DATA, config_complete_itf);
+
+  // IN and notification endpoints are polled
+  TEST_ASSERT_EQUAL(1, xfer_count(EDPT_NET_IN));
+  TEST_ASSERT_EQUAL(1, xfer_count(EDPT_NET_NOTIF));
+}
+
+// Datagrams queued while an NTB is sent are aggregated in the next NTB at offset % 4 == 2
+void test_net_host_ncm_xmit_aggregation(void)
+{
+  // NTH16 + NDP16 with room for CFG_TUH_NET_MAX_DATAGRAMS_PER_NTB entries and terminator
+  uint16_t const header_len = 12 + 8 + (CFG_TUH_NET_MAX_DATAGRAMS_PER_NTB+1)*4;
+  TEST_ASSERT_EQUAL(56, header_len);
+
+  mount_ncm();
+
+  // sent right away
+  TEST_ASSERT_TRUE( tuh_network_xmit(DADDR, NULL, 61) );
+  TEST_ASSERT_EQUAL(1, xfer_count(EDPT_NET_OUT));
+
+  uint8_t const* ntb = last_xfer(EDPT_NET_OUT)->buffer;
+  TEST_ASSERT_EQUAL(58 + 61, last_xfer(EDPT_NET_OUT)->len);
+  TEST_ASSERT_EQUAL_HEX32(NTH16_SIGNATURE, tu_unaligned_read32(ntb));
+  TEST_ASSERT_EQUAL(58 + 61, tu_unaligned_read16(ntb + 8));
+  TEST_ASSERT_EQUAL(12, tu_unaligned_read16(ntb + 10));
+  TEST_ASSERT_EQUAL_HEX32(NDP16_SIGNATURE_NCM0, tu_unaligned_read32(ntb + 12));
+  TEST_ASSERT_EQUAL(8 + 2*4, tu_unaligned_read16(ntb + 16));
+  TEST_ASSERT_EQUAL(58, tu_unaligned_read16(ntb + 20));
+  TEST_ASSERT_EQUAL(61, tu_unaligned_read16(ntb + 22));
+  TEST_ASSERT_EQUAL(0, tu_unaligned_read32(ntb + 24));
+  TEST_ASSERT_EACH_EQUAL_HEX8(61, ntb + 58, 61);
+
+  // aggregated while 1st NTB is sent
+  TEST_ASSERT_TRUE( tuh_network_xmit(DADDR, NULL, 61) );
+  TEST_ASSERT_TRUE( tuh_network_xmit(DADDR, NULL, 100) );
+  TEST_ASSERT_EQUAL(1, xfer_count(EDPT_NET_OUT));
+
+  complete_out();
+  TEST_ASSERT_EQUAL(2, xfer_count(EDPT_NET_OUT));
+
+  ntb = last_xfer(EDPT_NET_OUT)->buffer;
+  TEST_ASSERT_EQUAL(122 + 100, last_xfer(EDPT_NET_OUT)->len);
+  TEST_ASSERT_EQUAL(1, tu_unaligned_read16(ntb + 6));
+  TEST_ASSERT_EQUAL(122 + 100, tu_unaligned_read16(ntb + 8));
+  TEST_ASSERT_EQUAL(8 + 3*4, tu_unaligned_read16(ntb + 16));
+  TEST_ASSERT_EQUAL(58, tu_unaligned_read16(ntb + 20));
+  TEST_ASSERT_EQUAL(61, tu_unaligned_read16(ntb + 22));
+  TEST_ASSERT_EQUAL(122, tu_unaligned_read16(ntb + 24));
+  TEST_ASSERT_EQUAL(100, tu_unaligned_read16(ntb + 26));
+  TEST_ASSERT_EQUAL(0, tu_unaligned_read32(ntb + 28));
+  TEST_ASSERT_EACH_EQUAL_HEX8(61, ntb + 58, 61);
+  TEST_ASSERT_EACH_EQUAL_HEX8(100, ntb + 122, 100);
+
+  complete_out();
+  TEST_ASSERT_EQUAL(2, xfer_count(EDPT_NET_OUT));
+}
+
+// NTB of a multiple of packet size is terminated with ZLP, unless it has the maximum size of the device
+void test_net_host_ncm_xmit_zlp(void)
+{
+  mount_ncm();
+
+  // 512 bytes
+  TEST_ASSERT_TRUE( tuh_network_xmit(DADDR, NULL, 512 - 58) );
+  TEST_ASSERT_EQUAL(512, last_xfer(EDPT_NET_OUT)->len);
+
+  // 2nd NTB is filled up to NTB_OUT_MAX: 2nd datagram at 534 is the last one with a full MTU
+  TEST_ASSERT_TRUE( tuh_network_xmit(DADDR, NULL, 534 - 58) );
+  TEST_ASSERT_TRUE( tuh_network_can_xmit(DADDR, CFG_TUH_NET_MTU) );
+  TEST_ASSERT_TRUE( tuh_network_xmit(DADDR, NULL, CFG_TUH_NET_MTU) );
+  TEST_ASSERT_FALSE( tuh_network_can_xmit(DADDR, 1) );
+
+  // ZLP before the next NTB
+  complete_out();
+  TEST_ASSERT_EQUAL(2, xfer_count(EDPT_NET_OUT));
+  TEST_ASSERT_EQUAL(0, last_xfer(EDPT_NET_OUT)->len);
+  TEST_ASSERT_NULL(last_xfer(EDPT_NET_OUT)->buffer);
+
+  complete_out();
+  TEST_ASSERT_EQUAL(3, xfer_count(EDPT_NET_OUT));
+  TEST_ASSERT_EQUAL(NTB_OUT_MAX, last_xfer(EDPT_NET_OUT)->len);
+  TEST_ASSERT_EQUAL(534, tu_unaligned_read16(last_xfer(EDPT_NET_OUT)->buffer + 24));
+
+  // no ZLP after NTB of maximum size
+  complete_out();
+  TEST_ASSERT_EQUAL(3, xfer_count(EDPT_NET_OUT));
+  TEST_ASSERT_TRUE( tuh_network_can_xmit(DADDR, CFG_TUH_NET_MTU) );
+}
+
+// Datagrams of NDPs chained to following offsets are all received
+void test_net_host_ncm_recv_ndp_chain(void)
+{
+  uint8_t ntb[128];
+  uint16_t const dg1[][2] = { { 48, 16 } };
+  uint16_t const dg2[][2] = { { 96, 16 } };
+
+  mount_ncm();
+
+  memset(ntb, 0, sizeof(ntb));
+  write_nth(ntb, sizeof(ntb), 12);
+  write_ndp(ntb, 12, 64, 1, dg1);
+  write_ndp(ntb, 64, 0, 1, dg2);
+  memset(ntb + 48, 0x11, 16);
+  memset(ntb + 96, 0x22, 16);
+
+  receive(ntb, sizeof(ntb));
+  TEST_ASSERT_EQUAL(1, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x11, recv_first[0]);
+
+  tuh_network_recv_renew(DADDR);
+  TEST_ASSERT_EQUAL(2, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x22, recv_first[1]);
+  TEST_ASSERT_EQUAL(16, recv_size[1]);
+
+  tuh_network_recv_renew(DADDR);
+  TEST_ASSERT_EQUAL(2, recv_count);
+}
+
+// Malformed NTBs are dropped (or only their valid datagrams received), reception goes on
+void test_net_host_ncm_recv_malformed(void)
+{
+  uint8_t ntb[128];
+  uint16_t const dg_valid[][2] = { { 48, 16 } };
+  uint16_t const dg_range[][2] = { { 40, 200 }, { 48, 16 } };
+
+  mount_ncm();
+
+  // wBlockLength beyond received data
+  memset(ntb, 0, sizeof(ntb));
+  write_nth(ntb, 200, 12);
+  write_ndp(ntb, 12, 0, 1, dg_valid);
+  receive(ntb, sizeof(ntb));
+  TEST_ASSERT_EQUAL(0, recv_count);
+
+  // datagram beyond received data is skipped
+  memset(ntb, 0, sizeof(ntb));
+  write_nth(ntb, sizeof(ntb), 12);
+  write_ndp(ntb, 12, 0, 2, dg_range);
+  memset(ntb + 48, 0x33, 16);
+  receive(ntb, sizeof(ntb));
+  TEST_ASSERT_EQUAL(1, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x33, recv_first[0]);
+  tuh_network_recv_renew(DADDR);
+  TEST_ASSERT_EQUAL(1, recv_count);
+
+  // NDP referencing itself: its datagrams are received once, then NTB is dropped
+  memset(ntb, 0, sizeof(ntb));
+  write_nth(ntb, sizeof(ntb), 12);
+  write_ndp(ntb, 12, 12, 1, dg_valid);
+  memset(ntb + 48, 0x44, 16);
+  receive(ntb, sizeof(ntb));
+  TEST_ASSERT_EQUAL(2, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x44, recv_first[1]);
+  tuh_network_recv_renew(DADDR);
+  TEST_ASSERT_EQUAL(2, recv_count);
+
+  // every buffer is released and queued again
+  TEST_ASSERT_EQUAL(4, xfer_count(EDPT_NET_IN));
+
+  memset(ntb, 0, sizeof(ntb));
+  write_nth(ntb, sizeof(ntb), 12);
+  write_ndp(ntb, 12, 0, 1, dg_valid);
+  memset(ntb + 48, 0x55, 16);
+  receive(ntb, sizeof(ntb));
+  TEST_ASSERT_EQUAL(3, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x55, recv_first[2]);
+  tuh_network_recv_renew(DADDR);
+
+  // unaligned wNdpIndex
+  memset(ntb, 0, sizeof(ntb));
+  write_nth(ntb, sizeof(ntb), 14);
+  write_ndp(ntb, 14, 0, 1, dg_valid);
+  receive(ntb, sizeof(ntb));
+  TEST_ASSERT_EQUAL(3, recv_count);
+
+  // wNdpIndex inside NTH
+  memset(ntb, 0, sizeof(ntb));
+  write_ndp(ntb, 8, 0, 1, dg_valid);
+  write_nth(ntb, sizeof(ntb), 8);
+  receive(ntb, sizeof(ntb));
+  TEST_ASSERT_EQUAL(3, recv_count);
+
+  // unaligned wNextNdpIndex: datagrams of the 1st NDP only
+  uint16_t const dg_next[][2] = { { 100, 16 } };
+  memset(ntb, 0, sizeof(ntb));
+  write_nth(ntb, sizeof(ntb), 12);
+  write_ndp(ntb, 12, 70, 1, dg_valid);
+  write_ndp(ntb, 70, 0, 1, dg_next);
+  memset(ntb + 48, 0x66, 16);
+  memset(ntb + 100, 0x77, 16);
+  receive(ntb, sizeof(ntb));
+  TEST_ASSERT_EQUAL(4, recv_count);
+  TEST_ASSERT_EQUAL_HEX8(0x66, recv_first[3]);
+  tuh_network_recv_renew(DADDR);
+  TEST_ASSERT_EQUAL(4, recv_count);
+}
@@ -0,0 +1,103 @@
+import sys
+import struct
+import argparse
+
+import numpy as np
+import matplotlib.pyplot as plt
+
+# Layout of audio_trace_record_t in audio_device.h
+RECORD_FORMAT = '<HBBHHIII'
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+RECORD_FIELDS = ['frame', 'func_id', 'ep', 'n_bytes', 'ff_count', 'sof_offset', 'proc_time', 'fb_value']
+
+
+def unpack_records(data):
+    n = len(data) // RECORD_SIZE
+    return [dict(zip(RECORD_FIELDS, struct.unpack_from(RECORD_FORMAT, data, i * RECORD_SIZE))) for i in range(n)]
+
+
+def read_usb(vid, pid, request, index, count):
+    import usb.core
+
+    dev = usb.core.find(idVendor=vid, idProduct=pid)
+    if dev is None:
+        sys.exit('Device {:04x}:{:04x} not found'.format(vid, pid))
+
+    # Vendor request, device to host, recipient interface
+    data = bytearray()
+    while len(data) < count * RECORD_SIZE:
+        chunk = dev.ctrl_transfer(0xC1, request, 0, index, 8 * RECORD_SIZE)
+        if len(chunk) == 0:
+            break
+        data += bytes(chunk)
+    return data
+
+
+def read_file(path):
+    if path.endswith('.csv'):
+        records = []
+        with open(path) as f:
+            for line in f:
+                values = line.strip().split(',')
+                if not values[0].isdigit():
+                    continue
+                records.append(dict(zip(RECORD_FIELDS, [int(v, 0) for v in values])))
+        return records
+
+    with open(path, 'rb') as f:
+        return unpack_records(f.read())
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Plot buffering latency and jitter from audio class trace records')
+    parser.add_argument('--file', help='binary dump of audio_trace_record_t or CSV with one record per line')
+    parser.add_argument('--vid', type=lambda x: int(x, 0), default=0xCafe)
+    parser.add_argument('--pid', type=lambda x: int(x, 0), default=0x4010)
+    parser.add_argument('--request', type=lambda x: int(x, 0), default=0x01, help='bRequest handled by tud_audio_trace_control_xfer()')
+    parser.add_argument('--index', type=int, default=0, help='wIndex i.e interface number')
+    parser.add_argument('--count', type=int, default=1000, help='number of records to read from device')
+    parser.add_argument('--ep', type=lambda x: int(x, 0), help='only plot this endpoint')
+    parser.add_argument('--clock', type=float, default=1e6, help='timestamp clock in Hz of tud_audio_trace_timestamp_cb()')
+    parser.add_argument('--bytes-per-frame', type=int, default=192, help='nominal bytes per (micro)frame e.g 192 for 48kHz 16bit stereo')
+    parser.add_argument('--frame-period', type=float, default=1e-3, help='(micro)frame period in seconds')
+    args = parser.parse_args()
+
+    if args.file:
+        records = read_file(args.file)
+    else:
+        records = unpack_records(read_usb(args.vid, args.pid, args.request, args.index, args.count))
+
+    if args.ep is not None:
+        records = [r for r in records if r['ep'] == args.ep]
+
+    if len(records) < 2:
+        sys.exit('Not enough records')
+
+    frame = np.unwrap(np.array([r['frame'] for r in records], dtype=float), period=2048)
+    ff_count = np.array([r['ff_count'] for r in records], dtype=float)
+    sof_offset = np.array([r['sof_offset'] for r in records], dtype=float) / args.clock * 1e6
+    proc_time = np.array([r['proc_time'] for r in records], dtype=float) / args.clock * 1e6
+    fb_value = np.array([r['fb_value'] for r in records], dtype=float)
+
+    # Buffering latency: data waiting in FIFO expressed as time at nominal rate
+    latency = ff_count / args.bytes_per_frame * args.frame_period * 1e3
+    # Jitter: deviation of packet handling time relative to SOF
+    jitter = sof_offset - np.median(sof_offset)
+
+    print('records    : {}'.format(len(records)))
+    print('latency    : mean {:.3f} ms, min {:.3f} ms, max {:.3f} ms'.format(latency.mean(), latency.min(), latency.max()))
+    print('jitter     : std {:.2f} us, peak-peak {:.2f} us'.format(jitter.std(), jitter.max() - jitter.min()))
+    print('proc time  : mean {:.2f} us, max {:.2f} us'.format(proc_time.mean(), proc_time.max()))
+
+    fig, axs = plt.subplots(4, 1, sharex=True)
+    axs[0].plot(frame, latency)
+    axs[0].set_ylabel('Latency [ms]')
+    axs[1].plot(frame, jitter, '.')
+    axs[1].set_ylabel('SOF jitter [us]')
+    axs[2].plot(frame, proc_time, '.')
+    axs[2].set_ylabel('Proc time [us]')
+    axs[3].plot(frame, fb_value)
+    axs[3].set_ylabel('Feedback')
+    axs[3].set_xlabel('Frame')
+    fig.suptitle('Audio trace')
+    plt.show()